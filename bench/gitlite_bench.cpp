@@ -0,0 +1,421 @@
+// Synthetic-repository benchmark for the core RepoService operations.
+//
+// Builds a repository of --files files under a scratch directory, then
+// replays --commits commits spread round-robin over main and --branches
+// topic branches, pushing after each one and pulling into a second
+// repository. Topic branches touch disjoint files, so the final merges into
+// main never conflict. Every call is timed; the report is one JSON object
+// with count, p50/p99/max latency and throughput per operation, plus the
+// process's peak RSS.
+
+#include "hashing.hpp"
+#include "repo_service.hpp"
+#include "storage_manager.hpp"
+#include "utils.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <exception>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <sys/resource.h>
+#include <unistd.h>
+
+namespace fs = std::filesystem;
+
+namespace {
+
+struct Options {
+    std::size_t files = 1000;
+    std::size_t commits = 50;
+    std::size_t branches = 2;
+    // Percentage of a branch's files rewritten by each commit.
+    std::size_t churn = 5;
+    std::size_t minSize = 256;
+    std::size_t maxSize = 64 * 1024;
+    std::size_t logRounds = 20;
+    std::uint64_t seed = 1;
+    fs::path dir;
+    std::string out;
+    bool keep = false;
+};
+
+struct Samples {
+    std::vector<double> seconds;
+    std::uint64_t bytes = 0;
+};
+
+using Clock = std::chrono::steady_clock;
+
+class Recorder {
+public:
+    template <typename F>
+    void time(const std::string &op, std::uint64_t bytes, F &&body) {
+        auto start = Clock::now();
+        body();
+        std::chrono::duration<double> elapsed = Clock::now() - start;
+        auto &samples = ops_[op];
+        samples.seconds.push_back(elapsed.count());
+        samples.bytes += bytes;
+    }
+
+    const std::map<std::string, Samples> &ops() const { return ops_; }
+
+private:
+    std::map<std::string, Samples> ops_;
+};
+
+[[noreturn]] void fail(const std::string &what, const std::string &error) {
+    std::cerr << "gitlite-bench: " << what << ": " << error << "\n";
+    std::exit(EXIT_FAILURE);
+}
+
+void printUsage() {
+    std::cerr << "Usage: gitlite-bench [--files N] [--commits N] [--branches N] [--churn PCT]\n"
+                 "                     [--min-size BYTES] [--max-size BYTES] [--log-rounds N]\n"
+                 "                     [--seed N] [--dir PATH] [--out FILE] [--keep]\n"
+                 "\n"
+                 "  --files       Files in the generated workspace (default 1000).\n"
+                 "  --commits     Commits replayed after the initial one (default 50).\n"
+                 "  --branches    Topic branches besides main (default 2).\n"
+                 "  --churn       Percent of a branch's files each commit rewrites (default 5).\n"
+                 "  --min-size    Smallest file; sizes are log-uniform (default 256).\n"
+                 "  --max-size    Largest file (default 65536).\n"
+                 "  --log-rounds  Full history walks timed at the end (default 20).\n"
+                 "  --dir         Scratch directory (default: a new one under $TMPDIR).\n"
+                 "  --out         Write the JSON report here instead of stdout.\n"
+                 "  --keep        Leave the scratch directory in place.\n";
+}
+
+bool parseOptions(int argc, char **argv, Options &options) {
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--keep") {
+            options.keep = true;
+            continue;
+        }
+        if (arg == "--help" || arg == "-h" || i + 1 >= argc) {
+            return false;
+        }
+        std::string value = argv[++i];
+        if (arg == "--dir") {
+            options.dir = value;
+            continue;
+        }
+        if (arg == "--out") {
+            options.out = value;
+            continue;
+        }
+        std::uint64_t number = 0;
+        try {
+            std::size_t used = 0;
+            number = std::stoull(value, &used);
+            if (used != value.size()) {
+                return false;
+            }
+        } catch (const std::exception &) {
+            return false;
+        }
+        if (arg == "--files") {
+            options.files = number;
+        } else if (arg == "--commits") {
+            options.commits = number;
+        } else if (arg == "--branches") {
+            options.branches = number;
+        } else if (arg == "--churn") {
+            options.churn = number;
+        } else if (arg == "--min-size") {
+            options.minSize = number;
+        } else if (arg == "--max-size") {
+            options.maxSize = number;
+        } else if (arg == "--log-rounds") {
+            options.logRounds = number;
+        } else if (arg == "--seed") {
+            options.seed = number;
+        } else {
+            return false;
+        }
+    }
+    return options.files > 0 && options.minSize > 0 && options.minSize <= options.maxSize && options.churn <= 100;
+}
+
+// Text-like contents: slices of one shared pool of words, so blobs compress
+// roughly like source files, each behind a header that makes it unique.
+class ContentGenerator {
+public:
+    ContentGenerator(const Options &options) : options_(options), random_(options.seed) {
+        static const char *words[] = {"int",   "return", "const", "auto ", "std::", "string", "if (",  "for (",
+                                      "while", "vector", "error", "path",  "commit", "branch", "  ",   "\n"};
+        std::uniform_int_distribution<std::size_t> pick(0, sizeof(words) / sizeof(words[0]) - 1);
+        while (pool_.size() < options.maxSize + 4096) {
+            pool_ += words[pick(random_)];
+            pool_ += ' ';
+        }
+    }
+
+    std::size_t nextSize() {
+        std::uniform_real_distribution<double> unit(std::log(double(options_.minSize)),
+                                                    std::log(double(options_.maxSize) + 1));
+        return std::min<std::size_t>(options_.maxSize, std::size_t(std::exp(unit(random_))));
+    }
+
+    std::string contents(const std::string &header, std::size_t size) {
+        std::uniform_int_distribution<std::size_t> offset(0, pool_.size() - size);
+        std::string text = header + "\n";
+        text += pool_.substr(offset(random_), size > text.size() ? size - text.size() : 0);
+        return text;
+    }
+
+    std::mt19937_64 &random() { return random_; }
+
+private:
+    const Options &options_;
+    std::mt19937_64 random_;
+    std::string pool_;
+};
+
+struct TrackedFile {
+    std::string path;
+    std::size_t size = 0;
+};
+
+std::uint64_t writeFile(const fs::path &workspace, const TrackedFile &file, const std::string &text) {
+    fs::path target = workspace / file.path;
+    fs::create_directories(target.parent_path());
+    std::ofstream out(target, std::ios::binary | std::ios::trunc);
+    out << text;
+    if (!out) {
+        fail("write " + file.path, "unable to write file");
+    }
+    return text.size();
+}
+
+std::string branchName(std::size_t branch) {
+    return branch == 0 ? "main" : "topic" + std::to_string(branch);
+}
+
+void checkout(Recorder &recorder, const RepoService &service, const fs::path &repo, const std::string &branch) {
+    CheckoutResult result;
+    std::string error;
+    bool ok = true;
+    recorder.time("checkout", 0, [&] { ok = service.checkout(repo, branch, result, error); });
+    if (!ok) {
+        fail("checkout " + branch, error);
+    }
+}
+
+void addAndCommit(Recorder &recorder,
+                  const RepoService &service,
+                  const fs::path &repo,
+                  const std::vector<std::string> &paths,
+                  std::uint64_t bytes,
+                  const std::string &message) {
+    StageResult staged;
+    std::string error;
+    bool ok = true;
+    recorder.time("add", bytes, [&] { ok = service.addFiles(repo, paths, staged, error); });
+    if (!ok || !staged.failed.empty()) {
+        fail("add", ok ? staged.failed.front().first + ": " + staged.failed.front().second : error);
+    }
+    CommitRecord record;
+    recorder.time("commit", 0, [&] { ok = service.commit(repo, "bench", message, record, error); });
+    if (!ok) {
+        fail("commit", error);
+    }
+}
+
+void sync(Recorder &recorder, const RepoService &service, const fs::path &from, const fs::path &remote, const fs::path &to) {
+    SyncResult result;
+    std::string error;
+    bool ok = true;
+    recorder.time("push", 0, [&] { ok = service.push(from, remote, result, error); });
+    if (!ok) {
+        fail("push", error);
+    }
+    recorder.time("pull", 0, [&] { ok = service.pull(to, remote, result, error); });
+    if (!ok) {
+        fail("pull", error);
+    }
+}
+
+double percentile(std::vector<double> sorted, double p) {
+    std::sort(sorted.begin(), sorted.end());
+    std::size_t rank = std::size_t(std::ceil(p * double(sorted.size())));
+    return sorted[std::min(sorted.size() - 1, rank == 0 ? 0 : rank - 1)];
+}
+
+std::string report(const Options &options, const Recorder &recorder, double wallSeconds) {
+    struct rusage usage {};
+    getrusage(RUSAGE_SELF, &usage);
+    std::ostringstream out;
+    out << std::fixed << std::setprecision(3);
+    out << "{\"benchmark\":\"gitlite-bench\",\"schema\":1,\"sha256_backend\":"
+        << gitlite::util::jsonQuote(hashing::sha256Backend()) << ",\"params\":{\"files\":" << options.files
+        << ",\"commits\":" << options.commits << ",\"branches\":" << options.branches << ",\"churn_pct\":"
+        << options.churn << ",\"min_size\":" << options.minSize << ",\"max_size\":" << options.maxSize
+        << ",\"log_rounds\":" << options.logRounds << ",\"seed\":" << options.seed << "},\"operations\":{";
+    bool first = true;
+    for (const auto &[name, samples] : recorder.ops()) {
+        double total = 0;
+        for (double s : samples.seconds) {
+            total += s;
+        }
+        out << (first ? "" : ",") << gitlite::util::jsonQuote(name) << ":{\"count\":" << samples.seconds.size()
+            << ",\"total_s\":" << total << ",\"p50_ms\":" << percentile(samples.seconds, 0.50) * 1e3
+            << ",\"p99_ms\":" << percentile(samples.seconds, 0.99) * 1e3 << ",\"max_ms\":"
+            << *std::max_element(samples.seconds.begin(), samples.seconds.end()) * 1e3 << ",\"ops_per_s\":"
+            << (total > 0 ? double(samples.seconds.size()) / total : 0.0) << ",\"bytes\":" << samples.bytes
+            << ",\"mib_per_s\":" << (total > 0 ? double(samples.bytes) / total / (1024.0 * 1024.0) : 0.0) << "}";
+        first = false;
+    }
+    // ru_maxrss is in kilobytes on Linux.
+    out << "},\"wall_s\":" << wallSeconds << ",\"peak_rss_kb\":" << usage.ru_maxrss << "}\n";
+    return out.str();
+}
+
+int run(const Options &options) {
+    auto wallStart = Clock::now();
+    Recorder recorder;
+    fs::path scratch = options.dir.empty()
+                           ? fs::temp_directory_path() / ("gitlite-bench-" + std::to_string(getpid()))
+                           : options.dir;
+    if (fs::exists(scratch / "storage")) {
+        fail("scratch directory", (scratch / "storage").string() + " already exists");
+    }
+    fs::create_directories(scratch);
+    fs::path previous = fs::current_path();
+    // StorageManager roots itself at ./storage.
+    fs::current_path(scratch);
+
+    {
+        StorageManager storage;
+        RepoService service(storage);
+        std::string error;
+        if (!storage.createRepo("bench", "origin", error) || !storage.createRepo("bench", "mirror", error)) {
+            fail("create repository", error);
+        }
+        fs::path repo = storage.repoPath("bench", "origin");
+        fs::path mirror = storage.repoPath("bench", "mirror");
+        fs::path remote = storage.root() / "_remotes" / "bench" / "origin";
+        fs::path workspace = repo / "workspace";
+
+        ContentGenerator generator(options);
+        std::vector<TrackedFile> files(options.files);
+        std::vector<std::string> paths;
+        std::uint64_t total = 0;
+        for (std::size_t i = 0; i < files.size(); ++i) {
+            // 32 files per directory, 16 directories per parent.
+            files[i].path = "d" + std::to_string(i / 512) + "/s" + std::to_string(i / 32 % 16) + "/f" +
+                            std::to_string(i) + ".txt";
+            files[i].size = generator.nextSize();
+            total += writeFile(workspace, files[i], generator.contents(files[i].path, files[i].size));
+            paths.push_back(files[i].path);
+        }
+
+        for (const auto &file : files) {
+            recorder.time("hash", file.size, [&] { hashing::sha256File(workspace / file.path); });
+        }
+
+        addAndCommit(recorder, service, repo, paths, total, "initial");
+        for (std::size_t b = 1; b <= options.branches; ++b) {
+            if (!service.createBranch(repo, branchName(b), error)) {
+                fail("create branch", error);
+            }
+        }
+        sync(recorder, service, repo, remote, mirror);
+
+        std::size_t lanes = options.branches + 1;
+        for (std::size_t c = 1; c <= options.commits; ++c) {
+            std::size_t lane = c % lanes;
+            checkout(recorder, service, repo, branchName(lane));
+            std::vector<std::size_t> owned;
+            for (std::size_t i = lane; i < files.size(); i += lanes) {
+                owned.push_back(i);
+            }
+            if (owned.empty()) {
+                continue;
+            }
+            std::shuffle(owned.begin(), owned.end(), generator.random());
+            owned.resize(std::max<std::size_t>(1, owned.size() * options.churn / 100));
+            std::vector<std::string> changed;
+            std::uint64_t bytes = 0;
+            for (std::size_t i : owned) {
+                bytes += writeFile(workspace, files[i],
+                                   generator.contents(files[i].path + " rev " + std::to_string(c), files[i].size));
+                changed.push_back(files[i].path);
+            }
+            addAndCommit(recorder, service, repo, changed, bytes, "commit " + std::to_string(c));
+            sync(recorder, service, repo, remote, mirror);
+        }
+
+        checkout(recorder, service, repo, "main");
+        for (std::size_t b = 1; b <= options.branches; ++b) {
+            MergeResult merged;
+            bool ok = true;
+            recorder.time("merge", 0, [&] { ok = service.mergeBranch(repo, branchName(b), "bench", merged, error); });
+            if (!ok || !merged.conflicts.empty()) {
+                fail("merge " + branchName(b), ok ? "unexpected conflicts" : error);
+            }
+        }
+        sync(recorder, service, repo, remote, mirror);
+
+        std::string tip = service.branchHead(repo, "main");
+        for (std::size_t r = 0; r < options.logRounds; ++r) {
+            std::size_t seen = 0;
+            recorder.time("log", 0, [&] {
+                service.walkHistory(repo, tip, 0, [&](const CommitRecord &) {
+                    ++seen;
+                    return true;
+                });
+            });
+            if (seen == 0) {
+                fail("log", "history is empty");
+            }
+        }
+    }
+
+    fs::current_path(previous);
+    std::chrono::duration<double> wall = Clock::now() - wallStart;
+    std::string text = report(options, recorder, wall.count());
+    if (options.out.empty()) {
+        std::cout << text;
+    } else {
+        std::ofstream out(options.out, std::ios::trunc);
+        out << text;
+        if (!out) {
+            fail("write report", options.out);
+        }
+    }
+    if (!options.keep) {
+        std::error_code ec;
+        fs::remove_all(options.dir.empty() ? scratch : scratch / "storage", ec);
+    }
+    return EXIT_SUCCESS;
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+    Options options;
+    if (!parseOptions(argc, argv, options)) {
+        printUsage();
+        return 2;
+    }
+    try {
+        hashing::ensureSodium();
+        return run(options);
+    } catch (const std::exception &ex) {
+        std::cerr << "gitlite-bench: " << ex.what() << "\n";
+        return EXIT_FAILURE;
+    }
+}
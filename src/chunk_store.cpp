@@ -0,0 +1,351 @@
+#include "chunk_store.hpp"
+
+#include "compression.hpp"
+#include "hashing.hpp"
+#include "journal.hpp"
+#include "stats.hpp"
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <system_error>
+
+namespace fs = std::filesystem;
+
+namespace chunks {
+
+namespace {
+
+constexpr char kManifestMagic[kMagicSize] = {'G', 'L', 'C', 'K'};
+constexpr char kCompressedMagic[4] = {'G', 'L', 'Z', '1'};
+constexpr std::uint32_t kManifestVersion = 1;
+constexpr std::size_t kManifestHeaderSize = kMagicSize + 4 + 8 + 4;
+constexpr std::size_t kManifestEntrySize = hashing::kDigestBytes + 4;
+constexpr std::uint64_t kDefaultThreshold = std::uint64_t(4) << 20;
+
+// Normalized chunking: a stricter mask before the average size and a looser
+// one after it pulls chunk sizes towards the average. The gear hash shifts
+// left once per byte, so its top bits cover the last 64 bytes.
+constexpr std::uint64_t kMaskSmall = ~std::uint64_t(0) << (64 - 20);
+constexpr std::uint64_t kMaskLarge = ~std::uint64_t(0) << (64 - 16);
+
+constexpr std::array<std::uint64_t, 256> makeGear() {
+    // splitmix64; the table must never change, or boundaries (and with them
+    // every stored chunk id) would shift.
+    std::array<std::uint64_t, 256> table{};
+    std::uint64_t state = 0x676c6974652d6364ULL;
+    for (auto &entry : table) {
+        state += 0x9e3779b97f4a7c15ULL;
+        std::uint64_t z = state;
+        z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+        z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+        entry = z ^ (z >> 31);
+    }
+    return table;
+}
+
+constexpr std::array<std::uint64_t, 256> kGear = makeGear();
+
+void putU32(std::string &out, std::uint32_t value) {
+    for (int i = 0; i < 4; ++i) {
+        out.push_back(static_cast<char>((value >> (8 * i)) & 0xff));
+    }
+}
+
+void putU64(std::string &out, std::uint64_t value) {
+    for (int i = 0; i < 8; ++i) {
+        out.push_back(static_cast<char>((value >> (8 * i)) & 0xff));
+    }
+}
+
+std::uint64_t getLE(const unsigned char *p, int bytes) {
+    std::uint64_t value = 0;
+    for (int i = bytes - 1; i >= 0; --i) {
+        value = (value << 8) | p[i];
+    }
+    return value;
+}
+
+fs::path chunkPath(const fs::path &dir, const std::string &id) {
+    return dir / id.substr(0, 2) / id.substr(2);
+}
+
+bool readChunk(const std::vector<fs::path> &dirs, const ChunkRef &chunk, std::string &data) {
+    stats::count(stats::Counter::FsCalls);
+    std::ifstream in;
+    for (const auto &dir : dirs) {
+        in.open(chunkPath(dir, chunk.id), std::ios::binary);
+        if (in) {
+            break;
+        }
+        in.clear();
+    }
+    if (!in.is_open()) {
+        return false;
+    }
+    data.assign(std::istreambuf_iterator<char>(in), {});
+    if (in.bad()) {
+        return false;
+    }
+    if (data.size() >= sizeof(kCompressedMagic) &&
+        std::memcmp(data.data(), kCompressedMagic, sizeof(kCompressedMagic)) == 0) {
+        std::string decoded;
+        if (!compression::inflateBytes(reinterpret_cast<const unsigned char *>(data.data()) + sizeof(kCompressedMagic),
+                                       data.size() - sizeof(kCompressedMagic),
+                                       decoded)) {
+            return false;
+        }
+        data.swap(decoded);
+    }
+    return data.size() == chunk.length;
+}
+
+} // namespace
+
+std::uint64_t threshold() {
+    static const std::uint64_t value = [] {
+        const char *text = std::getenv("GLITE_CHUNK_THRESHOLD");
+        if (!text || !*text) {
+            return kDefaultThreshold;
+        }
+        char *end = nullptr;
+        unsigned long long parsed = std::strtoull(text, &end, 10);
+        return *end == '\0' ? static_cast<std::uint64_t>(parsed) : kDefaultThreshold;
+    }();
+    return value;
+}
+
+std::size_t cutPoint(const unsigned char *data, std::size_t length) {
+    if (length <= kMinChunk) {
+        return length;
+    }
+    std::size_t limit = length < kMaxChunk ? length : kMaxChunk;
+    std::size_t normal = limit < kAverageChunk ? limit : kAverageChunk;
+    std::uint64_t hash = 0;
+    std::size_t i = kMinChunk;
+    for (; i < normal; ++i) {
+        hash = (hash << 1) + kGear[data[i]];
+        if ((hash & kMaskSmall) == 0) {
+            return i + 1;
+        }
+    }
+    for (; i < limit; ++i) {
+        hash = (hash << 1) + kGear[data[i]];
+        if ((hash & kMaskLarge) == 0) {
+            return i + 1;
+        }
+    }
+    return limit;
+}
+
+bool isManifest(const char *data, std::size_t length) {
+    return length >= kMagicSize && std::memcmp(data, kManifestMagic, kMagicSize) == 0;
+}
+
+std::string encodeManifest(const Manifest &manifest) {
+    std::string out(kManifestMagic, kMagicSize);
+    out.reserve(kManifestHeaderSize + manifest.chunks.size() * kManifestEntrySize);
+    putU32(out, kManifestVersion);
+    putU64(out, manifest.size);
+    putU32(out, static_cast<std::uint32_t>(manifest.chunks.size()));
+    unsigned char raw[hashing::kDigestBytes];
+    for (const auto &chunk : manifest.chunks) {
+        hashing::fromHex(chunk.id, raw, sizeof(raw));
+        out.append(reinterpret_cast<const char *>(raw), sizeof(raw));
+        putU32(out, chunk.length);
+    }
+    return out;
+}
+
+bool decodeManifest(const std::string &data, Manifest &manifest) {
+    manifest = {};
+    if (data.size() < kManifestHeaderSize || !isManifest(data.data(), data.size())) {
+        return false;
+    }
+    const auto *p = reinterpret_cast<const unsigned char *>(data.data());
+    if (getLE(p + kMagicSize, 4) != kManifestVersion) {
+        return false;
+    }
+    manifest.size = getLE(p + kMagicSize + 4, 8);
+    auto count = static_cast<std::size_t>(getLE(p + kMagicSize + 12, 4));
+    if (data.size() != kManifestHeaderSize + count * kManifestEntrySize) {
+        return false;
+    }
+    std::uint64_t total = 0;
+    manifest.chunks.resize(count);
+    const unsigned char *entry = p + kManifestHeaderSize;
+    for (auto &chunk : manifest.chunks) {
+        chunk.id = hashing::toHex(entry, hashing::kDigestBytes);
+        chunk.length = static_cast<std::uint32_t>(getLE(entry + hashing::kDigestBytes, 4));
+        total += chunk.length;
+        entry += kManifestEntrySize;
+    }
+    return total == manifest.size;
+}
+
+bool enabled() {
+    return threshold() > 0;
+}
+
+bool contains(const fs::path &dir, const std::string &id) {
+    std::error_code ec;
+    return id.size() > 2 && fs::is_regular_file(chunkPath(dir, id), ec);
+}
+
+bool write(const fs::path &dir, const unsigned char *data, std::size_t length, std::string &id, std::string &error) {
+    id = hashing::sha256Digest(data, length).hex();
+    fs::path target = chunkPath(dir, id);
+    std::error_code ec;
+    if (fs::is_regular_file(target, ec)) {
+        stats::count(stats::Counter::ChunksReused);
+        return true;
+    }
+    fs::create_directories(target.parent_path(), ec);
+    static std::atomic<unsigned long> counter{0};
+    auto ticks = std::chrono::steady_clock::now().time_since_epoch().count();
+    fs::path scratch = dir / ("tmp-" + std::to_string(ticks) + "-" + std::to_string(counter++));
+
+    // Same rule as loose objects: keep zlib output only when it saves ~5%.
+    std::string compressed;
+    bool compress = compression::deflateBytes(data, length, compressed) && compressed.size() + length / 20 < length;
+    {
+        stats::count(stats::Counter::FsCalls);
+        std::ofstream out(scratch, std::ios::binary | std::ios::trunc);
+        if (compress) {
+            out.write(kCompressedMagic, sizeof(kCompressedMagic));
+            out << compressed;
+        } else {
+            out.write(reinterpret_cast<const char *>(data), static_cast<std::streamsize>(length));
+        }
+        out.flush();
+        if (!out) {
+            out.close();
+            fs::remove(scratch, ec);
+            error = "Unable to write chunk " + id + ".";
+            return false;
+        }
+    }
+    // Another writer may have stored the same chunk meanwhile; the rename
+    // then replaces identical bytes.
+    fs::rename(scratch, target, ec);
+    if (ec) {
+        std::error_code ignored;
+        fs::remove(scratch, ignored);
+        error = "Unable to store chunk " + id + ": " + ec.message();
+        return false;
+    }
+    journal::noteObject(target);
+    stats::count(stats::Counter::ChunksWritten);
+    return true;
+}
+
+bool writeAll(const fs::path &dir, const std::string &data, Manifest &manifest, std::string &error) {
+    manifest = {};
+    manifest.size = data.size();
+    const auto *bytes = reinterpret_cast<const unsigned char *>(data.data());
+    std::size_t offset = 0;
+    while (offset < data.size()) {
+        std::size_t length = cutPoint(bytes + offset, data.size() - offset);
+        ChunkRef chunk;
+        chunk.length = static_cast<std::uint32_t>(length);
+        if (!write(dir, bytes + offset, length, chunk.id, error)) {
+            return false;
+        }
+        manifest.chunks.push_back(std::move(chunk));
+        offset += length;
+    }
+    return true;
+}
+
+bool copy(const std::vector<fs::path> &from, const fs::path &to, const std::string &id, std::string &error) {
+    fs::path target = chunkPath(to, id);
+    std::error_code ec;
+    if (fs::is_regular_file(target, ec)) {
+        return true;
+    }
+    for (const auto &dir : from) {
+        fs::path source = chunkPath(dir, id);
+        if (!fs::is_regular_file(source, ec)) {
+            continue;
+        }
+        fs::create_directories(target.parent_path(), ec);
+        // Chunk files are never rewritten in place, so sharing the inode is
+        // safe.
+        fs::create_hard_link(source, target, ec);
+        if (ec) {
+            ec.clear();
+            fs::copy_file(source, target, fs::copy_options::skip_existing, ec);
+        }
+        if (ec) {
+            error = "Unable to copy chunk " + id + ": " + ec.message();
+            return false;
+        }
+        journal::noteObject(target);
+        return true;
+    }
+    error = "Chunk " + id + " is missing.";
+    return false;
+}
+
+bool assemble(const std::vector<fs::path> &dirs, const Manifest &manifest, std::string &data, std::string &error) {
+    data.clear();
+    data.reserve(static_cast<std::size_t>(manifest.size));
+    std::string chunk;
+    for (const auto &ref : manifest.chunks) {
+        if (!readChunk(dirs, ref, chunk)) {
+            error = "Missing or corrupt chunk " + ref.id + ".";
+            return false;
+        }
+        data += chunk;
+    }
+    return true;
+}
+
+bool assemble(const std::vector<fs::path> &dirs, const Manifest &manifest, std::ostream &out, std::string &error) {
+    std::string chunk;
+    for (const auto &ref : manifest.chunks) {
+        if (!readChunk(dirs, ref, chunk)) {
+            error = "Missing or corrupt chunk " + ref.id + ".";
+            return false;
+        }
+        out << chunk;
+    }
+    return static_cast<bool>(out);
+}
+
+std::size_t prune(const fs::path &dir, const std::unordered_set<std::string> &live, std::chrono::seconds grace) {
+    std::size_t removed = 0;
+    std::error_code ec;
+    if (!fs::is_directory(dir, ec)) {
+        return removed;
+    }
+    // Young files may belong to a manifest that is still being written.
+    auto now = fs::file_time_type::clock::now();
+    auto expired = [&](const fs::path &path) {
+        std::error_code timeEc;
+        auto written = fs::last_write_time(path, timeEc);
+        return !timeEc && now - written >= grace;
+    };
+    for (const auto &fan : fs::directory_iterator(dir, ec)) {
+        std::string prefix = fan.path().filename().string();
+        if (!fan.is_directory(ec)) {
+            if (prefix.rfind("tmp-", 0) == 0 && expired(fan.path())) {
+                fs::remove(fan.path(), ec);
+            }
+            continue;
+        }
+        for (const auto &entry : fs::directory_iterator(fan.path(), ec)) {
+            std::string id = prefix + entry.path().filename().string();
+            if (live.count(id) == 0 && expired(entry.path()) && fs::remove(entry.path(), ec)) {
+                ++removed;
+            }
+        }
+    }
+    return removed;
+}
+
+} // namespace chunks
@@ -0,0 +1,97 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <ostream>
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+// Content-defined chunking for large blobs, and the chunk directories that
+// hold the chunks.
+//
+// A blob of at least threshold() bytes is cut into chunks where a gear hash
+// over the preceding bytes hits a mask (FastCDC with normalized chunking), so
+// an edit only moves the boundaries next to it. Each chunk is stored once per
+// repository, named by its SHA-256, in the chunk directory of the object store
+// that holds the manifest (.glite/objects/chunks/<2 hex>/<62 hex>). Chunk
+// files hold the raw bytes or "GLZ1" followed by a zlib stream, like loose
+// objects.
+//
+// The blob itself is stored as a manifest under its usual id, the hash of
+// the whole contents, so trees, commits and the wire protocol never see
+// chunks:
+//   "GLCK" | u32 version | u64 size | u32 count | count x (32-byte id | u32 length)
+// All integers are little-endian.
+//
+// A fork reads manifests borrowed through its alternates with the chunk
+// directories of those alternates. gc removes chunks that no reachable
+// manifest of the repository lists (prune).
+namespace chunks {
+
+constexpr std::size_t kMinChunk = 64 * 1024;
+constexpr std::size_t kAverageChunk = 256 * 1024;
+constexpr std::size_t kMaxChunk = 1024 * 1024;
+
+// Blobs at least this large are chunked; 0 turns chunking off. Defaults to
+// 4 MiB and is read once from GLITE_CHUNK_THRESHOLD.
+std::uint64_t threshold();
+
+// Length of the chunk that starts at `data`. Never more than `length`, so a
+// caller streaming a file must hold kMaxChunk bytes (or the rest of the
+// file) before asking.
+std::size_t cutPoint(const unsigned char *data, std::size_t length);
+
+struct ChunkRef {
+    std::string id;
+    std::uint32_t length = 0;
+};
+
+struct Manifest {
+    std::uint64_t size = 0;
+    std::vector<ChunkRef> chunks;
+};
+
+constexpr std::size_t kMagicSize = 4;
+bool isManifest(const char *data, std::size_t length);
+std::string encodeManifest(const Manifest &manifest);
+bool decodeManifest(const std::string &data, Manifest &manifest);
+
+bool enabled();
+
+bool contains(const std::filesystem::path &dir, const std::string &id);
+// Stores one chunk in `dir` unless it is already present; `id` receives its
+// hash. Safe to call from several threads at once.
+bool write(const std::filesystem::path &dir,
+           const unsigned char *data,
+           std::size_t length,
+           std::string &id,
+           std::string &error);
+// Cuts `data` into chunks and stores the ones `dir` lacks.
+bool writeAll(const std::filesystem::path &dir, const std::string &data, Manifest &manifest, std::string &error);
+// Hard-links (or copies) chunk `id` from the first of `from` that has it.
+bool copy(const std::vector<std::filesystem::path> &from,
+          const std::filesystem::path &to,
+          const std::string &id,
+          std::string &error);
+
+// Streams the manifest's chunks in order, each from the first of `dirs` that
+// has it.
+bool assemble(const std::vector<std::filesystem::path> &dirs,
+              const Manifest &manifest,
+              std::string &data,
+              std::string &error);
+bool assemble(const std::vector<std::filesystem::path> &dirs,
+              const Manifest &manifest,
+              std::ostream &out,
+              std::string &error);
+
+// Deletes the chunks in `dir` that `live` lacks and that are older than
+// `grace`, plus stale scratch files. Returns the number of chunks deleted.
+std::size_t prune(const std::filesystem::path &dir,
+                  const std::unordered_set<std::string> &live,
+                  std::chrono::seconds grace);
+
+} // namespace chunks
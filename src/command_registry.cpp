@@ -0,0 +1,397 @@
+#include "command_registry.hpp"
+
+#include <algorithm>
+#include <iterator>
+
+namespace commands {
+
+namespace {
+
+constexpr Spec kSpecs[] = {
+    {Id::Logout, "logout", "exit quit", Category::Auth, 0, 0, "logout",
+     "logout\tEnd current user session"},
+    {Id::Whoami, "whoami", "", Category::Auth, 0, 0, "whoami",
+     "whoami\tDisplay current user and role"},
+    {Id::LsUsers, "ls-users", "", Category::Auth, 0, 0, "ls-users",
+     "ls-users\tList all users"},
+
+    {Id::Init, "init", "", Category::Repo, 0, 0, "init",
+     "init\tInitialize repository in current folder"},
+    {Id::Create, "create", "", Category::Repo, 1, 1, "create <repo-name>",
+     "create <repo>\tCreate new repository"},
+    {Id::Delete, "delete", "", Category::Repo, 1, 1, "delete <repo>",
+     "delete <repo>\tDelete repository"},
+    {Id::SetPublic, "set-public", "", Category::Repo, 1, 1, "set-public <repo>",
+     "set-public <repo>\tMark repo as public"},
+    {Id::SetPrivate, "set-private", "", Category::Repo, 1, 1, "set-private <repo>",
+     "set-private <repo>\tMake repo private"},
+    {Id::Visibility, "visibility", "", Category::Repo, 0, 2, "visibility [repo] [public|private]",
+     "visibility [repo] [public|private]\tToggle or set repo visibility"},
+    {Id::List, "list", "", Category::Repo, 0, 0, "list",
+     "list\tList all your repositories"},
+    {Id::LsRepos, "ls-repos", "", Category::Repo, 0, 1, "ls-repos [user]",
+     "ls-repos <user>\tShow user's repositories"},
+    {Id::Repos, "repos", "", Category::Repo, 1, kAnyArgs, "repos all|public [prefix] [-n <count>] [--skip <count>]",
+     "repos public [prefix] [-n N] [--skip K]\tBrowse public repositories\n"
+     "repos all [prefix] [-n N] [--skip K]\tList all repositories, 50 per page (admins)"},
+    {Id::View, "view", "", Category::Repo, 1, 1, "view <user>/<repo>",
+     "view <user>/<repo>\tView repository contents"},
+    {Id::Repack, "repack", "", Category::Repo, 0, 2, "repack [-a] [repo]",
+     "repack [-a] [repo]\tMove loose objects into a pack (-a merges packs)"},
+    {Id::Gc, "gc", "", Category::Repo, 0, 2, "gc [--now] [repo]",
+     "gc [--now] [repo]\tDelete unreachable objects and repack (--now: no grace period)"},
+
+    {Id::Add, "add", "", Category::Files, 1, 2, "add <file|dir|glob> [repo]",
+     "add <file> [repo]\tStage file for commit (optionally target repo)\n"
+     "add <dir>|.|<glob>\tStage recursively, skipping .gliteignore matches"},
+    {Id::Status, "status", "", Category::Files, 0, 1, "status [repo]",
+     "status [repo]\tShow staged, modified and untracked files"},
+    {Id::Rm, "rm", "", Category::Files, 1, 1, "rm <file>",
+     "rm <file>*\tRemove file from staging and workspace"},
+    {Id::Diff, "diff", "", Category::Files, 0, 2, "diff [--staged] | diff <old-commit> <new-commit>",
+     "diff*\tLine diff of workspace changes not yet staged\n"
+     "diff --staged*\tLine diff of staged changes against HEAD\n"
+     "diff <c1> <c2>*\tLine diff between two commits"},
+    {Id::Reset, "reset", "", Category::Files, 1, 1, "reset <file>",
+     "reset <file>*\tUnstage a file"},
+    {Id::Ignore, "ignore", "", Category::Files, 1, 1, "ignore <pattern>",
+     "ignore <pattern>*\tAdd pattern to .gliteignore"},
+
+    {Id::Commit, "commit", "", Category::Commit, 0, kAnyArgs, "commit -m <message>",
+     "commit -m \"message\"*\tCreate commit with message"},
+    {Id::Log, "log", "", Category::Commit, 0, 8, "log [repo] [-n <count>] [--skip <count>] [<a>..<b>] [-- <path>]",
+     "log [repo] [-n N] [--skip K] [a..b] [-- path]\tShow commit history, one page at a time"},
+    {Id::Show, "show", "", Category::Commit, 1, 1, "show <commit-hash>",
+     "show <commit-hash>*\tShow commit details and its line diff"},
+    {Id::Revert, "revert", "", Category::Commit, 1, 1, "revert <commit-hash>",
+     "revert <commit-hash>*\tUndo a commit"},
+    {Id::Tag, "tag", "", Category::Commit, 1, 2, "tag <name> [repo]",
+     "tag <name> [repo]\tTag current commit"},
+    {Id::Tags, "tags", "", Category::Commit, 0, 1, "tags [repo]",
+     "tags [repo]\tList all tags"},
+
+    {Id::Branch, "branch", "", Category::Branch, 0, 2, "branch [list] [repo] | branch <name> [repo]",
+     "branch [repo]\tList all branches\n"
+     "branch list [repo]\tAlias for listing branches\n"
+     "branch <name> [repo]\tCreate new branch"},
+    {Id::Checkout, "checkout", "", Category::Branch, 1, 2, "checkout <branch> [repo]",
+     "checkout <branch> [repo]\tSwitch to branch"},
+    {Id::Merge, "merge", "", Category::Branch, 1, 2, "merge <branch> [repo]",
+     "merge <branch> [repo]\tThree-way merge into current (fast-forwards when possible)"},
+    {Id::Rebase, "rebase", "", Category::Branch, 1, 2, "rebase <branch> [repo]",
+     "rebase <branch> [repo]\tRebase current branch onto another"},
+    {Id::RenameBranch, "rename-branch", "", Category::Branch, 2, 3, "rename-branch <old> <new> [repo]",
+     "rename-branch <old> <new> [repo]\tRename branch"},
+    {Id::DeleteBranch, "delete-branch", "", Category::Branch, 1, 2, "delete-branch <name> [repo]",
+     "delete-branch <name> [repo]\tDelete branch"},
+
+    {Id::Push, "push", "", Category::Sync, 0, 1, "push [url]",
+     "push* [url]\tSend new commits to remote mirror (fast-forward only)"},
+    {Id::Pull, "pull", "", Category::Sync, 0, 1, "pull [url]",
+     "pull* [url]\tFetch, then fast-forward local branches"},
+    {Id::Fetch, "fetch", "", Category::Sync, 0, 1, "fetch [url]",
+     "fetch* [url]\tDownload objects into refs/remotes/ only"},
+    {Id::Sync, "sync", "", Category::Sync, 0, 1, "sync [url]",
+     "sync* [url]\tPull, then push"},
+    {Id::Clone, "clone", "", Category::Sync, 1, 4,
+     "clone <user>/<repo> [--depth N] | clone gitlite://host[:port]/<user>/<repo> [--depth N] [--filter=blob:none]",
+     "clone <user>/<repo>\tClone repository to current directory\n"
+     "clone <url>\tClone from a GitLite server (gitlite://host[:port]/<user>/<repo>)\n"
+     "  --depth N\tKeep only the last N commits of history\n"
+     "  --filter=blob:none\tNetwork only: fetch file contents when checkout or diff needs them"},
+
+    {Id::Perm, "perm", "", Category::Collab, 2, 3, "perm add|rm|list <repo> [user]",
+     "perm add <repo> <user>\tGrant collaborator access\n"
+     "perm rm <repo> <user>\tRevoke collaborator access\n"
+     "perm list <repo>\tList all collaborators"},
+    {Id::Transfer, "transfer", "", Category::Collab, 2, 2, "transfer <repo> <new-owner>",
+     "transfer <repo> <new-owner>\tTransfer repository ownership"},
+    {Id::Fork, "fork", "", Category::Collab, 1, 1, "fork <user>/<repo>",
+     "fork <user>/<repo>\tFork repository to your account (shares its objects)"},
+
+    {Id::MakeAdmin, "make-admin", "", Category::Admin, 1, 1, "make-admin <user>",
+     "make-admin <user>\tPromote user to admin"},
+    {Id::RemoveAdmin, "remove-admin", "", Category::Admin, 1, 1, "remove-admin <user>",
+     "remove-admin <user>\tDemote admin to user"},
+
+    {Id::Menu, "menu", "", Category::Utility, 0, 0, "menu",
+     "menu\tShow dashboard menu"},
+    {Id::Help, "help", "", Category::Utility, 0, 1, "help [category]",
+     "help\tShow help categories\n"
+     "help/<category>\tShow commands for category"},
+    {Id::Clear, "clear", "", Category::Utility, 0, 0, "clear",
+     "clear\tClear terminal"},
+    {Id::Version, "version", "", Category::Utility, 0, 0, "version",
+     "version\tShow version"},
+    {Id::Stats, "stats", "", Category::Utility, 0, 2, "stats [on|off|reset|trace <file>|trace off]",
+     "stats\tShow counters, hot-path timers and recent command times\n"
+     "stats on|off|reset\tStart, stop or zero instrumentation (process-wide)\n"
+     "stats trace <file>\tRecord a Chrome trace of this session; 'stats trace off' writes it"},
+    {Id::Config, "config", "", Category::Utility, 0, kAnyArgs, "config set|get|list <key> [value]",
+     "config set <key> <value>\tSet configuration\n"
+     "config get <key>\tGet configuration\n"
+     "config list\tList all configurations\n"
+     "(config applies to the current repo, e.g. pack.depth / pack.window)"},
+    {Id::Cd, "cd", "", Category::Utility, 0, 1, "cd [path]",
+     "cd <path>\tChange directory\n"
+     "cd ..\tGo to parent directory\n"
+     "cd ~\tGo to home directory"},
+    {Id::Pwd, "pwd", "", Category::Utility, 0, 0, "pwd",
+     "pwd\tShow current directory"},
+    {Id::Ls, "ls", "dir", Category::Utility, 0, 0, "ls",
+     "ls / dir\tList directory contents"},
+};
+
+static_assert(sizeof(kSpecs) / sizeof(kSpecs[0]) == kCommandCount, "every command needs a spec");
+
+constexpr bool specsInIdOrder() {
+    for (std::size_t i = 0; i < kCommandCount; ++i) {
+        if (static_cast<std::size_t>(kSpecs[i].id) != i) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static_assert(specsInIdOrder(), "kSpecs must follow the order of commands::Id");
+
+struct CategoryInfo {
+    Category category;
+    std::string_view key;
+    std::string_view summary;
+    std::string_view title;
+    // Printed after the command lines, if any.
+    std::string_view footer;
+};
+
+constexpr CategoryInfo kCategories[] = {
+    {Category::Auth, "auth", "User & Authentication", "User & Authentication Commands:",
+     "  (Note: signup/login done from main menu)\n"
+     "  (Scripts: gitlite --batch --user <name> '<command>' ... ; see README)"},
+    {Category::Repo, "repo", "Repository Management", "Repository Management Commands:",
+     "\nWorkflow:\n"
+     "  1. cd <path> - Navigate to your project folder\n"
+     "  2. ls - List files in directory\n"
+     "  3. init - Create .glite repository\n"
+     "  4. add <file> - Stage files from current directory\n"
+     "  5. commit -m \"message\" - Commit changes"},
+    {Category::Files, "files", "File Tracking", "File Tracking Commands:",
+     "\nExamples:\n"
+     "  add workspace/main.cpp\n"
+     "  add .\n"
+     "  add src/**/*.cpp\n"
+     "  status tejas/assignments"},
+    {Category::Commit, "commit", "Commit System", "Commit System Commands:",
+     "\nExamples:\n"
+     "  commit -m \"Initial commit\"\n"
+     "  log tejas/assignments"},
+    {Category::Branch, "branch", "Branching & Merging", "Branching & Merging Commands:",
+     "\nExamples:\n"
+     "  branch feature-x\n"
+     "  branch list tejas/assignments\n"
+     "  checkout main tejas/assignments"},
+    {Category::Sync, "sync", "Syncing & Collaboration", "Syncing Commands:",
+     "\npush, pull, fetch and sync accept a gitlite:// URL; without one they use the\n"
+     "repo's remote.url (set by a network clone, or with 'config set remote.url <url>').\n"
+     "The remote password comes from GLITE_REMOTE_PASSWORD or a prompt.\n\n"
+     "Note: Without a URL, remotes are stored in storage/_remotes/; only missing objects are copied."},
+    {Category::Collab, "collab", "Collaboration & Permissions", "Collaboration & Permissions Commands:",
+     "\nExample:\n"
+     "  perm add myrepo alice\n"
+     "  perm list myrepo"},
+    {Category::Admin, "admin", "Admin & Role Management", "Admin Commands (Admin only):",
+     "\nNote: Only admins can use these commands. 'repos all' (help/repo) lists every repository."},
+    {Category::Utility, "utility", "UI & Utility Commands", "UI & Utility Commands:", ""},
+};
+
+static_assert(sizeof(kCategories) / sizeof(kCategories[0]) == static_cast<std::size_t>(Category::Count),
+              "every category needs an entry");
+
+// --- Perfect hash over every name and alias ---
+
+constexpr bool isSpace(char c) {
+    return c == ' ';
+}
+
+template <typename Visit>
+constexpr void forEachName(Visit &&visit) {
+    for (std::size_t i = 0; i < kCommandCount; ++i) {
+        visit(kSpecs[i].name, i);
+        std::string_view aliases = kSpecs[i].aliases;
+        std::size_t start = 0;
+        while (start < aliases.size()) {
+            if (isSpace(aliases[start])) {
+                ++start;
+                continue;
+            }
+            std::size_t end = start;
+            while (end < aliases.size() && !isSpace(aliases[end])) {
+                ++end;
+            }
+            visit(aliases.substr(start, end - start), i);
+            start = end;
+        }
+    }
+}
+
+constexpr std::size_t countNames() {
+    std::size_t count = 0;
+    forEachName([&count](std::string_view, std::size_t) { ++count; });
+    return count;
+}
+
+constexpr std::size_t kNameCount = countNames();
+
+struct Name {
+    std::string_view text;
+    std::uint8_t spec = 0;
+};
+
+constexpr std::array<Name, kNameCount> collectNames() {
+    std::array<Name, kNameCount> names{};
+    std::size_t next = 0;
+    forEachName([&names, &next](std::string_view text, std::size_t spec) {
+        names[next].text = text;
+        names[next].spec = static_cast<std::uint8_t>(spec);
+        ++next;
+    });
+    return names;
+}
+
+constexpr std::array<Name, kNameCount> kNames = collectNames();
+
+// Eight slots per name keeps the expected number of seeds to try small.
+constexpr std::size_t kSlotBits = 9;
+constexpr std::size_t kSlotCount = std::size_t{1} << kSlotBits;
+constexpr std::uint8_t kEmptySlot = 0xff;
+
+static_assert(kNameCount < kEmptySlot && kNameCount * 8 <= kSlotCount, "grow kSlotBits");
+
+// FNV-1a from a seeded basis, folded so the high bits reach the slot index.
+constexpr std::size_t slotOf(std::string_view text, std::uint32_t seed) {
+    std::uint32_t hash = 2166136261u ^ (seed * 0x9e3779b9u);
+    for (char c : text) {
+        hash ^= static_cast<unsigned char>(c);
+        hash *= 16777619u;
+    }
+    hash ^= hash >> 15;
+    return hash & (kSlotCount - 1);
+}
+
+struct Table {
+    std::uint32_t seed = 0;
+    std::array<std::uint8_t, kSlotCount> slots{};
+};
+
+constexpr Table buildTable() {
+    Table table;
+    for (std::uint32_t seed = 1; seed < 4096; ++seed) {
+        for (auto &slot : table.slots) {
+            slot = kEmptySlot;
+        }
+        bool collided = false;
+        for (std::size_t i = 0; i < kNameCount && !collided; ++i) {
+            auto &slot = table.slots[slotOf(kNames[i].text, seed)];
+            collided = slot != kEmptySlot;
+            slot = static_cast<std::uint8_t>(i);
+        }
+        if (!collided) {
+            table.seed = seed;
+            return table;
+        }
+    }
+    throw "no collision-free seed; grow kSlotBits";
+}
+
+constexpr Table kTable = buildTable();
+
+// Visits each "<syntax>\t<description>" line of a help entry.
+template <typename Visit>
+void forEachHelpLine(std::string_view help, Visit &&visit) {
+    while (!help.empty()) {
+        std::size_t end = help.find('\n');
+        std::string_view line = help.substr(0, end);
+        help = end == std::string_view::npos ? std::string_view() : help.substr(end + 1);
+        std::size_t tab = line.find('\t');
+        if (tab == std::string_view::npos) {
+            visit(line, std::string_view());
+        } else {
+            visit(line.substr(0, tab), line.substr(tab + 1));
+        }
+    }
+}
+
+} // namespace
+
+const Spec *find(std::string_view name) {
+    std::uint8_t slot = kTable.slots[slotOf(name, kTable.seed)];
+    if (slot == kEmptySlot || kNames[slot].text != name) {
+        return nullptr;
+    }
+    return &kSpecs[kNames[slot].spec];
+}
+
+const Spec &spec(Id id) {
+    return kSpecs[static_cast<std::size_t>(id)];
+}
+
+std::string usageError(const Spec &spec) {
+    return "Error: Usage: " + std::string(spec.usage);
+}
+
+std::string categoryList() {
+    std::string result;
+    for (std::size_t i = 0; i < std::size(kCategories); ++i) {
+        std::string key(kCategories[i].key);
+        key.resize(std::max<std::size_t>(key.size() + 1, 11), ' ');
+        result += "  " + std::to_string(i + 1) + ". " + key + "- " + std::string(kCategories[i].summary) + "\n";
+    }
+    return result;
+}
+
+std::optional<std::string> categoryHelp(const std::string &category) {
+    for (std::size_t i = 0; i < std::size(kCategories); ++i) {
+        const CategoryInfo &info = kCategories[i];
+        if (category != info.key && category != std::to_string(i + 1)) {
+            continue;
+        }
+        // Descriptions line up within a category; very long syntax just
+        // gets one space.
+        constexpr std::size_t kMaxSyntaxWidth = 28;
+        std::size_t width = 0;
+        for (const Spec &entry : kSpecs) {
+            if (entry.category == info.category) {
+                forEachHelpLine(entry.help, [&width](std::string_view syntax, std::string_view text) {
+                    if (!text.empty() && syntax.size() < kMaxSyntaxWidth) {
+                        width = std::max(width, syntax.size() + 1);
+                    }
+                });
+            }
+        }
+        std::string result(info.title);
+        result += '\n';
+        for (const Spec &entry : kSpecs) {
+            if (entry.category != info.category) {
+                continue;
+            }
+            forEachHelpLine(entry.help, [&result, width](std::string_view syntax, std::string_view text) {
+                result += "  ";
+                result += syntax;
+                if (!text.empty()) {
+                    result.append(syntax.size() < width ? width - syntax.size() : 1, ' ');
+                    result += "- ";
+                    result += text;
+                }
+                result += '\n';
+            });
+        }
+        result += info.footer;
+        while (!result.empty() && result.back() == '\n') {
+            result.pop_back();
+        }
+        return result;
+    }
+    return std::nullopt;
+}
+
+} // namespace commands
@@ -0,0 +1,133 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <utility>
+
+// The command surface shared by every front end (terminal, batch mode and
+// server sessions): names, aliases, argument bounds, usage and help text.
+// Names resolve through a perfect hash built at compile time, so a lookup is
+// one hash and one string compare.
+namespace commands {
+
+enum class Id {
+    // auth
+    Logout,
+    Whoami,
+    LsUsers,
+    // repo
+    Init,
+    Create,
+    Delete,
+    SetPublic,
+    SetPrivate,
+    Visibility,
+    List,
+    LsRepos,
+    Repos,
+    View,
+    Repack,
+    Gc,
+    // files
+    Add,
+    Status,
+    Rm,
+    Diff,
+    Reset,
+    Ignore,
+    // commit
+    Commit,
+    Log,
+    Show,
+    Revert,
+    Tag,
+    Tags,
+    // branch
+    Branch,
+    Checkout,
+    Merge,
+    Rebase,
+    RenameBranch,
+    DeleteBranch,
+    // sync
+    Push,
+    Pull,
+    Fetch,
+    Sync,
+    Clone,
+    // collab
+    Perm,
+    Transfer,
+    Fork,
+    // admin
+    MakeAdmin,
+    RemoveAdmin,
+    // utility
+    Menu,
+    Help,
+    Clear,
+    Version,
+    Stats,
+    Config,
+    Cd,
+    Pwd,
+    Ls,
+    Count
+};
+
+constexpr std::size_t kCommandCount = static_cast<std::size_t>(Id::Count);
+
+enum class Category { Auth, Repo, Files, Commit, Branch, Sync, Collab, Admin, Utility, Count };
+
+constexpr std::size_t kAnyArgs = SIZE_MAX;
+
+struct Spec {
+    Id id;
+    std::string_view name;
+    // Space-separated alternative names.
+    std::string_view aliases;
+    Category category;
+    // Bounds on the words after the command name.
+    std::size_t minArgs;
+    std::size_t maxArgs;
+    std::string_view usage;
+    // One "<syntax>\t<description>" entry per line for help/<category>.
+    std::string_view help;
+};
+
+// `name` must already be lowercase. Returns nullptr for unknown commands.
+const Spec *find(std::string_view name);
+const Spec &spec(Id id);
+
+std::string usageError(const Spec &spec);
+
+// The "Categories:" block of `help`.
+std::string categoryList();
+// Accepts a category key ("repo") or its number ("2").
+std::optional<std::string> categoryHelp(const std::string &category);
+
+// Orders {Id, handler} pairs into a table indexed by Id. Evaluated as a
+// constant, a missing or duplicated binding fails to compile.
+template <typename Handler, std::size_t N>
+constexpr std::array<Handler, kCommandCount> bindHandlers(const std::pair<Id, Handler> (&bindings)[N]) {
+    std::array<Handler, kCommandCount> table{};
+    for (std::size_t i = 0; i < N; ++i) {
+        auto &slot = table[static_cast<std::size_t>(bindings[i].first)];
+        if (slot != nullptr) {
+            throw "command bound twice";
+        }
+        slot = bindings[i].second;
+    }
+    for (std::size_t i = 0; i < kCommandCount; ++i) {
+        if (table[i] == nullptr) {
+            throw "command without a handler";
+        }
+    }
+    return table;
+}
+
+} // namespace commands
@@ -0,0 +1,455 @@
+#include "commit_graph.hpp"
+
+#include "hashing.hpp"
+#include "mapped_file.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <queue>
+#include <system_error>
+#include <unordered_set>
+
+namespace fs = std::filesystem;
+
+namespace {
+
+constexpr char kGraphMagic[4] = {'G', 'L', 'C', 'G'};
+constexpr std::uint32_t kGraphVersion = 1;
+constexpr std::size_t kHeaderSize = 12;
+constexpr std::size_t kRecordSize = hashing::kDigestBytes + 4 + 4 + 4 + 8;
+
+void putU32(std::string &out, std::uint32_t value) {
+    for (int i = 0; i < 4; ++i) {
+        out.push_back(static_cast<char>((value >> (8 * i)) & 0xff));
+    }
+}
+
+void putU64(std::string &out, std::uint64_t value) {
+    for (int i = 0; i < 8; ++i) {
+        out.push_back(static_cast<char>((value >> (8 * i)) & 0xff));
+    }
+}
+
+std::uint32_t getU32(const unsigned char *p) {
+    std::uint32_t value = 0;
+    for (int i = 3; i >= 0; --i) {
+        value = (value << 8) | p[i];
+    }
+    return value;
+}
+
+std::uint64_t getU64(const unsigned char *p) {
+    std::uint64_t value = 0;
+    for (int i = 7; i >= 0; --i) {
+        value = (value << 8) | p[i];
+    }
+    return value;
+}
+
+} // namespace
+
+CommitGraph::CommitGraph(const fs::path &repoRoot)
+    : path_(repoRoot / ".glite" / "commit-graph") {}
+
+void CommitGraph::reset() {
+    persisted_ = 0;
+    ids_.clear();
+    parents_.clear();
+    generations_.clear();
+    times_.clear();
+    byId_.clear();
+}
+
+bool CommitGraph::load() {
+    reset();
+    loaded_ = true;
+    MappedFile file;
+    std::error_code ec;
+    if (!fs::exists(path_, ec) || !file.open(path_)) {
+        return true;
+    }
+    const unsigned char *data = file.data();
+    if (file.size() < kHeaderSize || std::memcmp(data, kGraphMagic, 4) != 0 || getU32(data + 4) != kGraphVersion) {
+        // Unreadable cache: start over; the next append rewrites the file.
+        return false;
+    }
+    std::uint32_t count = getU32(data + 8);
+    if (file.size() < kHeaderSize + static_cast<std::size_t>(count) * kRecordSize) {
+        return false;
+    }
+    ids_.reserve(static_cast<std::size_t>(count) * hashing::kDigestBytes);
+    parents_.reserve(static_cast<std::size_t>(count) * 2);
+    generations_.reserve(count);
+    times_.reserve(count);
+    byId_.reserve(count);
+    for (std::uint32_t i = 0; i < count; ++i) {
+        const unsigned char *record = data + kHeaderSize + static_cast<std::size_t>(i) * kRecordSize;
+        const unsigned char *fields = record + hashing::kDigestBytes;
+        std::uint32_t p1 = getU32(fields);
+        std::uint32_t p2 = getU32(fields + 4);
+        if ((p1 != kNone && p1 >= i) || (p2 != kNone && p2 >= i)) {
+            reset();
+            return false;
+        }
+        ids_.append(reinterpret_cast<const char *>(record), hashing::kDigestBytes);
+        parents_.push_back(p1);
+        parents_.push_back(p2);
+        generations_.push_back(getU32(fields + 8));
+        times_.push_back(static_cast<std::int64_t>(getU64(fields + 12)));
+        byId_.emplace(std::string(reinterpret_cast<const char *>(record), hashing::kDigestBytes), i);
+    }
+    persisted_ = count;
+    return true;
+}
+
+bool CommitGraph::lookup(const std::string &id, std::uint32_t &position) const {
+    unsigned char raw[hashing::kDigestBytes];
+    if (!hashing::fromHex(id, raw, sizeof(raw))) {
+        return false;
+    }
+    auto it = byId_.find(std::string(reinterpret_cast<const char *>(raw), sizeof(raw)));
+    if (it == byId_.end()) {
+        return false;
+    }
+    position = it->second;
+    return true;
+}
+
+std::string CommitGraph::id(std::uint32_t position) const {
+    return hashing::toHex(reinterpret_cast<const unsigned char *>(ids_.data()) +
+                              static_cast<std::size_t>(position) * hashing::kDigestBytes,
+                          hashing::kDigestBytes);
+}
+
+std::string CommitGraph::digest(std::size_t count) const {
+    count = std::min(count, size());
+    return hashing::sha256Digest(reinterpret_cast<const unsigned char *>(ids_.data()), count * hashing::kDigestBytes).hex();
+}
+
+bool CommitGraph::rewrite(LockFile &lock, std::string &error) {
+    std::string out(kGraphMagic, sizeof(kGraphMagic));
+    putU32(out, kGraphVersion);
+    putU32(out, static_cast<std::uint32_t>(size()));
+    for (std::size_t i = 0; i < size(); ++i) {
+        out.append(ids_, i * hashing::kDigestBytes, hashing::kDigestBytes);
+        putU32(out, parents_[i * 2]);
+        putU32(out, parents_[i * 2 + 1]);
+        putU32(out, generations_[i]);
+        putU64(out, static_cast<std::uint64_t>(times_[i]));
+    }
+    if (!lock.write(out, error) || !lock.commit(error)) {
+        error = "Unable to write commit graph: " + error;
+        return false;
+    }
+    persisted_ = size();
+    return true;
+}
+
+bool CommitGraph::retain(const std::function<bool(const std::string &id)> &keep, std::string &error) {
+    if (!loaded_ && !load()) {
+        reset();
+    }
+    std::vector<std::uint32_t> remap(size(), kNone);
+    std::string ids;
+    std::vector<std::uint32_t> parents;
+    std::vector<std::uint32_t> generations;
+    std::vector<std::int64_t> times;
+    for (std::uint32_t i = 0; i < size(); ++i) {
+        if (!keep(id(i))) {
+            continue;
+        }
+        remap[i] = static_cast<std::uint32_t>(generations.size());
+        ids.append(ids_, static_cast<std::size_t>(i) * hashing::kDigestBytes, hashing::kDigestBytes);
+        for (int which = 0; which < 2; ++which) {
+            std::uint32_t p = parent(i, which);
+            parents.push_back(p == kNone ? kNone : remap[p]);
+        }
+        generations.push_back(generations_[i]);
+        times.push_back(times_[i]);
+    }
+    if (generations.size() == size()) {
+        return true;
+    }
+    ids_ = std::move(ids);
+    parents_ = std::move(parents);
+    generations_ = std::move(generations);
+    times_ = std::move(times);
+    byId_.clear();
+    for (std::uint32_t i = 0; i < size(); ++i) {
+        byId_.emplace(ids_.substr(static_cast<std::size_t>(i) * hashing::kDigestBytes, hashing::kDigestBytes), i);
+    }
+    LockFile lock(path_);
+    std::string busy;
+    if (!lock.acquire(busy)) {
+        // Stale entries only cost some memory until the next gc.
+        return true;
+    }
+    return rewrite(lock, error);
+}
+
+bool CommitGraph::append(const std::string &id, const Parents &parents, std::string &error) {
+    if (!loaded_ && !load()) {
+        reset();
+    }
+    std::uint32_t existing = 0;
+    if (lookup(id, existing)) {
+        return true;
+    }
+    unsigned char raw[hashing::kDigestBytes];
+    if (!hashing::fromHex(id, raw, sizeof(raw))) {
+        error = "Invalid commit id " + id + ".";
+        return false;
+    }
+    std::uint32_t slots[2] = {kNone, kNone};
+    std::uint32_t generation = 1;
+    int used = 0;
+    for (const auto &parentId : parents.ids) {
+        std::uint32_t position = 0;
+        if (used < 2 && lookup(parentId, position)) {
+            slots[used++] = position;
+            generation = std::max(generation, generations_[position] + 1);
+        }
+    }
+
+    std::uint32_t position = static_cast<std::uint32_t>(size());
+    ids_.append(reinterpret_cast<const char *>(raw), sizeof(raw));
+    parents_.push_back(slots[0]);
+    parents_.push_back(slots[1]);
+    generations_.push_back(generation);
+    times_.push_back(parents.time);
+    byId_.emplace(std::string(reinterpret_cast<const char *>(raw), sizeof(raw)), position);
+
+    LockFile lock(path_);
+    std::string busy;
+    if (!lock.acquire(busy)) {
+        return true;
+    }
+    // The in-place append is only valid when the file holds exactly the
+    // records this instance knows about (another writer may have grown it).
+    std::uint32_t onDisk = kNone;
+    {
+        std::ifstream in(path_, std::ios::binary);
+        unsigned char header[kHeaderSize];
+        if (in.read(reinterpret_cast<char *>(header), sizeof(header)) &&
+            std::memcmp(header, kGraphMagic, 4) == 0 && getU32(header + 4) == kGraphVersion) {
+            onDisk = getU32(header + 8);
+        }
+    }
+    if (onDisk != persisted_ || persisted_ + 1 != size()) {
+        return rewrite(lock, error);
+    }
+    // Append the record, then publish it by bumping the count. A crash in
+    // between leaves trailing bytes that the count does not cover.
+    std::string record(reinterpret_cast<const char *>(raw), sizeof(raw));
+    putU32(record, slots[0]);
+    putU32(record, slots[1]);
+    putU32(record, generation);
+    putU64(record, static_cast<std::uint64_t>(parents.time));
+    std::string count;
+    putU32(count, position + 1);
+    std::fstream file(path_, std::ios::binary | std::ios::in | std::ios::out);
+    if (!file) {
+        return rewrite(lock, error);
+    }
+    file.seekp(static_cast<std::streamoff>(kHeaderSize + static_cast<std::size_t>(position) * kRecordSize));
+    file.write(record.data(), static_cast<std::streamsize>(record.size()));
+    file.flush();
+    file.seekp(8);
+    file.write(count.data(), static_cast<std::streamsize>(count.size()));
+    file.flush();
+    if (!file) {
+        error = "Unable to update commit graph.";
+        return false;
+    }
+    persisted_ = size();
+    return true;
+}
+
+bool CommitGraph::ensure(const std::string &tip,
+                         const ParentReader &reader,
+                         std::uint32_t &position,
+                         std::string &error) {
+    if (!loaded_ && !load()) {
+        // A damaged file is rebuilt from the commit objects; the next
+        // append rewrites it because its count no longer matches.
+        reset();
+    }
+    if (lookup(tip, position)) {
+        return true;
+    }
+    // Depth-first over missing commits; a commit is appended once all of its
+    // parents are present.
+    struct Pending {
+        std::string id;
+        Parents parents;
+        bool expanded = false;
+    };
+    std::vector<Pending> stack;
+    std::unordered_set<std::string> missing;
+    stack.push_back({tip, {}, false});
+    while (!stack.empty()) {
+        Pending &top = stack.back();
+        std::uint32_t found = 0;
+        if (lookup(top.id, found)) {
+            stack.pop_back();
+            continue;
+        }
+        if (!top.expanded) {
+            top.expanded = true;
+            if (!reader(top.id, top.parents)) {
+                missing.insert(top.id);
+                stack.pop_back();
+                continue;
+            }
+            std::vector<std::string> parentIds = top.parents.ids;
+            for (const auto &parentId : parentIds) {
+                if (!lookup(parentId, found) && !missing.count(parentId)) {
+                    stack.push_back({parentId, {}, false});
+                }
+            }
+            continue;
+        }
+        Pending done = std::move(stack.back());
+        stack.pop_back();
+        if (!append(done.id, done.parents, error)) {
+            return false;
+        }
+    }
+    if (!lookup(tip, position)) {
+        error = "Commit " + tip + " not found.";
+        return false;
+    }
+    return true;
+}
+
+bool CommitGraph::isAncestor(std::uint32_t ancestor, std::uint32_t descendant) const {
+    std::uint32_t floor = generations_[ancestor];
+    std::vector<std::uint32_t> pending = {descendant};
+    std::vector<bool> seen(size(), false);
+    while (!pending.empty()) {
+        std::uint32_t current = pending.back();
+        pending.pop_back();
+        if (current == ancestor) {
+            return true;
+        }
+        if (seen[current] || generations_[current] <= floor) {
+            continue;
+        }
+        seen[current] = true;
+        for (int k = 0; k < 2; ++k) {
+            std::uint32_t p = parent(current, k);
+            if (p != kNone && !seen[p]) {
+                pending.push_back(p);
+            }
+        }
+    }
+    return false;
+}
+
+void CommitGraph::aheadBehind(std::uint32_t a, std::uint32_t b, std::size_t &ahead, std::size_t &behind) const {
+    ahead = 0;
+    behind = 0;
+    if (a == b) {
+        return;
+    }
+    // Bit 1: reachable from a, bit 2: from b. `open` counts marked positions
+    // not yet visited that only one side reaches.
+    std::vector<std::uint8_t> marks(size(), 0);
+    marks[a] |= 1;
+    marks[b] |= 2;
+    std::size_t open = 2;
+    for (std::uint32_t current = std::max(a, b) + 1; current-- > 0 && open > 0;) {
+        std::uint8_t mark = marks[current];
+        if (mark == 0) {
+            continue;
+        }
+        if (mark != 3) {
+            --open;
+            (mark == 1 ? ahead : behind) += 1;
+        }
+        for (int k = 0; k < 2; ++k) {
+            std::uint32_t p = parent(current, k);
+            if (p == kNone || (marks[p] | mark) == marks[p]) {
+                continue;
+            }
+            std::uint8_t before = marks[p];
+            marks[p] |= mark;
+            if (before == 0 && marks[p] != 3) {
+                ++open;
+            } else if (before != 0 && marks[p] == 3) {
+                --open;
+            }
+        }
+    }
+}
+
+bool CommitGraph::mergeBase(std::uint32_t a, std::uint32_t b, std::uint32_t &base) const {
+    std::vector<bool> fromA(size(), false);
+    std::vector<std::uint32_t> pending = {a};
+    while (!pending.empty()) {
+        std::uint32_t current = pending.back();
+        pending.pop_back();
+        if (fromA[current]) {
+            continue;
+        }
+        fromA[current] = true;
+        for (int k = 0; k < 2; ++k) {
+            std::uint32_t p = parent(current, k);
+            if (p != kNone && !fromA[p]) {
+                pending.push_back(p);
+            }
+        }
+    }
+    // Highest generation first, so the first hit is a best common ancestor.
+    auto lower = [this](std::uint32_t x, std::uint32_t y) { return generations_[x] < generations_[y]; };
+    std::priority_queue<std::uint32_t, std::vector<std::uint32_t>, decltype(lower)> queue(lower);
+    std::vector<bool> seen(size(), false);
+    queue.push(b);
+    while (!queue.empty()) {
+        std::uint32_t current = queue.top();
+        queue.pop();
+        if (seen[current]) {
+            continue;
+        }
+        seen[current] = true;
+        if (fromA[current]) {
+            base = current;
+            return true;
+        }
+        for (int k = 0; k < 2; ++k) {
+            std::uint32_t p = parent(current, k);
+            if (p != kNone && !seen[p]) {
+                queue.push(p);
+            }
+        }
+    }
+    return false;
+}
+
+void CommitGraph::walk(std::uint32_t tip, const std::function<bool(std::uint32_t position)> &visitor) const {
+    auto older = [this](std::uint32_t x, std::uint32_t y) {
+        if (times_[x] != times_[y]) {
+            return times_[x] < times_[y];
+        }
+        return generations_[x] < generations_[y];
+    };
+    std::priority_queue<std::uint32_t, std::vector<std::uint32_t>, decltype(older)> queue(older);
+    std::vector<bool> queued(size(), false);
+    queue.push(tip);
+    queued[tip] = true;
+    while (!queue.empty()) {
+        std::uint32_t current = queue.top();
+        queue.pop();
+        if (!visitor(current)) {
+            return;
+        }
+        for (int k = 0; k < 2; ++k) {
+            std::uint32_t p = parent(current, k);
+            if (p != kNone && !queued[p]) {
+                queued[p] = true;
+                queue.push(p);
+            }
+        }
+    }
+}
@@ -0,0 +1,90 @@
+#pragma once
+
+#include "lock_file.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <functional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Compact ancestry cache in .glite/commit-graph so history walks and
+// ancestry queries never open commit objects.
+//
+// Layout (little-endian):
+//   "GLCG" | u32 version | u32 count
+//   count x { 32-byte raw id | u32 parent1 | u32 parent2 | u32 generation | i64 time }
+// Parents are positions in the same file (kNone when absent) and always come
+// before their children, so new commits are appended and only the count in
+// the header is rewritten. generation is 1 for a root commit and
+// 1 + max(parent generations) otherwise.
+//
+// Writers hold commit-graph.lock. Since the file is only a cache, a writer
+// that finds the lock taken keeps its additions in memory and lets a later
+// append write them out.
+class CommitGraph {
+public:
+    static constexpr std::uint32_t kNone = 0xffffffffu;
+
+    struct Parents {
+        std::vector<std::string> ids;
+        std::int64_t time = 0;
+    };
+    // Reads the parents and commit time of a commit that is not in the graph
+    // yet. Returns false when the commit object is missing.
+    using ParentReader = std::function<bool(const std::string &id, Parents &parents)>;
+
+    explicit CommitGraph(const std::filesystem::path &repoRoot);
+
+    bool load();
+
+    std::size_t size() const { return generations_.size(); }
+    bool lookup(const std::string &id, std::uint32_t &position) const;
+    std::string id(std::uint32_t position) const;
+    std::uint32_t parent(std::uint32_t position, int which) const { return parents_[position * 2 + which]; }
+    std::uint32_t generation(std::uint32_t position) const { return generations_[position]; }
+    std::int64_t time(std::uint32_t position) const { return times_[position]; }
+    // SHA-256 of the first `count` raw ids. Files indexed by position (see
+    // reach_bitmaps.hpp) record it to detect a renumbered graph.
+    std::string digest(std::size_t count) const;
+
+    bool append(const std::string &id, const Parents &parents, std::string &error);
+    // Drops the commits for which `keep` is false and rewrites the file
+    // (gc). Every kept commit's parents must be kept too.
+    bool retain(const std::function<bool(const std::string &id)> &keep, std::string &error);
+
+    // Adds `tip` and any of its ancestors that are missing, oldest first.
+    // Heads written by other tools (push, fetch) are picked up this way.
+    bool ensure(const std::string &tip, const ParentReader &reader, std::uint32_t &position, std::string &error);
+
+    bool isAncestor(std::uint32_t ancestor, std::uint32_t descendant) const;
+
+    // Best common ancestor: the common ancestor with the highest generation,
+    // which cannot itself be an ancestor of another common ancestor.
+    bool mergeBase(std::uint32_t a, std::uint32_t b, std::uint32_t &base) const;
+
+    // Commits reachable from `a` but not `b` (ahead) and the reverse
+    // (behind). Parents sit before children, so one descending pass over
+    // positions settles both counts; it stops once the two sides meet.
+    void aheadBehind(std::uint32_t a, std::uint32_t b, std::size_t &ahead, std::size_t &behind) const;
+
+    // Visits commits reachable from `tip` newest first (by commit time, then
+    // generation). Returning false from the visitor stops the walk.
+    void walk(std::uint32_t tip, const std::function<bool(std::uint32_t position)> &visitor) const;
+
+private:
+    std::filesystem::path path_;
+    std::string ids_;
+    std::vector<std::uint32_t> parents_;
+    std::vector<std::uint32_t> generations_;
+    std::vector<std::int64_t> times_;
+    std::unordered_map<std::string, std::uint32_t> byId_;
+    bool loaded_ = false;
+    // Records known to be in the file; the rest are only in memory.
+    std::size_t persisted_ = 0;
+
+    void reset();
+    bool rewrite(LockFile &lock, std::string &error);
+};
@@ -0,0 +1,243 @@
+#include "compression.hpp"
+
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <vector>
+
+#include <zlib.h>
+
+namespace {
+
+constexpr std::size_t kChunk = 64 * 1024;
+constexpr std::size_t kDeltaBlock = 16;
+constexpr unsigned char kOpInsert = 0x00;
+constexpr unsigned char kOpCopy = 0x01;
+
+void putVarint(std::string &out, std::uint64_t value) {
+    while (value >= 0x80) {
+        out.push_back(static_cast<char>((value & 0x7f) | 0x80));
+        value >>= 7;
+    }
+    out.push_back(static_cast<char>(value));
+}
+
+bool getVarint(const std::string &in, std::size_t &pos, std::uint64_t &value) {
+    value = 0;
+    int shift = 0;
+    while (pos < in.size() && shift < 64) {
+        auto byte = static_cast<unsigned char>(in[pos++]);
+        value |= static_cast<std::uint64_t>(byte & 0x7f) << shift;
+        if ((byte & 0x80) == 0) {
+            return true;
+        }
+        shift += 7;
+    }
+    return false;
+}
+
+std::uint64_t blockHash(const char *p) {
+    std::uint64_t a = 0;
+    std::uint64_t b = 0;
+    std::memcpy(&a, p, 8);
+    std::memcpy(&b, p + 8, 8);
+    std::uint64_t h = a * 0x9E3779B97F4A7C15ULL ^ (b + 0x632BE59BD9B4E019ULL) * 0xC2B2AE3D27D4EB4FULL;
+    return h ^ (h >> 29);
+}
+
+void emitInsert(std::string &out, const std::string &target, std::size_t from, std::size_t to) {
+    if (to <= from) {
+        return;
+    }
+    out.push_back(static_cast<char>(kOpInsert));
+    putVarint(out, to - from);
+    out.append(target, from, to - from);
+}
+
+} // namespace
+
+namespace compression {
+
+bool deflateBytes(const unsigned char *data, std::size_t length, std::string &out, int level) {
+    out.clear();
+    uLongf bound = compressBound(static_cast<uLong>(length));
+    out.resize(bound);
+    int rc = compress2(reinterpret_cast<Bytef *>(&out[0]), &bound, data, static_cast<uLong>(length), level);
+    if (rc != Z_OK) {
+        out.clear();
+        return false;
+    }
+    out.resize(bound);
+    return true;
+}
+
+bool inflateBytes(const unsigned char *data, std::size_t length, std::string &out) {
+    out.clear();
+    z_stream zs {};
+    if (inflateInit(&zs) != Z_OK) {
+        return false;
+    }
+    zs.next_in = const_cast<Bytef *>(data);
+    zs.avail_in = static_cast<uInt>(length);
+    std::vector<unsigned char> buffer(kChunk);
+    int rc = Z_OK;
+    while (rc != Z_STREAM_END) {
+        zs.next_out = buffer.data();
+        zs.avail_out = static_cast<uInt>(buffer.size());
+        rc = inflate(&zs, Z_NO_FLUSH);
+        if (rc != Z_OK && rc != Z_STREAM_END) {
+            inflateEnd(&zs);
+            out.clear();
+            return false;
+        }
+        out.append(reinterpret_cast<const char *>(buffer.data()), buffer.size() - zs.avail_out);
+        if (rc == Z_OK && zs.avail_in == 0 && zs.avail_out != 0) {
+            // Truncated stream: no more input and zlib is not done.
+            inflateEnd(&zs);
+            out.clear();
+            return false;
+        }
+    }
+    inflateEnd(&zs);
+    return true;
+}
+
+struct DeflateStream::State {
+    z_stream zs {};
+};
+
+DeflateStream::DeflateStream(int level)
+    : state_(std::make_unique<State>()) {
+    if (deflateInit(&state_->zs, level) != Z_OK) {
+        throw std::runtime_error("Failed to initialize zlib.");
+    }
+}
+
+DeflateStream::~DeflateStream() {
+    deflateEnd(&state_->zs);
+}
+
+bool DeflateStream::update(const unsigned char *data, std::size_t length, std::string &out) {
+    z_stream &zs = state_->zs;
+    zs.next_in = const_cast<Bytef *>(data);
+    zs.avail_in = static_cast<uInt>(length);
+    unsigned char buffer[kChunk];
+    while (zs.avail_in > 0) {
+        zs.next_out = buffer;
+        zs.avail_out = sizeof(buffer);
+        if (deflate(&zs, Z_NO_FLUSH) == Z_STREAM_ERROR) {
+            return false;
+        }
+        out.append(reinterpret_cast<const char *>(buffer), sizeof(buffer) - zs.avail_out);
+    }
+    return true;
+}
+
+bool DeflateStream::finish(std::string &out) {
+    z_stream &zs = state_->zs;
+    zs.next_in = nullptr;
+    zs.avail_in = 0;
+    unsigned char buffer[kChunk];
+    int rc = Z_OK;
+    while (rc != Z_STREAM_END) {
+        zs.next_out = buffer;
+        zs.avail_out = sizeof(buffer);
+        rc = deflate(&zs, Z_FINISH);
+        if (rc == Z_STREAM_ERROR) {
+            return false;
+        }
+        out.append(reinterpret_cast<const char *>(buffer), sizeof(buffer) - zs.avail_out);
+    }
+    return true;
+}
+
+std::string makeDelta(const std::string &base, const std::string &target) {
+    std::string delta;
+    putVarint(delta, base.size());
+    putVarint(delta, target.size());
+
+    if (base.size() < kDeltaBlock || target.size() < kDeltaBlock) {
+        emitInsert(delta, target, 0, target.size());
+        return delta;
+    }
+
+    std::size_t slots = 1;
+    while (slots < (base.size() / kDeltaBlock) * 2) {
+        slots <<= 1;
+    }
+    std::vector<std::uint32_t> table(slots, 0);
+    const std::uint64_t mask = slots - 1;
+    for (std::size_t offset = 0; offset + kDeltaBlock <= base.size(); offset += kDeltaBlock) {
+        auto &slot = table[blockHash(base.data() + offset) & mask];
+        if (slot == 0) {
+            slot = static_cast<std::uint32_t>(offset + 1);
+        }
+    }
+
+    std::size_t literalStart = 0;
+    std::size_t i = 0;
+    while (i + kDeltaBlock <= target.size()) {
+        std::uint32_t slot = table[blockHash(target.data() + i) & mask];
+        if (slot == 0 || std::memcmp(base.data() + (slot - 1), target.data() + i, kDeltaBlock) != 0) {
+            ++i;
+            continue;
+        }
+        std::size_t baseOffset = slot - 1;
+        std::size_t start = i;
+        while (start > literalStart && baseOffset > 0 && base[baseOffset - 1] == target[start - 1]) {
+            --start;
+            --baseOffset;
+        }
+        std::size_t length = (i - start) + kDeltaBlock;
+        while (baseOffset + length < base.size() && start + length < target.size() &&
+               base[baseOffset + length] == target[start + length]) {
+            ++length;
+        }
+        emitInsert(delta, target, literalStart, start);
+        delta.push_back(static_cast<char>(kOpCopy));
+        putVarint(delta, baseOffset);
+        putVarint(delta, length);
+        i = start + length;
+        literalStart = i;
+    }
+    emitInsert(delta, target, literalStart, target.size());
+    return delta;
+}
+
+bool applyDelta(const std::string &base, const std::string &delta, std::string &out) {
+    out.clear();
+    std::size_t pos = 0;
+    std::uint64_t baseSize = 0;
+    std::uint64_t resultSize = 0;
+    if (!getVarint(delta, pos, baseSize) || !getVarint(delta, pos, resultSize) || baseSize != base.size()) {
+        return false;
+    }
+    out.reserve(static_cast<std::size_t>(resultSize));
+    while (pos < delta.size()) {
+        auto op = static_cast<unsigned char>(delta[pos++]);
+        if (op == kOpInsert) {
+            std::uint64_t length = 0;
+            if (!getVarint(delta, pos, length) || length > delta.size() - pos) {
+                return false;
+            }
+            out.append(delta, pos, static_cast<std::size_t>(length));
+            pos += static_cast<std::size_t>(length);
+        } else if (op == kOpCopy) {
+            std::uint64_t offset = 0;
+            std::uint64_t length = 0;
+            if (!getVarint(delta, pos, offset) || !getVarint(delta, pos, length) ||
+                offset > base.size() || length > base.size() - offset) {
+                return false;
+            }
+            out.append(base, static_cast<std::size_t>(offset), static_cast<std::size_t>(length));
+        } else {
+            return false;
+        }
+        if (out.size() > resultSize) {
+            return false;
+        }
+    }
+    return out.size() == resultSize;
+}
+
+} // namespace compression
@@ -0,0 +1,40 @@
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <string>
+
+namespace compression {
+
+constexpr int kDefaultLevel = 6;
+
+// zlib (deflate) encoding. Both return false on corrupt input or zlib errors.
+bool deflateBytes(const unsigned char *data, std::size_t length, std::string &out, int level = kDefaultLevel);
+bool inflateBytes(const unsigned char *data, std::size_t length, std::string &out);
+
+// Incremental deflate for callers that stream data (e.g. staging large files).
+class DeflateStream {
+public:
+    explicit DeflateStream(int level = kDefaultLevel);
+    ~DeflateStream();
+
+    DeflateStream(const DeflateStream &) = delete;
+    DeflateStream &operator=(const DeflateStream &) = delete;
+
+    // Appends compressed output for `data` to `out`.
+    bool update(const unsigned char *data, std::size_t length, std::string &out);
+    bool finish(std::string &out);
+
+private:
+    struct State;
+    std::unique_ptr<State> state_;
+};
+
+// Copy/insert delta against a base buffer. The encoding is
+//   varint baseSize | varint resultSize | ops...
+//   op 0x00: varint length, literal bytes
+//   op 0x01: varint offset, varint length (copy from base)
+std::string makeDelta(const std::string &base, const std::string &target);
+bool applyDelta(const std::string &base, const std::string &delta, std::string &out);
+
+} // namespace compression
@@ -1,12 +1,18 @@
 #include "gitlite_app.hpp"
 
+#include "command_registry.hpp"
 #include "hashing.hpp"
+#include "ignore_rules.hpp"
 #include "utils.hpp"
 
 #include <algorithm>
+#include <cstdio>
+#include <cstdlib>
 #include <filesystem>
 #include <fstream>
+#include <iostream>
 #include <ncurses.h>
+#include <set>
 #include <sstream>
 #include <system_error>
 #include <string>
@@ -21,16 +27,190 @@ using gitlite::util::trim;
 
 namespace fs = std::filesystem;
 
-GitLiteApp::GitLiteApp()
-    : storage_(),
+namespace {
+
+// Streams output into the terminal pane through a pager, so a long diff is
+// shown a screenful at a time and generated only as fast as it is read.
+class TerminalStream {
+public:
+    explicit TerminalStream(TerminalUI &ui) : pager_(ui) {}
+
+    textdiff::LineSink sink() {
+        return [this](const std::string &line) {
+            pager_.add(line);
+            ++count_;
+        };
+    }
+
+    void flush() { pager_.flush(); }
+
+    std::size_t count() const { return count_; }
+
+private:
+    TerminalUI::Pager pager_;
+    std::size_t count_ = 0;
+};
+
+std::string describeSync(const std::string &verb, const SyncResult &result) {
+    std::ostringstream out;
+    if (result.updatedRefs.empty() && result.rejectedRefs.empty()) {
+        out << "Already up to date.";
+        return out.str();
+    }
+    out << verb << " " << result.objectsTransferred << " object(s)";
+    if (!result.updatedRefs.empty()) {
+        out << "; updated";
+        for (const auto &ref : result.updatedRefs) {
+            out << " " << ref;
+        }
+    }
+    if (result.filesWritten > 0) {
+        out << "; " << result.filesWritten << " file(s) written";
+    }
+    if (!result.rejectedRefs.empty()) {
+        out << "; rejected";
+        for (const auto &ref : result.rejectedRefs) {
+            out << " " << ref;
+        }
+    }
+    out << ".";
+    return out.str();
+}
+
+std::vector<std::string> describeStatus(const std::string &branch, const WorkspaceStatus &state) {
+    auto label = [](char kind) {
+        switch (kind) {
+        case 'A':
+            return "new file:  ";
+        case 'D':
+            return "deleted:   ";
+        default:
+            return "modified:  ";
+        }
+    };
+    std::vector<std::string> lines = {"On branch " + branch};
+    if (!state.staged.empty()) {
+        lines.push_back("Changes to be committed:");
+        for (const auto &change : state.staged) {
+            lines.push_back(std::string("  ") + label(change.first) + change.second);
+        }
+    }
+    if (!state.unstaged.empty()) {
+        lines.push_back("Changes not staged for commit:");
+        for (const auto &change : state.unstaged) {
+            lines.push_back(std::string("  ") + label(change.first) + change.second);
+        }
+    }
+    if (!state.untracked.empty()) {
+        lines.push_back("Untracked files:");
+        for (const auto &path : state.untracked) {
+            lines.push_back("  " + path);
+        }
+    }
+    if (state.staged.empty() && state.unstaged.empty() && state.untracked.empty()) {
+        lines.push_back("Nothing to commit, workspace clean.");
+    }
+    return lines;
+}
+
+} // namespace
+
+GitLiteApp::GitLiteApp(bool headless)
+    : ownedStorage_(std::make_unique<StorageManager>()),
+      storage_(*ownedStorage_),
+      repoService_(storage_),
+      ui_(headless),
+      currentDir_(fs::current_path()) {}
+
+GitLiteApp::GitLiteApp(StorageManager &storage, bool headless)
+    : storage_(storage),
       repoService_(storage_),
+      ui_(headless),
       currentDir_(fs::current_path()) {}
 
+void GitLiteApp::confineToStorage() {
+    confined_ = true;
+    currentDir_ = storage_.root();
+}
+
+GitLiteApp::~GitLiteApp() {
+    std::string error;
+    if (!finishTrace(error)) {
+        std::cerr << error << std::endl;
+    }
+}
+
 void GitLiteApp::run() {
     hashing::ensureSodium();
     showLanding();
 }
 
+int GitLiteApp::runBatch(const BatchOptions &options) {
+    hashing::ensureSodium();
+    std::string error;
+    if (!login(options.username, options.password, error)) {
+        std::cerr << "Login failed: " << error << std::endl;
+        return 2;
+    }
+    if (const char *tracePath = std::getenv("GLITE_TRACE")) {
+        if (!startTrace(tracePath, error)) {
+            std::cerr << error << std::endl;
+        }
+    }
+
+    int status = 0;
+    for (const auto &line : options.commands) {
+        std::string command = trim(line);
+        if (command.empty() || command[0] == '#') {
+            continue;
+        }
+        std::vector<std::string> output;
+        bool ok = runCommand(command, output);
+        if (options.json) {
+            std::string record = "{\"command\":" + gitlite::util::jsonQuote(command) +
+                                 ",\"ok\":" + (ok ? "true" : "false") + ",\"output\":[";
+            for (std::size_t i = 0; i < output.size(); ++i) {
+                record += (i ? "," : "") + gitlite::util::jsonQuote(output[i]);
+            }
+            std::cout << record << "]}\n";
+        } else {
+            std::ostream &out = ok ? std::cout : std::cerr;
+            for (const auto &text : output) {
+                out << text << '\n';
+            }
+        }
+        if (!ok) {
+            status = 1;
+            if (!options.keepGoing) {
+                break;
+            }
+        }
+        if (!session_) {
+            break;
+        }
+    }
+    std::cout.flush();
+    session_.reset();
+    if (!finishTrace(error)) {
+        std::cerr << error << std::endl;
+    }
+    return status;
+}
+
+bool GitLiteApp::login(const std::string &username, const std::string &password, std::string &error) {
+    return authenticate(username, password, error);
+}
+
+bool GitLiteApp::runCommand(const std::string &command, std::vector<std::string> &output) {
+    if (!executeCommand(command)) {
+        session_.reset();
+    }
+    output = ui_.takeOutput();
+    return std::none_of(output.begin(), output.end(), [](const std::string &text) {
+        return text.rfind("Error", 0) == 0 || text.rfind("Unknown command", 0) == 0;
+    });
+}
+
 void GitLiteApp::showLanding() {
     while (true) {
         clear();
@@ -94,22 +274,30 @@ void GitLiteApp::handleLogin() {
         return;
     }
     auto password = ui_.prompt("Password:", true, 64);
-    auto users = storage_.loadUsers();
-    auto it = std::find_if(users.begin(), users.end(), [&](const User &u) { return u.username == username; });
-    if (it == users.end()) {
-        ui_.message("Login Failed", {"Unknown username."}, 3);
-        return;
-    }
-    if (!hashing::verifyPassword(it->passwordHash, password)) {
-        ui_.message("Login Failed", {"Incorrect password."}, 3);
+    std::string error;
+    if (!authenticate(username, password, error)) {
+        ui_.message("Login Failed", {error}, 3);
         return;
     }
-    session_ = *it;
     ui_.message("Welcome", {"Login successful.", "Hello " + session_->username + "!"});
     terminalMode();
     session_.reset();
 }
 
+bool GitLiteApp::authenticate(const std::string &username, const std::string &password, std::string &error) {
+    auto user = storage_.findUser(username);
+    if (!user) {
+        error = "Unknown username.";
+        return false;
+    }
+    if (!hashing::verifyPassword(user->passwordHash, password)) {
+        error = "Incorrect password.";
+        return false;
+    }
+    session_ = std::move(user);
+    return true;
+}
+
 void GitLiteApp::terminalMode() {
     // Initialize split-screen
     ui_.initSplitScreen();
@@ -119,6 +307,13 @@ void GitLiteApp::terminalMode() {
     
     // Update sidebar with public repos
     updateSidebar();
+    ui_.setIdleHandler([this] { return onIdle(); });
+    std::string traceError;
+    if (const char *tracePath = std::getenv("GLITE_TRACE")) {
+        if (!startTrace(tracePath, traceError)) {
+            ui_.addTerminalLine("Error: " + traceError);
+        }
+    }
     
     while (session_) {
         // Get command with current directory in prompt
@@ -129,451 +324,650 @@ void GitLiteApp::terminalMode() {
         if (command.empty()) {
             continue;
         }
-        
-        // Parse and execute command
-        std::vector<std::string> args = split(command, ' ');
-        std::string cmd = args.empty() ? "" : args[0];
-        std::transform(cmd.begin(), cmd.end(), cmd.begin(), ::tolower);
-        
-        std::string result;
-        
-        if (cmd == "menu") {
-            ui_.addTerminalLine("Opening dashboard...");
-            dashboard();
-            updateSidebar();
-        } else if (cmd == "help") {
-            if (args.size() >= 2) {
-                // help/<category> format
-                std::string category = args[1];
-                result = getHelpForCategory(category);
-                addMultiLineToTerminal(result);
-            } else if (command.find('/') != std::string::npos) {
-                // help/repo format (single word with slash)
-                size_t pos = command.find('/');
-                std::string category = command.substr(pos + 1);
-                result = getHelpForCategory(category);
-                addMultiLineToTerminal(result);
-            } else {
-                // Just "help" - show categories
-                result = getHelpCategories();
-                addMultiLineToTerminal(result);
-            }
-        } else if (cmd == "logout" || cmd == "exit" || cmd == "quit") {
-            ui_.addTerminalLine("Logging out...");
+        if (!executeCommand(command)) {
             break;
-        } else if (cmd == "whoami") {
-            result = "User: " + session_->username + " (Role: " + session_->role + ")";
-            ui_.addTerminalLine(result);
-        } else if (cmd == "clear") {
-            ui_.clearTerminal();
-            ui_.addTerminalLine("Terminal cleared.");
-        } else if (cmd == "init") {
-            result = handleInitCommand();
-            ui_.addTerminalLine(result);
-        } else if (cmd == "create") {
-            if (args.size() < 2) {
-                ui_.addTerminalLine("Error: Usage: create <repo-name>");
-            } else {
-                result = handleCreateCommand(args[1]);
-                ui_.addTerminalLine(result);
-            }
-        } else if (cmd == "list") {
-            result = handleListCommand();
-            addMultiLineToTerminal(result);
-        } else if (cmd == "ls-users") {
-            result = handleLsUsersCommand();
-            addMultiLineToTerminal(result);
-        } else if (cmd == "ls-repos") {
-            std::string username = args.size() >= 2 ? args[1] : session_->username;
-            result = handleLsReposCommand(username);
-            addMultiLineToTerminal(result);
-        } else if (cmd == "status") {
-            std::optional<std::string> repoOverride;
-            if (args.size() >= 2) {
-                repoOverride = args[1];
+        }
+        updateSidebar();
+    }
+    ui_.setIdleHandler(nullptr);
+    if (!finishTrace(traceError)) {
+        ui_.message("Trace", {traceError});
+    }
+}
+
+bool GitLiteApp::executeCommand(const std::string &command) {
+    if (!stats::enabled()) {
+        return dispatchCommand(command);
+    }
+    stats::TraceBinding binding(trace_.get());
+    std::int64_t start = stats::nowNs();
+    bool keepSession = dispatchCommand(command);
+    std::int64_t elapsed = stats::nowNs() - start;
+    if (trace_) {
+        trace_->add(command, start, elapsed);
+    }
+    recentCommands_.emplace_back(command, elapsed / 1e6);
+    if (recentCommands_.size() > 10) {
+        recentCommands_.pop_front();
+    }
+    return keepSession;
+}
+
+namespace {
+
+std::optional<std::string> argAt(const std::vector<std::string> &args, std::size_t index) {
+    return index < args.size() ? std::optional<std::string>(args[index]) : std::nullopt;
+}
+
+} // namespace
+
+// One static function per command. args[0] is the command word as typed;
+// the argument count has already been checked against the command's Spec.
+struct GitLiteApp::CommandHandlers {
+    using Args = std::vector<std::string>;
+    using Handler = bool (*)(GitLiteApp &, const commands::Spec &, const Args &);
+
+    static Handler handler(commands::Id id);
+
+    static bool menu(GitLiteApp &app, const commands::Spec &, const Args &) {
+        if (app.ui_.headless()) {
+            app.ui_.addTerminalLine("Error: 'menu' is not available in batch mode.");
+            return true;
+        }
+        app.ui_.addTerminalLine("Opening dashboard...");
+        app.dashboard();
+        app.updateSidebar();
+        return true;
+    }
+
+    static bool help(GitLiteApp &app, const commands::Spec &, const Args &args) {
+        app.addMultiLineToTerminal(args.size() >= 2 ? app.getHelpForCategory(args[1]) : app.getHelpCategories());
+        return true;
+    }
+
+    static bool logout(GitLiteApp &app, const commands::Spec &, const Args &) {
+        app.ui_.addTerminalLine("Logging out...");
+        return false;
+    }
+
+    static bool whoami(GitLiteApp &app, const commands::Spec &, const Args &) {
+        app.ui_.addTerminalLine("User: " + app.session_->username + " (Role: " + app.session_->role + ")");
+        return true;
+    }
+
+    static bool clear(GitLiteApp &app, const commands::Spec &, const Args &) {
+        app.ui_.clearTerminal();
+        app.ui_.addTerminalLine("Terminal cleared.");
+        return true;
+    }
+
+    static bool init(GitLiteApp &app, const commands::Spec &, const Args &) {
+        app.ui_.addTerminalLine(app.handleInitCommand());
+        return true;
+    }
+
+    static bool create(GitLiteApp &app, const commands::Spec &, const Args &args) {
+        app.ui_.addTerminalLine(app.handleCreateCommand(args[1]));
+        return true;
+    }
+
+    static bool list(GitLiteApp &app, const commands::Spec &, const Args &) {
+        app.addMultiLineToTerminal(app.handleListCommand());
+        return true;
+    }
+
+    static bool lsUsers(GitLiteApp &app, const commands::Spec &, const Args &) {
+        app.addMultiLineToTerminal(app.handleLsUsersCommand());
+        return true;
+    }
+
+    static bool lsRepos(GitLiteApp &app, const commands::Spec &, const Args &args) {
+        app.addMultiLineToTerminal(app.handleLsReposCommand(args.size() >= 2 ? args[1] : app.session_->username));
+        return true;
+    }
+
+    static bool status(GitLiteApp &app, const commands::Spec &, const Args &args) {
+        app.addMultiLineToTerminal(app.handleStatusCommand(argAt(args, 1)));
+        return true;
+    }
+
+    static bool add(GitLiteApp &app, const commands::Spec &, const Args &args) {
+        app.ui_.addTerminalLine(app.handleAddCommand(args[1], argAt(args, 2)));
+        return true;
+    }
+
+    static bool commit(GitLiteApp &app, const commands::Spec &spec, const Args &args) {
+        std::string message;
+        if (args.size() >= 3 && args[1] == "-m") {
+            message = args[2];
+            for (size_t i = 3; i < args.size(); i++) {
+                message += " " + args[i];
             }
-            result = handleStatusCommand(repoOverride);
-            addMultiLineToTerminal(result);
-        } else if (cmd == "add") {
-            if (args.size() < 2) {
-                ui_.addTerminalLine("Error: Usage: add <file> [repo]");
-            } else {
-                std::optional<std::string> repoOverride;
-                if (args.size() >= 3) {
-                    repoOverride = args[2];
+        } else if (app.ui_.headless()) {
+            app.ui_.addTerminalLine(commands::usageError(spec));
+        } else {
+            message = app.ui_.prompt("Commit message:", false, 128);
+        }
+        if (!message.empty()) {
+            app.ui_.addTerminalLine(app.handleCommitCommand(message));
+        }
+        return true;
+    }
+
+    static bool log(GitLiteApp &app, const commands::Spec &spec, const Args &args) {
+        std::optional<std::string> repoOverride;
+        std::size_t limit = 10;
+        std::size_t skip = 0;
+        std::string range;
+        std::string path;
+        bool valid = true;
+        for (size_t i = 1; i < args.size() && valid; ++i) {
+            if (args[i] == "--") {
+                // Exactly one path follows.
+                valid = i + 2 == args.size() && !args[i + 1].empty();
+                if (valid) {
+                    path = args[i + 1];
                 }
-                result = handleAddCommand(args[1], repoOverride);
-                ui_.addTerminalLine(result);
+                break;
             }
-        } else if (cmd == "commit") {
-            std::string message;
-            if (args.size() >= 3 && args[1] == "-m") {
-                message = args[2];
-                for (size_t i = 3; i < args.size(); i++) {
-                    message += " " + args[i];
+            if (range.empty() && args[i].find("..") != std::string::npos) {
+                range = args[i];
+            } else if ((args[i] == "-n" || args[i] == "--skip") && i + 1 < args.size()) {
+                try {
+                    std::size_t value = static_cast<std::size_t>(std::stoul(args[i + 1]));
+                    (args[i] == "-n" ? limit : skip) = value;
+                } catch (const std::exception &) {
+                    valid = false;
                 }
+                ++i;
+            } else if (!repoOverride && !args[i].empty() && args[i][0] != '-') {
+                repoOverride = args[i];
             } else {
-                message = ui_.prompt("Commit message:", false, 128);
-            }
-            if (!message.empty()) {
-                result = handleCommitCommand(message);
-                ui_.addTerminalLine(result);
+                valid = false;
             }
-        } else if (cmd == "log") {
-            std::optional<std::string> repoOverride;
-            if (args.size() >= 2) {
-                repoOverride = args[1];
-            }
-            result = handleLogCommand(repoOverride);
-            addMultiLineToTerminal(result);
-        } else if (cmd == "branch") {
-            if (args.size() == 1) {
-                result = handleBranchListCommand();
-                addMultiLineToTerminal(result);
+        }
+        if (!valid) {
+            app.ui_.addTerminalLine(commands::usageError(spec));
+            return true;
+        }
+        app.addMultiLineToTerminal(app.handleLogCommand(repoOverride, limit, skip, range, path));
+        return true;
+    }
+
+    static bool branch(GitLiteApp &app, const commands::Spec &, const Args &args) {
+        if (args.size() == 1) {
+            app.addMultiLineToTerminal(app.handleBranchListCommand());
+        } else if (args[1] == "list") {
+            app.addMultiLineToTerminal(app.handleBranchListCommand(argAt(args, 2)));
+        } else if (args[1].find('/') != std::string::npos || app.isRepoIdentifier(args[1])) {
+            app.addMultiLineToTerminal(app.handleBranchListCommand(args[1]));
+        } else {
+            app.ui_.addTerminalLine(app.handleBranchCreateCommand(args[1], argAt(args, 2)));
+        }
+        return true;
+    }
+
+    static bool checkout(GitLiteApp &app, const commands::Spec &, const Args &args) {
+        app.ui_.addTerminalLine(app.handleCheckoutCommand(args[1], argAt(args, 2)));
+        return true;
+    }
+
+    static bool merge(GitLiteApp &app, const commands::Spec &, const Args &args) {
+        app.ui_.addTerminalLine(app.handleMergeCommand(args[1], argAt(args, 2)));
+        return true;
+    }
+
+    static bool rebase(GitLiteApp &app, const commands::Spec &, const Args &args) {
+        app.ui_.addTerminalLine(app.handleRebaseCommand(args[1], argAt(args, 2)));
+        return true;
+    }
+
+    static bool renameBranch(GitLiteApp &app, const commands::Spec &, const Args &args) {
+        app.ui_.addTerminalLine(app.handleRenameBranchCommand(args[1], args[2], argAt(args, 3)));
+        return true;
+    }
+
+    static bool deleteBranch(GitLiteApp &app, const commands::Spec &, const Args &args) {
+        app.ui_.addTerminalLine(app.handleDeleteBranchCommand(args[1], argAt(args, 2)));
+        return true;
+    }
+
+    static bool repack(GitLiteApp &app, const commands::Spec &spec, const Args &args) {
+        bool all = false;
+        std::optional<std::string> repoOverride;
+        for (size_t i = 1; i < args.size(); ++i) {
+            if (args[i] == "-a" || args[i] == "--all") {
+                all = true;
+            } else if (!repoOverride) {
+                repoOverride = args[i];
             } else {
-                std::string subcommand = args[1];
-                if (subcommand == "list") {
-                    std::optional<std::string> repoOverride;
-                    if (args.size() >= 3) {
-                        repoOverride = args[2];
-                    }
-                    result = handleBranchListCommand(repoOverride);
-                    addMultiLineToTerminal(result);
-                } else if (subcommand.find('/') != std::string::npos || isRepoIdentifier(subcommand)) {
-                    result = handleBranchListCommand(subcommand);
-                    addMultiLineToTerminal(result);
-                } else {
-                    std::optional<std::string> repoOverride;
-                    if (args.size() >= 3) {
-                        repoOverride = args[2];
-                    }
-                    result = handleBranchCreateCommand(subcommand, repoOverride);
-                    ui_.addTerminalLine(result);
-                }
+                app.ui_.addTerminalLine(commands::usageError(spec));
+                return true;
             }
-        } else if (cmd == "checkout") {
-            if (args.size() < 2) {
-                ui_.addTerminalLine("Error: Usage: checkout <branch>");
+        }
+        app.ui_.addTerminalLine(app.handleRepackCommand(all, repoOverride));
+        return true;
+    }
+
+    static bool gc(GitLiteApp &app, const commands::Spec &spec, const Args &args) {
+        bool pruneNow = false;
+        std::optional<std::string> repoOverride;
+        for (size_t i = 1; i < args.size(); ++i) {
+            if (args[i] == "--now") {
+                pruneNow = true;
+            } else if (!repoOverride) {
+                repoOverride = args[i];
             } else {
-                std::optional<std::string> repoOverride;
-                if (args.size() >= 3) {
-                    repoOverride = args[2];
-                }
-                result = handleCheckoutCommand(args[1], repoOverride);
-                ui_.addTerminalLine(result);
+                app.ui_.addTerminalLine(commands::usageError(spec));
+                return true;
             }
-        } else if (cmd == "merge") {
-            if (args.size() < 2) {
-                ui_.addTerminalLine("Error: Usage: merge <branch>");
+        }
+        app.ui_.addTerminalLine(app.handleGcCommand(pruneNow, repoOverride));
+        return true;
+    }
+
+    static bool perm(GitLiteApp &app, const commands::Spec &spec, const Args &args) {
+        if (args.size() == 4 && args[1] == "add") {
+            app.ui_.addTerminalLine(app.handlePermAddCommand(args[2], args[3]));
+        } else if (args.size() == 4 && args[1] == "rm") {
+            app.ui_.addTerminalLine(app.handlePermRmCommand(args[2], args[3]));
+        } else if (args.size() == 3 && args[1] == "list") {
+            app.addMultiLineToTerminal(app.handlePermListCommand(args[2]));
+        } else {
+            app.ui_.addTerminalLine(commands::usageError(spec));
+        }
+        return true;
+    }
+
+    static bool fork(GitLiteApp &app, const commands::Spec &, const Args &args) {
+        app.ui_.addTerminalLine(app.handleForkCommand(args[1]));
+        return true;
+    }
+
+    static bool transfer(GitLiteApp &app, const commands::Spec &, const Args &args) {
+        app.ui_.addTerminalLine(app.handleTransferCommand(args[1], args[2]));
+        return true;
+    }
+
+    static bool push(GitLiteApp &app, const commands::Spec &, const Args &args) {
+        app.ui_.addTerminalLine(app.handlePushCommand(argAt(args, 1)));
+        return true;
+    }
+
+    static bool pull(GitLiteApp &app, const commands::Spec &, const Args &args) {
+        app.ui_.addTerminalLine(app.handlePullCommand(argAt(args, 1)));
+        return true;
+    }
+
+    static bool fetch(GitLiteApp &app, const commands::Spec &, const Args &args) {
+        app.ui_.addTerminalLine(app.handleFetchCommand(argAt(args, 1)));
+        return true;
+    }
+
+    static bool sync(GitLiteApp &app, const commands::Spec &, const Args &args) {
+        app.ui_.addTerminalLine(app.handleSyncCommand(argAt(args, 1)));
+        return true;
+    }
+
+    static bool clone(GitLiteApp &app, const commands::Spec &spec, const Args &args) {
+        transport::CloneOptions options;
+        std::string source;
+        bool valid = true;
+        for (size_t i = 1; i < args.size() && valid; ++i) {
+            if (args[i] == "--depth" && i + 1 < args.size()) {
+                const std::string &value = args[++i];
+                valid = !value.empty() && value.size() < 10 && std::all_of(value.begin(), value.end(), ::isdigit) &&
+                        std::stoul(value) > 0;
+                options.depth = valid ? std::stoul(value) : 0;
+            } else if (args[i] == "--filter=blob:none") {
+                options.blobless = true;
+            } else if (source.empty() && !args[i].empty() && args[i][0] != '-') {
+                source = args[i];
             } else {
-                std::optional<std::string> repoOverride;
-                if (args.size() >= 3) {
-                    repoOverride = args[2];
-                }
-                result = handleMergeCommand(args[1], repoOverride);
-                ui_.addTerminalLine(result);
+                valid = false;
             }
-        } else if (cmd == "rebase") {
-            if (args.size() < 2) {
-                ui_.addTerminalLine("Error: Usage: rebase <branch>");
-            } else {
-                std::optional<std::string> repoOverride;
-                if (args.size() >= 3) {
-                    repoOverride = args[2];
-                }
-                result = handleRebaseCommand(args[1], repoOverride);
-                ui_.addTerminalLine(result);
+        }
+        if (source.empty() || !valid) {
+            app.ui_.addTerminalLine(commands::usageError(spec));
+            return true;
+        }
+        app.ui_.addTerminalLine(app.handleCloneCommand(source, options));
+        return true;
+    }
+
+    static bool remove(GitLiteApp &app, const commands::Spec &, const Args &args) {
+        app.ui_.addTerminalLine(app.handleDeleteCommand(args[1]));
+        return true;
+    }
+
+    static bool setPublic(GitLiteApp &app, const commands::Spec &, const Args &args) {
+        app.ui_.addTerminalLine(app.handleSetPublicCommand(args[1]));
+        return true;
+    }
+
+    static bool setPrivate(GitLiteApp &app, const commands::Spec &, const Args &args) {
+        app.ui_.addTerminalLine(app.handleSetPrivateCommand(args[1]));
+        return true;
+    }
+
+    static bool visibility(GitLiteApp &app, const commands::Spec &spec, const Args &args) {
+        auto parseState = [](std::string value) -> std::optional<bool> {
+            std::transform(value.begin(), value.end(), value.begin(), ::tolower);
+            if (value == "public" || value == "private") {
+                return value == "public";
             }
-        } else if (cmd == "rename-branch") {
-            if (args.size() < 3) {
-                ui_.addTerminalLine("Error: Usage: rename-branch <old> <new>");
-            } else {
-                std::optional<std::string> repoOverride;
-                if (args.size() >= 4) {
-                    repoOverride = args[3];
-                }
-                result = handleRenameBranchCommand(args[1], args[2], repoOverride);
-                ui_.addTerminalLine(result);
+            return std::nullopt;
+        };
+        std::optional<std::string> repoOverride;
+        std::optional<bool> newState;
+        if (args.size() >= 2) {
+            newState = parseState(args[1]);
+            if (!newState) {
+                repoOverride = args[1];
             }
-        } else if (cmd == "delete-branch") {
-            if (args.size() < 2) {
-                ui_.addTerminalLine("Error: Usage: delete-branch <name>");
-            } else {
-                std::optional<std::string> repoOverride;
-                if (args.size() >= 3) {
-                    repoOverride = args[2];
+        }
+        if (args.size() >= 3) {
+            if (repoOverride) {
+                newState = parseState(args[2]);
+                if (!newState) {
+                    app.ui_.addTerminalLine(commands::usageError(spec));
+                    return true;
                 }
-                result = handleDeleteBranchCommand(args[1], repoOverride);
-                ui_.addTerminalLine(result);
-            }
-        } else if (cmd == "perm") {
-            if (args.size() >= 3 && args[1] == "add") {
-                result = handlePermAddCommand(args[2], args[3]);
-                ui_.addTerminalLine(result);
-            } else if (args.size() >= 3 && args[1] == "rm") {
-                result = handlePermRmCommand(args[2], args[3]);
-                ui_.addTerminalLine(result);
-            } else if (args.size() >= 2 && args[1] == "list") {
-                result = handlePermListCommand(args[2]);
-                addMultiLineToTerminal(result);
-            } else {
-                ui_.addTerminalLine("Error: Usage: perm add|rm|list <repo> [user]");
-            }
-        } else if (cmd == "fork") {
-            if (args.size() < 2) {
-                ui_.addTerminalLine("Error: Usage: fork <user>/<repo>");
             } else {
-                result = handleForkCommand(args[1]);
-                ui_.addTerminalLine(result);
-            }
-        } else if (cmd == "transfer") {
-            if (args.size() < 3) {
-                ui_.addTerminalLine("Error: Usage: transfer <repo> <new-owner>");
-            } else {
-                result = handleTransferCommand(args[1], args[2]);
-                ui_.addTerminalLine(result);
-            }
-        } else if (cmd == "push") {
-            result = handlePushCommand();
-            ui_.addTerminalLine(result);
-        } else if (cmd == "pull") {
-            result = handlePullCommand();
-            ui_.addTerminalLine(result);
-        } else if (cmd == "fetch") {
-            result = handleFetchCommand();
-            ui_.addTerminalLine(result);
-        } else if (cmd == "sync") {
-            result = handleSyncCommand();
-            ui_.addTerminalLine(result);
-        } else if (cmd == "clone") {
-            if (args.size() < 2) {
-                ui_.addTerminalLine("Error: Usage: clone <user>/<repo>");
-            } else {
-                result = handleCloneCommand(args[1]);
-                ui_.addTerminalLine(result);
-            }
-        } else if (cmd == "delete") {
-            if (args.size() < 2) {
-                ui_.addTerminalLine("Error: Usage: delete <repo>");
-            } else {
-                result = handleDeleteCommand(args[1]);
-                ui_.addTerminalLine(result);
-            }
-        } else if (cmd == "set-public") {
-            if (args.size() < 2) {
-                ui_.addTerminalLine("Error: Usage: set-public <repo>");
-            } else {
-                result = handleSetPublicCommand(args[1]);
-                ui_.addTerminalLine(result);
-            }
-        } else if (cmd == "set-private") {
-            if (args.size() < 2) {
-                ui_.addTerminalLine("Error: Usage: set-private <repo>");
-            } else {
-                result = handleSetPrivateCommand(args[1]);
-                ui_.addTerminalLine(result);
-            }
-        } else if (cmd == "visibility") {
-            auto toLower = [](std::string value) {
-                std::transform(value.begin(), value.end(), value.begin(), ::tolower);
-                return value;
-            };
-            std::optional<std::string> repoOverride;
-            std::optional<bool> newState;
-            bool firstArgIsState = false;
-
-            if (args.size() >= 2) {
-                std::string first = toLower(args[1]);
-                if (first == "public") {
-                    newState = true;
-                    firstArgIsState = true;
-                } else if (first == "private") {
-                    newState = false;
-                    firstArgIsState = true;
-                } else {
-                    repoOverride = args[1];
-                }
+                repoOverride = args[2];
             }
+        }
+        app.ui_.addTerminalLine(app.handleVisibilityCommand(repoOverride, newState));
+        return true;
+    }
 
-            if (args.size() >= 3) {
-                if (firstArgIsState) {
-                    repoOverride = args[2];
-                } else {
-                    std::string second = toLower(args[2]);
-                    if (second == "public") {
-                        newState = true;
-                    } else if (second == "private") {
-                        newState = false;
-                    } else {
-                        ui_.addTerminalLine("Error: Usage: visibility [repo] [public|private]");
-                        continue;
-                    }
-                }
-            }
+    static bool view(GitLiteApp &app, const commands::Spec &, const Args &args) {
+        app.addMultiLineToTerminal(app.handleViewCommand(args[1]));
+        return true;
+    }
 
-            if (args.size() >= 4) {
-                ui_.addTerminalLine("Error: Usage: visibility [repo] [public|private]");
-                continue;
-            }
+    static bool rm(GitLiteApp &app, const commands::Spec &, const Args &args) {
+        app.ui_.addTerminalLine(app.handleRmCommand(args[1]));
+        return true;
+    }
 
-            result = handleVisibilityCommand(repoOverride, newState);
-            ui_.addTerminalLine(result);
-        } else if (cmd == "view") {
-            if (args.size() < 2) {
-                ui_.addTerminalLine("Error: Usage: view <user>/<repo>");
-            } else {
-                result = handleViewCommand(args[1]);
-                addMultiLineToTerminal(result);
-            }
-        } else if (cmd == "rm") {
-            if (args.size() < 2) {
-                ui_.addTerminalLine("Error: Usage: rm <file>");
-            } else {
-                result = handleRmCommand(args[1]);
-                ui_.addTerminalLine(result);
-            }
-        } else if (cmd == "diff") {
-            result = handleDiffCommand();
-            addMultiLineToTerminal(result);
-        } else if (cmd == "reset") {
-            if (args.size() < 2) {
-                ui_.addTerminalLine("Error: Usage: reset <file>");
-            } else {
-                result = handleResetCommand(args[1]);
-                ui_.addTerminalLine(result);
-            }
-        } else if (cmd == "ignore") {
-            if (args.size() < 2) {
-                ui_.addTerminalLine("Error: Usage: ignore <pattern>");
-            } else {
-                result = handleIgnoreCommand(args[1]);
-                ui_.addTerminalLine(result);
-            }
-        } else if (cmd == "show") {
-            if (args.size() < 2) {
-                ui_.addTerminalLine("Error: Usage: show <commit-hash>");
-            } else {
-                result = handleShowCommand(args[1]);
-                addMultiLineToTerminal(result);
-            }
-        } else if (cmd == "revert") {
-            if (args.size() < 2) {
-                ui_.addTerminalLine("Error: Usage: revert <commit-hash>");
-            } else {
-                result = handleRevertCommand(args[1]);
-                ui_.addTerminalLine(result);
-            }
-        } else if (cmd == "tag") {
-            if (args.size() < 2) {
-                ui_.addTerminalLine("Error: Usage: tag <name>");
-            } else {
-                std::optional<std::string> repoOverride;
-                if (args.size() >= 3) {
-                    repoOverride = args[2];
+    static bool diff(GitLiteApp &app, const commands::Spec &, const Args &args) {
+        app.addMultiLineToTerminal(app.handleDiffCommand(Args(args.begin() + 1, args.end())));
+        return true;
+    }
+
+    static bool reset(GitLiteApp &app, const commands::Spec &, const Args &args) {
+        app.ui_.addTerminalLine(app.handleResetCommand(args[1]));
+        return true;
+    }
+
+    static bool ignore(GitLiteApp &app, const commands::Spec &, const Args &args) {
+        app.ui_.addTerminalLine(app.handleIgnoreCommand(args[1]));
+        return true;
+    }
+
+    static bool show(GitLiteApp &app, const commands::Spec &, const Args &args) {
+        app.addMultiLineToTerminal(app.handleShowCommand(args[1]));
+        return true;
+    }
+
+    static bool revert(GitLiteApp &app, const commands::Spec &, const Args &args) {
+        app.ui_.addTerminalLine(app.handleRevertCommand(args[1]));
+        return true;
+    }
+
+    static bool tag(GitLiteApp &app, const commands::Spec &, const Args &args) {
+        app.ui_.addTerminalLine(app.handleTagCommand(args[1], argAt(args, 2)));
+        return true;
+    }
+
+    static bool tags(GitLiteApp &app, const commands::Spec &, const Args &args) {
+        app.addMultiLineToTerminal(app.handleTagsCommand(argAt(args, 1)));
+        return true;
+    }
+
+    static bool makeAdmin(GitLiteApp &app, const commands::Spec &, const Args &args) {
+        app.ui_.addTerminalLine(app.handleMakeAdminCommand(args[1]));
+        return true;
+    }
+
+    static bool removeAdmin(GitLiteApp &app, const commands::Spec &, const Args &args) {
+        app.ui_.addTerminalLine(app.handleRemoveAdminCommand(args[1]));
+        return true;
+    }
+
+    static bool repos(GitLiteApp &app, const commands::Spec &spec, const Args &args) {
+        CatalogQuery query;
+        query.limit = 50;
+        bool valid = args[1] == "all" || args[1] == "public";
+        for (size_t i = 2; i < args.size() && valid; ++i) {
+            if ((args[i] == "-n" || args[i] == "--skip") && i + 1 < args.size()) {
+                try {
+                    std::size_t value = static_cast<std::size_t>(std::stoul(args[i + 1]));
+                    (args[i] == "-n" ? query.limit : query.skip) = value;
+                } catch (const std::exception &) {
+                    valid = false;
                 }
-                result = handleTagCommand(args[1], repoOverride);
-                ui_.addTerminalLine(result);
-            }
-        } else if (cmd == "tags") {
-            std::optional<std::string> repoOverride;
-            if (args.size() >= 2) {
-                repoOverride = args[1];
-            }
-            result = handleTagsCommand(repoOverride);
-            addMultiLineToTerminal(result);
-        } else if (cmd == "make-admin") {
-            if (args.size() < 2) {
-                ui_.addTerminalLine("Error: Usage: make-admin <user>");
-            } else {
-                result = handleMakeAdminCommand(args[1]);
-                ui_.addTerminalLine(result);
-            }
-        } else if (cmd == "remove-admin") {
-            if (args.size() < 2) {
-                ui_.addTerminalLine("Error: Usage: remove-admin <user>");
+                ++i;
+            } else if (query.prefix.empty() && !args[i].empty() && args[i][0] != '-') {
+                query.prefix = args[i];
             } else {
-                result = handleRemoveAdminCommand(args[1]);
-                ui_.addTerminalLine(result);
+                valid = false;
             }
-        } else if (cmd == "repos") {
-            if (args.size() >= 1 && args[0] == "all") {
-                result = handleReposAllCommand();
-                addMultiLineToTerminal(result);
-            } else {
-                ui_.addTerminalLine("Error: Usage: repos all");
-            }
-        } else if (cmd == "version") {
-            result = handleVersionCommand();
-            ui_.addTerminalLine(result);
-        } else if (cmd == "config") {
-            result = handleConfigCommand(args);
-            ui_.addTerminalLine(result);
-        } else if (cmd == "cd") {
-            if (args.size() < 2) {
-                // cd without args goes to home (workspace root)
-                currentDir_ = storage_.root().parent_path();
-                ui_.addTerminalLine("Changed to: " + currentDir_.string());
-            } else {
-                result = handleCdCommand(args[1]);
-                ui_.addTerminalLine(result);
-            }
-        } else if (cmd == "pwd") {
-            result = handlePwdCommand();
-            ui_.addTerminalLine(result);
-        } else if (cmd == "ls" || cmd == "dir") {
-            result = handleLsCommand();
-            addMultiLineToTerminal(result);
+        }
+        if (!valid) {
+            app.ui_.addTerminalLine(commands::usageError(spec));
+            return true;
+        }
+        query.publicOnly = args[1] == "public";
+        app.addMultiLineToTerminal(app.handleReposCommand(query));
+        return true;
+    }
+
+    static bool version(GitLiteApp &app, const commands::Spec &, const Args &) {
+        app.ui_.addTerminalLine(app.handleVersionCommand());
+        return true;
+    }
+
+    static bool statsCommand(GitLiteApp &app, const commands::Spec &, const Args &args) {
+        app.addMultiLineToTerminal(app.handleStatsCommand(Args(args.begin() + 1, args.end())));
+        return true;
+    }
+
+    static bool config(GitLiteApp &app, const commands::Spec &, const Args &args) {
+        app.addMultiLineToTerminal(app.handleConfigCommand(Args(args.begin() + 1, args.end())));
+        return true;
+    }
+
+    static bool cd(GitLiteApp &app, const commands::Spec &, const Args &args) {
+        if (args.size() < 2) {
+            // cd without args goes to home (workspace root)
+            app.ui_.addTerminalLine(app.handleCdCommand("~"));
         } else {
-            result = "Unknown command: " + cmd + ". Type 'help' for available commands.";
-            ui_.addTerminalLine(result);
+            app.ui_.addTerminalLine(app.handleCdCommand(args[1]));
         }
-        
-        updateSidebar();
+        return true;
     }
+
+    static bool pwd(GitLiteApp &app, const commands::Spec &, const Args &) {
+        app.ui_.addTerminalLine(app.handlePwdCommand());
+        return true;
+    }
+
+    static bool ls(GitLiteApp &app, const commands::Spec &, const Args &) {
+        app.addMultiLineToTerminal(app.handleLsCommand());
+        return true;
+    }
+};
+
+GitLiteApp::CommandHandlers::Handler GitLiteApp::CommandHandlers::handler(commands::Id id) {
+    using commands::Id;
+    static constexpr std::pair<Id, Handler> kBindings[] = {
+        {Id::Logout, &logout},
+        {Id::Whoami, &whoami},
+        {Id::LsUsers, &lsUsers},
+        {Id::Init, &init},
+        {Id::Create, &create},
+        {Id::Delete, &remove},
+        {Id::SetPublic, &setPublic},
+        {Id::SetPrivate, &setPrivate},
+        {Id::Visibility, &visibility},
+        {Id::List, &list},
+        {Id::LsRepos, &lsRepos},
+        {Id::Repos, &repos},
+        {Id::View, &view},
+        {Id::Repack, &repack},
+        {Id::Gc, &gc},
+        {Id::Add, &add},
+        {Id::Status, &status},
+        {Id::Rm, &rm},
+        {Id::Diff, &diff},
+        {Id::Reset, &reset},
+        {Id::Ignore, &ignore},
+        {Id::Commit, &commit},
+        {Id::Log, &log},
+        {Id::Show, &show},
+        {Id::Revert, &revert},
+        {Id::Tag, &tag},
+        {Id::Tags, &tags},
+        {Id::Branch, &branch},
+        {Id::Checkout, &checkout},
+        {Id::Merge, &merge},
+        {Id::Rebase, &rebase},
+        {Id::RenameBranch, &renameBranch},
+        {Id::DeleteBranch, &deleteBranch},
+        {Id::Push, &push},
+        {Id::Pull, &pull},
+        {Id::Fetch, &fetch},
+        {Id::Sync, &sync},
+        {Id::Clone, &clone},
+        {Id::Perm, &perm},
+        {Id::Transfer, &transfer},
+        {Id::Fork, &fork},
+        {Id::MakeAdmin, &makeAdmin},
+        {Id::RemoveAdmin, &removeAdmin},
+        {Id::Menu, &menu},
+        {Id::Help, &help},
+        {Id::Clear, &clear},
+        {Id::Version, &version},
+        {Id::Stats, &statsCommand},
+        {Id::Config, &config},
+        {Id::Cd, &cd},
+        {Id::Pwd, &pwd},
+        {Id::Ls, &ls},
+    };
+    static constexpr auto kTable = commands::bindHandlers(kBindings);
+    return kTable[static_cast<std::size_t>(id)];
 }
 
-void GitLiteApp::updateSidebar() {
-    std::vector<std::string> sidebarContent;
+bool GitLiteApp::dispatchCommand(const std::string &command) {
+    std::vector<std::string> args = split(command, ' ');
+    std::string name = args.empty() ? "" : args[0];
+    std::transform(name.begin(), name.end(), name.begin(), ::tolower);
+
+    // help/<category> is a single word.
+    if (name.rfind("help/", 0) == 0) {
+        args.insert(args.begin() + 1, args[0].substr(5));
+        name = "help";
+    }
 
+    const commands::Spec *spec = commands::find(name);
+    if (!spec) {
+        ui_.addTerminalLine("Unknown command: " + name + ". Type 'help' for available commands.");
+        return true;
+    }
+    std::size_t argCount = args.size() - 1;
+    if (argCount < spec->minArgs || argCount > spec->maxArgs) {
+        ui_.addTerminalLine(commands::usageError(*spec));
+        return true;
+    }
+    return CommandHandlers::handler(spec->id)(*this, *spec, args);
+}
+
+void GitLiteApp::updateSidebar() {
     if (!session_) {
-        sidebarContent.push_back("Not logged in.");
-        ui_.drawSidebar(sidebarContent, "Repositories");
+        ui_.drawSidebar({"Not logged in."}, "Repositories");
         return;
     }
+    if (!sidebarFeed_) {
+        sidebarFeed_ = std::make_unique<SidebarFeed>(storage_, repoService_);
+    }
+    sidebarFeed_->request(session_->username, currentDir_);
+    drawSidebarSnapshot();
+}
+
+bool GitLiteApp::onIdle() {
+    bool redraw = pollSidebar();
+    std::vector<std::string> lines;
+    {
+        std::lock_guard<std::mutex> lock(backgroundMutex_);
+        lines.swap(backgroundOutput_);
+    }
+    for (const auto &line : lines) {
+        ui_.addTerminalLine(line);
+    }
+    return redraw || !lines.empty();
+}
+
+std::optional<std::string> GitLiteApp::runInBackground(std::function<std::string()> job) {
+    if (ui_.headless()) {
+        return job();
+    }
+    if (!backgroundJobs_) {
+        backgroundJobs_ = std::make_unique<ThreadPool>(1, 4);
+    }
+    backgroundJobs_->submit([this, job = std::move(job), trace = stats::currentTrace()] {
+        stats::TraceBinding binding(trace);
+        std::string line;
+        try {
+            line = job();
+        } catch (const std::exception &ex) {
+            line = std::string("Error: ") + ex.what();
+        }
+        std::lock_guard<std::mutex> lock(backgroundMutex_);
+        backgroundOutput_.push_back(std::move(line));
+    });
+    return std::nullopt;
+}
+
+bool GitLiteApp::pollSidebar() {
+    if (!session_ || !sidebarFeed_ || !sidebarFeed_->takeUpdate()) {
+        return false;
+    }
+    drawSidebarSnapshot();
+    return true;
+}
 
-    auto repos = storage_.listUserRepos(session_->username);
+void GitLiteApp::drawSidebarSnapshot() {
+    std::vector<std::string> sidebarContent;
     sidebarContent.push_back("My repositories:");
 
-    if (repos.empty()) {
+    // Shown as it stands, however old; the feed is already refreshing it.
+    auto snapshot = sidebarFeed_->latest();
+    if (!snapshot || snapshot->username != session_->username) {
+        sidebarContent.push_back("  (loading...)");
+    } else if (snapshot->repos.empty()) {
         sidebarContent.push_back("  (none)");
     } else {
-        std::error_code ec;
-        auto currentCanonical = fs::weakly_canonical(currentDir_, ec);
-        for (size_t i = 0; i < repos.size() && i < 15; ++i) {
-            const auto &name = repos[i];
-            fs::path repoRoot = storage_.repoPath(session_->username, name);
-            std::string visibility = storage_.getVisibility(session_->username, name);
-
-            std::string prefix = "  ";
-            std::error_code repoEc;
-            auto repoCanonical = fs::weakly_canonical(repoRoot, repoEc);
-            if (!ec && !repoEc) {
-                fs::path workspacePath = repoRoot / "workspace";
-                std::error_code wsEc;
-                auto workspaceCanonical = fs::weakly_canonical(workspacePath, wsEc);
-                if (currentCanonical == repoCanonical ||
-                    (!wsEc && currentCanonical == workspaceCanonical)) {
-                    prefix = "> ";
-                }
+        for (const auto &repo : snapshot->repos) {
+            std::string line = (repo.current ? "> " : "  ") + repo.name + " [" + repo.visibility + "]";
+            if (repo.dirty.value_or(false)) {
+                line += " *";
             }
-
-            sidebarContent.push_back(prefix + name + " [" + visibility + "]");
+            if (repo.aheadBehind && (repo.aheadBehind->first || repo.aheadBehind->second)) {
+                line += " +" + std::to_string(repo.aheadBehind->first) + " -" +
+                        std::to_string(repo.aheadBehind->second);
+            }
+            sidebarContent.push_back(line);
         }
-        if (repos.size() > 15) {
+        if (snapshot->more) {
             sidebarContent.push_back("  ...");
         }
     }
 
+    sidebarContent.push_back("");
+    sidebarContent.push_back("  * uncommitted changes");
+    sidebarContent.push_back("  +N -N ahead/behind fetch");
     sidebarContent.push_back("");
     sidebarContent.push_back("Tips:");
     sidebarContent.push_back("  create <name>");
@@ -587,15 +981,7 @@ std::string GitLiteApp::getHelpCategories() {
     result += "  Use 'help/<category>' to see commands for that category\n\n";
     result += "  * Commands marked with an asterisk must be run inside the target repository folder\n\n";
     result += "Categories:\n";
-    result += "  1. auth       - User & Authentication\n";
-    result += "  2. repo       - Repository Management\n";
-    result += "  3. files      - File Tracking\n";
-    result += "  4. commit     - Commit System\n";
-    result += "  5. branch     - Branching & Merging\n";
-    result += "  6. sync       - Syncing & Collaboration\n";
-    result += "  7. collab     - Collaboration & Permissions\n";
-    result += "  8. admin      - Admin & Role Management\n";
-    result += "  9. utility    - UI & Utility Commands\n\n";
+    result += commands::categoryList() + "\n";
     result += "Quick Start:\n";
     result += "  1. cd <path>               - Navigate to folder\n";
     result += "  2. ls                      - List files in current directory\n";
@@ -611,111 +997,11 @@ std::string GitLiteApp::getHelpCategories() {
 std::string GitLiteApp::getHelpForCategory(const std::string &category) {
     std::string cat = category;
     std::transform(cat.begin(), cat.end(), cat.begin(), ::tolower);
-    
-    if (cat == "auth" || cat == "1") {
-        return "User & Authentication Commands:\n"
-               "  logout              - End current user session\n"
-               "  whoami              - Display current user and role\n"
-               "  ls-users            - List all users\n"
-               "  (Note: signup/login done from main menu)";
-    } else if (cat == "repo" || cat == "2") {
-        return "Repository Management Commands:\n"
-               "  init                - Initialize repository in current folder\n"
-               "  create <repo>       - Create new repository\n"
-               "  clone <user>/<repo> - Clone existing repository\n"
-               "  delete <repo>       - Delete repository\n"
-               "  set-public <repo>   - Mark repo as public\n"
-               "  set-private <repo>  - Make repo private\n"
-               "  visibility [repo] [public|private] - Toggle or set repo visibility\n"
-               "  list                - List all your repositories\n"
-               "  ls-repos <user>     - Show user's repositories\n"
-               "  view <user>/<repo>  - View repository contents\n\n"
-               "Workflow:\n"
-               "  1. cd <path> - Navigate to your project folder\n"
-               "  2. ls - List files in directory\n"
-               "  3. init - Create .glite repository\n"
-               "  4. add <file> - Stage files from current directory\n"
-               "  5. commit -m \"message\" - Commit changes";
-    } else if (cat == "files" || cat == "3") {
-        return "File Tracking Commands:\n"
-               "  add <file> [repo]   - Stage file for commit (optionally target repo)\n"
-               "  status [repo]       - Show staged files\n"
-               "  rm <file>*          - Remove file from staging and workspace\n"
-               "  diff*               - Show changes since last commit\n"
-               "  reset <file>*       - Unstage a file\n"
-               "  ignore <pattern>*   - Add pattern to .gliteignore\n\n"
-               "Examples:\n"
-               "  add workspace/main.cpp\n"
-               "  status tejas/assignments";
-    } else if (cat == "commit" || cat == "4") {
-        return "Commit System Commands:\n"
-               "  commit -m \"message\"* - Create commit with message\n"
-               "  log [repo]            - Show commit history\n"
-               "  show <commit-hash>*   - Show commit details\n"
-               "  revert <commit-hash>* - Undo a commit\n"
-               "  tag <name> [repo]     - Tag current commit\n"
-               "  tags [repo]           - List all tags\n\n"
-               "Examples:\n"
-               "  commit -m \"Initial commit\"\n"
-               "  log tejas/assignments";
-    } else if (cat == "branch" || cat == "5") {
-        return "Branching & Merging Commands:\n"
-               "  branch [repo]             - List all branches\n"
-               "  branch list [repo]        - Alias for listing branches\n"
-               "  branch <name> [repo]      - Create new branch\n"
-               "  checkout <branch> [repo]  - Switch to branch\n"
-               "  merge <branch> [repo]     - Merge branch into current\n"
-               "  rebase <branch> [repo]    - Rebase current branch onto another\n"
-               "  rename-branch <old> <new> [repo] - Rename branch\n"
-               "  delete-branch <name> [repo]- Delete branch\n\n"
-               "Examples:\n"
-               "  branch feature-x\n"
-               "  branch list tejas/assignments\n"
-               "  checkout main tejas/assignments";
-    } else if (cat == "sync" || cat == "6") {
-        return "Syncing Commands:\n"
-               "  push*               - Push commits to remote mirror\n"
-               "  pull*               - Pull from remote mirror\n"
-               "  fetch*              - Fetch remote branches\n"
-               "  sync*               - Fetch + merge automatically\n"
-               "  clone <user>/<repo> - Clone repository to current directory\n\n"
-               "Note: Remotes are stored in storage/_remotes/";
-    } else if (cat == "collab" || cat == "7") {
-        return "Collaboration & Permissions Commands:\n"
-               "  perm add <repo> <user>    - Grant collaborator access\n"
-               "  perm rm <repo> <user>     - Revoke collaborator access\n"
-               "  perm list <repo>          - List all collaborators\n"
-               "  transfer <repo> <new-owner> - Transfer repository ownership\n"
-               "  fork <user>/<repo>        - Fork repository to your account\n\n"
-               "Example:\n"
-               "  perm add myrepo alice\n"
-               "  perm list myrepo";
-    } else if (cat == "admin" || cat == "8") {
-        return "Admin Commands (Admin only):\n"
-               "  make-admin <user>   - Promote user to admin\n"
-               "  remove-admin <user> - Demote admin to user\n"
-               "  repos all           - List all repositories\n\n"
-               "Note: Only admins can use these commands";
-    } else if (cat == "utility" || cat == "9") {
-        return "UI & Utility Commands:\n"
-               "  menu                - Show dashboard menu\n"
-               "  help                - Show help categories\n"
-               "  help/<category>     - Show commands for category\n"
-               "  clear               - Clear terminal\n"
-               "  version             - Show version\n"
-               "  config set <key> <value> - Set configuration\n"
-               "  config get <key>    - Get configuration\n"
-               "  config list         - List all configurations\n\n"
-               "Navigation Commands:\n"
-               "  cd <path>           - Change directory\n"
-               "  cd ..               - Go to parent directory\n"
-               "  cd ~                - Go to home directory\n"
-               "  pwd                 - Show current directory\n"
-               "  ls / dir            - List directory contents";
-    } else {
-        return "Unknown category: " + category + "\n"
-               "Use 'help' to see available categories";
+    if (auto help = commands::categoryHelp(cat)) {
+        return *help;
     }
+    return "Unknown category: " + category + "\n"
+           "Use 'help' to see available categories";
 }
 
 void GitLiteApp::dashboard() {
@@ -769,42 +1055,39 @@ void GitLiteApp::createRepository() {
 }
 
 void GitLiteApp::showMyRepos() {
-    auto repos = storage_.listUserRepos(session_->username);
+    CatalogQuery query;
+    query.owner = session_->username;
+    auto repos = storage_.queryCatalog(query).entries;
     if (repos.empty()) {
         ui_.message("My Repos", {"No repositories yet. Create one first!"});
         return;
     }
     std::vector<std::string> items;
-    for (const auto &name : repos) {
-        std::string visibility = storage_.getVisibility(session_->username, name);
-        items.push_back(name + " [" + visibility + "]");
+    for (const auto &entry : repos) {
+        items.push_back(entry.name + " [" + entry.visibility + "]");
     }
     int choice = ui_.list("My Repositories", items);
     if (choice >= 0 && choice < static_cast<int>(repos.size())) {
-        manageRepository(session_->username, repos[choice], true);
+        manageRepository(session_->username, repos[choice].name, true);
     }
 }
 
 void GitLiteApp::browsePublicRepos() {
-    auto all = storage_.listAllRepos();
-    std::vector<std::pair<std::string, std::string>> publicRepos;
-    for (const auto &pair : all) {
-        if (repoService_.isPublic(pair.first, pair.second)) {
-            publicRepos.push_back(pair);
-        }
-    }
+    CatalogQuery query;
+    query.publicOnly = true;
+    auto publicRepos = storage_.queryCatalog(query).entries;
     if (publicRepos.empty()) {
         ui_.message("Public Repos", {"No public repositories available."});
         return;
     }
     std::vector<std::string> options;
     for (const auto &entry : publicRepos) {
-        options.push_back(entry.first + "/" + entry.second);
+        options.push_back(entry.owner + "/" + entry.name);
     }
     int choice = ui_.list("Public Repositories", options, "↑↓ Navigate | ↵ Select | Q Back");
     if (choice >= 0 && choice < static_cast<int>(publicRepos.size())) {
-        bool owner = publicRepos[choice].first == session_->username;
-        manageRepository(publicRepos[choice].first, publicRepos[choice].second, owner);
+        bool owner = publicRepos[choice].owner == session_->username;
+        manageRepository(publicRepos[choice].owner, publicRepos[choice].name, owner);
     }
 }
 
@@ -924,16 +1207,13 @@ void GitLiteApp::manageRepository(const std::string &owner, const std::string &r
 }
 
 void GitLiteApp::showStatus(const fs::path &repoRoot) {
-    auto entries = repoService_.readIndex(repoRoot);
-    if (entries.empty()) {
-        ui_.message("Status", {"Index empty. No staged files."});
+    WorkspaceStatus state;
+    std::string error;
+    if (!repoService_.status(repoRoot, state, error)) {
+        ui_.message("Status", {error}, 3);
         return;
     }
-    std::vector<std::string> lines = {"Staged files:"};
-    for (const auto &entry : entries) {
-        lines.push_back("  " + entry.first + " -> " + entry.second.substr(0, 12) + "...");
-    }
-    ui_.message("Status", lines);
+    ui_.message("Status", describeStatus(repoService_.currentBranch(repoRoot), state));
 }
 
 void GitLiteApp::addFileToRepo(const fs::path &repoRoot, bool canWrite) {
@@ -1025,8 +1305,15 @@ void GitLiteApp::checkoutBranch(const fs::path &repoRoot, bool canWrite) {
     }
     int choice = ui_.list("Checkout Branch", names);
     if (choice >= 0 && choice < static_cast<int>(names.size())) {
-        repoService_.setCurrentBranch(repoRoot, names[choice]);
-        ui_.message("Checkout", {"Switched to branch " + names[choice]});
+        CheckoutResult checkedOut;
+        std::string err;
+        if (repoService_.checkout(repoRoot, names[choice], checkedOut, err)) {
+            ui_.message("Checkout", {"Switched to branch " + names[choice],
+                                     std::to_string(checkedOut.filesWritten) + " file(s) written, " +
+                                         std::to_string(checkedOut.filesRemoved) + " removed."});
+        } else {
+            ui_.message("Checkout", {err}, 3);
+        }
     }
 }
 
@@ -1037,8 +1324,9 @@ void GitLiteApp::pushRepo(const fs::path &repoRoot, const std::string &owner, co
     }
     fs::path remoteRoot = storage_.root() / "_remotes" / owner / repo;
     std::string err;
-    if (repoService_.push(repoRoot, remoteRoot, err)) {
-        ui_.message("Push", {"Remote mirror updated."});
+    SyncResult result;
+    if (repoService_.push(repoRoot, remoteRoot, result, err)) {
+        ui_.message("Push", {describeSync("Pushed", result)});
     } else {
         ui_.message("Push", {err}, 3);
     }
@@ -1054,8 +1342,9 @@ void GitLiteApp::pullRepo(const fs::path &repoRoot,
     }
     fs::path remoteRoot = storage_.root() / "_remotes" / owner / repo;
     std::string err;
-    if (repoService_.pull(repoRoot, remoteRoot, err)) {
-        ui_.message("Pull", {"Repository refreshed from mirror."});
+    SyncResult result;
+    if (repoService_.pull(repoRoot, remoteRoot, result, err)) {
+        ui_.message("Pull", {describeSync("Pulled", result)});
     } else {
         ui_.message("Pull", {err}, 3);
     }
@@ -1075,18 +1364,28 @@ void GitLiteApp::viewCommitHistory(const fs::path &repoRoot) {
     if (branchChoice < 0 || branchChoice >= static_cast<int>(names.size())) {
         return;
     }
-    auto records = repoService_.history(repoRoot, names[branchChoice], 20);
-    if (records.empty()) {
-        ui_.message("Commit History", {"No commits recorded yet."});
-        return;
-    }
-    std::vector<std::string> lines;
-    lines.push_back("Branch: " + names[branchChoice]);
-    for (const auto &record : records) {
-        lines.push_back(record.id.substr(0, 10) + " | " + record.timestamp + " | " + record.author);
-        lines.push_back("  " + record.message);
+    const std::size_t pageSize = 20;
+    for (std::size_t skip = 0;; skip += pageSize) {
+        auto records = repoService_.history(repoRoot, names[branchChoice], pageSize + 1, skip);
+        if (records.empty()) {
+            ui_.message("Commit History", {skip == 0 ? "No commits recorded yet." : "No more commits."});
+            return;
+        }
+        bool more = records.size() > pageSize;
+        if (more) {
+            records.pop_back();
+        }
+        std::vector<std::string> lines;
+        lines.push_back("Branch: " + names[branchChoice]);
+        for (const auto &record : records) {
+            lines.push_back(record.id.substr(0, 10) + " | " + record.timestamp + " | " + record.author);
+            lines.push_back("  " + record.message);
+        }
+        ui_.message("Commit History", lines);
+        if (!more || !ui_.confirm("Show older commits?")) {
+            return;
+        }
     }
-    ui_.message("Commit History", lines);
 }
 
 void GitLiteApp::manageCollaborators(const std::string &owner, const std::string &repo, bool canManage) {
@@ -1147,8 +1446,7 @@ void GitLiteApp::toggleVisibility(const std::string &owner, const std::string &r
 }
 
 bool GitLiteApp::userExists(const std::string &username) {
-    auto users = storage_.loadUsers();
-    return std::any_of(users.begin(), users.end(), [&](const User &u) { return u.username == username; });
+    return storage_.findUser(username).has_value();
 }
 
 bool GitLiteApp::hasWriteAccess(const std::string &owner, const std::string &repo) {
@@ -1161,13 +1459,7 @@ bool GitLiteApp::hasWriteAccess(const std::string &owner, const std::string &rep
     if (session_->username == owner) {
         return true;
     }
-    auto perms = storage_.loadPermissions();
-    std::string key = owner + "/" + repo;
-    auto it = perms.find(key);
-    if (it == perms.end()) {
-        return false;
-    }
-    return it->second.count(session_->username) > 0;
+    return storage_.isCollaborator(owner, repo, session_->username);
 }
 
 bool GitLiteApp::parseRepoIdentifier(const std::string &raw,
@@ -1234,6 +1526,8 @@ bool GitLiteApp::resolveRepoContext(const std::optional<std::string> &repoOverri
                                     bool requireWriteAccess,
                                     RepoContext &ctx,
                                     std::string &error) {
+    static stats::Site site("GitLiteApp::resolveRepoContext");
+    stats::Timer timer(site);
     if (!session_) {
         error = "Error: Not logged in.";
         return false;
@@ -1299,6 +1593,9 @@ bool GitLiteApp::resolveRepoContext(const std::optional<std::string> &repoOverri
 std::string GitLiteApp::handleInitCommand() {
     fs::path glitePath = currentDir_ / ".glite";
     
+    if (!withinStorage(currentDir_)) {
+        return "Error: Path is outside the storage root.";
+    }
     if (fs::exists(glitePath)) {
         return "Error: Repository already initialized in this directory.";
     }
@@ -1347,15 +1644,16 @@ std::string GitLiteApp::handleListCommand() {
         return "Error: Not logged in.";
     }
     
-    auto repos = storage_.listUserRepos(session_->username);
+    CatalogQuery query;
+    query.owner = session_->username;
+    auto repos = storage_.queryCatalog(query).entries;
     if (repos.empty()) {
         return "No repositories found.";
     }
     
     std::string result = "Your repositories:\n";
-    for (const auto &repo : repos) {
-        std::string visibility = storage_.getVisibility(session_->username, repo);
-        result += "  " + repo + " [" + visibility + "]\n";
+    for (const auto &entry : repos) {
+        result += "  " + entry.name + " [" + entry.visibility + "]\n";
     }
     return result;
 }
@@ -1393,14 +1691,14 @@ std::string GitLiteApp::handleStatusCommand(const std::optional<std::string> &re
         return error;
     }
 
-    auto entries = repoService_.readIndex(ctx.root);
-    if (entries.empty()) {
-        return "No staged files.";
+    WorkspaceStatus state;
+    if (!repoService_.status(ctx.root, state, error)) {
+        return "Error: " + error;
     }
-    
-    std::string result = "Staged files:\n";
-    for (const auto &entry : entries) {
-        result += "  " + entry.first + "\n";
+
+    std::string result;
+    for (const auto &line : describeStatus(repoService_.currentBranch(ctx.root), state)) {
+        result += line + "\n";
     }
     return result;
 }
@@ -1447,6 +1745,45 @@ std::string GitLiteApp::handleAddCommand(const std::string &file,
         }
     }
 
+    // Directories and globs go through one batched, parallel index update.
+    auto stagePathspec = [&](const std::string &spec) {
+        std::vector<std::string> paths;
+        std::string stageError;
+        if (!repoService_.collectWorkspaceFiles(ctx.root, spec, paths, stageError)) {
+            return "Error: " + stageError;
+        }
+        if (paths.empty()) {
+            return std::string("Nothing to add (no matching files).");
+        }
+        StageResult staged;
+        if (!repoService_.addFiles(ctx.root, paths, staged, stageError)) {
+            return "Error: " + stageError;
+        }
+        std::string summary = "Added " + std::to_string(staged.staged.size()) + " file(s)";
+        if (!staged.unchanged.empty()) {
+            summary += ", " + std::to_string(staged.unchanged.size()) + " unchanged";
+        }
+        if (!staged.failed.empty()) {
+            summary += ", " + std::to_string(staged.failed.size()) + " failed (" + staged.failed.front().first +
+                       ": " + staged.failed.front().second + ")";
+        }
+        if (repoOverride) {
+            summary += " -> " + repoLabel;
+        }
+        return summary;
+    };
+
+    if (hasGlobCharacters(file)) {
+        // Globs match workspace paths, relative to the current directory when
+        // that is inside workspace/.
+        std::error_code hereEc;
+        fs::path here = fs::relative(currentDir_, workspacePath, hereEc);
+        if (!hereEc && !here.empty() && here != "." && !pathHasTraversal(here)) {
+            return stagePathspec((here / file).generic_string());
+        }
+        return stagePathspec(file);
+    }
+
     fs::path sourcePath;
     fs::path providedPath(file);
     if (providedPath.is_absolute()) {
@@ -1460,6 +1797,9 @@ std::string GitLiteApp::handleAddCommand(const std::string &file,
     if (!canonicalEc) {
         sourcePath = canonicalSource;
     }
+    if (!withinStorage(sourcePath)) {
+        return "Error: Path is outside the storage root.";
+    }
 
     if (!fs::exists(sourcePath)) {
         return "Error: File not found: " + sourcePath.string();
@@ -1469,6 +1809,65 @@ std::string GitLiteApp::handleAddCommand(const std::string &file,
     fs::path relativeToWorkspace = fs::relative(sourcePath, workspacePath, relEc);
     bool alreadyInWorkspace = !relEc && !pathHasTraversal(relativeToWorkspace);
 
+    if (fs::is_directory(sourcePath)) {
+        std::error_code rootEc;
+        fs::path rootPath = fs::weakly_canonical(ctx.root, rootEc);
+        if (rootEc) {
+            rootPath = ctx.root;
+        }
+        if (sourcePath == rootPath) {
+            return stagePathspec("");
+        }
+        if (alreadyInWorkspace) {
+            return stagePathspec(relativeToWorkspace.generic_string());
+        }
+        std::error_code insideEc;
+        fs::path insideRoot = fs::relative(sourcePath, rootPath, insideEc);
+        if (!insideEc && !pathHasTraversal(insideRoot)) {
+            return "Error: Only files under workspace/ can be staged.";
+        }
+        fs::path rootInside = fs::relative(rootPath, sourcePath, insideEc);
+        if (!insideEc && !pathHasTraversal(rootInside)) {
+            return "Error: Cannot add a directory that contains the repository.";
+        }
+
+        // A directory from outside is copied into the workspace first, the
+        // same way single files are.
+        fs::path destinationRoot = providedPath.is_absolute()
+                                       ? providedPath.filename()
+                                       : sanitizeRelativePath(providedPath.lexically_normal());
+        if (destinationRoot.empty()) {
+            destinationRoot = sourcePath.filename();
+        }
+        IgnoreRules ignore;
+        ignore.load(ctx.root);
+        std::error_code walkEc;
+        fs::recursive_directory_iterator it(sourcePath, fs::directory_options::skip_permission_denied, walkEc);
+        for (; !walkEc && it != fs::recursive_directory_iterator(); it.increment(walkEc)) {
+            fs::path relative = destinationRoot / it->path().lexically_relative(sourcePath);
+            bool isDirectory = it->is_directory();
+            if (ignore.ignored(relative.generic_string(), isDirectory)) {
+                if (isDirectory) {
+                    it.disable_recursion_pending();
+                }
+                continue;
+            }
+            if (isDirectory || !it->is_regular_file()) {
+                continue;
+            }
+            std::error_code copyEc;
+            fs::create_directories((workspacePath / relative).parent_path(), copyEc);
+            fs::copy_file(it->path(), workspacePath / relative, fs::copy_options::overwrite_existing, copyEc);
+            if (copyEc) {
+                return "Error: Failed to copy " + relative.generic_string() + " into workspace: " + copyEc.message();
+            }
+        }
+        if (walkEc) {
+            return "Error: " + walkEc.message();
+        }
+        return stagePathspec(destinationRoot.generic_string());
+    }
+
     fs::path repoRelativePath;
     if (alreadyInWorkspace) {
         repoRelativePath = relativeToWorkspace;
@@ -1540,24 +1939,87 @@ std::string GitLiteApp::handleCommitCommand(const std::string &message) {
     return "Error: " + error;
 }
 
-std::string GitLiteApp::handleLogCommand(const std::optional<std::string> &repoOverride) {
+std::string GitLiteApp::handleLogCommand(const std::optional<std::string> &repoOverride,
+                                         std::size_t limit,
+                                         std::size_t skip,
+                                         const std::string &range,
+                                         const std::string &path) {
     RepoContext ctx;
     std::string error;
     if (!resolveRepoContext(repoOverride, false, ctx, error)) {
         return error;
     }
     
-    std::string branch = repoService_.currentBranch(ctx.root);
-    auto records = repoService_.history(ctx.root, branch, 10);
-    
-    if (records.empty()) {
-        return "No commits yet.";
+    HistoryFilter filter;
+    std::string tip;
+    std::string result;
+    if (!range.empty()) {
+        std::size_t dots = range.find("..");
+        std::string base = range.substr(0, dots);
+        std::string target = range.substr(dots + 2);
+        for (const std::string *name : {&base, &target}) {
+            if (repoService_.resolveRef(ctx.root, *name).empty()) {
+                return "Error: Unknown branch or tag '" + *name + "'.";
+            }
+        }
+        tip = repoService_.resolveRef(ctx.root, target);
+        filter.exclude = repoService_.resolveRef(ctx.root, base);
+        result = "Commits on " + target + " not on " + base;
+    } else {
+        std::string branch = repoService_.currentBranch(ctx.root);
+        tip = repoService_.branchHead(ctx.root, branch);
+        result = "Commit history (" + branch + ")";
+    }
+    if (!path.empty()) {
+        filter.path = fs::path(path).lexically_normal().generic_string();
+        while (!filter.path.empty() && filter.path.back() == '/') {
+            filter.path.pop_back();
+        }
+        if (filter.path.empty() || filter.path == "." || filter.path == ".." || filter.path.rfind("../", 0) == 0 ||
+            fs::path(filter.path).is_absolute()) {
+            return "Error: Path is outside the workspace: " + path;
+        }
+        result += " touching " + filter.path;
+    }
+    result += ":\n";
+    std::size_t shown = 0;
+    bool more = false;
+    std::string unreadable;
+    // The walk stops one commit past the page, which tells us whether
+    // another page exists.
+    repoService_.walkHistory(ctx.root, tip, skip, filter, [&](const CommitView &commit) {
+        if (shown == limit) {
+            more = true;
+            return false;
+        }
+        if (!commit.readable) {
+            unreadable = std::string(commit.id);
+            return false;
+        }
+        ++shown;
+        result.append(commit.id.substr(0, 10)).append(" | ").append(commit.timestamp).append(" | ");
+        result.append(commit.author).append("\n  ").append(commit.message).append("\n");
+        return true;
+    });
+    if (!unreadable.empty()) {
+        return "Error: unreadable commit " + unreadable + ".";
     }
     
-    std::string result = "Commit history (" + branch + "):\n";
-    for (const auto &record : records) {
-        result += record.id.substr(0, 10) + " | " + record.timestamp + " | " + record.author + "\n";
-        result += "  " + record.message + "\n";
+    if (shown == 0 && !more) {
+        if (skip > 0) {
+            return "No more commits.";
+        }
+        return range.empty() && path.empty() ? "No commits yet." : "No matching commits.";
+    }
+    if (more) {
+        result += "(more: log -n " + std::to_string(limit) + " --skip " + std::to_string(skip + limit);
+        if (!range.empty()) {
+            result += " " + range;
+        }
+        if (!path.empty()) {
+            result += " -- " + path;
+        }
+        result += ")\n";
     }
     return result;
 }
@@ -1569,17 +2031,16 @@ std::string GitLiteApp::handleBranchListCommand(const std::optional<std::string>
         return error;
     }
     
-    auto branches = repoService_.listBranchesWithHead(ctx.root);
     std::string current = repoService_.currentBranch(ctx.root);
-    
-    if (branches.empty()) {
-        return "No branches found.";
-    }
-    
     std::string result = "Branches:\n";
-    for (const auto &pair : branches) {
-        std::string marker = (pair.first == current) ? "* " : "  ";
-        result += marker + pair.first + "\n";
+    bool any = false;
+    repoService_.forEachBranch(ctx.root, [&](const std::string &name, const std::string &) {
+        any = true;
+        result.append(name == current ? "* " : "  ").append(name).append("\n");
+        return true;
+    });
+    if (!any) {
+        return "No branches found.";
     }
     return result;
 }
@@ -1610,15 +2071,22 @@ std::string GitLiteApp::handleCheckoutCommand(const std::string &branch,
         return error;
     }
     
-    repoService_.setCurrentBranch(ctx.root, branch);
-    return "Switched to branch: " + branch;
+    CheckoutResult checkedOut;
+    if (!repoService_.checkout(ctx.root, branch, checkedOut, error)) {
+        return "Error: " + error;
+    }
+    if (checkedOut.alreadyOn) {
+        return "Already on branch: " + branch;
+    }
+    return "Switched to branch: " + branch + " (" + std::to_string(checkedOut.filesWritten) + " file(s) written, " +
+           std::to_string(checkedOut.filesRemoved) + " removed)";
 }
 
 void GitLiteApp::addMultiLineToTerminal(const std::string &text) {
     std::istringstream iss(text);
     std::string line;
-    while (std::getline(iss, line)) {
-        ui_.addTerminalLine(line);
+    TerminalUI::Pager pager(ui_);
+    while (std::getline(iss, line) && pager.add(line)) {
     }
 }
 
@@ -1639,10 +2107,27 @@ std::string GitLiteApp::handleMergeCommand(const std::string &branch,
         return error;
     }
     
-    if (repoService_.mergeBranch(ctx.root, branch, error)) {
-        return "Merged branch '" + branch + "' into current branch.";
+    MergeResult merged;
+    if (!repoService_.mergeBranch(ctx.root, branch, session_->username, merged, error)) {
+        return "Error: " + error;
     }
-    return "Error: " + error;
+    if (merged.upToDate) {
+        return "Already up to date with '" + branch + "'.";
+    }
+    if (merged.fastForward) {
+        return "Fast-forwarded to '" + branch + "' (" + merged.commitId.substr(0, 8) + "); " +
+               std::to_string(merged.filesWritten) + " file(s) written.";
+    }
+    if (!merged.conflicts.empty()) {
+        std::string result = "Merge of '" + branch + "' stopped with conflicts in:\n";
+        for (const auto &path : merged.conflicts) {
+            result += "  " + path + "\n";
+        }
+        result += "Edit these files, add them, then commit to finish the merge.";
+        return result;
+    }
+    return "Merged branch '" + branch + "' into current branch (" + merged.commitId.substr(0, 8) + "); " +
+           std::to_string(merged.filesWritten) + " file(s) updated.";
 }
 
 std::string GitLiteApp::handleRebaseCommand(const std::string &branch,
@@ -1697,6 +2182,61 @@ std::string GitLiteApp::handleDeleteBranchCommand(const std::string &branchName,
     return "Error: " + error;
 }
 
+std::string GitLiteApp::handleRepackCommand(bool all, const std::optional<std::string> &repoOverride) {
+    RepoContext ctx;
+    std::string error;
+    if (!resolveRepoContext(repoOverride, true, ctx, error)) {
+        return error;
+    }
+
+    RepackStats stats;
+    if (!repoService_.repack(ctx.root, all, stats, error)) {
+        return "Error: " + error;
+    }
+    if (stats.packedObjects == 0) {
+        return "Nothing to pack.";
+    }
+    std::string result = "Packed " + std::to_string(stats.packedObjects) + " objects (" +
+                         std::to_string(stats.removedLoose) + " loose removed";
+    if (stats.removedPacks > 0) {
+        result += ", " + std::to_string(stats.removedPacks) + " packs merged";
+    }
+    return result + ").";
+}
+
+std::string GitLiteApp::handleGcCommand(bool pruneNow, const std::optional<std::string> &repoOverride) {
+    RepoContext ctx;
+    std::string error;
+    if (!resolveRepoContext(repoOverride, true, ctx, error)) {
+        return error;
+    }
+    std::string name = ctx.root.filename().string();
+    auto done = runInBackground([this, root = ctx.root, name, pruneNow] {
+        RepackStats stats;
+        std::string error;
+        if (!repoService_.gc(root, pruneNow, stats, error)) {
+            return "Error: gc " + name + ": " + error;
+        }
+        if (stats.prunedObjects == 0 && stats.packedObjects == 0 && stats.keptRecent == 0 &&
+            stats.prunedChunks == 0) {
+            return "gc " + name + ": nothing to collect.";
+        }
+        std::string result = "gc " + name + ": pruned " + std::to_string(stats.prunedObjects) +
+                             " unreachable objects, packed " + std::to_string(stats.packedObjects) + " (" +
+                             std::to_string(stats.removedLoose) + " loose removed, " +
+                             std::to_string(stats.removedPacks) + " packs retired).";
+        if (stats.prunedChunks > 0) {
+            result += " Pruned " + std::to_string(stats.prunedChunks) + " unused chunks.";
+        }
+        if (stats.keptRecent > 0) {
+            result += " Kept " + std::to_string(stats.keptRecent) +
+                      " recent unreachable objects; 'gc --now' drops them too.";
+        }
+        return result;
+    });
+    return done ? *done : "gc " + name + " running in the background.";
+}
+
 // Collaboration commands
 std::string GitLiteApp::handlePermAddCommand(const std::string &repo, const std::string &user) {
     if (!session_) {
@@ -1799,7 +2339,11 @@ std::string GitLiteApp::handleForkCommand(const std::string &userRepo) {
     }
     
     fs::path destRepo = storage_.repoPath(session_->username, newRepoName);
-    repoService_.pull(destRepo, sourceRepo, error);
+    SyncResult result;
+    if (!repoService_.fork(destRepo, sourceRepo, result, error)) {
+        return "Error: " + error;
+    }
+    storage_.refreshCatalogEntry(session_->username, newRepoName);
     
     return "Forked '" + userRepo + "' to '" + session_->username + "/" + newRepoName + "'.";
 }
@@ -1826,16 +2370,18 @@ std::string GitLiteApp::handleTransferCommand(const std::string &repo, const std
     }
     
     // Move repository
-    fs::path oldPath = storage_.repoPath(session_->username, repo);
-    fs::path newPath = storage_.repoPath(newOwner, repo);
-    
-    if (fs::exists(newPath)) {
+    if (storage_.repoExists(newOwner, repo)) {
         return "Error: Repository already exists for user '" + newOwner + "'.";
     }
     
     try {
-        fs::create_directories(newPath.parent_path());
-        fs::rename(oldPath, newPath);
+        std::string error;
+        // Forks name this repository's objects by path, so they get their own
+        // copies before it moves.
+        if (!repoService_.detachForks(storage_.repoPath(session_->username, repo), error) ||
+            !storage_.transferRepo(session_->username, repo, newOwner, error)) {
+            return "Error: " + error;
+        }
         
         // Update permissions
         auto perms = storage_.loadPermissions();
@@ -1854,7 +2400,48 @@ std::string GitLiteApp::handleTransferCommand(const std::string &repo, const std
 }
 
 // Syncing commands
-std::string GitLiteApp::handlePushCommand() {
+bool GitLiteApp::resolveRemote(const fs::path &repoPath,
+                               const std::optional<std::string> &remote,
+                               std::optional<transport::RemoteUrl> &url,
+                               std::string &error) {
+    url.reset();
+    std::string configured;
+    if (remote) {
+        configured = *remote;
+    } else {
+        auto config = StorageManager::readRepoConfig(repoPath);
+        auto it = config.find("remote.url");
+        if (it == config.end()) {
+            return true;
+        }
+        configured = it->second;
+    }
+    transport::RemoteUrl parsed;
+    if (!transport::parseRemoteUrl(configured, parsed, error)) {
+        return false;
+    }
+    url = parsed;
+    return true;
+}
+
+bool GitLiteApp::remoteCredentials(const transport::RemoteUrl &url,
+                                   transport::Credentials &credentials,
+                                   std::string &error) {
+    credentials.user = url.user.empty() ? session_->username : url.user;
+    if (const char *password = std::getenv("GLITE_REMOTE_PASSWORD")) {
+        credentials.password = password;
+    } else {
+        credentials.password = ui_.prompt("Password for " + credentials.user + "@" + url.host + ":", true, 64);
+    }
+    if (credentials.password.empty()) {
+        error = "No password for " + credentials.user + "@" + url.host + "; set GLITE_REMOTE_PASSWORD.";
+        return false;
+    }
+    transport::rememberCredentials(url, credentials);
+    return true;
+}
+
+std::string GitLiteApp::handlePushCommand(const std::optional<std::string> &remote) {
     if (!session_) {
         return "Error: Not logged in.";
     }
@@ -1863,6 +2450,21 @@ std::string GitLiteApp::handlePushCommand() {
     if (repoPath.empty()) {
         return "Error: Not a GitLite repository. Run 'init' first.";
     }
+
+    std::optional<transport::RemoteUrl> url;
+    std::string error;
+    SyncResult result;
+    if (!resolveRemote(repoPath, remote, url, error)) {
+        return "Error: " + error;
+    }
+    if (url) {
+        transport::Credentials credentials;
+        if (!remoteCredentials(*url, credentials, error) ||
+            !transport::push(repoService_, repoPath, *url, credentials, result, error)) {
+            return "Error: " + error;
+        }
+        return describeSync("Pushed", result);
+    }
     
     // Find repo in storage
     std::string repoName = repoPath.filename().string();
@@ -1871,14 +2473,13 @@ std::string GitLiteApp::handlePushCommand() {
     }
     
     fs::path remoteRoot = storage_.root() / "_remotes" / session_->username / repoName;
-    std::string error;
-    if (repoService_.push(repoPath, remoteRoot, error)) {
-        return "Pushed to remote.";
+    if (repoService_.push(repoPath, remoteRoot, result, error)) {
+        return describeSync("Pushed", result);
     }
     return "Error: " + error;
 }
 
-std::string GitLiteApp::handlePullCommand() {
+std::string GitLiteApp::handlePullCommand(const std::optional<std::string> &remote) {
     if (!session_) {
         return "Error: Not logged in.";
     }
@@ -1887,33 +2488,88 @@ std::string GitLiteApp::handlePullCommand() {
     if (repoPath.empty()) {
         return "Error: Not a GitLite repository. Run 'init' first.";
     }
+
+    std::optional<transport::RemoteUrl> url;
+    std::string error;
+    SyncResult result;
+    if (!resolveRemote(repoPath, remote, url, error)) {
+        return "Error: " + error;
+    }
+    if (url) {
+        transport::Credentials credentials;
+        if (!remoteCredentials(*url, credentials, error) ||
+            !transport::pull(repoService_, repoPath, *url, credentials, result, error)) {
+            return "Error: " + error;
+        }
+        return describeSync("Pulled", result);
+    }
     
     std::string repoName = repoPath.filename().string();
     fs::path remoteRoot = storage_.root() / "_remotes" / session_->username / repoName;
     
-    std::string error;
-    if (repoService_.pull(repoPath, remoteRoot, error)) {
-        return "Pulled from remote.";
+    if (repoService_.pull(repoPath, remoteRoot, result, error)) {
+        return describeSync("Pulled", result);
     }
     return "Error: " + error;
 }
 
-std::string GitLiteApp::handleFetchCommand() {
-    return handlePullCommand(); // Simplified: fetch = pull for now
+std::string GitLiteApp::handleFetchCommand(const std::optional<std::string> &remote) {
+    if (!session_) {
+        return "Error: Not logged in.";
+    }
+
+    fs::path repoPath = getCurrentRepoPath();
+    if (repoPath.empty()) {
+        return "Error: Not a GitLite repository. Run 'init' first.";
+    }
+
+    std::optional<transport::RemoteUrl> url;
+    std::string error;
+    SyncResult result;
+    if (!resolveRemote(repoPath, remote, url, error)) {
+        return "Error: " + error;
+    }
+    if (url) {
+        transport::Credentials credentials;
+        if (!remoteCredentials(*url, credentials, error) ||
+            !transport::fetch(repoService_, repoPath, *url, credentials, result, error)) {
+            return "Error: " + error;
+        }
+        return describeSync("Fetched", result);
+    }
+
+    std::string repoName = repoPath.filename().string();
+    fs::path remoteRoot = storage_.root() / "_remotes" / session_->username / repoName;
+
+    if (repoService_.fetch(repoPath, remoteRoot, result, error)) {
+        return describeSync("Fetched", result);
+    }
+    return "Error: " + error;
 }
 
-std::string GitLiteApp::handleSyncCommand() {
-    std::string result = handleFetchCommand();
-    if (result.find("Error") == std::string::npos) {
-        return "Synced successfully.";
+std::string GitLiteApp::handleSyncCommand(const std::optional<std::string> &remote) {
+    // Integrate remote work first so the push below is a fast-forward.
+    std::string pulled = handlePullCommand(remote);
+    if (pulled.rfind("Error", 0) == 0) {
+        return pulled;
     }
-    return result;
+    std::string pushed = handlePushCommand(remote);
+    if (pushed.rfind("Error", 0) == 0) {
+        return pushed;
+    }
+    return "Pull: " + pulled + "\nPush: " + pushed;
 }
 
-std::string GitLiteApp::handleCloneCommand(const std::string &userRepo) {
+std::string GitLiteApp::handleCloneCommand(const std::string &userRepo, const transport::CloneOptions &options) {
     if (!session_) {
         return "Error: Not logged in.";
     }
+    if (transport::isRemoteUrl(userRepo)) {
+        return handleRemoteCloneCommand(userRepo, options);
+    }
+    if (options.blobless) {
+        return "Error: --filter=blob:none needs a gitlite:// URL; local clones share one disk already.";
+    }
     
     size_t pos = userRepo.find('/');
     if (pos == std::string::npos) {
@@ -1939,15 +2595,58 @@ std::string GitLiteApp::handleCloneCommand(const std::string &userRepo) {
     }
     
     try {
-        fs::create_directories(destRepo);
         std::string error;
-        repoService_.pull(destRepo, sourceRepo, error);
-        return "Cloned '" + userRepo + "' to current directory.";
+        SyncResult result;
+        if (!repoService_.clone(destRepo, sourceRepo, result, error, options.depth)) {
+            return "Error: " + error;
+        }
+        return "Cloned '" + userRepo + "' to current directory (" +
+               std::to_string(result.objectsTransferred) + " objects" +
+               (options.depth > 0 ? ", depth " + std::to_string(options.depth) : std::string()) + ").";
     } catch (const std::exception &ex) {
         return "Error: " + std::string(ex.what());
     }
 }
 
+std::string GitLiteApp::handleRemoteCloneCommand(const std::string &rawUrl, const transport::CloneOptions &options) {
+    transport::RemoteUrl url;
+    std::string error;
+    if (!transport::parseRemoteUrl(rawUrl, url, error)) {
+        return "Error: " + error;
+    }
+    // The recorded remote.url names the account, so later fetches of a
+    // partial clone's missing objects know whom to log in as.
+    if (url.user.empty()) {
+        url.user = session_->username;
+    }
+    fs::path destRepo = currentDir_ / url.repo;
+    // A directory left by an interrupted clone of the same URL is resumed.
+    if (fs::exists(destRepo)) {
+        auto config = StorageManager::readRepoConfig(destRepo);
+        auto it = config.find("remote.url");
+        bool started = !repoService_.branchHead(destRepo, repoService_.currentBranch(destRepo)).empty();
+        if (it == config.end() || it->second != url.toString() || started) {
+            return "Error: Directory '" + url.repo + "' already exists.";
+        }
+    }
+
+    transport::Credentials credentials;
+    SyncResult result;
+    if (!remoteCredentials(url, credentials, error) ||
+        !transport::clone(repoService_, destRepo, url, credentials, result, error, options)) {
+        return "Error: " + error;
+    }
+    std::string mode;
+    if (options.depth > 0) {
+        mode += ", depth " + std::to_string(options.depth);
+    }
+    if (options.blobless) {
+        mode += ", file contents on demand";
+    }
+    return "Cloned '" + url.toString() + "' to current directory (" + std::to_string(result.objectsTransferred) +
+           " objects" + mode + ").";
+}
+
 // Repository management
 std::string GitLiteApp::handleDeleteCommand(const std::string &repo) {
     if (!session_) {
@@ -1963,8 +2662,12 @@ std::string GitLiteApp::handleDeleteCommand(const std::string &repo) {
     }
     
     try {
-        fs::path repoPath = storage_.repoPath(session_->username, repo);
-        fs::remove_all(repoPath);
+        std::string error;
+        // Forks borrowing this repository's objects get their own copies first.
+        if (!repoService_.detachForks(storage_.repoPath(session_->username, repo), error) ||
+            !storage_.deleteRepo(session_->username, repo, error)) {
+            return "Error: " + error;
+        }
         
         // Remove from permissions
         auto perms = storage_.loadPermissions();
@@ -2037,10 +2740,10 @@ std::string GitLiteApp::handleViewCommand(const std::string &userRepo) {
     result += "Visibility: " + storage_.getVisibility(owner, repo) + "\n";
     result += "Branches:\n";
     
-    auto branches = repoService_.listBranchesWithHead(repoPath);
-    for (const auto &pair : branches) {
-        result += "  " + pair.first + "\n";
-    }
+    repoService_.forEachBranch(repoPath, [&result](const std::string &name, const std::string &) {
+        result.append("  ").append(name).append("\n");
+        return true;
+    });
     
     return result;
 }
@@ -2059,13 +2762,34 @@ std::string GitLiteApp::handleRmCommand(const std::string &file) {
     return "Error: " + error;
 }
 
-std::string GitLiteApp::handleDiffCommand() {
+std::string GitLiteApp::handleDiffCommand(const std::vector<std::string> &args) {
     fs::path repoPath = getCurrentRepoPath();
     if (repoPath.empty()) {
         return "Error: Not a GitLite repository. Run 'init' first.";
     }
     
-    return repoService_.getDiff(repoPath);
+    bool staged = !args.empty() && (args[0] == "--staged" || args[0] == "--cached");
+    if ((staged && args.size() != 1) || (!staged && args.size() != 0 && args.size() != 2)) {
+        return "Error: Usage: diff [--staged] | diff <old-commit> <new-commit>";
+    }
+    std::string error;
+    TerminalStream stream(ui_);
+    bool ok = false;
+    if (args.size() == 2) {
+        for (const auto &commit : args) {
+            if (repoService_.getCommit(repoPath, commit).id.empty()) {
+                return "Error: Commit " + commit + " not found.";
+            }
+        }
+        ok = repoService_.diffCommitContents(repoPath, args[0], args[1], stream.sink(), error);
+    } else {
+        ok = repoService_.diffWorkspace(repoPath, staged, stream.sink(), error);
+    }
+    stream.flush();
+    if (!ok) {
+        return "Error: " + error;
+    }
+    return stream.count() == 0 ? "No differences." : std::string();
 }
 
 std::string GitLiteApp::handleResetCommand(const std::string &file) {
@@ -2106,17 +2830,22 @@ std::string GitLiteApp::handleShowCommand(const std::string &commitHash) {
         return "Error: Commit not found.";
     }
     
-    std::string result = "Commit: " + record.id + "\n";
-    result += "Author: " + record.author + "\n";
-    result += "Date: " + record.timestamp + "\n";
-    result += "Branch: " + record.branch + "\n";
-    result += "Message: " + record.message + "\n";
-    result += "Files:\n";
-    for (const auto &file : record.files) {
-        result += "  " + file.first + "\n";
+    TerminalStream stream(ui_);
+    textdiff::LineSink sink = stream.sink();
+    sink("Commit: " + record.id);
+    if (!record.parent2.empty()) {
+        sink("Merge: " + record.parent.substr(0, 8) + " " + record.parent2.substr(0, 8));
     }
-    
-    return result;
+    sink("Author: " + record.author);
+    sink("Date: " + record.timestamp);
+    sink("Branch: " + record.branch);
+    sink("Message: " + record.message);
+    sink("");
+    // Merge commits are shown against their first parent.
+    std::string error;
+    bool ok = repoService_.diffCommitContents(repoPath, record.parent, record.id, sink, error);
+    stream.flush();
+    return ok ? std::string() : "Error: " + error;
 }
 
 std::string GitLiteApp::handleRevertCommand(const std::string &commitHash) {
@@ -2211,20 +2940,35 @@ std::string GitLiteApp::handleRemoveAdminCommand(const std::string &username) {
     return "User '" + username + "' demoted to regular user.";
 }
 
-std::string GitLiteApp::handleReposAllCommand() {
-    if (!session_ || session_->role != "admin") {
+std::string GitLiteApp::handleReposCommand(const CatalogQuery &query) {
+    if (!session_) {
+        return "Error: Not logged in.";
+    }
+    if (!query.publicOnly && session_->role != "admin") {
         return "Error: Only admins can list all repositories.";
     }
     
-    auto all = storage_.listAllRepos();
-    if (all.empty()) {
-        return "No repositories found.";
+    auto page = storage_.queryCatalog(query);
+    if (page.entries.empty()) {
+        return page.total == 0 ? "No repositories found." : "No repositories on this page.";
     }
     
-    std::string result = "All repositories:\n";
-    for (const auto &pair : all) {
-        std::string visibility = storage_.getVisibility(pair.first, pair.second);
-        result += "  " + pair.first + "/" + pair.second + " [" + visibility + "]\n";
+    std::string result = query.publicOnly ? "Public repositories:\n" : "All repositories:\n";
+    for (const auto &entry : page.entries) {
+        result += "  " + entry.owner + "/" + entry.name + " [" + entry.visibility + "]";
+        if (entry.lastCommit > 0) {
+            result += "  last commit " + gitlite::util::formatTimestamp(entry.lastCommit);
+        }
+        result += "  " + std::to_string((entry.size + 1023) / 1024) + " KiB\n";
+    }
+    std::size_t shown = query.skip + page.entries.size();
+    if (page.total > page.entries.size()) {
+        result += "Showing " + std::to_string(query.skip + 1) + "-" + std::to_string(shown) + " of " +
+                  std::to_string(page.total) + ".";
+        if (shown < page.total) {
+            result += " Use --skip " + std::to_string(shown) + " for more.";
+        }
+        result += "\n";
     }
     return result;
 }
@@ -2234,23 +2978,178 @@ std::string GitLiteApp::handleVersionCommand() {
     return "GitLite v1.0.0 - Offline Terminal GitHub Clone";
 }
 
+std::string GitLiteApp::handleStatsCommand(const std::vector<std::string> &args) {
+    // A server's counters cover every session, and a trace path is a file
+    // on the server.
+    if (!ownedStorage_ && session_->role != "admin") {
+        return "Error: Only admins can use stats on a server.";
+    }
+    std::string error;
+    if (args.size() == 1 && (args[0] == "on" || args[0] == "off")) {
+        stats::setEnabled(args[0] == "on");
+        return std::string("Instrumentation ") + (args[0] == "on" ? "on." : "off.");
+    }
+    if (args.size() == 1 && args[0] == "reset") {
+        stats::reset();
+        recentCommands_.clear();
+        return "Instrumentation counters reset.";
+    }
+    if (args.size() == 2 && args[0] == "trace" && args[1] == "off") {
+        if (!trace_) {
+            return "Error: No trace is being recorded.";
+        }
+        std::string path = trace_->path().string();
+        std::size_t events = trace_->size();
+        if (!finishTrace(error)) {
+            return "Error: " + error;
+        }
+        return "Wrote " + std::to_string(events) + " trace events to " + path + ".";
+    }
+    if (args.size() == 2 && args[0] == "trace") {
+        fs::path path = args[1];
+        if (path.is_relative()) {
+            path = currentDir_ / path;
+        }
+        if (!withinStorage(path)) {
+            return "Error: Path is outside the storage root.";
+        }
+        if (!startTrace(path, error)) {
+            return "Error: " + error;
+        }
+        return "Tracing this session to " + path.string() + " (instrumentation on).";
+    }
+    if (!args.empty()) {
+        return "Error: Usage: stats [on|off|reset|trace <file>|trace off]";
+    }
+
+    if (!stats::enabled()) {
+        return "Instrumentation is off. Run 'stats on' (or set GLITE_STATS=1) to start counting.";
+    }
+    auto snap = stats::snapshot();
+    std::ostringstream out;
+    char line[160];
+    out << "Counters (process-wide, since start or 'stats reset'):\n";
+    for (std::size_t i = 0; i < snap.counters.size(); ++i) {
+        std::snprintf(line, sizeof(line), "  %-18s %14llu\n", stats::counterName(static_cast<stats::Counter>(i)),
+                      static_cast<unsigned long long>(snap.counters[i]));
+        out << line;
+    }
+    std::snprintf(line, sizeof(line), "  %-18s %s\n", "sha256 backend", hashing::sha256Backend());
+    out << line;
+    if (!snap.sites.empty()) {
+        std::snprintf(line, sizeof(line), "\n%-40s %9s %12s %10s\n", "Timers", "calls", "total ms", "max ms");
+        out << line;
+        for (const auto &site : snap.sites) {
+            std::snprintf(line, sizeof(line), "  %-38s %9llu %12.3f %10.3f\n", site.name.c_str(),
+                          static_cast<unsigned long long>(site.calls), site.totalNs / 1e6, site.maxNs / 1e6);
+            out << line;
+        }
+    }
+    if (!recentCommands_.empty()) {
+        out << "\nRecent commands (this session):\n";
+        for (const auto &[command, ms] : recentCommands_) {
+            std::snprintf(line, sizeof(line), "  %10.3f ms  %s\n", ms, command.substr(0, 60).c_str());
+            out << line;
+        }
+    }
+    if (trace_) {
+        out << "\nTracing to " << trace_->path().string() << " (" << trace_->size() << " events).\n";
+    }
+    std::string text = out.str();
+    text.pop_back();
+    return text;
+}
+
+bool GitLiteApp::startTrace(const fs::path &path, std::string &error) {
+    if (trace_) {
+        error = "A trace is already being recorded to " + trace_->path().string() + ".";
+        return false;
+    }
+    std::ofstream probe(path, std::ios::app);
+    if (!probe) {
+        error = "Unable to write trace to " + path.string() + ".";
+        return false;
+    }
+    trace_ = std::make_unique<stats::Trace>(path);
+    stats::setEnabled(true);
+    return true;
+}
+
+bool GitLiteApp::finishTrace(std::string &error) {
+    if (!trace_) {
+        return true;
+    }
+    std::unique_ptr<stats::Trace> trace = std::move(trace_);
+    return trace->write(error);
+}
+
 std::string GitLiteApp::handleConfigCommand(const std::vector<std::string> &args) {
+    const std::string usage = "Usage: config set|get|list <key> [value]";
     if (args.empty()) {
-        return "Usage: config set|get|list <key> [value]";
+        return usage;
     }
-    
+
+    bool isSet = args[0] == "set";
+    if (!(args[0] == "list" || (args[0] == "get" && args.size() >= 2) || (isSet && args.size() >= 3))) {
+        return usage;
+    }
+
+    RepoContext ctx;
+    std::string error;
+    if (!resolveRepoContext(std::nullopt, isSet, ctx, error)) {
+        return error;
+    }
+
+    auto config = StorageManager::readRepoConfig(ctx.root);
     if (args[0] == "list") {
-        return "Config system not yet implemented.";
-    } else if (args[0] == "get" && args.size() >= 2) {
-        return "Config '" + args[1] + "' not found.";
-    } else if (args[0] == "set" && args.size() >= 3) {
-        return "Config '" + args[1] + "' set to '" + args[2] + "'.";
+        if (config.empty()) {
+            return "No configuration set.";
+        }
+        std::string result = "Repository configuration:\n";
+        for (const auto &entry : config) {
+            result += "  " + entry.first + "=" + entry.second + "\n";
+        }
+        return result;
     }
-    
-    return "Usage: config set|get|list <key> [value]";
+    if (args[0] == "get") {
+        auto it = config.find(args[1]);
+        if (it == config.end()) {
+            return "Config '" + args[1] + "' not found.";
+        }
+        return args[1] + "=" + it->second;
+    }
+
+    static const std::set<std::string> reserved = {"name", "owner", "created"};
+    if (reserved.count(args[1]) > 0) {
+        return "Error: '" + args[1] + "' is managed by GitLite and cannot be changed.";
+    }
+    std::string value = args[2];
+    for (size_t i = 3; i < args.size(); ++i) {
+        value += " " + args[i];
+    }
+    config[args[1]] = value;
+    if (!StorageManager::writeRepoConfig(ctx.root, config)) {
+        return "Error: Failed to write configuration.";
+    }
+    return "Config '" + args[1] + "' set to '" + value + "'.";
 }
 
 // Navigation commands
+bool GitLiteApp::withinStorage(const fs::path &path) const {
+    if (!confined_) {
+        return true;
+    }
+    // Both sides resolved, so neither ".." nor a symlink can lead out.
+    std::error_code ec;
+    fs::path root = fs::weakly_canonical(storage_.root(), ec);
+    fs::path target = fs::weakly_canonical(fs::absolute(path, ec), ec);
+    if (ec) {
+        return false;
+    }
+    fs::path relative = target.lexically_relative(root);
+    return !relative.empty() && *relative.begin() != "..";
+}
+
 std::string GitLiteApp::handleCdCommand(const std::string &path) {
     fs::path targetPath;
     
@@ -2260,7 +3159,7 @@ std::string GitLiteApp::handleCdCommand(const std::string &path) {
     } else if (path == "." || path == "./") {
         return "Already in: " + currentDir_.string();
     } else if (path == "~" || path == "~/" || path.empty()) {
-        targetPath = storage_.root().parent_path();
+        targetPath = confined_ ? storage_.root() : storage_.root().parent_path();
     } else if (fs::path(path).is_absolute()) {
         targetPath = fs::path(path);
     } else {
@@ -2286,6 +3185,9 @@ std::string GitLiteApp::handleCdCommand(const std::string &path) {
     if (!fs::is_directory(targetPath)) {
         return "Error: Not a directory: " + path;
     }
+    if (!withinStorage(targetPath)) {
+        return "Error: Path is outside the storage root.";
+    }
     
     currentDir_ = targetPath;
     return "Changed to: " + currentDir_.string();
@@ -2298,6 +3200,9 @@ std::string GitLiteApp::handlePwdCommand() {
 std::string GitLiteApp::handleLsCommand() {
     std::string result = "Contents of: " + currentDir_.string() + "\n\n";
     
+    if (!withinStorage(currentDir_)) {
+        return "Error: Path is outside the storage root.";
+    }
     if (!fs::exists(currentDir_)) {
         return "Error: Directory does not exist.";
     }
@@ -1,30 +1,89 @@
 #pragma once
 
 #include "repo_service.hpp"
+#include "sidebar_feed.hpp"
+#include "stats.hpp"
 #include "storage_manager.hpp"
 #include "terminal_ui.hpp"
+#include "thread_pool.hpp"
+#include "transport.hpp"
 
+#include <deque>
 #include <filesystem>
+#include <memory>
+#include <mutex>
 #include <optional>
 #include <string>
+#include <vector>
+
+// Options for running commands without the interactive UI.
+struct BatchOptions {
+    std::string username;
+    std::string password;
+    std::vector<std::string> commands;
+    bool json = false;
+    bool keepGoing = false;
+};
 
 class GitLiteApp {
 public:
-    GitLiteApp();
+    // A headless app never initialises ncurses; only runBatch() is usable.
+    explicit GitLiteApp(bool headless = false);
+    // Shares `storage` with other apps, e.g. one per server session. The
+    // storage must outlive the app.
+    GitLiteApp(StorageManager &storage, bool headless);
+    // Writes out a trace started with `stats trace`.
+    ~GitLiteApp();
 
     void run();
 
+    // Logs in once and runs each command as if typed at the terminal prompt.
+    // Returns the process exit status: 0 if every command succeeded, 1 if a
+    // command reported an error, 2 if the login failed.
+    int runBatch(const BatchOptions &options);
+
+    bool login(const std::string &username, const std::string &password, std::string &error);
+    bool loggedIn() const { return session_.has_value(); }
+    // Runs one command line headlessly and returns its output lines. Returns
+    // false when the command reported an error. `exit` and `logout` end the
+    // session; check loggedIn() afterwards.
+    bool runCommand(const std::string &command, std::vector<std::string> &output);
+    // Keeps every path a command touches under the storage root, and starts
+    // there. The server sets this for remote sessions.
+    void confineToStorage();
+
 private:
-    StorageManager storage_;
+    std::unique_ptr<StorageManager> ownedStorage_;
+    StorageManager &storage_;
     RepoService repoService_;
     TerminalUI ui_;
     std::optional<User> session_;
     std::filesystem::path currentDir_;
+    bool confined_ = false;
+    // Set while `stats trace` is collecting for this session.
+    std::unique_ptr<stats::Trace> trace_;
+    // Wall time of this session's latest commands, newest last.
+    std::deque<std::pair<std::string, double>> recentCommands_;
+    // Started with the split screen; batch and server apps never need it.
+    std::unique_ptr<SidebarFeed> sidebarFeed_;
+    // Lines from commands finished in the background (gc), printed at the
+    // prompt's next idle poll.
+    std::mutex backgroundMutex_;
+    std::vector<std::string> backgroundOutput_;
+    // Declared last so running jobs finish before the state they use goes.
+    std::unique_ptr<ThreadPool> backgroundJobs_;
 
     void showLanding();
     void handleSignup();
     void handleLogin();
+    bool authenticate(const std::string &username, const std::string &password, std::string &error);
     void terminalMode();
+    // Runs one command line; returns false when the command ends the session.
+    // Times the command when instrumentation is on.
+    bool executeCommand(const std::string &command);
+    // Looks the command up in the registry and runs its handler.
+    bool dispatchCommand(const std::string &command);
+    struct CommandHandlers;
     void dashboard();
 
     void createRepository();
@@ -33,7 +92,17 @@ private:
     void showHelp();
     std::string getHelpCategories();
     std::string getHelpForCategory(const std::string &category);
+    // Asks the sidebar feed for a refresh and draws what it has now.
     void updateSidebar();
+    // Idle hook for the prompt: draws a sidebar snapshot the feed finished
+    // since, and prints what background jobs reported.
+    bool onIdle();
+    bool pollSidebar();
+    // Runs `job` on the background thread in the terminal and returns
+    // nullopt; batch and server sessions want results in order, so there it
+    // runs inline and its line is returned.
+    std::optional<std::string> runInBackground(std::function<std::string()> job);
+    void drawSidebarSnapshot();
     
     // Command handlers
     std::string handleInitCommand();
@@ -44,7 +113,13 @@ private:
     std::string handleStatusCommand(const std::optional<std::string> &repoOverride = std::nullopt);
     std::string handleAddCommand(const std::string &file, const std::optional<std::string> &repoOverride = std::nullopt);
     std::string handleCommitCommand(const std::string &message);
-    std::string handleLogCommand(const std::optional<std::string> &repoOverride = std::nullopt);
+    // `range` is "<a>..<b>": commits on b that a does not reach. `path`
+    // limits the log to commits that changed it.
+    std::string handleLogCommand(const std::optional<std::string> &repoOverride = std::nullopt,
+                                 std::size_t limit = 10,
+                                 std::size_t skip = 0,
+                                 const std::string &range = {},
+                                 const std::string &path = {});
     std::string handleBranchListCommand(const std::optional<std::string> &repoOverride = std::nullopt);
     std::string handleBranchCreateCommand(const std::string &branchName,
                                           const std::optional<std::string> &repoOverride = std::nullopt);
@@ -59,6 +134,11 @@ private:
                                           const std::optional<std::string> &repoOverride = std::nullopt);
     std::string handleDeleteBranchCommand(const std::string &branchName,
                                           const std::optional<std::string> &repoOverride = std::nullopt);
+    std::string handleRepackCommand(bool all, const std::optional<std::string> &repoOverride = std::nullopt);
+    std::string handleGcCommand(bool pruneNow, const std::optional<std::string> &repoOverride = std::nullopt);
+    std::string handleStatsCommand(const std::vector<std::string> &args);
+    bool startTrace(const std::filesystem::path &path, std::string &error);
+    bool finishTrace(std::string &error);
     
     // Collaboration commands
     std::string handlePermAddCommand(const std::string &repo, const std::string &user);
@@ -68,11 +148,19 @@ private:
     std::string handleTransferCommand(const std::string &repo, const std::string &newOwner);
     
     // Syncing commands
-    std::string handlePushCommand();
-    std::string handlePullCommand();
-    std::string handleFetchCommand();
-    std::string handleSyncCommand();
-    std::string handleCloneCommand(const std::string &userRepo);
+    // With a gitlite:// URL, or remote.url in the repo config, these talk to
+    // a GitLite server; otherwise they sync with the mirror under _remotes/.
+    std::string handlePushCommand(const std::optional<std::string> &remote = std::nullopt);
+    std::string handlePullCommand(const std::optional<std::string> &remote = std::nullopt);
+    std::string handleFetchCommand(const std::optional<std::string> &remote = std::nullopt);
+    std::string handleSyncCommand(const std::optional<std::string> &remote = std::nullopt);
+    std::string handleCloneCommand(const std::string &userRepo, const transport::CloneOptions &options);
+    std::string handleRemoteCloneCommand(const std::string &rawUrl, const transport::CloneOptions &options);
+    bool resolveRemote(const std::filesystem::path &repoPath,
+                       const std::optional<std::string> &remote,
+                       std::optional<transport::RemoteUrl> &url,
+                       std::string &error);
+    bool remoteCredentials(const transport::RemoteUrl &url, transport::Credentials &credentials, std::string &error);
     
     // Repository management
     std::string handleDeleteCommand(const std::string &repo);
@@ -84,7 +172,7 @@ private:
     
     // File operations
     std::string handleRmCommand(const std::string &file);
-    std::string handleDiffCommand();
+    std::string handleDiffCommand(const std::vector<std::string> &args);
     std::string handleResetCommand(const std::string &file);
     std::string handleIgnoreCommand(const std::string &pattern);
     
@@ -101,9 +189,12 @@ private:
     // Admin commands
     std::string handleMakeAdminCommand(const std::string &username);
     std::string handleRemoveAdminCommand(const std::string &username);
-    std::string handleReposAllCommand();
+    std::string handleReposCommand(const CatalogQuery &query);
     
     // Navigation commands
+    // False when the session is confined and `path` resolves outside the
+    // storage root.
+    bool withinStorage(const std::filesystem::path &path) const;
     std::string handleCdCommand(const std::string &path);
     std::string handlePwdCommand();
     std::string handleLsCommand();
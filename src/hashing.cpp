@@ -1,23 +1,278 @@
 #include "hashing.hpp"
 
+#include "stats.hpp"
+
+#include <algorithm>
+#include <cstdlib>
 #include <fstream>
-#include <iomanip>
-#include <sstream>
+#include <numeric>
 #include <stdexcept>
 #include <vector>
 
 #include <sodium.h>
 
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#define GITLITE_SHA_X86 1
+#include <cpuid.h>
+#include <immintrin.h>
+#elif defined(__aarch64__) && (defined(__ARM_FEATURE_SHA2) || defined(__ARM_FEATURE_CRYPTO))
+#define GITLITE_SHA_ARM 1
+#include <arm_neon.h>
+#if defined(__linux__)
+#include <asm/hwcap.h>
+#include <sys/auxv.h>
+#endif
+#endif
+
 namespace {
 
-std::string toHex(const unsigned char *data, std::size_t length) {
-    std::ostringstream oss;
-    for (std::size_t i = 0; i < length; ++i) {
-        oss << std::hex << std::setw(2) << std::setfill('0') << static_cast<int>(data[i]);
+constexpr std::size_t kReadWindow = 64 * 1024;
+constexpr std::size_t kBlockBytes = 64;
+
+struct HexTable {
+    char pairs[512] = {};
+    signed char values[256] = {};
+};
+
+constexpr HexTable makeHexTable() {
+    HexTable table;
+    const char digits[] = "0123456789abcdef";
+    for (int i = 0; i < 256; ++i) {
+        table.pairs[2 * i] = digits[i >> 4];
+        table.pairs[2 * i + 1] = digits[i & 15];
+        table.values[i] = -1;
+    }
+    for (int i = 0; i < 10; ++i) {
+        table.values['0' + i] = static_cast<signed char>(i);
+    }
+    for (int i = 0; i < 6; ++i) {
+        table.values['a' + i] = static_cast<signed char>(10 + i);
+        table.values['A' + i] = static_cast<signed char>(10 + i);
+    }
+    return table;
+}
+
+constexpr HexTable kHex = makeHexTable();
+
+alignas(16) constexpr std::uint32_t kRoundConstants[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2,
+};
+
+constexpr std::uint32_t kInitialState[8] = {
+    0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19,
+};
+
+using CompressFn = void (*)(std::uint32_t *state, const unsigned char *data, std::size_t blocks);
+// Two independent messages, `blocks` blocks each.
+using Compress2Fn = void (*)(std::uint32_t *stateA,
+                             const unsigned char *dataA,
+                             std::uint32_t *stateB,
+                             const unsigned char *dataB,
+                             std::size_t blocks);
+
+#if GITLITE_SHA_X86
+
+// Follows Intel's SHA extensions reference: the state is kept as ABEF/CDGH
+// halves, each step runs four rounds and the schedule for later steps is
+// computed alongside. With two lanes the compiler interleaves independent
+// instruction chains, so the rounds of one message fill the latency of the
+// other's.
+template <int Lanes>
+__attribute__((target("sha,sse4.1"))) inline void shaNiBlocks(std::uint32_t *const *states,
+                                                             const unsigned char *const *data,
+                                                             std::size_t blocks) {
+    const __m128i byteSwap = _mm_set_epi64x(0x0c0d0e0f08090a0bULL, 0x0405060700010203ULL);
+    __m128i abef[Lanes];
+    __m128i cdgh[Lanes];
+    for (int l = 0; l < Lanes; ++l) {
+        __m128i dcba = _mm_shuffle_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i *>(states[l])), 0xB1);
+        __m128i efgh = _mm_shuffle_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i *>(states[l] + 4)), 0x1B);
+        abef[l] = _mm_alignr_epi8(dcba, efgh, 8);
+        cdgh[l] = _mm_blend_epi16(efgh, dcba, 0xF0);
+    }
+    for (std::size_t block = 0; block < blocks; ++block) {
+        __m128i savedAbef[Lanes];
+        __m128i savedCdgh[Lanes];
+        __m128i msg[Lanes][4];
+        for (int l = 0; l < Lanes; ++l) {
+            savedAbef[l] = abef[l];
+            savedCdgh[l] = cdgh[l];
+            const unsigned char *in = data[l] + block * kBlockBytes;
+            for (int i = 0; i < 4; ++i) {
+                msg[l][i] = _mm_shuffle_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i *>(in + 16 * i)), byteSwap);
+            }
+        }
+#pragma GCC unroll 16
+        for (int g = 0; g < 16; ++g) {
+            const __m128i k = _mm_load_si128(reinterpret_cast<const __m128i *>(kRoundConstants + 4 * g));
+            for (int l = 0; l < Lanes; ++l) {
+                __m128i *m = msg[l];
+                __m128i w = _mm_add_epi32(m[g & 3], k);
+                cdgh[l] = _mm_sha256rnds2_epu32(cdgh[l], abef[l], w);
+                if (g >= 3 && g <= 14) {
+                    __m128i carry = _mm_alignr_epi8(m[g & 3], m[(g + 3) & 3], 4);
+                    m[(g + 1) & 3] = _mm_sha256msg2_epu32(_mm_add_epi32(m[(g + 1) & 3], carry), m[g & 3]);
+                }
+                abef[l] = _mm_sha256rnds2_epu32(abef[l], cdgh[l], _mm_shuffle_epi32(w, 0x0E));
+                if (g >= 1 && g <= 12) {
+                    m[(g + 3) & 3] = _mm_sha256msg1_epu32(m[(g + 3) & 3], m[g & 3]);
+                }
+            }
+        }
+        for (int l = 0; l < Lanes; ++l) {
+            abef[l] = _mm_add_epi32(abef[l], savedAbef[l]);
+            cdgh[l] = _mm_add_epi32(cdgh[l], savedCdgh[l]);
+        }
+    }
+    for (int l = 0; l < Lanes; ++l) {
+        __m128i feba = _mm_shuffle_epi32(abef[l], 0x1B);
+        __m128i dchg = _mm_shuffle_epi32(cdgh[l], 0xB1);
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(states[l]), _mm_blend_epi16(feba, dchg, 0xF0));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(states[l] + 4), _mm_alignr_epi8(dchg, feba, 8));
+    }
+}
+
+void shaNiCompress(std::uint32_t *state, const unsigned char *data, std::size_t blocks) {
+    shaNiBlocks<1>(&state, &data, blocks);
+}
+
+void shaNiCompress2(std::uint32_t *stateA,
+                    const unsigned char *dataA,
+                    std::uint32_t *stateB,
+                    const unsigned char *dataB,
+                    std::size_t blocks) {
+    std::uint32_t *states[2] = {stateA, stateB};
+    const unsigned char *data[2] = {dataA, dataB};
+    shaNiBlocks<2>(states, data, blocks);
+}
+
+bool cpuHasShaNi() {
+    unsigned int eax = 0, ebx = 0, ecx = 0, edx = 0;
+    if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx) || !(ecx & (1u << 19)) || !(ecx & (1u << 9))) {
+        return false;
+    }
+    return __get_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx) && (ebx & (1u << 29));
+}
+
+#elif GITLITE_SHA_ARM
+
+void armCompress(std::uint32_t *state, const unsigned char *data, std::size_t blocks) {
+    uint32x4_t abcd = vld1q_u32(state);
+    uint32x4_t efgh = vld1q_u32(state + 4);
+    for (std::size_t block = 0; block < blocks; ++block) {
+        const uint32x4_t savedAbcd = abcd;
+        const uint32x4_t savedEfgh = efgh;
+        const unsigned char *in = data + block * kBlockBytes;
+        uint32x4_t msg[4];
+        for (int i = 0; i < 4; ++i) {
+            msg[i] = vreinterpretq_u32_u8(vrev32q_u8(vld1q_u8(in + 16 * i)));
+        }
+#pragma GCC unroll 16
+        for (int g = 0; g < 16; ++g) {
+            uint32x4_t w = vaddq_u32(msg[g & 3], vld1q_u32(kRoundConstants + 4 * g));
+            if (g < 12) {
+                msg[g & 3] = vsha256su0q_u32(msg[g & 3], msg[(g + 1) & 3]);
+            }
+            uint32x4_t previous = abcd;
+            abcd = vsha256hq_u32(abcd, efgh, w);
+            efgh = vsha256h2q_u32(efgh, previous, w);
+            if (g < 12) {
+                msg[g & 3] = vsha256su1q_u32(msg[g & 3], msg[(g + 2) & 3], msg[(g + 3) & 3]);
+            }
+        }
+        abcd = vaddq_u32(abcd, savedAbcd);
+        efgh = vaddq_u32(efgh, savedEfgh);
+    }
+    vst1q_u32(state, abcd);
+    vst1q_u32(state + 4, efgh);
+}
+
+bool cpuHasArmSha2() {
+#if defined(__linux__)
+    return (getauxval(AT_HWCAP) & HWCAP_SHA2) != 0;
+#else
+    return true;
+#endif
+}
+
+#endif
+
+struct Backend {
+    const char *name = "portable";
+    // Null for the libsodium fallback.
+    CompressFn compress = nullptr;
+    Compress2Fn compress2 = nullptr;
+};
+
+const Backend &backend() {
+    static const Backend selected = [] {
+        Backend chosen;
+        const char *forced = std::getenv("GLITE_SHA256");
+        if (forced && std::string(forced) == "portable") {
+            return chosen;
+        }
+#if GITLITE_SHA_X86
+        if (cpuHasShaNi()) {
+            chosen = {"sha-ni", shaNiCompress, shaNiCompress2};
+        }
+#elif GITLITE_SHA_ARM
+        if (cpuHasArmSha2()) {
+            chosen = {"armv8", armCompress, nullptr};
+        }
+#endif
+        return chosen;
+    }();
+    return selected;
+}
+
+// The final one or two blocks: the rest of the message, 0x80, zeros and the
+// bit length.
+std::size_t padTail(const unsigned char *tail, std::size_t tailLength, std::uint64_t totalLength, unsigned char *out) {
+    std::size_t blocks = tailLength + 9 <= kBlockBytes ? 1 : 2;
+    std::memset(out, 0, blocks * kBlockBytes);
+    if (tailLength > 0) {
+        std::memcpy(out, tail, tailLength);
+    }
+    out[tailLength] = 0x80;
+    std::uint64_t bits = totalLength * 8;
+    for (int i = 0; i < 8; ++i) {
+        out[blocks * kBlockBytes - 1 - i] = static_cast<unsigned char>(bits >> (8 * i));
+    }
+    return blocks;
+}
+
+void storeDigest(const std::uint32_t *state, hashing::Digest &digest) {
+    for (int i = 0; i < 8; ++i) {
+        digest.bytes[4 * i] = static_cast<unsigned char>(state[i] >> 24);
+        digest.bytes[4 * i + 1] = static_cast<unsigned char>(state[i] >> 16);
+        digest.bytes[4 * i + 2] = static_cast<unsigned char>(state[i] >> 8);
+        digest.bytes[4 * i + 3] = static_cast<unsigned char>(state[i]);
     }
-    return oss.str();
 }
 
+// A message split into the full blocks read in place and a padded tail.
+struct Message {
+    std::uint32_t state[8];
+    const unsigned char *body = nullptr;
+    std::size_t bodyBlocks = 0;
+    unsigned char tail[2 * kBlockBytes];
+    std::size_t tailBlocks = 0;
+
+    void start(const unsigned char *data, std::size_t length) {
+        std::memcpy(state, kInitialState, sizeof(state));
+        body = data;
+        bodyBlocks = length / kBlockBytes;
+        tailBlocks = padTail(data + bodyBlocks * kBlockBytes, length % kBlockBytes, length, tail);
+    }
+};
+
 } // namespace
 
 namespace hashing {
@@ -28,23 +283,243 @@ void ensureSodium() {
     }
 }
 
+std::string toHex(const unsigned char *data, std::size_t length) {
+    std::string out;
+    toHex(data, length, out);
+    return out;
+}
+
+void toHex(const unsigned char *data, std::size_t length, std::string &out) {
+    out.resize(length * 2);
+    for (std::size_t i = 0; i < length; ++i) {
+        std::memcpy(&out[2 * i], kHex.pairs + 2 * data[i], 2);
+    }
+}
+
+bool fromHex(const std::string &hex, unsigned char *out, std::size_t length) {
+    if (hex.size() != length * 2) {
+        return false;
+    }
+    for (std::size_t i = 0; i < length; ++i) {
+        int hi = kHex.values[static_cast<unsigned char>(hex[2 * i])];
+        int lo = kHex.values[static_cast<unsigned char>(hex[2 * i + 1])];
+        if (hi < 0 || lo < 0) {
+            return false;
+        }
+        out[i] = static_cast<unsigned char>((hi << 4) | lo);
+    }
+    return true;
+}
+
+const char *sha256Backend() {
+    return backend().name;
+}
+
+struct Sha256Stream::State {
+    crypto_hash_sha256_state sodium;
+    std::uint32_t state[8];
+    unsigned char buffer[kBlockBytes];
+    std::size_t buffered = 0;
+    std::uint64_t total = 0;
+};
+
+Sha256Stream::Sha256Stream()
+    : state_(std::make_unique<State>()) {
+    if (backend().compress) {
+        std::memcpy(state_->state, kInitialState, sizeof(state_->state));
+    } else {
+        crypto_hash_sha256_init(&state_->sodium);
+    }
+}
+
+Sha256Stream::~Sha256Stream() = default;
+
+void Sha256Stream::update(const unsigned char *data, std::size_t length) {
+    stats::count(stats::Counter::BytesHashed, length);
+    CompressFn compress = backend().compress;
+    if (!compress) {
+        crypto_hash_sha256_update(&state_->sodium, data, length);
+        return;
+    }
+    State &s = *state_;
+    s.total += length;
+    if (s.buffered > 0) {
+        std::size_t take = std::min(length, kBlockBytes - s.buffered);
+        std::memcpy(s.buffer + s.buffered, data, take);
+        s.buffered += take;
+        data += take;
+        length -= take;
+        if (s.buffered < kBlockBytes) {
+            return;
+        }
+        compress(s.state, s.buffer, 1);
+        s.buffered = 0;
+    }
+    std::size_t blocks = length / kBlockBytes;
+    if (blocks > 0) {
+        compress(s.state, data, blocks);
+    }
+    s.buffered = length % kBlockBytes;
+    if (s.buffered > 0) {
+        std::memcpy(s.buffer, data + blocks * kBlockBytes, s.buffered);
+    }
+}
+
+Digest Sha256Stream::finalDigest() {
+    Digest digest;
+    CompressFn compress = backend().compress;
+    if (!compress) {
+        crypto_hash_sha256_final(&state_->sodium, digest.bytes.data());
+        return digest;
+    }
+    unsigned char tail[2 * kBlockBytes];
+    std::size_t blocks = padTail(state_->buffer, state_->buffered, state_->total, tail);
+    compress(state_->state, tail, blocks);
+    storeDigest(state_->state, digest);
+    return digest;
+}
+
+std::string Sha256Stream::finalHex() {
+    return finalDigest().hex();
+}
+
+Digest sha256Digest(const unsigned char *data, std::size_t length) {
+    stats::count(stats::Counter::BytesHashed, length);
+    Digest digest;
+    CompressFn compress = backend().compress;
+    if (!compress) {
+        crypto_hash_sha256(digest.bytes.data(), data, length);
+        return digest;
+    }
+    Message message;
+    message.start(data, length);
+    if (message.bodyBlocks > 0) {
+        compress(message.state, message.body, message.bodyBlocks);
+    }
+    compress(message.state, message.tail, message.tailBlocks);
+    storeDigest(message.state, digest);
+    return digest;
+}
+
 std::string sha256Bytes(const unsigned char *data, std::size_t length) {
-    unsigned char hash[crypto_hash_sha256_BYTES];
-    crypto_hash_sha256(hash, data, length);
-    return toHex(hash, crypto_hash_sha256_BYTES);
+    return sha256Digest(data, length).hex();
 }
 
 std::string sha256String(const std::string &text) {
     return sha256Bytes(reinterpret_cast<const unsigned char *>(text.data()), text.size());
 }
 
+void sha256Batch(const Buffer *inputs, std::size_t count, Digest *out) {
+    const Backend &selected = backend();
+    if (!selected.compress2) {
+        // sha256Digest does the counting.
+        for (std::size_t i = 0; i < count; ++i) {
+            out[i] = sha256Digest(inputs[i].data, inputs[i].length);
+        }
+        return;
+    }
+    // Lanes run in lockstep, so neighbours in length order are paired.
+    if (stats::enabled()) {
+        std::uint64_t bytes = 0;
+        for (std::size_t k = 0; k < count; ++k) {
+            bytes += inputs[k].length;
+        }
+        stats::count(stats::Counter::BytesHashed, bytes);
+    }
+    std::vector<std::size_t> order(count);
+    std::iota(order.begin(), order.end(), std::size_t(0));
+    std::sort(order.begin(), order.end(),
+              [inputs](std::size_t a, std::size_t b) { return inputs[a].length < inputs[b].length; });
+    std::size_t i = 0;
+    for (; i + 1 < count; i += 2) {
+        Message a;
+        Message b;
+        a.start(inputs[order[i]].data, inputs[order[i]].length);
+        b.start(inputs[order[i + 1]].data, inputs[order[i + 1]].length);
+        std::size_t shared = std::min(a.bodyBlocks, b.bodyBlocks);
+        if (shared > 0) {
+            selected.compress2(a.state, a.body, b.state, b.body, shared);
+        }
+        if (a.bodyBlocks == shared && b.bodyBlocks == shared && a.tailBlocks == b.tailBlocks) {
+            selected.compress2(a.state, a.tail, b.state, b.tail, a.tailBlocks);
+        } else {
+            for (Message *message : {&a, &b}) {
+                if (message->bodyBlocks > shared) {
+                    selected.compress(message->state, message->body + shared * kBlockBytes,
+                                      message->bodyBlocks - shared);
+                }
+                selected.compress(message->state, message->tail, message->tailBlocks);
+            }
+        }
+        storeDigest(a.state, out[order[i]]);
+        storeDigest(b.state, out[order[i + 1]]);
+    }
+    if (i < count) {
+        Message last;
+        last.start(inputs[order[i]].data, inputs[order[i]].length);
+        if (last.bodyBlocks > 0) {
+            selected.compress(last.state, last.body, last.bodyBlocks);
+        }
+        selected.compress(last.state, last.tail, last.tailBlocks);
+        storeDigest(last.state, out[order[i]]);
+    }
+}
+
 std::string sha256File(const std::filesystem::path &path) {
+    static stats::Site site("sha256File");
+    stats::Timer timer(site);
+    stats::count(stats::Counter::FsCalls);
     std::ifstream in(path, std::ios::binary);
     if (!in) {
         throw std::runtime_error("Unable to open file for hashing: " + path.string());
     }
-    std::vector<unsigned char> buffer(std::istreambuf_iterator<char>(in), {});
-    return sha256Bytes(buffer.data(), buffer.size());
+    Sha256Stream hasher;
+    std::vector<char> buffer(kReadWindow);
+    while (in) {
+        in.read(buffer.data(), static_cast<std::streamsize>(buffer.size()));
+        std::streamsize got = in.gcount();
+        if (got <= 0) {
+            break;
+        }
+        hasher.update(reinterpret_cast<const unsigned char *>(buffer.data()), static_cast<std::size_t>(got));
+    }
+    if (in.bad()) {
+        throw std::runtime_error("Read error while hashing: " + path.string());
+    }
+    return hasher.finalHex();
+}
+
+std::string sha256FileCopy(const std::filesystem::path &source, const std::filesystem::path &destination) {
+    static stats::Site site("sha256FileCopy");
+    stats::Timer timer(site);
+    stats::count(stats::Counter::FsCalls, 2);
+    std::ifstream in(source, std::ios::binary);
+    if (!in) {
+        throw std::runtime_error("Unable to open file for hashing: " + source.string());
+    }
+    std::ofstream out(destination, std::ios::binary | std::ios::trunc);
+    if (!out) {
+        throw std::runtime_error("Unable to open file for writing: " + destination.string());
+    }
+    Sha256Stream hasher;
+    std::vector<char> buffer(kReadWindow);
+    while (in) {
+        in.read(buffer.data(), static_cast<std::streamsize>(buffer.size()));
+        std::streamsize got = in.gcount();
+        if (got <= 0) {
+            break;
+        }
+        hasher.update(reinterpret_cast<const unsigned char *>(buffer.data()), static_cast<std::size_t>(got));
+        out.write(buffer.data(), got);
+    }
+    if (in.bad()) {
+        throw std::runtime_error("Read error while hashing: " + source.string());
+    }
+    out.flush();
+    if (!out) {
+        throw std::runtime_error("Write error while copying: " + destination.string());
+    }
+    return hasher.finalHex();
 }
 
 std::string hashPassword(const std::string &password) {
@@ -1,23 +1,96 @@
 #pragma once
 
+#include <array>
 #include <cstddef>
+#include <cstdint>
+#include <cstring>
 #include <filesystem>
+#include <memory>
 #include <string>
 
 namespace hashing {
 
 void ensureSodium();
 
+constexpr std::size_t kDigestBytes = 32;
+
+std::string toHex(const unsigned char *data, std::size_t length);
+// Same, into `out`, whose capacity is reused across calls.
+void toHex(const unsigned char *data, std::size_t length, std::string &out);
+
+// Decodes a lowercase or uppercase hex string of exactly 2 * length characters.
+bool fromHex(const std::string &hex, unsigned char *out, std::size_t length);
+
+// A raw SHA-256 digest. Object ids are still hex strings in files and on the
+// wire; this is for code that compares or indexes many of them.
+struct Digest {
+    std::array<unsigned char, kDigestBytes> bytes{};
+
+    std::string hex() const { return toHex(bytes.data(), bytes.size()); }
+    static bool parse(const std::string &hex, Digest &out) { return fromHex(hex, out.bytes.data(), kDigestBytes); }
+
+    bool operator==(const Digest &other) const { return bytes == other.bytes; }
+    bool operator!=(const Digest &other) const { return bytes != other.bytes; }
+    bool operator<(const Digest &other) const { return bytes < other.bytes; }
+};
+
+// The digest is already uniformly distributed, so its first word will do.
+struct DigestHash {
+    std::size_t operator()(const Digest &digest) const {
+        std::size_t value = 0;
+        std::memcpy(&value, digest.bytes.data(), sizeof(value));
+        return value;
+    }
+};
+
+// SHA-256 runs on the CPU's SHA instructions (x86 SHA-NI, ARMv8 crypto
+// extensions) when present and on libsodium otherwise. Detection happens once;
+// GLITE_SHA256=portable forces libsodium. Returns "sha-ni", "armv8" or
+// "portable".
+const char *sha256Backend();
+
+// Incremental SHA-256 so callers can hash data as it streams past instead of
+// buffering whole files.
+class Sha256Stream {
+public:
+    Sha256Stream();
+    ~Sha256Stream();
+
+    Sha256Stream(const Sha256Stream &) = delete;
+    Sha256Stream &operator=(const Sha256Stream &) = delete;
+
+    void update(const unsigned char *data, std::size_t length);
+    Digest finalDigest();
+    std::string finalHex();
+
+private:
+    struct State;
+    std::unique_ptr<State> state_;
+};
+
+Digest sha256Digest(const unsigned char *data, std::size_t length);
+
 std::string sha256Bytes(const unsigned char *data, std::size_t length);
 
 std::string sha256String(const std::string &text);
 
+struct Buffer {
+    const unsigned char *data = nullptr;
+    std::size_t length = 0;
+};
+
+// Hashes `count` independent buffers into `out`. With SHA-NI two messages
+// run through the rounds in interleaved lanes, which hides most of the
+// instruction latency that limits a single stream on small inputs.
+void sha256Batch(const Buffer *inputs, std::size_t count, Digest *out);
+
 std::string sha256File(const std::filesystem::path &path);
 
+// Hashes `source` while copying it to `destination`, reading the file once.
+std::string sha256FileCopy(const std::filesystem::path &source, const std::filesystem::path &destination);
+
 std::string hashPassword(const std::string &password);
 
 bool verifyPassword(const std::string &hash, const std::string &password);
 
 } // namespace hashing
-
-
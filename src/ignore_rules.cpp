@@ -0,0 +1,183 @@
+#include "ignore_rules.hpp"
+
+#include "utils.hpp"
+
+#include <fstream>
+
+namespace {
+
+bool matchClass(std::string_view pattern, std::size_t &p, char ch) {
+    // `p` points just past '['.
+    bool negate = p < pattern.size() && (pattern[p] == '!' || pattern[p] == '^');
+    if (negate) {
+        ++p;
+    }
+    bool matched = false;
+    bool first = true;
+    while (p < pattern.size() && (first || pattern[p] != ']')) {
+        first = false;
+        char low = pattern[p];
+        char high = low;
+        if (p + 2 < pattern.size() && pattern[p + 1] == '-' && pattern[p + 2] != ']') {
+            high = pattern[p + 2];
+            p += 2;
+        }
+        if (ch >= low && ch <= high) {
+            matched = true;
+        }
+        ++p;
+    }
+    if (p < pattern.size()) {
+        ++p;
+    }
+    return matched != negate;
+}
+
+bool matchFrom(std::string_view pattern, std::size_t p, std::string_view text, std::size_t t) {
+    while (p < pattern.size()) {
+        char pc = pattern[p];
+        if (pc == '*') {
+            if (p + 1 < pattern.size() && pattern[p + 1] == '*') {
+                // "**/" matches zero or more whole segments; a trailing "**"
+                // matches everything below.
+                std::size_t next = p + 2;
+                if (next < pattern.size() && pattern[next] == '/') {
+                    ++next;
+                }
+                for (std::size_t i = t; i <= text.size(); ++i) {
+                    if ((i == t || text[i - 1] == '/') && matchFrom(pattern, next, text, i)) {
+                        return true;
+                    }
+                }
+                return next >= pattern.size();
+            }
+            for (std::size_t i = t; i <= text.size(); ++i) {
+                if (matchFrom(pattern, p + 1, text, i)) {
+                    return true;
+                }
+                if (i < text.size() && text[i] == '/') {
+                    break;
+                }
+            }
+            return false;
+        }
+        if (t >= text.size()) {
+            return false;
+        }
+        if (pc == '?') {
+            if (text[t] == '/') {
+                return false;
+            }
+            ++p;
+            ++t;
+            continue;
+        }
+        if (pc == '[') {
+            ++p;
+            if (text[t] == '/' || !matchClass(pattern, p, text[t])) {
+                return false;
+            }
+            ++t;
+            continue;
+        }
+        if (pc == '\\' && p + 1 < pattern.size()) {
+            ++p;
+            pc = pattern[p];
+        }
+        if (pc != text[t]) {
+            return false;
+        }
+        ++p;
+        ++t;
+    }
+    return t == text.size();
+}
+
+} // namespace
+
+bool globMatch(std::string_view pattern, std::string_view text) {
+    return matchFrom(pattern, 0, text, 0);
+}
+
+bool hasGlobCharacters(const std::string &text) {
+    return text.find_first_of("*?[") != std::string::npos;
+}
+
+void IgnoreRules::load(const std::filesystem::path &repoRoot) {
+    rules_.clear();
+    std::ifstream in(repoRoot / ".gliteignore");
+    std::string line;
+    while (std::getline(in, line)) {
+        addPattern(line);
+    }
+}
+
+void IgnoreRules::addPattern(const std::string &line) {
+    std::string text = gitlite::util::trim(line);
+    if (text.empty() || text[0] == '#') {
+        return;
+    }
+    Rule rule;
+    if (text[0] == '!') {
+        rule.negated = true;
+        text.erase(0, 1);
+    }
+    if (!text.empty() && text.back() == '/') {
+        rule.directoryOnly = true;
+        text.pop_back();
+    }
+    if (!text.empty() && text[0] == '/') {
+        text.erase(0, 1);
+        rule.anchored = true;
+    } else if (text.find('/') != std::string::npos) {
+        rule.anchored = true;
+    }
+    if (text.empty()) {
+        return;
+    }
+    // '*' never crosses a '/', so a single leading or trailing one around a
+    // plain string is a suffix or prefix test.
+    auto plain = [](std::string_view part) { return part.find_first_of("*?[\\") == std::string_view::npos; };
+    std::string_view view(text);
+    if (plain(view)) {
+        rule.kind = Kind::Literal;
+    } else if (view.size() > 1 && view.front() == '*' && plain(view.substr(1))) {
+        rule.kind = Kind::Suffix;
+        rule.literal = text.substr(1);
+    } else if (view.size() > 1 && view.back() == '*' && plain(view.substr(0, view.size() - 1))) {
+        rule.kind = Kind::Prefix;
+        rule.literal = text.substr(0, text.size() - 1);
+    }
+    rule.pattern = text;
+    rules_.push_back(std::move(rule));
+}
+
+bool IgnoreRules::Rule::matches(std::string_view text) const {
+    switch (kind) {
+    case Kind::Literal:
+        return text == pattern;
+    case Kind::Suffix:
+        return text.size() >= literal.size() && text.substr(text.size() - literal.size()) == literal &&
+               text.substr(0, text.size() - literal.size()).find('/') == std::string_view::npos;
+    case Kind::Prefix:
+        return text.size() >= literal.size() && text.substr(0, literal.size()) == literal &&
+               text.substr(literal.size()).find('/') == std::string_view::npos;
+    case Kind::Glob:
+        break;
+    }
+    return globMatch(pattern, text);
+}
+
+bool IgnoreRules::ignored(std::string_view relativePath, bool isDirectory) const {
+    std::size_t slash = relativePath.find_last_of('/');
+    std::string_view basename = slash == std::string_view::npos ? relativePath : relativePath.substr(slash + 1);
+    for (auto rule = rules_.rbegin(); rule != rules_.rend(); ++rule) {
+        if (rule->directoryOnly && !isDirectory) {
+            continue;
+        }
+        if (rule->matches(rule->anchored ? relativePath : basename)) {
+            return !rule->negated;
+        }
+    }
+    return false;
+}
@@ -0,0 +1,49 @@
+#pragma once
+
+#include <filesystem>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Shell-style match of `text` against `pattern`. `*` and `?` never cross a
+// '/', `**` matches any number of path segments, and `[...]` is a character
+// class (`[!...]` negates).
+bool globMatch(std::string_view pattern, std::string_view text);
+
+bool hasGlobCharacters(const std::string &text);
+
+// Patterns from <repo>/.gliteignore, applied to workspace-relative paths with
+// gitignore semantics: blank lines and '#' comments are skipped, a leading '!'
+// re-includes, a trailing '/' only matches directories, and a pattern without
+// a '/' (other than a trailing one) matches the basename at any depth. The
+// last matching rule wins. Only the path itself is tested; callers walking a
+// tree prune ignored directories so their contents are never visited.
+//
+// Rules are classified when added: plain names, "*suffix" and "prefix*"
+// compare strings directly, and only the rest run the glob matcher. Rules
+// are tried newest first, so the first match decides. The object is
+// read-only after loading and may be shared between threads.
+class IgnoreRules {
+public:
+    void load(const std::filesystem::path &repoRoot);
+    void addPattern(const std::string &line);
+
+    bool ignored(std::string_view relativePath, bool isDirectory) const;
+    bool empty() const { return rules_.empty(); }
+
+private:
+    enum class Kind { Literal, Suffix, Prefix, Glob };
+
+    struct Rule {
+        std::string pattern;
+        // The pattern without its '*' for Suffix and Prefix rules.
+        std::string literal;
+        Kind kind = Kind::Glob;
+        bool negated = false;
+        bool directoryOnly = false;
+        bool anchored = false;
+
+        bool matches(std::string_view text) const;
+    };
+    std::vector<Rule> rules_;
+};
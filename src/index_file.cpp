@@ -0,0 +1,398 @@
+#include "index_file.hpp"
+
+#include "hashing.hpp"
+#include "journal.hpp"
+#include "lock_file.hpp"
+#include "stats.hpp"
+#include "utils.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <system_error>
+
+#if !defined(_WIN32)
+#include <sys/stat.h>
+#endif
+
+namespace fs = std::filesystem;
+
+namespace {
+
+constexpr char kIndexMagic[4] = {'G', 'L', 'I', 'X'};
+constexpr std::uint32_t kIndexVersion = 1;
+constexpr std::size_t kHeaderSize = 16;
+constexpr std::size_t kStatBytes = hashing::kDigestBytes + 8 + 8 + 8 + 4;
+
+void putU32(std::string &out, std::uint32_t value) {
+    for (int i = 0; i < 4; ++i) {
+        out.push_back(static_cast<char>((value >> (8 * i)) & 0xff));
+    }
+}
+
+void putU64(std::string &out, std::uint64_t value) {
+    for (int i = 0; i < 8; ++i) {
+        out.push_back(static_cast<char>((value >> (8 * i)) & 0xff));
+    }
+}
+
+void putVarint(std::string &out, std::uint64_t value) {
+    while (value >= 0x80) {
+        out.push_back(static_cast<char>((value & 0x7f) | 0x80));
+        value >>= 7;
+    }
+    out.push_back(static_cast<char>(value));
+}
+
+std::uint32_t getU32(const unsigned char *p) {
+    std::uint32_t value = 0;
+    for (int i = 3; i >= 0; --i) {
+        value = (value << 8) | p[i];
+    }
+    return value;
+}
+
+std::uint64_t getU64(const unsigned char *p) {
+    std::uint64_t value = 0;
+    for (int i = 7; i >= 0; --i) {
+        value = (value << 8) | p[i];
+    }
+    return value;
+}
+
+bool getVarint(const unsigned char *data, std::size_t end, std::size_t &offset, std::uint64_t &value) {
+    value = 0;
+    for (int shift = 0; shift < 64; shift += 7) {
+        if (offset >= end) {
+            return false;
+        }
+        unsigned char byte = data[offset++];
+        value |= static_cast<std::uint64_t>(byte & 0x7f) << shift;
+        if ((byte & 0x80) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+std::string encode(const std::vector<IndexEntry> &entries, std::string &error) {
+    std::string out(kIndexMagic, sizeof(kIndexMagic));
+    putU32(out, kIndexVersion);
+    putU32(out, static_cast<std::uint32_t>(entries.size()));
+    putU32(out, IndexFile::kRestartInterval);
+
+    std::vector<std::uint32_t> restarts;
+    unsigned char raw[hashing::kDigestBytes];
+    const std::string *previous = nullptr;
+    for (std::size_t i = 0; i < entries.size(); ++i) {
+        const IndexEntry &entry = entries[i];
+        if (!hashing::fromHex(entry.hash, raw, sizeof(raw))) {
+            error = "Invalid blob id for " + entry.path + ".";
+            return {};
+        }
+        std::size_t shared = 0;
+        if (i % IndexFile::kRestartInterval == 0) {
+            restarts.push_back(static_cast<std::uint32_t>(out.size()));
+        } else {
+            std::size_t limit = std::min(previous->size(), entry.path.size());
+            while (shared < limit && (*previous)[shared] == entry.path[shared]) {
+                ++shared;
+            }
+        }
+        putVarint(out, shared);
+        putVarint(out, entry.path.size() - shared);
+        out.append(entry.path, shared, std::string::npos);
+        out.append(reinterpret_cast<const char *>(raw), sizeof(raw));
+        putU64(out, static_cast<std::uint64_t>(entry.mtimeNs));
+        putU64(out, entry.size);
+        putU64(out, entry.inode);
+        putU32(out, entry.mode);
+        previous = &entry.path;
+    }
+    for (std::uint32_t offset : restarts) {
+        putU32(out, offset);
+    }
+    putU32(out, static_cast<std::uint32_t>(restarts.size()));
+    return out;
+}
+
+// Sorts by path and keeps the last entry given for each path.
+void sortUnique(std::vector<IndexEntry> &entries) {
+    std::stable_sort(entries.begin(), entries.end(),
+                     [](const IndexEntry &a, const IndexEntry &b) { return a.path < b.path; });
+    std::vector<IndexEntry> unique;
+    unique.reserve(entries.size());
+    for (auto &entry : entries) {
+        if (!unique.empty() && unique.back().path == entry.path) {
+            unique.back() = std::move(entry);
+        } else {
+            unique.push_back(std::move(entry));
+        }
+    }
+    entries.swap(unique);
+}
+
+bool writeBytes(const fs::path &path, const std::string &bytes) {
+    std::ofstream out(path, std::ios::binary | std::ios::trunc);
+    if (!out) {
+        return false;
+    }
+    out.write(bytes.data(), static_cast<std::streamsize>(bytes.size()));
+    out.flush();
+    return static_cast<bool>(out);
+}
+
+} // namespace
+
+bool statIndexEntry(const fs::path &file, IndexEntry &entry) {
+    stats::count(stats::Counter::FilesStatted);
+#if !defined(_WIN32)
+    struct stat st {};
+    if (::stat(file.c_str(), &st) != 0 || !S_ISREG(st.st_mode)) {
+        return false;
+    }
+#if defined(__APPLE__)
+    const auto &mtime = st.st_mtimespec;
+#else
+    const auto &mtime = st.st_mtim;
+#endif
+    entry.mtimeNs = static_cast<std::int64_t>(mtime.tv_sec) * 1000000000 + mtime.tv_nsec;
+    entry.size = static_cast<std::uint64_t>(st.st_size);
+    entry.inode = static_cast<std::uint64_t>(st.st_ino);
+    entry.mode = static_cast<std::uint32_t>(st.st_mode);
+    return true;
+#else
+    std::error_code ec;
+    if (!fs::is_regular_file(file, ec)) {
+        return false;
+    }
+    entry.mtimeNs = static_cast<std::int64_t>(
+        std::chrono::duration_cast<std::chrono::nanoseconds>(fs::last_write_time(file, ec).time_since_epoch()).count());
+    entry.size = fs::file_size(file, ec);
+    entry.inode = 0;
+    entry.mode = 0;
+    return !ec;
+#endif
+}
+
+bool indexEntryClean(const IndexEntry &entry, const IndexEntry &fresh, std::int64_t indexStamp) {
+    return entry.mtimeNs != 0 && entry.mtimeNs < indexStamp && entry.mtimeNs == fresh.mtimeNs &&
+           entry.size == fresh.size && entry.inode == fresh.inode && entry.mode == fresh.mode;
+}
+
+bool IndexFile::open(const fs::path &path) {
+    map_.close();
+    legacy_ = false;
+    legacyEntries_.clear();
+    count_ = 0;
+    restarts_ = nullptr;
+    restartCount_ = 0;
+    entriesEnd_ = 0;
+    stamp_ = 0;
+
+    IndexEntry self;
+    if (!statIndexEntry(path, self)) {
+        return true;
+    }
+    stamp_ = self.mtimeNs;
+    if (!map_.open(path)) {
+        return false;
+    }
+    const unsigned char *data = map_.data();
+    std::size_t size = map_.size();
+    if (size < sizeof(kIndexMagic) || std::memcmp(data, kIndexMagic, sizeof(kIndexMagic)) != 0) {
+        return parseLegacy();
+    }
+    if (size < kHeaderSize + 4 || getU32(data + 4) != kIndexVersion) {
+        return false;
+    }
+    count_ = getU32(data + 8);
+    interval_ = getU32(data + 12);
+    restartCount_ = getU32(data + size - 4);
+    if (interval_ == 0 || restartCount_ != (count_ + interval_ - 1) / interval_ ||
+        restartCount_ * 4 + 4 > size - kHeaderSize) {
+        count_ = 0;
+        return false;
+    }
+    entriesEnd_ = size - 4 - restartCount_ * 4;
+    restarts_ = data + entriesEnd_;
+    return true;
+}
+
+bool IndexFile::parseLegacy() {
+    legacy_ = true;
+    std::string text(reinterpret_cast<const char *>(map_.data()), map_.size());
+    std::istringstream in(text);
+    std::string line;
+    while (std::getline(in, line)) {
+        if (line.empty()) {
+            continue;
+        }
+        auto parts = gitlite::util::split(line, '\t');
+        if (parts.size() < 2) {
+            continue;
+        }
+        IndexEntry entry;
+        entry.path = parts[0];
+        entry.hash = parts[1];
+        // Two-column entries carry no stat data and are re-hashed on first use.
+        if (parts.size() == 6) {
+            try {
+                entry.mtimeNs = std::stoll(parts[2]);
+                entry.size = std::stoull(parts[3]);
+                entry.inode = std::stoull(parts[4]);
+                entry.mode = static_cast<std::uint32_t>(std::stoul(parts[5]));
+            } catch (const std::exception &) {
+                entry.mtimeNs = 0;
+            }
+        }
+        legacyEntries_.push_back(std::move(entry));
+    }
+    sortUnique(legacyEntries_);
+    count_ = legacyEntries_.size();
+    map_.close();
+    return true;
+}
+
+std::size_t IndexFile::restartOffset(std::size_t restart) const {
+    return getU32(restarts_ + restart * 4);
+}
+
+bool IndexFile::decode(std::size_t &offset, std::string &path, IndexEntry &entry) const {
+    const unsigned char *data = map_.data();
+    std::uint64_t shared = 0;
+    std::uint64_t suffix = 0;
+    if (!getVarint(data, entriesEnd_, offset, shared) || !getVarint(data, entriesEnd_, offset, suffix) ||
+        shared > path.size() || suffix > entriesEnd_ - offset || kStatBytes > entriesEnd_ - offset - suffix) {
+        return false;
+    }
+    path.resize(static_cast<std::size_t>(shared));
+    path.append(reinterpret_cast<const char *>(data + offset), static_cast<std::size_t>(suffix));
+    offset += static_cast<std::size_t>(suffix);
+    entry.path = path;
+    hashing::toHex(data + offset, hashing::kDigestBytes, entry.hash);
+    offset += hashing::kDigestBytes;
+    entry.mtimeNs = static_cast<std::int64_t>(getU64(data + offset));
+    entry.size = getU64(data + offset + 8);
+    entry.inode = getU64(data + offset + 16);
+    entry.mode = getU32(data + offset + 24);
+    offset += 28;
+    return true;
+}
+
+bool IndexFile::find(const std::string &path, IndexEntry &entry) const {
+    if (legacy_) {
+        auto it = std::lower_bound(legacyEntries_.begin(), legacyEntries_.end(), path,
+                                   [](const IndexEntry &e, const std::string &key) { return e.path < key; });
+        if (it == legacyEntries_.end() || it->path != path) {
+            return false;
+        }
+        entry = *it;
+        return true;
+    }
+    if (count_ == 0) {
+        return false;
+    }
+    // Restart entries hold full paths: find the last one <= path.
+    std::size_t lo = 0;
+    std::size_t hi = restartCount_;
+    while (hi - lo > 1) {
+        std::size_t mid = lo + (hi - lo) / 2;
+        std::size_t offset = restartOffset(mid);
+        std::string key;
+        IndexEntry probe;
+        if (!decode(offset, key, probe)) {
+            return false;
+        }
+        if (key <= path) {
+            lo = mid;
+        } else {
+            hi = mid;
+        }
+    }
+    std::size_t offset = restartOffset(lo);
+    std::size_t remaining = std::min<std::size_t>(interval_, count_ - lo * interval_);
+    std::string current;
+    for (std::size_t i = 0; i < remaining; ++i) {
+        if (!decode(offset, current, entry)) {
+            return false;
+        }
+        if (current == path) {
+            return true;
+        }
+        if (current > path) {
+            return false;
+        }
+    }
+    return false;
+}
+
+std::vector<IndexEntry> IndexFile::entries() const {
+    if (legacy_) {
+        return legacyEntries_;
+    }
+    std::vector<IndexEntry> result;
+    result.reserve(count_);
+    forEach([&result](const IndexEntry &entry) {
+        result.push_back(entry);
+        return true;
+    });
+    return result;
+}
+
+void IndexFile::forEach(const std::function<bool(const IndexEntry &)> &visitor) const {
+    if (legacy_) {
+        for (const auto &entry : legacyEntries_) {
+            if (!visitor(entry)) {
+                return;
+            }
+        }
+        return;
+    }
+    std::size_t offset = kHeaderSize;
+    std::string path;
+    IndexEntry entry;
+    for (std::size_t i = 0; i < count_; ++i) {
+        if (!decode(offset, path, entry) || !visitor(entry)) {
+            return;
+        }
+    }
+}
+
+bool IndexFile::write(const fs::path &path, std::vector<IndexEntry> entries, std::string &error) {
+    sortUnique(entries);
+
+    // Another writer holding index.lock makes this write fail rather than
+    // interleave with it.
+    LockFile lock(path);
+    if (!lock.acquire(error)) {
+        return false;
+    }
+    const fs::path &scratch = lock.path();
+    std::string bytes = encode(entries, error);
+    if (bytes.empty() || !writeBytes(scratch, bytes)) {
+        if (error.empty()) {
+            error = "Unable to write index.";
+        }
+        return false;
+    }
+    // Racy-git guard: a file modified within the same timestamp tick as this
+    // write would still match its recorded stat data later on.
+    IndexEntry self;
+    if (statIndexEntry(scratch, self)) {
+        bool smudged = false;
+        for (auto &entry : entries) {
+            if (entry.mtimeNs != 0 && entry.mtimeNs >= self.mtimeNs) {
+                entry.mtimeNs = 0;
+                smudged = true;
+            }
+        }
+        if (smudged && !writeBytes(scratch, encode(entries, error))) {
+            error = "Unable to write index.";
+            return false;
+        }
+    }
+    return journal::commitLock(lock, error);
+}
@@ -0,0 +1,80 @@
+#pragma once
+
+#include "mapped_file.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <functional>
+#include <string>
+#include <vector>
+
+// One staged path plus the stat data seen when it was hashed. A later stat
+// that matches every field lets status/add trust `hash` without re-reading
+// the file. mtimeNs == 0 marks an entry that must be re-hashed.
+struct IndexEntry {
+    std::string path;
+    std::string hash;
+    std::int64_t mtimeNs = 0;
+    std::uint64_t size = 0;
+    std::uint64_t inode = 0;
+    std::uint32_t mode = 0;
+};
+
+// Fills the stat fields of `entry` from a regular file.
+bool statIndexEntry(const std::filesystem::path &file, IndexEntry &entry);
+
+// True when `fresh` (just stat'ed) matches `entry` and the entry is older than
+// the index file stamp `indexStamp`, i.e. not racily clean.
+bool indexEntryClean(const IndexEntry &entry, const IndexEntry &fresh, std::int64_t indexStamp);
+
+// Read-only view of .glite/index.
+//
+// Layout (all integers little-endian):
+//   "GLIX" | u32 version | u32 entry count | u32 restart interval
+//   entries, sorted by path:
+//     varint shared prefix | varint suffix length | suffix
+//     32-byte raw hash | i64 mtime ns | u64 size | u64 inode | u32 mode
+//   u32 restart offsets[] | u32 restart count
+// Every `interval`-th entry stores its full path (shared == 0) and is listed
+// in the restart table, so a lookup binary-searches the restarts and then
+// decodes at most one run. The old `path\thash[\tstat...]` text index is
+// still accepted.
+class IndexFile {
+public:
+    static constexpr std::uint32_t kRestartInterval = 16;
+
+    bool open(const std::filesystem::path &path);
+
+    std::size_t size() const { return count_; }
+
+    // Modification time of the index file (0 when it does not exist).
+    std::int64_t stamp() const { return stamp_; }
+
+    bool find(const std::string &path, IndexEntry &entry) const;
+    std::vector<IndexEntry> entries() const;
+    // Decodes the entries in path order into one reused IndexEntry, so the
+    // visitor must copy what it keeps. Returning false stops the walk.
+    void forEach(const std::function<bool(const IndexEntry &)> &visitor) const;
+
+    // Sorts `entries` (the last entry for a duplicated path wins), writes them
+    // to a sibling temp file and renames it over `path`. Entries stamped at or
+    // after the new file's mtime are smudged (mtimeNs = 0) so the racy-clean
+    // check survives later rewrites.
+    static bool write(const std::filesystem::path &path, std::vector<IndexEntry> entries, std::string &error);
+
+private:
+    MappedFile map_;
+    bool legacy_ = false;
+    std::vector<IndexEntry> legacyEntries_;
+    std::size_t count_ = 0;
+    std::uint32_t interval_ = kRestartInterval;
+    const unsigned char *restarts_ = nullptr;
+    std::size_t restartCount_ = 0;
+    std::size_t entriesEnd_ = 0;
+    std::int64_t stamp_ = 0;
+
+    bool parseLegacy();
+    std::size_t restartOffset(std::size_t restart) const;
+    bool decode(std::size_t &offset, std::string &path, IndexEntry &entry) const;
+};
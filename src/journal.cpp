@@ -0,0 +1,483 @@
+#include "journal.hpp"
+
+#include "hashing.hpp"
+#include "stats.hpp"
+
+#include <cerrno>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <fstream>
+#include <mutex>
+#include <random>
+#include <set>
+#include <sstream>
+#include <system_error>
+#include <memory>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <zlib.h>
+
+#if !defined(_WIN32)
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+namespace fs = std::filesystem;
+
+namespace journal {
+
+namespace {
+
+// Past this size the journal is moved to journal.old on the next commit;
+// recovery only ever needs the last few transactions.
+constexpr std::uintmax_t kRotateBytes = 1 << 20;
+constexpr std::size_t kRecoverTailBytes = 64 * 1024;
+
+thread_local Transaction *tCurrent = nullptr;
+
+// Loose objects awaiting fsync, per repository. Each list is flushed only by
+// a commit of its own repository, and flushMutex is held for the whole
+// flush, so a commit that finds the list empty because another commit took
+// it waits until those objects are on disk.
+struct PendingObjects {
+    std::mutex flushMutex;
+    std::vector<fs::path> paths;
+};
+
+// Guards the map and every list in it. Entries are never removed, so
+// references stay valid.
+std::mutex gPendingMutex;
+std::unordered_map<std::string, std::unique_ptr<PendingObjects>> gPending;
+std::unordered_map<std::string, std::string> gCanonicalGlite;
+
+// Serializes appends and rotation between transactions of this process;
+// other processes are kept apart by O_APPEND and their ref locks.
+std::mutex gJournalMutex;
+
+std::mutex gRecoveredMutex;
+std::set<std::string> gRecovered;
+
+bool syncPath(const fs::path &path, bool directory) {
+    if (!fsyncEnabled()) {
+        return true;
+    }
+#if defined(_WIN32)
+    (void)path;
+    (void)directory;
+    return true;
+#else
+    int flags = O_RDONLY;
+    if (directory) {
+        flags |= O_DIRECTORY;
+    }
+    int fd = ::open(path.c_str(), flags);
+    if (fd < 0) {
+        return false;
+    }
+    stats::count(stats::Counter::Fsyncs);
+    bool ok = ::fsync(fd) == 0;
+    ::close(fd);
+    return ok;
+#endif
+}
+
+// Path of `target` relative to `base`, or empty when it lies outside it.
+fs::path relativeTo(const fs::path &base, const fs::path &target) {
+    fs::path relative = target.lexically_normal().lexically_relative(base.lexically_normal());
+    if (relative.empty() || *relative.begin() == "..") {
+        return {};
+    }
+    return relative;
+}
+
+std::string crcHex(const std::string &text) {
+    uLong crc = crc32(0L, Z_NULL, 0);
+    crc = crc32(crc, reinterpret_cast<const Bytef *>(text.data()), static_cast<uInt>(text.size()));
+    char buffer[9];
+    std::snprintf(buffer, sizeof buffer, "%08lx", static_cast<unsigned long>(crc));
+    return buffer;
+}
+
+// Empty when the file cannot be read.
+std::string digestOf(const fs::path &path) {
+    try {
+        return hashing::sha256File(path);
+    } catch (const std::exception &) {
+        return {};
+    }
+}
+
+// Names one transaction in the journal and in its lock links, so recovery
+// can tell its locks from those of writers still running.
+std::string transactionId() {
+    static std::mutex mutex;
+    static std::mt19937_64 random(std::random_device{}() ^
+                                  static_cast<std::uint64_t>(std::chrono::steady_clock::now().time_since_epoch().count()));
+    std::lock_guard<std::mutex> lock(mutex);
+    char buffer[17];
+    std::snprintf(buffer, sizeof buffer, "%016llx", static_cast<unsigned long long>(random()));
+    return buffer;
+}
+
+// "<target>.<id>.lock": a second name for a staged lock that only
+// transaction `id` uses. It ends in ".lock" so ref listings skip it.
+fs::path ownedLock(const fs::path &target, const std::string &id) {
+    fs::path path = target;
+    path += "." + id + ".lock";
+    return path;
+}
+
+std::string oneLine(std::string text) {
+    for (char &c : text) {
+        if (c == '\n' || c == '\r') {
+            c = ' ';
+        }
+    }
+    return text;
+}
+
+// The pending list of the repository whose .glite directory is `glite`,
+// keyed by its canonical path so every spelling of a root shares one list.
+PendingObjects &pendingFor(const fs::path &glite) {
+    std::string raw = glite.string();
+    {
+        std::lock_guard<std::mutex> lock(gPendingMutex);
+        auto known = gCanonicalGlite.find(raw);
+        if (known != gCanonicalGlite.end()) {
+            return *gPending[known->second];
+        }
+    }
+    std::error_code ec;
+    fs::path canonical = fs::weakly_canonical(fs::absolute(glite, ec), ec);
+    std::string key = ec ? glite.lexically_normal().string() : canonical.string();
+    std::lock_guard<std::mutex> lock(gPendingMutex);
+    gCanonicalGlite[raw] = key;
+    auto &slot = gPending[key];
+    if (!slot) {
+        slot = std::make_unique<PendingObjects>();
+    }
+    return *slot;
+}
+
+// The .glite directory `path` lies in, or empty.
+fs::path gliteOf(const fs::path &path) {
+    for (fs::path dir = path.parent_path(); !dir.empty() && dir != dir.parent_path(); dir = dir.parent_path()) {
+        if (dir.filename() == ".glite") {
+            return dir;
+        }
+    }
+    return {};
+}
+
+// Every loose object this repository noted so far, then each containing
+// directory once. An object deleted since (gc packed or pruned it) needs no
+// flush.
+bool flushPendingObjects(const fs::path &glite, std::string &error) {
+    if (!fsyncEnabled()) {
+        return true;
+    }
+    PendingObjects &pending = pendingFor(glite);
+    std::lock_guard<std::mutex> flushing(pending.flushMutex);
+    std::vector<fs::path> paths;
+    {
+        std::lock_guard<std::mutex> lock(gPendingMutex);
+        paths.swap(pending.paths);
+    }
+    std::unordered_set<std::string> directories;
+    for (const auto &path : paths) {
+        std::error_code ec;
+        if (!syncFile(path) && fs::exists(path, ec)) {
+            error = "Unable to flush object " + path.filename().string() + " to disk.";
+            return false;
+        }
+        directories.insert(path.parent_path().string());
+    }
+    // Directories go while flushMutex is still held, for the same reason.
+    for (const auto &directory : directories) {
+        std::error_code ec;
+        if (!syncDirectory(directory) && fs::exists(directory, ec)) {
+            error = "Unable to flush " + directory + " to disk.";
+            return false;
+        }
+    }
+    return true;
+}
+
+bool appendRecord(const fs::path &journalPath, const std::string &record, std::string &error) {
+    std::lock_guard<std::mutex> lock(gJournalMutex);
+    std::error_code ec;
+    bool created = !fs::exists(journalPath, ec);
+    if (!created && fs::file_size(journalPath, ec) > kRotateBytes && !ec) {
+        fs::path old = journalPath;
+        old += ".old";
+        fs::rename(journalPath, old, ec);
+        created = !ec;
+    }
+    {
+        std::ofstream out(journalPath, std::ios::binary | std::ios::app);
+        out.write(record.data(), static_cast<std::streamsize>(record.size()));
+        out.flush();
+        if (!out) {
+            error = "Unable to write " + journalPath.string() + ".";
+            return false;
+        }
+    }
+    if (!syncFile(journalPath) || (created && !syncDirectory(journalPath.parent_path()))) {
+        error = "Unable to flush " + journalPath.string() + " to disk.";
+        return false;
+    }
+    return true;
+}
+
+} // namespace
+
+bool fsyncEnabled() {
+    static const bool enabled = [] {
+        const char *flag = std::getenv("GLITE_FSYNC");
+        return !flag || (std::strcmp(flag, "0") != 0 && std::strcmp(flag, "off") != 0);
+    }();
+    return enabled;
+}
+
+bool syncFile(const fs::path &path) {
+    return syncPath(path, false);
+}
+
+bool syncDirectory(const fs::path &path) {
+    return syncPath(path, true);
+}
+
+void noteObject(const fs::path &path) {
+    if (!fsyncEnabled()) {
+        return;
+    }
+    fs::path glite = gliteOf(path);
+    if (glite.empty()) {
+        // No repository to commit it: flush now.
+        syncFile(path);
+        syncDirectory(path.parent_path());
+        return;
+    }
+    PendingObjects &pending = pendingFor(glite);
+    std::lock_guard<std::mutex> lock(gPendingMutex);
+    pending.paths.push_back(path);
+}
+
+Transaction::Transaction(const fs::path &repoRoot, std::string description)
+    : repoRoot_(repoRoot), glite_(repoRoot / ".glite"), description_(oneLine(std::move(description))),
+      previous_(tCurrent) {
+    if (tCurrent && tCurrent->covers(glite_ / "HEAD")) {
+        outer_ = tCurrent->outer_ ? tCurrent->outer_ : tCurrent;
+    }
+    tCurrent = this;
+}
+
+Transaction::~Transaction() {
+    for (const auto &staged : staged_) {
+        std::error_code ec;
+        fs::remove(staged.lock, ec);
+        if (!staged.link.empty()) {
+            fs::remove(staged.link, ec);
+        }
+    }
+    tCurrent = previous_;
+}
+
+Transaction *Transaction::current() {
+    return tCurrent;
+}
+
+bool Transaction::covers(const fs::path &target) const {
+    return !relativeTo(glite_, target).empty();
+}
+
+bool Transaction::stage(LockFile &lock, std::string &error) {
+    if (outer_) {
+        return outer_->stage(lock, error);
+    }
+    if (done_) {
+        error = "Transaction on " + repoRoot_.string() + " has already committed.";
+        return false;
+    }
+    Staged staged;
+    staged.target = lock.target();
+    staged.lock = lock.path();
+    staged.digest = digestOf(staged.lock);
+    if (staged.digest.empty()) {
+        error = "Unable to read " + staged.lock.string() + ".";
+        return false;
+    }
+    lock.disown();
+    staged_.push_back(std::move(staged));
+    return true;
+}
+
+bool Transaction::commit(std::string &error) {
+    if (outer_) {
+        return true;
+    }
+    static stats::Site site("journal::commit");
+    stats::Timer timer(site);
+    done_ = true;
+
+    if (!flushPendingObjects(glite_, error)) {
+        return false;
+    }
+    if (staged_.empty()) {
+        return true;
+    }
+    std::unordered_set<std::string> directories;
+    std::string id = transactionId();
+    std::string record = "T " + std::to_string(static_cast<long long>(std::time(nullptr))) + " " + description_ +
+                         "\nI " + id + "\n";
+    for (auto &staged : staged_) {
+        if (!syncFile(staged.lock)) {
+            error = "Unable to flush " + staged.lock.string() + " to disk.";
+            return false;
+        }
+        // Without a link (no hard links on this filesystem) a crash leaves
+        // the lock for the user, as an uncommitted one would be.
+        std::error_code ec;
+        fs::path link = ownedLock(staged.target, id);
+        fs::create_hard_link(staged.lock, link, ec);
+        if (!ec) {
+            staged.link = std::move(link);
+        }
+        directories.insert(staged.lock.parent_path().string());
+        record += "W " + relativeTo(glite_, staged.target).generic_string() + " " + staged.digest + "\n";
+    }
+    for (const auto &directory : directories) {
+        if (!syncDirectory(directory)) {
+            error = "Unable to flush " + directory + " to disk.";
+            return false;
+        }
+    }
+    record += "C " + crcHex(record) + "\n";
+    if (!appendRecord(glite_ / "journal", record, error)) {
+        return false;
+    }
+
+    // Committed: from here a failed rename is finished by recovery rather
+    // than rolled back.
+    std::vector<Staged> staged = std::move(staged_);
+    staged_.clear();
+    for (const auto &entry : staged) {
+        std::error_code ec;
+        fs::rename(entry.link.empty() ? entry.lock : entry.link, entry.target, ec);
+        if (ec) {
+            // ENOENT: recovery in another process already moved it into
+            // place and removed the lock.
+            if (digestOf(entry.target) != entry.digest) {
+                error = "Unable to replace " + entry.target.string() + ": " + ec.message();
+                return false;
+            }
+        } else if (!entry.link.empty()) {
+            // The target is in place, so releasing the lock lets the next
+            // writer in.
+            fs::remove(entry.lock, ec);
+        }
+    }
+    return true;
+}
+
+bool commitLock(LockFile &lock, std::string &error) {
+    fs::path glite = lock.target().parent_path();
+    while (!glite.empty() && glite.filename() != ".glite" && glite != glite.parent_path()) {
+        glite = glite.parent_path();
+    }
+    if (glite.filename() != ".glite") {
+        return lock.commit(error);
+    }
+    recover(glite.parent_path());
+    Transaction *bound = Transaction::current();
+    if (bound && bound->covers(lock.target())) {
+        return bound->stage(lock, error);
+    }
+    Transaction transaction(glite.parent_path(), "update " + relativeTo(glite, lock.target()).generic_string());
+    return transaction.stage(lock, error) && transaction.commit(error);
+}
+
+void recover(const fs::path &repoRoot) {
+    {
+        std::lock_guard<std::mutex> lock(gRecoveredMutex);
+        if (!gRecovered.insert(repoRoot.lexically_normal().string()).second) {
+            return;
+        }
+    }
+    fs::path glite = repoRoot / ".glite";
+    std::ifstream in(glite / "journal", std::ios::binary);
+    if (!in) {
+        return;
+    }
+    in.seekg(0, std::ios::end);
+    std::streamoff size = in.tellg();
+    std::streamoff start = size > static_cast<std::streamoff>(kRecoverTailBytes)
+                               ? size - static_cast<std::streamoff>(kRecoverTailBytes)
+                               : 0;
+    in.seekg(start);
+    std::string line;
+    if (start > 0) {
+        std::getline(in, line);
+    }
+
+    // Only transactions whose checksum line made it to disk count. Each
+    // write is kept as (transaction id, target).
+    std::vector<std::pair<std::string, std::string>> writes;
+    std::vector<std::pair<std::string, std::string>> committed;
+    std::string record;
+    std::string id;
+    bool open = false;
+    while (std::getline(in, line)) {
+        if (line.size() < 2 || line[1] != ' ') {
+            open = false;
+            continue;
+        }
+        if (line[0] == 'T') {
+            open = true;
+            record = line + "\n";
+            id.clear();
+            writes.clear();
+        } else if (line[0] == 'I' && open) {
+            record += line + "\n";
+            id = line.substr(2);
+        } else if (line[0] == 'W' && open) {
+            record += line + "\n";
+            std::istringstream fields(line.substr(2));
+            std::string path;
+            fields >> path;
+            writes.emplace_back(id, path);
+        } else if (line[0] == 'C' && open) {
+            if (line.substr(2) == crcHex(record)) {
+                committed.insert(committed.end(), writes.begin(), writes.end());
+            }
+            open = false;
+        }
+    }
+
+    // A link named by a committed transaction is that transaction's own,
+    // whoever holds <target>.lock now. The lock goes only when it is the
+    // same file the link was, i.e. the dead writer's.
+    for (const auto &write : committed) {
+        fs::path target = glite / fs::path(write.second);
+        if (write.first.empty() || relativeTo(glite, target).empty()) {
+            continue;
+        }
+        std::error_code ec;
+        fs::rename(ownedLock(target, write.first), target, ec);
+        if (ec) {
+            continue;
+        }
+        fs::path lockPath = target;
+        lockPath += ".lock";
+        if (fs::equivalent(lockPath, target, ec)) {
+            fs::remove(lockPath, ec);
+        }
+    }
+}
+
+} // namespace journal
@@ -0,0 +1,95 @@
+#pragma once
+
+#include "lock_file.hpp"
+
+#include <filesystem>
+#include <string>
+#include <vector>
+
+// Crash safety for the files a repository's history hangs off: refs, HEAD and
+// the index. Each is still written to "<target>.lock" and renamed into place;
+// this adds the fsyncs that make the rename survive power loss, and batches
+// them so one operation pays for one journal flush however many files it
+// touches.
+//
+// A transaction commits in three steps:
+//   1. fsync every loose object this repository wrote since its last
+//      commit (waiting for a concurrent commit that took them first) and each
+//      staged lock, hard-link each lock to "<target>.<id>.lock" under a
+//      random transaction id, and fsync their directories once;
+//   2. append the transaction and its id to .glite/journal and fsync it -
+//      the commit point;
+//   3. rename the links over their targets, then remove the locks.
+// A crash inside step 3 leaves links and locks behind. The next process to
+// write the repository finds the links of committed transactions by their
+// id and finishes the renames. Another writer's lock never carries that id,
+// so recovery cannot publish it. Locks from an uncommitted transaction are
+// left for the user, as before.
+//
+// GLITE_FSYNC=0 skips every fsync (the journal is still written), for
+// scratch repositories and benchmarks.
+namespace journal {
+
+bool fsyncEnabled();
+// Flush one file or directory to stable storage. No-ops when fsync is off.
+bool syncFile(const std::filesystem::path &path);
+bool syncDirectory(const std::filesystem::path &path);
+
+// Called once a loose object has been renamed into place. Its fsync is
+// deferred to the next commit point of the repository it belongs to, which
+// orders it before any ref that could name it. A file outside any .glite
+// directory is flushed at once.
+void noteObject(const std::filesystem::path &path);
+
+class Transaction {
+public:
+    // Binds itself to the calling thread until destroyed; commitLock() then
+    // stages this repository's locks here instead of committing them one by
+    // one. Constructed while another transaction on the same repository is
+    // bound, it joins that one and commit() defers to the outer commit.
+    Transaction(const std::filesystem::path &repoRoot, std::string description);
+    // Removes any staged locks that were not committed.
+    ~Transaction();
+
+    Transaction(const Transaction &) = delete;
+    Transaction &operator=(const Transaction &) = delete;
+
+    // Takes over a written lock; its rename happens at commit(). A
+    // transaction stages each target at most once.
+    bool stage(LockFile &lock, std::string &error);
+    bool commit(std::string &error);
+
+    // True when `target` lives in this transaction's repository.
+    bool covers(const std::filesystem::path &target) const;
+
+    static Transaction *current();
+
+private:
+    struct Staged {
+        std::filesystem::path target;
+        std::filesystem::path lock;
+        // The lock's "<target>.<id>.lock" name, once commit() has made it.
+        std::filesystem::path link;
+        std::string digest;
+    };
+
+    std::filesystem::path repoRoot_;
+    std::filesystem::path glite_;
+    std::string description_;
+    Transaction *outer_ = nullptr;
+    Transaction *previous_ = nullptr;
+    std::vector<Staged> staged_;
+    bool done_ = false;
+};
+
+// The durable replacement for LockFile::commit(): joins the bound
+// transaction when it covers the target, else commits a transaction of its
+// own around the single file.
+bool commitLock(LockFile &lock, std::string &error);
+
+// Finishes renames of transactions the journal records as committed, from
+// the links named by their ids. Runs once per repository per process, from
+// the first commitLock().
+void recover(const std::filesystem::path &repoRoot);
+
+} // namespace journal
@@ -0,0 +1,74 @@
+#include "lock_file.hpp"
+
+#include <cerrno>
+#include <cstdio>
+#include <fstream>
+#include <system_error>
+
+namespace fs = std::filesystem;
+
+LockFile::LockFile(const fs::path &target)
+    : target_(target), lockPath_(target) {
+    lockPath_ += ".lock";
+}
+
+LockFile::~LockFile() {
+    release();
+}
+
+bool LockFile::acquire(std::string &error) {
+    if (held_) {
+        return true;
+    }
+    std::error_code ec;
+    fs::create_directories(lockPath_.parent_path(), ec);
+    // "x" (C11) fails when the file exists, which makes creation the lock.
+    std::FILE *file = std::fopen(lockPath_.string().c_str(), "wbx");
+    if (!file) {
+        if (errno == EEXIST) {
+            error = "Unable to lock " + target_.filename().string() + ": " + lockPath_.string() +
+                    " exists. Another process may be writing; remove it if not.";
+        } else {
+            error = "Unable to create " + lockPath_.string() + ".";
+        }
+        return false;
+    }
+    std::fclose(file);
+    held_ = true;
+    return true;
+}
+
+bool LockFile::write(const std::string &data, std::string &error) {
+    std::ofstream out(lockPath_, std::ios::binary | std::ios::trunc);
+    out.write(data.data(), static_cast<std::streamsize>(data.size()));
+    out.flush();
+    if (!out) {
+        error = "Unable to write " + lockPath_.string() + ".";
+        return false;
+    }
+    return true;
+}
+
+bool LockFile::commit(std::string &error) {
+    if (!held_) {
+        error = "Lock on " + target_.string() + " is not held.";
+        return false;
+    }
+    std::error_code ec;
+    fs::rename(lockPath_, target_, ec);
+    if (ec) {
+        error = "Unable to replace " + target_.string() + ": " + ec.message();
+        release();
+        return false;
+    }
+    held_ = false;
+    return true;
+}
+
+void LockFile::release() {
+    if (held_) {
+        std::error_code ec;
+        fs::remove(lockPath_, ec);
+        held_ = false;
+    }
+}
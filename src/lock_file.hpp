@@ -0,0 +1,34 @@
+#pragma once
+
+#include <filesystem>
+#include <string>
+
+// Git-style "<target>.lock" file. acquire() creates it exclusively, so only
+// one writer (in any process) can hold it; the new contents are written to
+// path() and commit() renames them over the target. A lock that is neither
+// committed nor released is removed by the destructor.
+class LockFile {
+public:
+    explicit LockFile(const std::filesystem::path &target);
+    ~LockFile();
+
+    LockFile(const LockFile &) = delete;
+    LockFile &operator=(const LockFile &) = delete;
+
+    bool acquire(std::string &error);
+    // Replaces the lock file's contents.
+    bool write(const std::string &data, std::string &error);
+    bool commit(std::string &error);
+    void release();
+    // Forgets the lock without removing it, for a caller that takes over
+    // the rename (see journal::Transaction).
+    void disown() { held_ = false; }
+
+    const std::filesystem::path &path() const { return lockPath_; }
+    const std::filesystem::path &target() const { return target_; }
+
+private:
+    std::filesystem::path target_;
+    std::filesystem::path lockPath_;
+    bool held_ = false;
+};
@@ -1,11 +1,175 @@
 #include "gitlite_app.hpp"
+#include "object_store.hpp"
+#include "server.hpp"
+#include "stats.hpp"
+#include "transport.hpp"
 
+#include <cstdlib>
 #include <exception>
+#include <fstream>
 #include <iostream>
+#include <istream>
+#include <string>
+#include <vector>
 #include <ncurses.h>
 
-int main() {
+namespace {
+
+void printUsage() {
+    std::cerr << "Usage: gitlite [--batch [--user NAME] [--password PASS] [--json] [--keep-going]\n"
+                 "                       [-f SCRIPT | -] [COMMAND...]]\n"
+                 "       gitlite --serve [--bind ADDR] [--port N] [--threads N] [--idle-timeout SECS]\n"
+                 "\n"
+                 "  --batch       Run commands without the interactive UI.\n"
+                 "  --user        Account to log in as (default: $GLITE_USER).\n"
+                 "  --password    Password (default: $GLITE_PASSWORD).\n"
+                 "  --json        Print one JSON object per command.\n"
+                 "  --keep-going  Continue after a failed command.\n"
+                 "  -f SCRIPT     Read commands from SCRIPT, one per line ('-' for stdin).\n"
+                 "\n"
+                 "Each COMMAND argument is one command line, e.g. 'status' or 'commit -m fix'.\n"
+                 "With no COMMAND and no -f, commands are read from stdin.\n"
+                 "\n"
+                 "  --serve       Serve many sessions over TCP (default 127.0.0.1:9419).\n"
+                 "\n"
+                 "GLITE_STATS=1 turns on instrumentation (see the 'stats' command);\n"
+                 "GLITE_TRACE=FILE also writes a Chrome trace of the session to FILE.\n"
+                 "GLITE_FSYNC=0 skips fsync on commit (for scratch repositories).\n"
+                 "GLITE_CHUNK_THRESHOLD=BYTES chunks blobs at least that large (default 4 MiB, 0 off).\n";
+}
+
+void readCommands(std::istream &in, std::vector<std::string> &commands) {
+    std::string line;
+    while (std::getline(in, line)) {
+        commands.push_back(line);
+    }
+}
+
+int runBatch(int argc, char **argv) {
+    BatchOptions options;
+    if (const char *user = std::getenv("GLITE_USER")) {
+        options.username = user;
+    }
+    if (const char *password = std::getenv("GLITE_PASSWORD")) {
+        options.password = password;
+    }
+    std::string script;
+    for (int i = 2; i < argc; ++i) {
+        std::string arg = argv[i];
+        if ((arg == "--user" || arg == "--password" || arg == "-f") && i + 1 < argc) {
+            std::string value = argv[++i];
+            (arg == "--user" ? options.username : arg == "--password" ? options.password : script) = value;
+        } else if (arg == "--json") {
+            options.json = true;
+        } else if (arg == "--keep-going") {
+            options.keepGoing = true;
+        } else if (arg == "-") {
+            script = "-";
+        } else if (arg == "--help" || arg == "-h") {
+            printUsage();
+            return EXIT_SUCCESS;
+        } else if (arg.rfind("--", 0) == 0 || arg == "-f") {
+            std::cerr << "Unknown or incomplete option: " << arg << "\n";
+            printUsage();
+            return 2;
+        } else {
+            options.commands.push_back(arg);
+        }
+    }
+    if (options.username.empty()) {
+        std::cerr << "Batch mode needs --user or GLITE_USER.\n";
+        return 2;
+    }
+    if (script == "-" || (script.empty() && options.commands.empty())) {
+        readCommands(std::cin, options.commands);
+    } else if (!script.empty()) {
+        std::ifstream file(script);
+        if (!file) {
+            std::cerr << "Unable to read script " << script << ".\n";
+            return 2;
+        }
+        readCommands(file, options.commands);
+    }
+    ObjectStore::setMissingObjectFetcher(transport::fetchPromisedObjects);
+    GitLiteApp app(true);
+    return app.runBatch(options);
+}
+
+int runServer(int argc, char **argv) {
+    ServerOptions options;
+    for (int i = 2; i < argc; ++i) {
+        std::string arg = argv[i];
+        if ((arg == "--bind" || arg == "--port" || arg == "--threads" || arg == "--idle-timeout") && i + 1 < argc) {
+            std::string value = argv[++i];
+            if (arg == "--bind") {
+                options.host = value;
+                continue;
+            }
+            long number = 0;
+            try {
+                number = std::stol(value);
+            } catch (const std::exception &) {
+                number = -1;
+            }
+            if (number < 0 || (arg == "--port" && (number == 0 || number > 65535))) {
+                std::cerr << "Invalid value for " << arg << ": " << value << "\n";
+                return 2;
+            }
+            if (arg == "--port") {
+                options.port = static_cast<unsigned short>(number);
+            } else if (arg == "--threads") {
+                options.threads = static_cast<std::size_t>(number);
+            } else {
+                options.idleTimeoutSeconds = static_cast<int>(number);
+            }
+        } else if (arg == "--help" || arg == "-h") {
+            printUsage();
+            return EXIT_SUCCESS;
+        } else {
+            std::cerr << "Unknown or incomplete option: " << arg << "\n";
+            printUsage();
+            return 2;
+        }
+    }
+    Server server(options);
+    std::string error;
+    if (!server.run(error)) {
+        std::cerr << error << "\n";
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+    if (const char *flag = std::getenv("GLITE_STATS")) {
+        stats::setEnabled(std::string(flag) != "" && std::string(flag) != "0");
+    }
+    if (argc > 1 && std::string(argv[1]) == "--batch") {
+        try {
+            return runBatch(argc, argv);
+        } catch (const std::exception &ex) {
+            std::cerr << "Fatal error: " << ex.what() << std::endl;
+            return EXIT_FAILURE;
+        }
+    }
+    if (argc > 1 && std::string(argv[1]) == "--serve") {
+        try {
+            return runServer(argc, argv);
+        } catch (const std::exception &ex) {
+            std::cerr << "Fatal error: " << ex.what() << std::endl;
+            return EXIT_FAILURE;
+        }
+    }
+    if (argc > 1) {
+        printUsage();
+        return 2;
+    }
     try {
+        // Not installed for --serve: sessions must not fetch with each
+        // other's remembered passwords.
+        ObjectStore::setMissingObjectFetcher(transport::fetchPromisedObjects);
         GitLiteApp app;
         app.run();
     } catch (const std::exception &ex) {
@@ -15,5 +179,3 @@ int main() {
     }
     return EXIT_SUCCESS;
 }
-
-
@@ -0,0 +1,88 @@
+#include "mapped_file.hpp"
+
+#include <fstream>
+#include <iterator>
+#include <utility>
+
+#if !defined(_WIN32)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+MappedFile::~MappedFile() {
+    close();
+}
+
+MappedFile::MappedFile(MappedFile &&other) noexcept {
+    *this = std::move(other);
+}
+
+MappedFile &MappedFile::operator=(MappedFile &&other) noexcept {
+    if (this != &other) {
+        close();
+        size_ = other.size_;
+        opened_ = other.opened_;
+        mapped_ = other.mapped_;
+        fallback_ = std::move(other.fallback_);
+        data_ = mapped_ ? other.data_ : reinterpret_cast<const unsigned char *>(fallback_.data());
+        other.data_ = nullptr;
+        other.size_ = 0;
+        other.opened_ = false;
+        other.mapped_ = false;
+    }
+    return *this;
+}
+
+bool MappedFile::open(const std::filesystem::path &path) {
+    close();
+#if !defined(_WIN32)
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+    struct stat st {};
+    if (::fstat(fd, &st) != 0) {
+        ::close(fd);
+        return false;
+    }
+    size_ = static_cast<std::size_t>(st.st_size);
+    opened_ = true;
+    if (size_ == 0) {
+        ::close(fd);
+        return true;
+    }
+    void *addr = ::mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (addr != MAP_FAILED) {
+        data_ = static_cast<const unsigned char *>(addr);
+        mapped_ = true;
+        return true;
+    }
+    opened_ = false;
+    size_ = 0;
+#endif
+    std::ifstream in(path, std::ios::binary);
+    if (!in) {
+        return false;
+    }
+    fallback_.assign(std::istreambuf_iterator<char>(in), {});
+    size_ = fallback_.size();
+    opened_ = true;
+    data_ = size_ == 0 ? nullptr : reinterpret_cast<const unsigned char *>(fallback_.data());
+    return true;
+}
+
+void MappedFile::close() {
+#if !defined(_WIN32)
+    if (mapped_ && data_) {
+        ::munmap(const_cast<unsigned char *>(data_), size_);
+    }
+#endif
+    data_ = nullptr;
+    size_ = 0;
+    opened_ = false;
+    mapped_ = false;
+    fallback_.clear();
+}
@@ -0,0 +1,129 @@
+#include "merge.hpp"
+
+#include "text_diff.hpp"
+
+#include <vector>
+
+namespace merge {
+
+namespace {
+
+constexpr std::size_t kUnmatched = static_cast<std::size_t>(-1);
+
+// For every base line, the index of the same line on the other side (or
+// kUnmatched).
+std::vector<std::size_t> baseMap(const std::vector<std::string> &base, const std::vector<std::string> &side) {
+    std::vector<std::size_t> map(base.size(), kUnmatched);
+    for (const auto &match : textdiff::matchLines(base, side)) {
+        map[match.first] = match.second;
+    }
+    return map;
+}
+
+bool sameRange(const std::vector<std::string> &a,
+               std::size_t aBegin,
+               std::size_t aEnd,
+               const std::vector<std::string> &b,
+               std::size_t bBegin,
+               std::size_t bEnd) {
+    if (aEnd - aBegin != bEnd - bBegin) {
+        return false;
+    }
+    for (std::size_t i = 0; i < aEnd - aBegin; ++i) {
+        if (a[aBegin + i] != b[bBegin + i]) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void appendRange(std::string &out, const std::vector<std::string> &lines, std::size_t begin, std::size_t end) {
+    for (std::size_t i = begin; i < end; ++i) {
+        out += lines[i];
+    }
+}
+
+// Markers must start on a fresh line even when a side lacks a final newline.
+void appendConflictSide(std::string &out, const std::vector<std::string> &lines, std::size_t begin, std::size_t end) {
+    appendRange(out, lines, begin, end);
+    if (!out.empty() && out.back() != '\n') {
+        out += '\n';
+    }
+}
+
+} // namespace
+
+bool mergeText(const std::string &base,
+               const std::string &ours,
+               const std::string &theirs,
+               const std::string &oursLabel,
+               const std::string &theirsLabel,
+               TextMergeResult &result) {
+    result = {};
+    if (textdiff::looksBinary(base) || textdiff::looksBinary(ours) || textdiff::looksBinary(theirs)) {
+        return false;
+    }
+    auto baseLines = textdiff::splitLines(base);
+    auto oursLines = textdiff::splitLines(ours);
+    auto theirsLines = textdiff::splitLines(theirs);
+    auto toOurs = baseMap(baseLines, oursLines);
+    auto toTheirs = baseMap(baseLines, theirsLines);
+
+    std::size_t b = 0;
+    std::size_t o = 0;
+    std::size_t t = 0;
+    while (b < baseLines.size() || o < oursLines.size() || t < theirsLines.size()) {
+        if (b < baseLines.size() && toOurs[b] == o && toTheirs[b] == t) {
+            // Unchanged on both sides.
+            result.text += baseLines[b];
+            ++b;
+            ++o;
+            ++t;
+            continue;
+        }
+        // Unstable chunk: runs to the next base line kept by both sides.
+        std::size_t nextB = b;
+        while (nextB < baseLines.size() && (toOurs[nextB] == kUnmatched || toTheirs[nextB] == kUnmatched)) {
+            ++nextB;
+        }
+        std::size_t nextO = nextB < baseLines.size() ? toOurs[nextB] : oursLines.size();
+        std::size_t nextT = nextB < baseLines.size() ? toTheirs[nextB] : theirsLines.size();
+
+        bool oursUnchanged = sameRange(baseLines, b, nextB, oursLines, o, nextO);
+        bool theirsUnchanged = sameRange(baseLines, b, nextB, theirsLines, t, nextT);
+        if (oursUnchanged) {
+            appendRange(result.text, theirsLines, t, nextT);
+        } else if (theirsUnchanged || sameRange(oursLines, o, nextO, theirsLines, t, nextT)) {
+            appendRange(result.text, oursLines, o, nextO);
+        } else {
+            // Lines both sides agree on at the edges of the chunk stay outside
+            // the markers, as with git's zealous merge.
+            std::size_t head = 0;
+            while (o + head < nextO && t + head < nextT && oursLines[o + head] == theirsLines[t + head]) {
+                ++head;
+            }
+            std::size_t tail = 0;
+            while (o + head + tail < nextO && t + head + tail < nextT &&
+                   oursLines[nextO - tail - 1] == theirsLines[nextT - tail - 1]) {
+                ++tail;
+            }
+            appendRange(result.text, oursLines, o, o + head);
+            ++result.conflicts;
+            if (!result.text.empty() && result.text.back() != '\n') {
+                result.text += '\n';
+            }
+            result.text += "<<<<<<< " + oursLabel + "\n";
+            appendConflictSide(result.text, oursLines, o + head, nextO - tail);
+            result.text += "=======\n";
+            appendConflictSide(result.text, theirsLines, t + head, nextT - tail);
+            result.text += ">>>>>>> " + theirsLabel + "\n";
+            appendRange(result.text, oursLines, nextO - tail, nextO);
+        }
+        b = nextB;
+        o = nextO;
+        t = nextT;
+    }
+    return true;
+}
+
+} // namespace merge
@@ -0,0 +1,26 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+
+// Three-way text merge (diff3 style) for files changed on both sides.
+namespace merge {
+
+struct TextMergeResult {
+    std::string text;
+    std::size_t conflicts = 0;
+};
+
+// Merges `ours` and `theirs`, which both descend from `base`. Regions changed
+// on only one side are taken from that side; regions changed differently on
+// both sides are written between conflict markers labelled with `oursLabel`
+// and `theirsLabel`. Returns false without merging when any input looks
+// binary.
+bool mergeText(const std::string &base,
+               const std::string &ours,
+               const std::string &theirs,
+               const std::string &oursLabel,
+               const std::string &theirsLabel,
+               TextMergeResult &result);
+
+} // namespace merge
@@ -0,0 +1,1349 @@
+#include "object_store.hpp"
+
+#include "chunk_store.hpp"
+#include "compression.hpp"
+#include "hashing.hpp"
+#include "journal.hpp"
+#include "stats.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <system_error>
+#include <unordered_set>
+
+#if defined(__linux__)
+#include <fcntl.h>
+#include <linux/fs.h>
+#include <sys/ioctl.h>
+#include <unistd.h>
+#elif defined(__APPLE__)
+#include <sys/clonefile.h>
+#endif
+
+namespace fs = std::filesystem;
+
+namespace {
+
+constexpr char kPackMagic[4] = {'G', 'L', 'P', 'K'};
+constexpr char kIndexMagic[4] = {'G', 'L', 'P', 'I'};
+constexpr std::uint32_t kPackVersion = 1;
+constexpr std::size_t kPackHeaderSize = 8;
+constexpr std::size_t kEntryHeaderSize = 9;
+constexpr std::size_t kFanoutSize = 256 * 4;
+constexpr std::size_t kIndexHeaderSize = 8 + kFanoutSize;
+constexpr unsigned char kKindRaw = 0;
+constexpr unsigned char kKindZlib = 1;
+constexpr unsigned char kKindDelta = 2;
+constexpr unsigned char kKindChunked = 3;
+constexpr char kLooseMagic[4] = {'G', 'L', 'Z', '1'};
+constexpr std::size_t kReadWindow = 64 * 1024;
+// Guards against corrupt packs whose delta bases form a loop.
+constexpr int kMaxResolveDepth = 64;
+// Smaller blobs are cheaper to decode and write than to clone.
+constexpr std::uint64_t kCloneThreshold = 64 * 1024;
+// Bounds chains of alternates (a fork of a fork ...) and breaks cycles.
+constexpr int kMaxAlternateDepth = 5;
+
+std::mutex gFetcherMutex;
+ObjectStore::MissingObjectFetcher gFetcher;
+
+void putU32(std::string &out, std::uint32_t value) {
+    for (int i = 0; i < 4; ++i) {
+        out.push_back(static_cast<char>((value >> (8 * i)) & 0xff));
+    }
+}
+
+void putU64(std::string &out, std::uint64_t value) {
+    for (int i = 0; i < 8; ++i) {
+        out.push_back(static_cast<char>((value >> (8 * i)) & 0xff));
+    }
+}
+
+std::uint32_t getU32(const unsigned char *p) {
+    std::uint32_t value = 0;
+    for (int i = 3; i >= 0; --i) {
+        value = (value << 8) | p[i];
+    }
+    return value;
+}
+
+std::uint64_t getU64(const unsigned char *p) {
+    std::uint64_t value = 0;
+    for (int i = 7; i >= 0; --i) {
+        value = (value << 8) | p[i];
+    }
+    return value;
+}
+
+bool isObjectId(const std::string &id) {
+    if (id.size() != hashing::kDigestBytes * 2) {
+        return false;
+    }
+    return std::all_of(id.begin(), id.end(), [](char ch) {
+        return (ch >= '0' && ch <= '9') || (ch >= 'a' && ch <= 'f');
+    });
+}
+
+bool readWholeFile(const fs::path &path, std::string &data) {
+    stats::count(stats::Counter::FsCalls);
+    std::ifstream in(path, std::ios::binary);
+    if (!in) {
+        return false;
+    }
+    data.assign(std::istreambuf_iterator<char>(in), {});
+    return !in.bad();
+}
+
+bool hasLooseMagic(const char *data, std::size_t length) {
+    return length >= sizeof(kLooseMagic) && std::memcmp(data, kLooseMagic, sizeof(kLooseMagic)) == 0;
+}
+
+// Raw data that happens to start with the loose or manifest magic is always
+// compressed so it cannot be mistaken for an encoded object.
+bool looksEncoded(const char *data, std::size_t length) {
+    return hasLooseMagic(data, length) || chunks::isManifest(data, length);
+}
+
+// Compressed output is only kept when it saves at least ~5%.
+bool worthCompressing(std::size_t rawSize, std::size_t compressedSize) {
+    return compressedSize + rawSize / 20 < rawSize;
+}
+
+bool storedRaw(const fs::path &loose) {
+    std::ifstream in(loose, std::ios::binary);
+    char header[sizeof(kLooseMagic)] = {};
+    in.read(header, sizeof(header));
+    return in && !looksEncoded(header, sizeof(header));
+}
+
+bool storedManifest(const fs::path &loose) {
+    std::ifstream in(loose, std::ios::binary);
+    char header[chunks::kMagicSize] = {};
+    in.read(header, sizeof(header));
+    return in && chunks::isManifest(header, sizeof(header));
+}
+
+// Copy-on-write clone: the target gets its own inode, so later edits in the
+// workspace cannot reach the object file. False when unsupported.
+bool cloneFile(const fs::path &source, const fs::path &target) {
+#if defined(__linux__) && defined(FICLONE)
+    int in = ::open(source.c_str(), O_RDONLY | O_CLOEXEC);
+    if (in < 0) {
+        return false;
+    }
+    int out = ::open(target.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (out < 0) {
+        ::close(in);
+        return false;
+    }
+    bool cloned = ::ioctl(out, FICLONE, in) == 0;
+    ::close(in);
+    ::close(out);
+    return cloned;
+#elif defined(__APPLE__)
+    std::error_code ec;
+    fs::remove(target, ec);
+    return ::clonefile(source.c_str(), target.c_str(), 0) == 0;
+#else
+    (void)source;
+    (void)target;
+    return false;
+#endif
+}
+
+bool decodeLoose(std::string &data, const std::vector<fs::path> &chunkDirs) {
+    if (chunks::isManifest(data.data(), data.size())) {
+        chunks::Manifest manifest;
+        std::string error;
+        return chunks::decodeManifest(data, manifest) && chunks::assemble(chunkDirs, manifest, data, error);
+    }
+    if (!hasLooseMagic(data.data(), data.size())) {
+        return true;
+    }
+    std::string decoded;
+    if (!compression::inflateBytes(reinterpret_cast<const unsigned char *>(data.data()) + sizeof(kLooseMagic),
+                                   data.size() - sizeof(kLooseMagic),
+                                   decoded)) {
+        return false;
+    }
+    data.swap(decoded);
+    return true;
+}
+
+bool writeScratch(const fs::path &path, const std::string &header, const std::string &body) {
+    stats::count(stats::Counter::FsCalls);
+    std::ofstream out(path, std::ios::binary | std::ios::trunc);
+    if (!out) {
+        return false;
+    }
+    out << header << body;
+    out.flush();
+    return static_cast<bool>(out);
+}
+
+struct PendingObject {
+    std::string rawId;
+    std::string hexId;
+    std::string hint;
+    std::uint64_t size = 0;
+};
+
+} // namespace
+
+bool ObjectStore::Pack::find(const unsigned char *rawId, std::uint64_t &offset) const {
+    const unsigned char *base = index.data();
+    const unsigned char *fanout = base + 8;
+    std::uint32_t first = rawId[0];
+    std::uint32_t lo = first == 0 ? 0 : getU32(fanout + 4 * (first - 1));
+    std::uint32_t hi = getU32(fanout + 4 * first);
+    const unsigned char *ids = base + kIndexHeaderSize;
+    while (lo < hi) {
+        std::uint32_t mid = lo + (hi - lo) / 2;
+        int cmp = std::memcmp(ids + static_cast<std::size_t>(mid) * hashing::kDigestBytes, rawId, hashing::kDigestBytes);
+        if (cmp == 0) {
+            const unsigned char *offsets = ids + static_cast<std::size_t>(count) * hashing::kDigestBytes;
+            offset = getU64(offsets + static_cast<std::size_t>(mid) * 8);
+            return true;
+        }
+        if (cmp < 0) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return false;
+}
+
+bool ObjectStore::Pack::entryHeader(std::uint64_t offset, unsigned char &kind, std::uint64_t &length) const {
+    if (offset + kEntryHeaderSize > pack.size()) {
+        return false;
+    }
+    const unsigned char *entry = pack.data() + offset;
+    kind = entry[0];
+    length = getU64(entry + 1);
+    return offset + kEntryHeaderSize + length <= pack.size();
+}
+
+ObjectStore::ObjectStore(const fs::path &repoRoot) : ObjectStore(repoRoot, 0) {}
+
+ObjectStore::ObjectStore(const fs::path &repoRoot, int alternateDepth)
+    : objectsDir_(repoRoot / ".glite" / "objects"), alternateDepth_(alternateDepth) {}
+
+ObjectStore::~ObjectStore() = default;
+
+const fs::path &ObjectStore::objectsDir() const {
+    return objectsDir_;
+}
+
+void ObjectStore::loadPacks() const {
+    std::lock_guard<std::mutex> lock(packsMutex_);
+    if (packsLoaded_) {
+        return;
+    }
+    packsLoaded_ = true;
+    packs_.clear();
+    fs::path packDir = objectsDir_ / "pack";
+    std::error_code ec;
+    if (!fs::is_directory(packDir, ec)) {
+        return;
+    }
+    for (const auto &entry : fs::directory_iterator(packDir, ec)) {
+        if (entry.path().extension() == ".idx") {
+            addPack(entry.path());
+        }
+    }
+}
+
+bool ObjectStore::refreshPacks() const {
+    loadPacks();
+    fs::path packDir = objectsDir_ / "pack";
+    std::error_code ec;
+    if (!fs::is_directory(packDir, ec)) {
+        return false;
+    }
+    std::lock_guard<std::mutex> lock(packsMutex_);
+    std::unordered_set<std::string> known;
+    for (const auto &pack : packs_) {
+        known.insert(pack->indexPath.filename().string());
+    }
+    bool added = false;
+    for (const auto &entry : fs::directory_iterator(packDir, ec)) {
+        if (entry.path().extension() == ".idx" && known.count(entry.path().filename().string()) == 0) {
+            added = addPack(entry.path()) || added;
+        }
+    }
+    return added;
+}
+
+bool ObjectStore::addPack(const fs::path &indexPath) const {
+    auto pack = std::make_unique<Pack>();
+    pack->indexPath = indexPath;
+    pack->packPath = indexPath;
+    pack->packPath.replace_extension(".pack");
+    if (!pack->index.open(pack->indexPath) || !pack->pack.open(pack->packPath)) {
+        return false;
+    }
+    if (pack->index.size() < kIndexHeaderSize ||
+        std::memcmp(pack->index.data(), kIndexMagic, 4) != 0 ||
+        pack->pack.size() < kPackHeaderSize ||
+        std::memcmp(pack->pack.data(), kPackMagic, 4) != 0) {
+        return false;
+    }
+    pack->count = getU32(pack->index.data() + 8 + 255 * 4);
+    std::size_t expected = kIndexHeaderSize + static_cast<std::size_t>(pack->count) * (hashing::kDigestBytes + 8);
+    if (pack->index.size() < expected) {
+        return false;
+    }
+    packs_.push_back(std::move(pack));
+    return true;
+}
+
+bool ObjectStore::findPacked(const std::string &id, const Pack *&pack, std::uint64_t &offset) const {
+    unsigned char raw[hashing::kDigestBytes];
+    if (!hashing::fromHex(id, raw, sizeof(raw))) {
+        return false;
+    }
+    loadPacks();
+    // refreshPacks may append while another thread looks up.
+    std::lock_guard<std::mutex> lock(packsMutex_);
+    for (const auto &candidate : packs_) {
+        if (candidate->find(raw, offset)) {
+            pack = candidate.get();
+            return true;
+        }
+    }
+    return false;
+}
+
+bool ObjectStore::contains(const std::string &id) const {
+    if (!isObjectId(id)) {
+        return false;
+    }
+    const Pack *pack = nullptr;
+    std::uint64_t offset = 0;
+    if (findPacked(id, pack, offset)) {
+        return true;
+    }
+    std::error_code ec;
+    return fs::is_regular_file(objectsDir_ / id, ec) || alternateWith(id) != nullptr;
+}
+
+bool ObjectStore::readPacked(const Pack &pack, std::uint64_t offset, std::string &data, int depth) const {
+    unsigned char kind = 0;
+    std::uint64_t length = 0;
+    if (depth > kMaxResolveDepth || !pack.entryHeader(offset, kind, length)) {
+        return false;
+    }
+    const unsigned char *payload = pack.pack.data() + offset + kEntryHeaderSize;
+    auto size = static_cast<std::size_t>(length);
+    if (kind == kKindRaw) {
+        data.assign(reinterpret_cast<const char *>(payload), size);
+        return true;
+    }
+    if (kind == kKindZlib) {
+        return compression::inflateBytes(payload, size, data);
+    }
+    if (kind == kKindChunked) {
+        chunks::Manifest manifest;
+        std::string error;
+        return chunks::decodeManifest(std::string(reinterpret_cast<const char *>(payload), size), manifest) &&
+               chunks::assemble(chunkDirs(), manifest, data, error);
+    }
+    if (kind != kKindDelta || size < hashing::kDigestBytes) {
+        return false;
+    }
+    std::string delta;
+    if (!compression::inflateBytes(payload + hashing::kDigestBytes, size - hashing::kDigestBytes, delta)) {
+        return false;
+    }
+    std::string baseId = hashing::toHex(payload, hashing::kDigestBytes);
+    const Pack *basePack = nullptr;
+    std::uint64_t baseOffset = 0;
+    std::string base;
+    if (findPacked(baseId, basePack, baseOffset)) {
+        if (!readPacked(*basePack, baseOffset, base, depth + 1)) {
+            return false;
+        }
+    } else if (!readWholeFile(objectsDir_ / baseId, base) || !decodeLoose(base, chunkDirs())) {
+        return false;
+    }
+    return compression::applyDelta(base, delta, data);
+}
+
+bool ObjectStore::read(const std::string &id, std::string &data) const {
+    if (!isObjectId(id)) {
+        return false;
+    }
+    stats::count(stats::Counter::ObjectsRead);
+    const Pack *pack = nullptr;
+    std::uint64_t offset = 0;
+    if (findPacked(id, pack, offset)) {
+        return readPacked(*pack, offset, data, 0);
+    }
+    if (readWholeFile(objectsDir_ / id, data)) {
+        return decodeLoose(data, chunkDirs());
+    }
+    for (const auto &alternate : alternates()) {
+        if (alternate->read(id, data)) {
+            return true;
+        }
+    }
+    std::string error;
+    if (isPartial() && fetchMissing({id}, error) && readWholeFile(objectsDir_ / id, data) &&
+        decodeLoose(data, chunkDirs())) {
+        return true;
+    }
+    // Readers take no lock, so a repack may have moved the object into a pack
+    // written after packs_ was loaded. Pick up only the packs not seen yet;
+    // the ones already mapped stay valid even if their files are gone.
+    return refreshPacks() && findPacked(id, pack, offset) && readPacked(*pack, offset, data, 0);
+}
+
+bool ObjectStore::readManifest(const std::string &id, chunks::Manifest &manifest) const {
+    if (!isObjectId(id)) {
+        return false;
+    }
+    const Pack *pack = nullptr;
+    std::uint64_t offset = 0;
+    if (findPacked(id, pack, offset)) {
+        unsigned char kind = 0;
+        std::uint64_t length = 0;
+        return pack->entryHeader(offset, kind, length) && kind == kKindChunked &&
+               chunks::decodeManifest(std::string(reinterpret_cast<const char *>(pack->pack.data() + offset + kEntryHeaderSize),
+                                                  static_cast<std::size_t>(length)),
+                                      manifest);
+    }
+    fs::path loose = objectsDir_ / id;
+    std::error_code ec;
+    if (fs::is_regular_file(loose, ec)) {
+        std::string data;
+        return storedManifest(loose) && readWholeFile(loose, data) && chunks::decodeManifest(data, manifest);
+    }
+    const ObjectStore *alternate = alternateWith(id);
+    return alternate != nullptr && alternate->readManifest(id, manifest);
+}
+
+bool ObjectStore::writeManifest(const std::string &id, const chunks::Manifest &manifest, std::string &error) const {
+    if (contains(id)) {
+        return true;
+    }
+    for (const auto &chunk : manifest.chunks) {
+        if (!chunks::contains(chunkDir(), chunk.id)) {
+            error = "Chunk " + chunk.id + " of object " + id + " is not in the chunk store.";
+            return false;
+        }
+    }
+    fs::path scratch = scratchPath();
+    if (!writeScratch(scratch, std::string(), chunks::encodeManifest(manifest))) {
+        error = "Unable to write object " + id + ".";
+        std::error_code ec;
+        fs::remove(scratch, ec);
+        return false;
+    }
+    return adoptLoose(scratch, id, error);
+}
+
+bool ObjectStore::copyManifest(const ObjectStore &source, const std::string &id, std::string &error) const {
+    chunks::Manifest manifest;
+    if (!source.readManifest(id, manifest)) {
+        return false;
+    }
+    if (contains(id)) {
+        return true;
+    }
+    std::vector<fs::path> from = source.chunkDirs();
+    for (const auto &chunk : manifest.chunks) {
+        if (!chunks::copy(from, chunkDir(), chunk.id, error)) {
+            return false;
+        }
+    }
+    return writeManifest(id, manifest, error);
+}
+
+bool ObjectStore::materialize(const std::string &id, const fs::path &target, std::string &error) const {
+    // Chunked blobs are written one chunk at a time and never held whole.
+    chunks::Manifest manifest;
+    if (readManifest(id, manifest)) {
+        std::ofstream out(target, std::ios::binary | std::ios::trunc);
+        if (!chunks::assemble(chunkDirs(), manifest, out, error)) {
+            error = out ? error : "Unable to write " + target.string() + ".";
+            return false;
+        }
+        out.flush();
+        if (!out) {
+            error = "Unable to write " + target.string() + ".";
+            return false;
+        }
+        return true;
+    }
+    const Pack *pack = nullptr;
+    std::uint64_t offset = 0;
+    if (isObjectId(id) && !findPacked(id, pack, offset)) {
+        fs::path loose = objectsDir_ / id;
+        std::error_code ec;
+        auto size = fs::file_size(loose, ec);
+        if (ec) {
+            // Borrowed objects are cloned straight from the store that has them.
+            if (const ObjectStore *alternate = alternateWith(id)) {
+                return alternate->materialize(id, target, error);
+            }
+        } else if (size >= kCloneThreshold && storedRaw(loose)) {
+            if (cloneFile(loose, target)) {
+                return true;
+            }
+            fs::copy_file(loose, target, fs::copy_options::overwrite_existing, ec);
+            if (!ec) {
+                return true;
+            }
+        }
+    }
+    std::string data;
+    if (!read(id, data)) {
+        error = "Missing object " + id + ".";
+        return false;
+    }
+    std::ofstream out(target, std::ios::binary | std::ios::trunc);
+    out << data;
+    out.flush();
+    if (!out) {
+        error = "Unable to write " + target.string() + ".";
+        return false;
+    }
+    return true;
+}
+
+void ObjectStore::setMissingObjectFetcher(MissingObjectFetcher fetcher) {
+    std::lock_guard<std::mutex> lock(gFetcherMutex);
+    gFetcher = std::move(fetcher);
+}
+
+bool ObjectStore::isPartial() const {
+    std::error_code ec;
+    return fs::is_regular_file(objectsDir_.parent_path() / "promisor", ec);
+}
+
+bool ObjectStore::prefetch(const std::vector<std::string> &ids, std::string &error) const {
+    if (!isPartial()) {
+        return true;
+    }
+    std::vector<std::string> missing;
+    std::unordered_set<std::string> seen;
+    for (const auto &id : ids) {
+        if (isObjectId(id) && seen.insert(id).second && !contains(id)) {
+            missing.push_back(id);
+        }
+    }
+    return missing.empty() || fetchMissing(missing, error);
+}
+
+bool ObjectStore::fetchMissing(const std::vector<std::string> &ids, std::string &error) const {
+    // One fetch at a time: concurrent readers missing the same blob would
+    // otherwise download it twice.
+    std::lock_guard<std::mutex> lock(gFetcherMutex);
+    std::vector<std::string> missing;
+    for (const auto &id : ids) {
+        std::error_code ec;
+        if (!fs::is_regular_file(objectsDir_ / id, ec)) {
+            missing.push_back(id);
+        }
+    }
+    if (missing.empty()) {
+        return true;
+    }
+    if (!gFetcher) {
+        error = "Object " + missing.front() + " is not in this partial clone and cannot be fetched here.";
+        return false;
+    }
+    return gFetcher(objectsDir_.parent_path().parent_path(), missing, error);
+}
+
+std::vector<fs::path> ObjectStore::alternateDirs() const {
+    std::vector<fs::path> dirs;
+    std::ifstream in(objectsDir_ / "info" / "alternates");
+    std::string line;
+    while (std::getline(in, line)) {
+        if (!line.empty() && line.back() == '\r') {
+            line.pop_back();
+        }
+        if (!line.empty() && line[0] != '#') {
+            dirs.emplace_back(line);
+        }
+    }
+    return dirs;
+}
+
+const std::vector<std::unique_ptr<ObjectStore>> &ObjectStore::alternates() const {
+    std::lock_guard<std::mutex> lock(alternatesMutex_);
+    if (!alternatesLoaded_) {
+        alternatesLoaded_ = true;
+        if (alternateDepth_ < kMaxAlternateDepth) {
+            for (const auto &dir : alternateDirs()) {
+                std::error_code ec;
+                if (dir != objectsDir_ && fs::is_directory(dir, ec)) {
+                    alternates_.emplace_back(new ObjectStore(dir.parent_path().parent_path(), alternateDepth_ + 1));
+                }
+            }
+        }
+    }
+    return alternates_;
+}
+
+fs::path ObjectStore::chunkDir() const {
+    return objectsDir_ / "chunks";
+}
+
+std::vector<fs::path> ObjectStore::chunkDirs() const {
+    std::vector<fs::path> dirs = {chunkDir()};
+    for (const auto &alternate : alternates()) {
+        for (auto &dir : alternate->chunkDirs()) {
+            dirs.push_back(std::move(dir));
+        }
+    }
+    return dirs;
+}
+
+const ObjectStore *ObjectStore::alternateWith(const std::string &id) const {
+    for (const auto &alternate : alternates()) {
+        if (alternate->contains(id)) {
+            return alternate.get();
+        }
+    }
+    return nullptr;
+}
+
+bool ObjectStore::addAlternate(const fs::path &objectsDir, std::string &error) const {
+    fs::path dir = fs::absolute(objectsDir).lexically_normal();
+    for (const auto &existing : alternateDirs()) {
+        if (existing == dir) {
+            return true;
+        }
+    }
+    std::error_code ec;
+    fs::create_directories(objectsDir_ / "info", ec);
+    std::ofstream out(objectsDir_ / "info" / "alternates", std::ios::app);
+    out << dir.string() << "\n";
+    out.flush();
+    if (!out) {
+        error = "Unable to write " + (objectsDir_ / "info" / "alternates").string() + ".";
+        return false;
+    }
+    return true;
+}
+
+bool ObjectStore::dissociate(std::string &error) const {
+    // Hard links make this cheap on one filesystem; the source may be deleted
+    // right after, so sharing its inodes is safe.
+    auto adopt = [this, &error](const fs::path &source, const fs::path &target) {
+        std::error_code ec;
+        if (fs::exists(target, ec)) {
+            return true;
+        }
+        fs::create_hard_link(source, target, ec);
+        if (!ec) {
+            return true;
+        }
+        fs::path scratch = scratchPath();
+        fs::copy_file(source, scratch, ec);
+        if (!ec) {
+            fs::rename(scratch, target, ec);
+        }
+        if (ec) {
+            fs::remove(scratch, ec);
+            error = "Unable to copy " + source.string() + ".";
+            return false;
+        }
+        return true;
+    };
+    std::vector<fs::path> pending = alternateDirs();
+    std::unordered_set<std::string> visited;
+    while (!pending.empty()) {
+        fs::path dir = pending.back();
+        pending.pop_back();
+        if (dir == objectsDir_ || !visited.insert(dir.string()).second) {
+            continue;
+        }
+        ObjectStore source(dir.parent_path().parent_path());
+        std::error_code ec;
+        // Chunks first, so no manifest adopted here lists a chunk this store
+        // lacks.
+        if (fs::is_directory(dir / "chunks", ec)) {
+            for (const auto &entry : fs::recursive_directory_iterator(dir / "chunks", ec)) {
+                fs::path target = chunkDir() / entry.path().lexically_relative(dir / "chunks");
+                if (entry.is_directory(ec)) {
+                    fs::create_directories(target, ec);
+                } else if (entry.is_regular_file(ec) && entry.path().filename().string().rfind("tmp-", 0) != 0 &&
+                           !adopt(entry.path(), target)) {
+                    return false;
+                }
+            }
+        }
+        for (const auto &id : source.listLoose()) {
+            if (!adopt(dir / id, objectsDir_ / id)) {
+                return false;
+            }
+        }
+        if (fs::is_directory(dir / "pack", ec)) {
+            fs::create_directories(objectsDir_ / "pack", ec);
+            for (const auto &entry : fs::directory_iterator(dir / "pack", ec)) {
+                // The pack goes first: an index is only loaded next to its pack.
+                if (entry.path().extension() != ".idx") {
+                    continue;
+                }
+                fs::path packFile = entry.path();
+                packFile.replace_extension(".pack");
+                if (!adopt(packFile, objectsDir_ / "pack" / packFile.filename()) ||
+                    !adopt(entry.path(), objectsDir_ / "pack" / entry.path().filename())) {
+                    return false;
+                }
+            }
+        }
+        for (const auto &nested : source.alternateDirs()) {
+            pending.push_back(nested);
+        }
+    }
+    std::error_code ec;
+    fs::remove(objectsDir_ / "info" / "alternates", ec);
+    return true;
+}
+
+std::uint64_t ObjectStore::storedSize(const std::string &id) const {
+    const Pack *pack = nullptr;
+    std::uint64_t offset = 0;
+    if (findPacked(id, pack, offset)) {
+        unsigned char kind = 0;
+        std::uint64_t length = 0;
+        return pack->entryHeader(offset, kind, length) ? length : 0;
+    }
+    std::error_code ec;
+    auto size = fs::file_size(objectsDir_ / id, ec);
+    return ec ? 0 : static_cast<std::uint64_t>(size);
+}
+
+fs::path ObjectStore::scratchPath() const {
+    static std::atomic<unsigned long> counter{0};
+    auto ticks = std::chrono::steady_clock::now().time_since_epoch().count();
+    return objectsDir_ / ("tmp-" + std::to_string(ticks) + "-" + std::to_string(counter++));
+}
+
+bool ObjectStore::writeLoose(const std::string &id, const std::string &data, std::string &error) const {
+    if (contains(id)) {
+        return true;
+    }
+    if (chunks::enabled() && data.size() >= chunks::threshold()) {
+        chunks::Manifest manifest;
+        return chunks::writeAll(chunkDir(), data, manifest, error) && writeManifest(id, manifest, error);
+    }
+    fs::path scratch = scratchPath();
+    std::string compressed;
+    bool compress = compression::deflateBytes(reinterpret_cast<const unsigned char *>(data.data()), data.size(), compressed) &&
+                    (worthCompressing(data.size(), compressed.size()) || looksEncoded(data.data(), data.size()));
+    bool written = compress ? writeScratch(scratch, std::string(kLooseMagic, sizeof(kLooseMagic)), compressed)
+                            : writeScratch(scratch, std::string(), data);
+    if (!written) {
+        error = "Unable to write object " + id + ".";
+        std::error_code ec;
+        fs::remove(scratch, ec);
+        return false;
+    }
+    return adoptLoose(scratch, id, error);
+}
+
+bool ObjectStore::writeLooseFromFile(const fs::path &source, std::string &id, std::string &error) const {
+    static stats::Site site("ObjectStore::writeLooseFromFile");
+    stats::Timer timer(site);
+    if (chunks::enabled()) {
+        std::error_code ec;
+        auto size = fs::file_size(source, ec);
+        if (!ec && size >= chunks::threshold()) {
+            return writeChunkedFromFile(source, id, error);
+        }
+    }
+    stats::count(stats::Counter::FsCalls, 2);
+    std::ifstream in(source, std::ios::binary);
+    if (!in) {
+        error = "Unable to open file for hashing: " + source.string();
+        return false;
+    }
+    fs::path scratch = scratchPath();
+    std::ofstream out(scratch, std::ios::binary | std::ios::trunc);
+    if (!out) {
+        error = "Unable to write object for " + source.string() + ".";
+        return false;
+    }
+    auto fail = [&](const std::string &message) {
+        out.close();
+        std::error_code ec;
+        fs::remove(scratch, ec);
+        error = message;
+        return false;
+    };
+
+    std::vector<char> buffer(kReadWindow);
+    in.read(buffer.data(), static_cast<std::streamsize>(buffer.size()));
+    auto got = static_cast<std::size_t>(in.gcount());
+
+    // The first window decides the encoding: incompressible files (media,
+    // archives, binaries) are stored raw instead of paying for zlib.
+    std::string probe;
+    bool compress = compression::deflateBytes(reinterpret_cast<const unsigned char *>(buffer.data()), got, probe) &&
+                    (worthCompressing(got, probe.size()) || looksEncoded(buffer.data(), got));
+
+    hashing::Sha256Stream hasher;
+    compression::DeflateStream deflater;
+    std::string encoded;
+    if (compress) {
+        out.write(kLooseMagic, sizeof(kLooseMagic));
+    }
+    while (got > 0) {
+        const auto *bytes = reinterpret_cast<const unsigned char *>(buffer.data());
+        hasher.update(bytes, got);
+        if (compress) {
+            encoded.clear();
+            if (!deflater.update(bytes, got, encoded)) {
+                return fail("Compression failed for " + source.string() + ".");
+            }
+            out << encoded;
+        } else {
+            out.write(buffer.data(), static_cast<std::streamsize>(got));
+        }
+        if (!in) {
+            break;
+        }
+        in.read(buffer.data(), static_cast<std::streamsize>(buffer.size()));
+        got = static_cast<std::size_t>(in.gcount());
+    }
+    if (in.bad()) {
+        return fail("Read error while hashing: " + source.string());
+    }
+    if (compress) {
+        encoded.clear();
+        if (!deflater.finish(encoded)) {
+            return fail("Compression failed for " + source.string() + ".");
+        }
+        out << encoded;
+    }
+    out.flush();
+    if (!out) {
+        return fail("Unable to write object for " + source.string() + ".");
+    }
+    out.close();
+    id = hasher.finalHex();
+    return adoptLoose(scratch, id, error);
+}
+
+bool ObjectStore::writeChunkedFromFile(const fs::path &source, std::string &id, std::string &error) const {
+    static stats::Site site("ObjectStore::writeChunkedFromFile");
+    stats::Timer timer(site);
+    stats::count(stats::Counter::FsCalls);
+    std::ifstream in(source, std::ios::binary);
+    if (!in) {
+        error = "Unable to open file for hashing: " + source.string();
+        return false;
+    }
+    // The buffer holds at least one maximal chunk ahead of the cut, so
+    // boundaries come out the same as chunking the whole file at once.
+    hashing::Sha256Stream hasher;
+    chunks::Manifest manifest;
+    std::vector<char> block(kReadWindow);
+    std::string pending;
+    std::size_t start = 0;
+    bool done = false;
+    while (true) {
+        while (!done && pending.size() - start < chunks::kMaxChunk) {
+            in.read(block.data(), static_cast<std::streamsize>(block.size()));
+            auto got = static_cast<std::size_t>(in.gcount());
+            hasher.update(reinterpret_cast<const unsigned char *>(block.data()), got);
+            pending.append(block.data(), got);
+            done = !in;
+        }
+        if (in.bad()) {
+            error = "Read error while hashing: " + source.string();
+            return false;
+        }
+        std::size_t available = pending.size() - start;
+        if (available == 0) {
+            break;
+        }
+        const auto *bytes = reinterpret_cast<const unsigned char *>(pending.data()) + start;
+        chunks::ChunkRef chunk;
+        chunk.length = static_cast<std::uint32_t>(chunks::cutPoint(bytes, available));
+        if (!chunks::write(chunkDir(), bytes, chunk.length, chunk.id, error)) {
+            return false;
+        }
+        manifest.size += chunk.length;
+        manifest.chunks.push_back(std::move(chunk));
+        start += manifest.chunks.back().length;
+        if (start >= chunks::kMaxChunk) {
+            pending.erase(0, start);
+            start = 0;
+        }
+    }
+    id = hasher.finalHex();
+    return writeManifest(id, manifest, error);
+}
+
+void ObjectStore::writeLooseBatch(const std::vector<fs::path> &sources,
+                                  std::vector<std::string> &ids,
+                                  std::vector<std::string> &errors) const {
+    static stats::Site site("ObjectStore::writeLooseBatch");
+    stats::Timer timer(site);
+    ids.assign(sources.size(), std::string());
+    errors.assign(sources.size(), std::string());
+    std::vector<std::string> contents(sources.size());
+    std::vector<hashing::Buffer> buffers;
+    std::vector<std::size_t> owners;
+    for (std::size_t i = 0; i < sources.size(); ++i) {
+        if (!readWholeFile(sources[i], contents[i])) {
+            errors[i] = "Unable to open file for hashing: " + sources[i].string();
+            continue;
+        }
+        buffers.push_back({reinterpret_cast<const unsigned char *>(contents[i].data()), contents[i].size()});
+        owners.push_back(i);
+    }
+    std::vector<hashing::Digest> digests(buffers.size());
+    hashing::sha256Batch(buffers.data(), buffers.size(), digests.data());
+    for (std::size_t k = 0; k < owners.size(); ++k) {
+        std::size_t i = owners[k];
+        ids[i] = digests[k].hex();
+        if (!writeLoose(ids[i], contents[i], errors[i]) && errors[i].empty()) {
+            errors[i] = "Unable to store object.";
+        }
+    }
+}
+
+bool ObjectStore::adoptLoose(const fs::path &scratch, const std::string &id, std::string &error) const {
+    std::error_code ec;
+    if (contains(id)) {
+        fs::remove(scratch, ec);
+        return true;
+    }
+    fs::rename(scratch, objectsDir_ / id, ec);
+    if (ec) {
+        std::error_code ignored;
+        fs::remove(scratch, ignored);
+        error = "Unable to store object " + id + ": " + ec.message();
+        return false;
+    }
+    journal::noteObject(objectsDir_ / id);
+    stats::count(stats::Counter::ObjectsWritten);
+    return true;
+}
+
+std::vector<std::string> ObjectStore::listLoose() const {
+    std::vector<std::string> ids;
+    std::error_code ec;
+    if (!fs::is_directory(objectsDir_, ec)) {
+        return ids;
+    }
+    for (const auto &entry : fs::directory_iterator(objectsDir_, ec)) {
+        std::string name = entry.path().filename().string();
+        if (isObjectId(name) && entry.is_regular_file()) {
+            ids.push_back(name);
+        }
+    }
+    std::sort(ids.begin(), ids.end());
+    return ids;
+}
+
+bool ObjectStore::repack(bool all, const RepackOptions &options, RepackStats &stats, std::string &error) {
+    stats = {};
+    loadPacks();
+
+    std::vector<std::string> ids = listLoose();
+    std::vector<fs::path> retiredPacks;
+    std::vector<std::string> loose = ids;
+    if (all) {
+        for (const auto &pack : packs_) {
+            appendPackIds(*pack, ids);
+            retiredPacks.push_back(pack->indexPath);
+        }
+    }
+    if (ids.empty() || (!all && loose.empty())) {
+        return true;
+    }
+    if (all && loose.empty() && packs_.size() <= 1 && options.maxDeltaDepth <= 0) {
+        return true;
+    }
+
+    fs::path indexPath;
+    if (!writePack(std::move(ids), options, stats, indexPath, error)) {
+        return false;
+    }
+    for (const auto &id : loose) {
+        std::error_code removeEc;
+        if (fs::remove(objectsDir_ / id, removeEc)) {
+            ++stats.removedLoose;
+        }
+    }
+    for (const auto &retired : retiredPacks) {
+        if (retired != indexPath && removePack(retired)) {
+            ++stats.removedPacks;
+        }
+    }
+    return true;
+}
+
+void ObjectStore::appendPackIds(const Pack &pack, std::vector<std::string> &ids) {
+    const unsigned char *raw = pack.index.data() + kIndexHeaderSize;
+    for (std::uint32_t i = 0; i < pack.count; ++i) {
+        ids.push_back(hashing::toHex(raw + static_cast<std::size_t>(i) * hashing::kDigestBytes, hashing::kDigestBytes));
+    }
+}
+
+bool ObjectStore::removePack(const fs::path &indexPath) {
+    fs::path packPath = indexPath;
+    packPath.replace_extension(".pack");
+    // The index goes first so readers never see an index without its pack.
+    std::error_code ec;
+    fs::remove(indexPath, ec);
+    return fs::remove(packPath, ec);
+}
+
+bool ObjectStore::writePack(std::vector<std::string> ids,
+                            const RepackOptions &options,
+                            RepackStats &stats,
+                            fs::path &indexPath,
+                            std::string &error) {
+    std::vector<PendingObject> pending;
+    pending.reserve(ids.size());
+    for (auto &id : ids) {
+        PendingObject object;
+        object.rawId.resize(hashing::kDigestBytes);
+        hashing::fromHex(id, reinterpret_cast<unsigned char *>(&object.rawId[0]), hashing::kDigestBytes);
+        object.hexId = std::move(id);
+        pending.push_back(std::move(object));
+    }
+    std::sort(pending.begin(), pending.end(), [](const PendingObject &lhs, const PendingObject &rhs) {
+        return lhs.rawId < rhs.rawId;
+    });
+    pending.erase(std::unique(pending.begin(), pending.end(),
+                              [](const PendingObject &lhs, const PendingObject &rhs) { return lhs.rawId == rhs.rawId; }),
+                  pending.end());
+    auto hintFor = [&](const std::string &hexId) {
+        auto it = options.pathHints.find(hexId);
+        return it == options.pathHints.end() ? std::string() : it->second;
+    };
+
+    for (auto &object : pending) {
+        object.hint = hintFor(object.hexId);
+        object.size = storedSize(object.hexId);
+        stats.bytesBefore += object.size;
+    }
+    // Write order clusters versions of the same path, largest first, so that
+    // the sliding delta window sees likely bases (git's heuristic, minus types).
+    std::vector<std::size_t> order(pending.size());
+    for (std::size_t i = 0; i < order.size(); ++i) {
+        order[i] = i;
+    }
+    std::stable_sort(order.begin(), order.end(), [&](std::size_t lhs, std::size_t rhs) {
+        if (pending[lhs].hint != pending[rhs].hint) {
+            return pending[lhs].hint < pending[rhs].hint;
+        }
+        return pending[lhs].size > pending[rhs].size;
+    });
+
+    fs::path packDir = objectsDir_ / "pack";
+    std::error_code ec;
+    fs::create_directories(packDir, ec);
+    if (ec) {
+        error = "Unable to create pack directory: " + ec.message();
+        return false;
+    }
+
+    fs::path packScratch = scratchPath();
+    fs::path indexScratch = scratchPath();
+    auto cleanup = [&]() {
+        std::error_code ignored;
+        fs::remove(packScratch, ignored);
+        fs::remove(indexScratch, ignored);
+    };
+
+    struct WindowEntry {
+        std::string rawId;
+        std::string data;
+        int depth = 0;
+    };
+    std::vector<WindowEntry> window;
+    std::vector<std::uint64_t> offsets(pending.size(), 0);
+    {
+        std::ofstream out(packScratch, std::ios::binary | std::ios::trunc);
+        if (!out) {
+            error = "Unable to write pack file.";
+            return false;
+        }
+        std::string header(kPackMagic, 4);
+        putU32(header, kPackVersion);
+        out << header;
+        std::uint64_t position = header.size();
+        std::string data;
+        chunks::Manifest manifest;
+        for (std::size_t index : order) {
+            const auto &object = pending[index];
+            // Chunked blobs keep their manifest; the chunks stay where they are.
+            if (readManifest(object.hexId, manifest)) {
+                std::string payload = chunks::encodeManifest(manifest);
+                std::string entry(1, static_cast<char>(kKindChunked));
+                putU64(entry, payload.size());
+                out << entry << payload;
+                offsets[index] = position;
+                position += entry.size() + payload.size();
+                stats.bytesAfter += entry.size() + payload.size();
+                continue;
+            }
+            if (!read(object.hexId, data)) {
+                cleanup();
+                error = "Unable to read object " + object.hexId + " while packing.";
+                return false;
+            }
+
+            unsigned char kind = kKindRaw;
+            std::string payload;
+            std::string compressed;
+            if (compression::deflateBytes(reinterpret_cast<const unsigned char *>(data.data()), data.size(), compressed) &&
+                worthCompressing(data.size(), compressed.size())) {
+                kind = kKindZlib;
+                payload.swap(compressed);
+            }
+            int depth = 0;
+            if (options.maxDeltaDepth > 0) {
+                for (const auto &candidate : window) {
+                    if (candidate.depth >= options.maxDeltaDepth) {
+                        continue;
+                    }
+                    std::string delta = compression::makeDelta(candidate.data, data);
+                    std::string packedDelta;
+                    if (!compression::deflateBytes(reinterpret_cast<const unsigned char *>(delta.data()), delta.size(), packedDelta)) {
+                        continue;
+                    }
+                    std::size_t best = kind == kKindRaw ? data.size() : payload.size();
+                    if (packedDelta.size() + hashing::kDigestBytes < best) {
+                        kind = kKindDelta;
+                        payload = candidate.rawId + packedDelta;
+                        depth = candidate.depth + 1;
+                    }
+                }
+            }
+            if (kind == kKindRaw) {
+                payload = data;
+            } else if (kind == kKindDelta) {
+                ++stats.deltas;
+            }
+
+            std::string entry(1, static_cast<char>(kind));
+            putU64(entry, payload.size());
+            out << entry << payload;
+            offsets[index] = position;
+            position += entry.size() + payload.size();
+            stats.bytesAfter += entry.size() + payload.size();
+
+            if (options.maxDeltaDepth > 0 && options.window > 0) {
+                if (static_cast<int>(window.size()) >= options.window) {
+                    window.erase(window.begin());
+                }
+                window.push_back({object.rawId, std::move(data), depth});
+                data.clear();
+            }
+        }
+        out.flush();
+        if (!out) {
+            cleanup();
+            error = "Unable to write pack file.";
+            return false;
+        }
+    }
+
+    std::string idTable;
+    idTable.reserve(pending.size() * hashing::kDigestBytes);
+    std::uint32_t fanout[256] = {};
+    for (const auto &object : pending) {
+        idTable += object.rawId;
+        ++fanout[static_cast<unsigned char>(object.rawId[0])];
+    }
+    for (int i = 1; i < 256; ++i) {
+        fanout[i] += fanout[i - 1];
+    }
+    std::string packName = "pack-" + hashing::sha256String(idTable);
+    {
+        std::string index(kIndexMagic, 4);
+        putU32(index, kPackVersion);
+        for (std::uint32_t count : fanout) {
+            putU32(index, count);
+        }
+        index += idTable;
+        for (std::uint64_t offset : offsets) {
+            putU64(index, offset);
+        }
+        if (!writeScratch(indexScratch, std::string(), index)) {
+            cleanup();
+            error = "Unable to write pack index.";
+            return false;
+        }
+    }
+
+    fs::path packPath = packDir / (packName + ".pack");
+    indexPath = packDir / (packName + ".idx");
+    // Release our maps before replacing files that may share the new name.
+    packs_.clear();
+    packsLoaded_ = false;
+
+    // Loose objects and old packs are deleted next, so the new pack must be
+    // on disk first. The index is renamed last: a pack only becomes visible
+    // once both exist.
+    if (!journal::syncFile(packScratch) || !journal::syncFile(indexScratch)) {
+        cleanup();
+        error = "Unable to flush pack to disk.";
+        return false;
+    }
+    fs::rename(packScratch, packPath, ec);
+    if (!ec) {
+        fs::rename(indexScratch, indexPath, ec);
+    }
+    if (ec) {
+        cleanup();
+        error = "Unable to install pack: " + ec.message();
+        return false;
+    }
+    journal::syncDirectory(packDir);
+    stats.packedObjects = pending.size();
+    return true;
+}
+
+namespace {
+
+bool olderThan(const fs::path &path, std::chrono::seconds age, fs::file_time_type now) {
+    std::error_code ec;
+    auto written = fs::last_write_time(path, ec);
+    return !ec && now - written >= age;
+}
+
+} // namespace
+
+bool ObjectStore::prepareGc(const std::unordered_set<std::string> &reachable,
+                            std::chrono::seconds grace,
+                            const RepackOptions &options,
+                            GcPlan &plan,
+                            RepackStats &stats,
+                            std::string &error) {
+    stats = {};
+    plan = {};
+    loadPacks();
+    auto now = fs::file_time_type::clock::now();
+
+    plan.loose = listLoose();
+    std::vector<std::string> ids;
+    for (const auto &id : plan.loose) {
+        if (reachable.count(id) > 0) {
+            ids.push_back(id);
+        }
+    }
+    bool garbagePacked = false;
+    for (const auto &pack : packs_) {
+        std::vector<std::string> packIds;
+        appendPackIds(*pack, packIds);
+        std::size_t garbage = 0;
+        for (const auto &id : packIds) {
+            garbage += reachable.count(id) == 0;
+        }
+        if (garbage > 0 && !olderThan(pack->indexPath, grace, now)) {
+            stats.keptRecent += garbage;
+            continue;
+        }
+        garbagePacked = garbagePacked || garbage > 0;
+        for (const auto &id : packIds) {
+            if (reachable.count(id) > 0) {
+                ids.push_back(id);
+            }
+        }
+        plan.packs.emplace_back(pack->indexPath, std::move(packIds));
+    }
+    // A lone pack of live objects is already what gc would produce.
+    if (plan.loose.empty() && plan.packs.size() <= 1 && !garbagePacked) {
+        plan.packs.clear();
+        return true;
+    }
+    if (ids.empty()) {
+        return true;
+    }
+    plan.packed.insert(ids.begin(), ids.end());
+    return writePack(std::move(ids), options, stats, plan.packIndex, error);
+}
+
+void ObjectStore::finishGc(const GcPlan &plan,
+                           const std::unordered_set<std::string> &reachable,
+                           std::chrono::seconds grace,
+                           RepackStats &stats) {
+    auto now = fs::file_time_type::clock::now();
+    std::unordered_set<std::string> pruned;
+    for (const auto &id : plan.loose) {
+        fs::path path = objectsDir_ / id;
+        bool remove = plan.packed.count(id) > 0;
+        if (!remove && reachable.count(id) == 0) {
+            remove = olderThan(path, grace, now);
+            if (!remove) {
+                ++stats.keptRecent;
+            }
+        }
+        std::error_code ec;
+        if (remove && fs::remove(path, ec)) {
+            if (plan.packed.count(id) > 0) {
+                ++stats.removedLoose;
+            } else {
+                pruned.insert(id);
+            }
+        }
+    }
+    for (const auto &pack : plan.packs) {
+        if (pack.first == plan.packIndex) {
+            continue;
+        }
+        bool expired = olderThan(pack.first, grace, now);
+        bool retire = true;
+        for (const auto &id : pack.second) {
+            if (plan.packed.count(id) == 0 && (reachable.count(id) > 0 || !expired)) {
+                retire = false;
+                break;
+            }
+        }
+        if (!retire || !removePack(pack.first)) {
+            continue;
+        }
+        ++stats.removedPacks;
+        for (const auto &id : pack.second) {
+            if (plan.packed.count(id) == 0) {
+                pruned.insert(id);
+            }
+        }
+    }
+    packs_.clear();
+    packsLoaded_ = false;
+    stats.prunedObjects = pruned.size();
+    stats.prunedChunks = pruneChunks(grace);
+}
+
+std::size_t ObjectStore::pruneChunks(std::chrono::seconds grace) {
+    std::error_code ec;
+    if (!fs::is_directory(chunkDir(), ec)) {
+        return 0;
+    }
+    // Every manifest that survived is live, reachable or not: an unreachable
+    // one is only still here because it is too recent to prune.
+    std::vector<std::string> ids = listLoose();
+    loadPacks();
+    for (const auto &pack : packs_) {
+        appendPackIds(*pack, ids);
+    }
+    std::unordered_set<std::string> live;
+    chunks::Manifest manifest;
+    for (const auto &id : ids) {
+        if (readManifest(id, manifest)) {
+            for (const auto &chunk : manifest.chunks) {
+                live.insert(chunk.id);
+            }
+        }
+    }
+    return chunks::prune(chunkDir(), live, grace);
+}
@@ -0,0 +1,228 @@
+#pragma once
+
+#include "chunk_store.hpp"
+#include "mapped_file.hpp"
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+struct RepackOptions {
+    // Longest chain of deltas a reader may have to resolve; 0 disables deltas.
+    int maxDeltaDepth = 10;
+    // Number of preceding objects tried as delta bases.
+    int window = 10;
+    // Optional object id -> path hints so versions of one file sit together.
+    std::unordered_map<std::string, std::string> pathHints;
+};
+
+struct RepackStats {
+    std::size_t packedObjects = 0;
+    std::size_t removedLoose = 0;
+    std::size_t removedPacks = 0;
+    std::size_t deltas = 0;
+    std::uint64_t bytesBefore = 0;
+    std::uint64_t bytesAfter = 0;
+    // gc only: unreachable objects deleted, and those spared as too recent.
+    std::size_t prunedObjects = 0;
+    std::size_t keptRecent = 0;
+    // gc only: chunks that no remaining manifest lists.
+    std::size_t prunedChunks = 0;
+};
+
+// What ObjectStore::prepareGc saw and wrote, for finishGc.
+struct GcPlan {
+    std::vector<std::string> loose;
+    // Old packs to retire, with their object ids.
+    std::vector<std::pair<std::filesystem::path, std::vector<std::string>>> packs;
+    std::unordered_set<std::string> packed;
+    // Index of the new pack; empty when nothing needed packing.
+    std::filesystem::path packIndex;
+};
+
+// Content-addressed storage under .glite/objects.
+//
+// New objects are written loose (one file per object, named by its hex id),
+// which acts as a write-ahead tier. `repack` moves loose objects into an
+// append-only pack file with a sorted, fan-out id index that is read through
+// a memory map. Lookups consult the pack indexes first, then loose files.
+//
+// Loose files hold either the raw bytes or "GLZ1" followed by a zlib stream;
+// compression is skipped for data that does not shrink. Blobs of at least
+// chunks::threshold() bytes are cut into chunks kept in objects/chunks, and
+// their loose file is a "GLCK" manifest (chunk_store.hpp).
+//
+// Pack layout (pack/pack-<id>.pack):
+//   "GLPK" | u32 version | entries...
+//   entry: u8 kind | u64 payload length | payload
+//   kinds: 0 raw, 1 zlib, 2 delta (32-byte base id | zlib(delta)),
+//          3 chunk manifest
+// Index layout (pack/pack-<id>.idx):
+//   "GLPI" | u32 version | u32 fanout[256] | N x 32-byte id | N x u64 offset
+// All integers are little-endian. fanout[b] counts ids whose first byte <= b.
+//
+// objects/info/alternates lists further object directories, one absolute
+// path per line, that are searched after this one. A fork borrows its
+// source's objects this way instead of copying them; new objects are always
+// written here.
+//
+// A partial clone (.glite/promisor) may lack blobs. read() asks the fetcher
+// installed with setMissingObjectFetcher for an object it cannot find, and
+// prefetch() asks for many at once ahead of a checkout or diff.
+//
+// Const members may be called from several threads at once (e.g. parallel
+// staging). repack must not run concurrently with writers, but lock-free
+// readers may: read() looks an object up again in the packs currently on
+// disk when it is missing from the loaded packs and the loose files.
+class ObjectStore {
+public:
+    explicit ObjectStore(const std::filesystem::path &repoRoot);
+    ~ObjectStore();
+
+    const std::filesystem::path &objectsDir() const;
+
+    // Downloads `ids` into the partial clone at `repoRoot`.
+    using MissingObjectFetcher = std::function<bool(const std::filesystem::path &repoRoot,
+                                                    const std::vector<std::string> &ids,
+                                                    std::string &error)>;
+    static void setMissingObjectFetcher(MissingObjectFetcher fetcher);
+
+    bool isPartial() const;
+    // Fetches those of `ids` this partial clone lacks in one request. Does
+    // nothing for complete repositories.
+    bool prefetch(const std::vector<std::string> &ids, std::string &error) const;
+
+    std::vector<std::filesystem::path> alternateDirs() const;
+    bool addAlternate(const std::filesystem::path &objectsDir, std::string &error) const;
+    // Copies every borrowed object into this store and drops the alternates,
+    // so the source can be deleted.
+    bool dissociate(std::string &error) const;
+
+    bool contains(const std::string &id) const;
+    bool read(const std::string &id, std::string &data) const;
+
+    // Writes the contents of object `id` to `target`. Large loose objects
+    // stored raw are reflinked (FICLONE / clonefile) or copied by the kernel
+    // instead of being read into memory; everything else is decoded.
+    bool materialize(const std::string &id, const std::filesystem::path &target, std::string &error) const;
+
+    // Writes `data` as a loose object unless the store already has `id`.
+    bool writeLoose(const std::string &id, const std::string &data, std::string &error) const;
+
+    // True when `id` is stored as a chunk manifest, which then lands in
+    // `manifest`.
+    bool readManifest(const std::string &id, chunks::Manifest &manifest) const;
+    // Stores `id` as `manifest`. Fails when a chunk is missing from this
+    // store's chunk directory.
+    bool writeManifest(const std::string &id, const chunks::Manifest &manifest, std::string &error) const;
+    // Copies chunked object `id` from `source` as its manifest plus the
+    // chunks this store lacks, hard-linked where possible. False when
+    // `source` does not hold `id` as a manifest.
+    bool copyManifest(const ObjectStore &source, const std::string &id, std::string &error) const;
+
+    // Stages a workspace file as a loose object in one read, hashing and
+    // compressing as it goes, or chunking it when it is large. `id` receives
+    // the content hash.
+    bool writeLooseFromFile(const std::filesystem::path &source, std::string &id, std::string &error) const;
+
+    // Stages many small files at once: they are read whole and hashed
+    // together with hashing::sha256Batch, and only objects the store lacks
+    // are compressed and written. Per-file problems land in `errors`.
+    void writeLooseBatch(const std::vector<std::filesystem::path> &sources,
+                         std::vector<std::string> &ids,
+                         std::vector<std::string> &errors) const;
+
+    // Moves a fully written scratch file into place as loose object `id`.
+    bool adoptLoose(const std::filesystem::path &scratch, const std::string &id, std::string &error) const;
+
+    std::filesystem::path scratchPath() const;
+
+    std::vector<std::string> listLoose() const;
+
+    // Packs every loose object into a new pack. With `all`, existing packs are
+    // folded into the new pack as well so the store ends up with one pack.
+    bool repack(bool all, const RepackOptions &options, RepackStats &stats, std::string &error);
+
+    // Garbage collection in two steps, so that only the second has to keep
+    // writers out. prepareGc packs this store's objects (never an
+    // alternate's) that `reachable` holds into a new pack beside the old
+    // ones. A pack that holds unreachable objects younger than `grace` is
+    // left alone and survives whole.
+    //
+    // There is no per-object prune time: a packed object is as old as its
+    // pack's index file. Unreachable objects that a repack has just folded
+    // into a new pack therefore live another `grace` from that repack,
+    // while those in a pack older than `grace` go as soon as nothing
+    // reaches them, however recently they became unreachable. Loose
+    // objects age by their own mtime.
+    bool prepareGc(const std::unordered_set<std::string> &reachable,
+                   std::chrono::seconds grace,
+                   const RepackOptions &options,
+                   GcPlan &plan,
+                   RepackStats &stats,
+                   std::string &error);
+    // Deletes the loose objects the plan saw that are now packed or are
+    // unreachable and older than `grace`, and every old pack whose objects
+    // are all one or the other. `reachable` may have grown since prepareGc;
+    // objects it gained stay where they are. Chunks older than `grace` that
+    // no remaining manifest lists go too.
+    void finishGc(const GcPlan &plan, const std::unordered_set<std::string> &reachable,
+                  std::chrono::seconds grace, RepackStats &stats);
+
+private:
+    struct Pack {
+        std::filesystem::path packPath;
+        std::filesystem::path indexPath;
+        MappedFile pack;
+        MappedFile index;
+        std::uint32_t count = 0;
+
+        bool find(const unsigned char *rawId, std::uint64_t &offset) const;
+        bool entryHeader(std::uint64_t offset, unsigned char &kind, std::uint64_t &length) const;
+    };
+
+    std::filesystem::path objectsDir_;
+    int alternateDepth_ = 0;
+    mutable std::vector<std::unique_ptr<Pack>> packs_;
+    mutable bool packsLoaded_ = false;
+    mutable std::mutex packsMutex_;
+    mutable std::vector<std::unique_ptr<ObjectStore>> alternates_;
+    mutable bool alternatesLoaded_ = false;
+    mutable std::mutex alternatesMutex_;
+
+    ObjectStore(const std::filesystem::path &repoRoot, int alternateDepth);
+
+    void loadPacks() const;
+    // Maps packs written since loadPacks; true if any were added.
+    bool refreshPacks() const;
+    // Maps one pack; the caller holds packsMutex_.
+    bool addPack(const std::filesystem::path &indexPath) const;
+    const std::vector<std::unique_ptr<ObjectStore>> &alternates() const;
+    const ObjectStore *alternateWith(const std::string &id) const;
+    std::filesystem::path chunkDir() const;
+    // This store's chunk directory, then those of its alternates.
+    std::vector<std::filesystem::path> chunkDirs() const;
+    std::size_t pruneChunks(std::chrono::seconds grace);
+    bool fetchMissing(const std::vector<std::string> &ids, std::string &error) const;
+    bool findPacked(const std::string &id, const Pack *&pack, std::uint64_t &offset) const;
+    bool readPacked(const Pack &pack, std::uint64_t offset, std::string &data, int depth) const;
+    bool writeChunkedFromFile(const std::filesystem::path &source, std::string &id, std::string &error) const;
+    std::uint64_t storedSize(const std::string &id) const;
+    // Writes `ids` into a new pack and installs it.
+    bool writePack(std::vector<std::string> ids,
+                   const RepackOptions &options,
+                   RepackStats &stats,
+                   std::filesystem::path &indexPath,
+                   std::string &error);
+    static void appendPackIds(const Pack &pack, std::vector<std::string> &ids);
+    static bool removePack(const std::filesystem::path &indexPath);
+};
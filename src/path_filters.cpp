@@ -0,0 +1,249 @@
+#include "path_filters.hpp"
+
+#include "hashing.hpp"
+#include "lock_file.hpp"
+#include "mapped_file.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <system_error>
+#include <unordered_set>
+
+namespace fs = std::filesystem;
+
+namespace {
+
+constexpr char kFilterMagic[4] = {'G', 'L', 'P', 'F'};
+constexpr std::uint32_t kFilterVersion = 1;
+constexpr std::size_t kHeaderSize = 8;
+constexpr std::size_t kBitsPerPath = 10;
+constexpr std::size_t kMinBits = 64;
+constexpr std::uint32_t kProbes = 7;
+
+void putU32(std::string &out, std::uint32_t value) {
+    for (int i = 0; i < 4; ++i) {
+        out.push_back(static_cast<char>((value >> (8 * i)) & 0xff));
+    }
+}
+
+std::uint32_t getU32(const unsigned char *p) {
+    std::uint32_t value = 0;
+    for (int i = 3; i >= 0; --i) {
+        value = (value << 8) | p[i];
+    }
+    return value;
+}
+
+// FNV-1a; the two halves drive double hashing. Stored filters depend on
+// this function, so it must never change without a version bump.
+std::uint64_t pathHash(const std::string &path) {
+    std::uint64_t hash = 0xcbf29ce484222325ULL;
+    for (unsigned char c : path) {
+        hash ^= c;
+        hash *= 0x100000001b3ULL;
+    }
+    return hash;
+}
+
+template <typename Visit>
+void forEachProbe(const std::string &path, std::size_t bits, Visit visit) {
+    std::uint64_t hash = pathHash(path);
+    auto h1 = static_cast<std::uint32_t>(hash);
+    auto h2 = static_cast<std::uint32_t>(hash >> 32) | 1u;
+    for (std::uint32_t k = 0; k < kProbes; ++k) {
+        visit(static_cast<std::size_t>((h1 + k * h2) % bits));
+    }
+}
+
+bool rawId(const std::string &id, std::string &raw) {
+    unsigned char bytes[hashing::kDigestBytes];
+    if (!hashing::fromHex(id, bytes, sizeof(bytes))) {
+        return false;
+    }
+    raw.assign(reinterpret_cast<const char *>(bytes), sizeof(bytes));
+    return true;
+}
+
+void appendRecord(std::string &out, const std::string &raw, const std::string &filter) {
+    out += raw;
+    putU32(out, static_cast<std::uint32_t>(filter.size()));
+    out += filter;
+}
+
+bool hasHeader(const fs::path &path) {
+    std::ifstream in(path, std::ios::binary);
+    unsigned char header[kHeaderSize];
+    return in.read(reinterpret_cast<char *>(header), sizeof(header)) &&
+           std::memcmp(header, kFilterMagic, 4) == 0 && getU32(header + 4) == kFilterVersion;
+}
+
+std::string header() {
+    std::string out(kFilterMagic, sizeof(kFilterMagic));
+    putU32(out, kFilterVersion);
+    return out;
+}
+
+} // namespace
+
+ChangedPathFilters::ChangedPathFilters(const fs::path &repoRoot)
+    : path_(repoRoot / ".glite" / "commit-graph-paths") {}
+
+bool ChangedPathFilters::load() {
+    filters_.clear();
+    pending_.clear();
+    loaded_ = true;
+    MappedFile file;
+    std::error_code ec;
+    if (!fs::exists(path_, ec) || !file.open(path_)) {
+        return true;
+    }
+    const unsigned char *data = file.data();
+    if (file.size() < kHeaderSize || std::memcmp(data, kFilterMagic, 4) != 0 ||
+        getU32(data + 4) != kFilterVersion) {
+        return false;
+    }
+    std::size_t offset = kHeaderSize;
+    while (file.size() - offset >= hashing::kDigestBytes + 4) {
+        const unsigned char *record = data + offset;
+        std::size_t length = getU32(record + hashing::kDigestBytes);
+        std::size_t end = offset + hashing::kDigestBytes + 4 + length;
+        if (end > file.size()) {
+            break;
+        }
+        filters_[std::string(reinterpret_cast<const char *>(record), hashing::kDigestBytes)] =
+            std::string(reinterpret_cast<const char *>(record) + hashing::kDigestBytes + 4, length);
+        offset = end;
+    }
+    return true;
+}
+
+bool ChangedPathFilters::contains(const std::string &id) const {
+    std::string raw;
+    return rawId(id, raw) && filters_.count(raw) > 0;
+}
+
+bool ChangedPathFilters::mayHaveChanged(const std::string &id, const std::string &path) const {
+    std::string raw;
+    if (!rawId(id, raw)) {
+        return true;
+    }
+    auto it = filters_.find(raw);
+    if (it == filters_.end() || it->second.empty()) {
+        return true;
+    }
+    const std::string &filter = it->second;
+    bool hit = true;
+    forEachProbe(path, filter.size() * 8, [&](std::size_t bit) {
+        if ((static_cast<unsigned char>(filter[bit / 8]) & (1u << (bit % 8))) == 0) {
+            hit = false;
+        }
+    });
+    return hit;
+}
+
+void ChangedPathFilters::add(const std::string &id, const std::vector<std::string> &changedPaths) {
+    std::string raw;
+    if (!rawId(id, raw)) {
+        return;
+    }
+    std::unordered_set<std::string> keys;
+    for (const auto &path : changedPaths) {
+        for (std::size_t slash = path.find('/'); slash != std::string::npos; slash = path.find('/', slash + 1)) {
+            keys.insert(path.substr(0, slash));
+        }
+        keys.insert(path);
+        if (keys.size() > kMaxPaths) {
+            break;
+        }
+    }
+    std::string filter;
+    if (keys.size() <= kMaxPaths) {
+        std::size_t bits = std::max(kMinBits, keys.size() * kBitsPerPath);
+        filter.assign((bits + 7) / 8, '\0');
+        bits = filter.size() * 8;
+        for (const auto &key : keys) {
+            forEachProbe(key, bits, [&](std::size_t bit) {
+                filter[bit / 8] = static_cast<char>(static_cast<unsigned char>(filter[bit / 8]) | (1u << (bit % 8)));
+            });
+        }
+    }
+    if (filters_.count(raw) == 0) {
+        pending_.push_back(raw);
+    }
+    filters_[raw] = std::move(filter);
+}
+
+bool ChangedPathFilters::save(std::string &error) {
+    if (pending_.empty()) {
+        return true;
+    }
+    LockFile lock(path_);
+    std::string busy;
+    if (!lock.acquire(busy)) {
+        return true;
+    }
+    if (!hasHeader(path_)) {
+        // Missing or unreadable: write everything this instance knows.
+        std::string out = header();
+        for (const auto &entry : filters_) {
+            appendRecord(out, entry.first, entry.second);
+        }
+        if (!lock.write(out, error) || !lock.commit(error)) {
+            error = "Unable to write changed-path filters: " + error;
+            return false;
+        }
+        pending_.clear();
+        return true;
+    }
+    std::string out;
+    for (const auto &raw : pending_) {
+        auto it = filters_.find(raw);
+        if (it != filters_.end()) {
+            appendRecord(out, raw, it->second);
+        }
+    }
+    std::ofstream file(path_, std::ios::binary | std::ios::app);
+    file.write(out.data(), static_cast<std::streamsize>(out.size()));
+    file.flush();
+    if (!file) {
+        error = "Unable to update changed-path filters.";
+        return false;
+    }
+    pending_.clear();
+    return true;
+}
+
+bool ChangedPathFilters::retain(const std::function<bool(const std::string &id)> &keep, std::string &error) {
+    if (!loaded_ && !load()) {
+        filters_.clear();
+    }
+    std::size_t before = filters_.size();
+    for (auto it = filters_.begin(); it != filters_.end();) {
+        if (keep(hashing::toHex(reinterpret_cast<const unsigned char *>(it->first.data()), it->first.size()))) {
+            ++it;
+        } else {
+            it = filters_.erase(it);
+        }
+    }
+    if (filters_.size() == before) {
+        return true;
+    }
+    LockFile lock(path_);
+    std::string busy;
+    if (!lock.acquire(busy)) {
+        // Stale filters only cost some space until the next gc.
+        return true;
+    }
+    std::string out = header();
+    for (const auto &entry : filters_) {
+        appendRecord(out, entry.first, entry.second);
+    }
+    if (!lock.write(out, error) || !lock.commit(error)) {
+        error = "Unable to write changed-path filters: " + error;
+        return false;
+    }
+    pending_.clear();
+    return true;
+}
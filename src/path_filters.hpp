@@ -0,0 +1,57 @@
+#pragma once
+
+#include <cstddef>
+#include <filesystem>
+#include <functional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Changed-path Bloom filters in .glite/commit-graph-paths, next to the commit
+// graph, so path-limited history can pass over most commits without opening
+// them.
+//
+// A commit's filter holds every path that differs from its first parent (all
+// files for a root commit) and each leading directory of those paths, so a
+// query for "src" matches a change to "src/app/main.cpp". Layout
+// (little-endian):
+//   "GLPF" | u32 version
+//   records: 32-byte raw commit id | u32 length | length filter bytes
+// Filters spend 10 bits per path on 7 probes, about 1% false positives. A
+// commit that changes more than kMaxPaths paths gets an empty filter, which
+// matches every path. Records are keyed by commit id, not graph position, so
+// a renumbered graph leaves them valid; for an id listed twice the later
+// record wins.
+//
+// Records are appended under commit-graph-paths.lock. One cut short by a crash
+// is dropped on load, and its commit gets a new filter the next time a walk
+// reaches it. Like the graph this is only a cache: a writer that finds the
+// lock taken keeps its filters in memory.
+class ChangedPathFilters {
+public:
+    static constexpr std::size_t kMaxPaths = 512;
+
+    explicit ChangedPathFilters(const std::filesystem::path &repoRoot);
+
+    bool load();
+
+    bool contains(const std::string &id) const;
+    // False only when `id` has a filter and the filter rules `path` out.
+    bool mayHaveChanged(const std::string &id, const std::string &path) const;
+
+    // Builds the filter of `id` from the file paths it changed. Kept in memory
+    // until save(), which appends it; neither needs load() first.
+    void add(const std::string &id, const std::vector<std::string> &changedPaths);
+    bool save(std::string &error);
+
+    // Drops the filters of commits for which `keep` is false (gc).
+    bool retain(const std::function<bool(const std::string &id)> &keep, std::string &error);
+
+private:
+    std::filesystem::path path_;
+    // Raw id -> filter bytes.
+    std::unordered_map<std::string, std::string> filters_;
+    // Raw ids added since the last load or save.
+    std::vector<std::string> pending_;
+    bool loaded_ = false;
+};
@@ -0,0 +1,157 @@
+#include "reach_bitmaps.hpp"
+
+#include "hashing.hpp"
+#include "lock_file.hpp"
+#include "mapped_file.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <system_error>
+
+namespace fs = std::filesystem;
+
+namespace {
+
+constexpr char kBitmapMagic[4] = {'G', 'L', 'R', 'B'};
+constexpr std::uint32_t kBitmapVersion = 1;
+constexpr std::size_t kHeaderSize = 4 + 4 + 4 + hashing::kDigestBytes + 4;
+
+void putU32(std::string &out, std::uint32_t value) {
+    for (int i = 0; i < 4; ++i) {
+        out.push_back(static_cast<char>((value >> (8 * i)) & 0xff));
+    }
+}
+
+void putU64(std::string &out, std::uint64_t value) {
+    for (int i = 0; i < 8; ++i) {
+        out.push_back(static_cast<char>((value >> (8 * i)) & 0xff));
+    }
+}
+
+std::uint32_t getU32(const unsigned char *p) {
+    std::uint32_t value = 0;
+    for (int i = 3; i >= 0; --i) {
+        value = (value << 8) | p[i];
+    }
+    return value;
+}
+
+std::uint64_t getU64(const unsigned char *p) {
+    std::uint64_t value = 0;
+    for (int i = 7; i >= 0; --i) {
+        value = (value << 8) | p[i];
+    }
+    return value;
+}
+
+std::size_t wordsFor(std::size_t positions) {
+    return (positions + 63) / 64;
+}
+
+} // namespace
+
+ReachabilityBitmaps::ReachabilityBitmaps(const fs::path &repoRoot)
+    : path_(repoRoot / ".glite" / "commit-graph-bitmaps") {}
+
+bool ReachabilityBitmaps::load(const CommitGraph &graph) {
+    bitmaps_.clear();
+    MappedFile file;
+    std::error_code ec;
+    if (!fs::exists(path_, ec) || !file.open(path_)) {
+        return true;
+    }
+    const unsigned char *data = file.data();
+    if (file.size() < kHeaderSize || std::memcmp(data, kBitmapMagic, 4) != 0 ||
+        getU32(data + 4) != kBitmapVersion) {
+        return false;
+    }
+    std::uint32_t positions = getU32(data + 8);
+    std::uint32_t count = getU32(data + 12 + hashing::kDigestBytes);
+    std::size_t words = wordsFor(positions);
+    std::size_t recordSize = hashing::kDigestBytes + words * 8;
+    if (file.size() < kHeaderSize + static_cast<std::size_t>(count) * recordSize) {
+        return false;
+    }
+    if (positions > graph.size() ||
+        graph.digest(positions) != hashing::toHex(data + 12, hashing::kDigestBytes)) {
+        // Built against another numbering: not an error, just unusable.
+        return true;
+    }
+    for (std::uint32_t i = 0; i < count; ++i) {
+        const unsigned char *record = data + kHeaderSize + static_cast<std::size_t>(i) * recordSize;
+        std::uint32_t position = 0;
+        if (!graph.lookup(hashing::toHex(record, hashing::kDigestBytes), position)) {
+            continue;
+        }
+        Bits bits(words);
+        for (std::size_t w = 0; w < words; ++w) {
+            bits[w] = getU64(record + hashing::kDigestBytes + w * 8);
+        }
+        bitmaps_[position] = std::move(bits);
+    }
+    return true;
+}
+
+ReachabilityBitmaps::Bits ReachabilityBitmaps::reachable(const CommitGraph &graph, std::uint32_t tip) const {
+    Bits bits(wordsFor(graph.size()), 0);
+    std::vector<std::uint32_t> pending = {tip};
+    while (!pending.empty()) {
+        std::uint32_t current = pending.back();
+        pending.pop_back();
+        if (test(bits, current)) {
+            continue;
+        }
+        // A stored bitmap is closed under parents, so nothing below a set bit
+        // needs visiting.
+        auto stored = bitmaps_.find(current);
+        if (stored != bitmaps_.end()) {
+            for (std::size_t w = 0; w < stored->second.size(); ++w) {
+                bits[w] |= stored->second[w];
+            }
+            continue;
+        }
+        bits[current / 64] |= std::uint64_t(1) << (current % 64);
+        for (int k = 0; k < 2; ++k) {
+            std::uint32_t p = graph.parent(current, k);
+            if (p != CommitGraph::kNone && !test(bits, p)) {
+                pending.push_back(p);
+            }
+        }
+    }
+    return bits;
+}
+
+bool ReachabilityBitmaps::write(const CommitGraph &graph, const std::vector<std::uint32_t> &tips, std::string &error) {
+    // Oldest first, so later tips reuse the bitmaps of the earlier ones.
+    std::vector<std::uint32_t> sorted = tips;
+    std::sort(sorted.begin(), sorted.end());
+    sorted.erase(std::unique(sorted.begin(), sorted.end()), sorted.end());
+    bitmaps_.clear();
+    for (std::uint32_t tip : sorted) {
+        Bits bits = reachable(graph, tip);
+        bitmaps_[tip] = std::move(bits);
+    }
+
+    auto positions = static_cast<std::uint32_t>(graph.size());
+    std::string out(kBitmapMagic, sizeof(kBitmapMagic));
+    putU32(out, kBitmapVersion);
+    putU32(out, positions);
+    unsigned char digest[hashing::kDigestBytes];
+    hashing::fromHex(graph.digest(positions), digest, sizeof(digest));
+    out.append(reinterpret_cast<const char *>(digest), sizeof(digest));
+    putU32(out, static_cast<std::uint32_t>(sorted.size()));
+    for (std::uint32_t tip : sorted) {
+        unsigned char raw[hashing::kDigestBytes];
+        hashing::fromHex(graph.id(tip), raw, sizeof(raw));
+        out.append(reinterpret_cast<const char *>(raw), sizeof(raw));
+        for (std::uint64_t word : bitmaps_[tip]) {
+            putU64(out, word);
+        }
+    }
+    LockFile lock(path_);
+    if (!lock.acquire(error) || !lock.write(out, error) || !lock.commit(error)) {
+        error = "Unable to write reachability bitmaps: " + error;
+        return false;
+    }
+    return true;
+}
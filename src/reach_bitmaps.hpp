@@ -0,0 +1,51 @@
+#pragma once
+
+#include "commit_graph.hpp"
+
+#include <cstdint>
+#include <filesystem>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Optional reachability bitmaps in .glite/commit-graph-bitmaps: for a few
+// selected commits (the branch heads and tags when gc last ran), the set of
+// commit-graph positions each one reaches, one bit per position.
+//
+// Layout (little-endian):
+//   "GLRB" | u32 version | u32 positions | 32-byte digest of the graph's
+//   first `positions` ids | u32 count
+//   count x { 32-byte raw commit id | ceil(positions / 64) u64 words }
+// Bit i of word i / 64 stands for graph position i. The digest ties the file
+// to the graph it was built from; after gc renumbers the graph, or the graph
+// is rebuilt, the bitmaps are ignored until gc writes new ones. Commits
+// appended to the graph since then only add positions, so the bitmaps stay
+// valid for them.
+class ReachabilityBitmaps {
+public:
+    using Bits = std::vector<std::uint64_t>;
+
+    explicit ReachabilityBitmaps(const std::filesystem::path &repoRoot);
+
+    // Keeps the bitmaps that were built against `graph`'s current numbering.
+    bool load(const CommitGraph &graph);
+    std::size_t size() const { return bitmaps_.size(); }
+
+    // Every position `tip` reaches, `tip` included. The walk stops at any
+    // commit with a stored bitmap and ORs that bitmap in instead, so a head
+    // a few commits past the last gc costs a few steps.
+    Bits reachable(const CommitGraph &graph, std::uint32_t tip) const;
+
+    // Builds bitmaps for `tips` and rewrites the file under
+    // commit-graph-bitmaps.lock.
+    bool write(const CommitGraph &graph, const std::vector<std::uint32_t> &tips, std::string &error);
+
+    static bool test(const Bits &bits, std::uint32_t position) {
+        return position / 64 < bits.size() && (bits[position / 64] >> (position % 64)) & 1;
+    }
+
+private:
+    std::filesystem::path path_;
+    // Graph position -> bitmap, sized for the graph it was built from.
+    std::unordered_map<std::uint32_t, Bits> bitmaps_;
+};
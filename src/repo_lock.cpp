@@ -0,0 +1,64 @@
+#include "repo_lock.hpp"
+
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <unordered_map>
+
+namespace fs = std::filesystem;
+
+namespace {
+
+std::shared_mutex &lockFor(const std::string &key) {
+    // Entries are never removed, so references stay valid.
+    static std::mutex registryMutex;
+    static std::unordered_map<std::string, std::unique_ptr<std::shared_mutex>> registry;
+    std::lock_guard<std::mutex> guard(registryMutex);
+    auto &slot = registry[key];
+    if (!slot) {
+        slot = std::make_unique<std::shared_mutex>();
+    }
+    return *slot;
+}
+
+std::unordered_map<std::string, RepoLock::Mode> &heldByThisThread() {
+    thread_local std::unordered_map<std::string, RepoLock::Mode> held;
+    return held;
+}
+
+} // namespace
+
+RepoLock::RepoLock(const fs::path &repoRoot, Mode mode)
+    : mode_(mode) {
+    std::error_code ec;
+    fs::path canonical = fs::weakly_canonical(repoRoot, ec);
+    key_ = (ec ? repoRoot.lexically_normal() : canonical).string();
+    auto held = heldByThisThread().emplace(key_, mode_);
+    if (!held.second) {
+        // Upgrading in place would deadlock against another reader doing the
+        // same, and silently staying shared lets the nested call write under
+        // a read lock.
+        if (mode_ == Mode::Write && held.first->second == Mode::Read) {
+            throw std::logic_error("Write lock requested under a read lock on " + key_ + ".");
+        }
+        return;
+    }
+    mutex_ = &lockFor(key_);
+    if (mode_ == Mode::Write) {
+        mutex_->lock();
+    } else {
+        mutex_->lock_shared();
+    }
+}
+
+RepoLock::~RepoLock() {
+    if (!mutex_) {
+        return;
+    }
+    if (mode_ == Mode::Write) {
+        mutex_->unlock();
+    } else {
+        mutex_->unlock_shared();
+    }
+    heldByThisThread().erase(key_);
+}
@@ -0,0 +1,34 @@
+#pragma once
+
+#include <filesystem>
+#include <shared_mutex>
+#include <string>
+
+// Process-wide reader/writer lock for one repository, keyed by its canonical
+// root. Many sessions may read a repository at once; a writer waits for them
+// and excludes everyone else. Repositories are independent, so writers to
+// different repositories run in parallel.
+//
+// Guards are reentrant per thread: constructing a guard for a repository the
+// thread already holds is a no-op, so public RepoService methods can call
+// each other. The outermost guard must therefore use the strongest mode any
+// nested call needs; asking for Write while the thread holds Read throws
+// std::logic_error.
+//
+// Objects and refs are replaced by atomic renames, so code that only reads
+// objects and refs (the source side of clone, fetch and push) takes no lock.
+class RepoLock {
+public:
+    enum class Mode { Read, Write };
+
+    RepoLock(const std::filesystem::path &repoRoot, Mode mode);
+    ~RepoLock();
+
+    RepoLock(const RepoLock &) = delete;
+    RepoLock &operator=(const RepoLock &) = delete;
+
+private:
+    std::shared_mutex *mutex_ = nullptr;
+    std::string key_;
+    Mode mode_;
+};
@@ -1,18 +1,293 @@
 #include "repo_service.hpp"
 
 #include "hashing.hpp"
+#include "ignore_rules.hpp"
+#include "journal.hpp"
+#include "lock_file.hpp"
+#include "merge.hpp"
+#include "object_store.hpp"
+#include "path_filters.hpp"
+#include "reach_bitmaps.hpp"
+#include "repo_lock.hpp"
+#include "stats.hpp"
+#include "thread_pool.hpp"
 #include "utils.hpp"
 
 #include <algorithm>
+#include <condition_variable>
+#include <deque>
 #include <fstream>
+#include <memory>
+#include <mutex>
 #include <sstream>
 #include <stdexcept>
+#include <string_view>
+#include <unordered_map>
+#include <unordered_set>
 
 namespace fs = std::filesystem;
 using gitlite::util::split;
 using gitlite::util::timestamp;
 using gitlite::util::trim;
 
+namespace {
+
+// Splits "heads/<name>" or "tags/<name>". Anything else is refused, so a peer
+// cannot name a path outside refs/.
+bool parseRefName(const std::string &ref, bool &isTag, std::string &name) {
+    isTag = ref.rfind("tags/", 0) == 0;
+    if (!isTag && ref.rfind("heads/", 0) != 0) {
+        return false;
+    }
+    name = ref.substr(isTag ? 5 : 6);
+    return gitlite::util::isValidIdentifier(name) && name != "." && name != "..";
+}
+
+// Batches smaller than this are hashed on the calling thread.
+constexpr std::size_t kParallelStageThreshold = 8;
+// Files up to this size are staged in batches of kHashBatch, read whole.
+constexpr std::uint64_t kBatchFileBytes = 64 * 1024;
+constexpr std::size_t kHashBatch = 32;
+
+// Index entries are kept sorted by path, so lookups are binary searches.
+std::vector<IndexEntry>::iterator findEntry(std::vector<IndexEntry> &entries, const std::string &path) {
+    auto it = std::lower_bound(entries.begin(), entries.end(), path,
+                               [](const IndexEntry &entry, const std::string &key) { return entry.path < key; });
+    return (it != entries.end() && it->path == path) ? it : entries.end();
+}
+
+// Walks workspace/ for `status` from several threads at once. Directories
+// wait on a shared stack; each worker pops one, lists it, stats tracked files
+// against the index and queues the subdirectories it finds. Tracked files
+// whose stat data changed go to `dirty` for re-hashing, and files the index
+// does not know go to `untracked` unless .gliteignore covers them. An ignored
+// directory is still entered when the index tracks something inside it, but
+// nothing below it is reported as untracked. Symlinked directories are not
+// followed.
+struct WorkspaceWalk {
+    WorkspaceWalk(const fs::path &workspace,
+                  const std::vector<IndexEntry> &entries,
+                  const std::unordered_map<std::string_view, std::size_t> &byPath,
+                  const IgnoreRules &ignore,
+                  std::int64_t stamp,
+                  std::vector<char> &seen)
+        : workspace(workspace), entries(entries), byPath(byPath), ignore(ignore), stamp(stamp), seen(seen) {}
+
+    const fs::path &workspace;
+    const std::vector<IndexEntry> &entries;
+    const std::unordered_map<std::string_view, std::size_t> &byPath;
+    const IgnoreRules &ignore;
+    std::int64_t stamp;
+    // One slot per entry; only the worker that meets the file writes it.
+    std::vector<char> &seen;
+
+    std::vector<std::pair<std::size_t, IndexEntry>> dirty;
+    std::vector<std::string> untracked;
+    std::string error;
+
+    // (relative path, inside an ignored directory); the root is "".
+    std::vector<std::pair<std::string, bool>> pending{{std::string(), false}};
+    std::size_t busy = 0;
+    std::mutex mutex;
+    std::condition_variable changed;
+
+    void run() {
+        std::vector<std::pair<std::size_t, IndexEntry>> localDirty;
+        std::vector<std::string> localUntracked;
+        std::vector<std::pair<std::string, bool>> found;
+        std::string localError;
+        std::unique_lock<std::mutex> lock(mutex);
+        while (true) {
+            changed.wait(lock, [this] { return !pending.empty() || busy == 0; });
+            if (pending.empty()) {
+                break;
+            }
+            auto dir = std::move(pending.back());
+            pending.pop_back();
+            ++busy;
+            lock.unlock();
+            try {
+                list(dir.first, dir.second, found, localDirty, localUntracked);
+            } catch (const std::exception &ex) {
+                localError = ex.what();
+            }
+            lock.lock();
+            for (auto &sub : found) {
+                pending.push_back(std::move(sub));
+            }
+            found.clear();
+            --busy;
+            changed.notify_all();
+        }
+        for (auto &item : localDirty) {
+            dirty.push_back(std::move(item));
+        }
+        for (auto &path : localUntracked) {
+            untracked.push_back(std::move(path));
+        }
+        if (error.empty()) {
+            error = localError;
+        }
+        changed.notify_all();
+    }
+
+    bool tracksUnder(const std::string &dir) const {
+        std::string prefix = dir + "/";
+        auto it = std::lower_bound(entries.begin(), entries.end(), prefix,
+                                   [](const IndexEntry &entry, const std::string &key) { return entry.path < key; });
+        return it != entries.end() && it->path.compare(0, prefix.size(), prefix) == 0;
+    }
+
+    void list(const std::string &dir,
+              bool ignoredParent,
+              std::vector<std::pair<std::string, bool>> &found,
+              std::vector<std::pair<std::size_t, IndexEntry>> &localDirty,
+              std::vector<std::string> &localUntracked) {
+        std::error_code ec;
+        fs::directory_iterator it(dir.empty() ? workspace : workspace / dir,
+                                  fs::directory_options::skip_permission_denied, ec);
+        for (; !ec && it != fs::directory_iterator(); it.increment(ec)) {
+            std::string relative = it->path().filename().string();
+            if (!dir.empty()) {
+                relative = dir + "/" + relative;
+            }
+            std::error_code typeEc;
+            if (!it->is_symlink(typeEc) && it->is_directory(typeEc)) {
+                bool ignoredDir = ignoredParent || ignore.ignored(relative, true);
+                if (!ignoredDir || tracksUnder(relative)) {
+                    found.emplace_back(std::move(relative), ignoredDir);
+                }
+                continue;
+            }
+            auto tracked = byPath.find(relative);
+            if (tracked == byPath.end()) {
+                if (!ignoredParent && it->is_regular_file(typeEc) && !ignore.ignored(relative, false)) {
+                    localUntracked.push_back(std::move(relative));
+                }
+                continue;
+            }
+            IndexEntry fresh;
+            if (!statIndexEntry(it->path(), fresh)) {
+                continue;
+            }
+            seen[tracked->second] = 1;
+            if (!indexEntryClean(entries[tracked->second], fresh, stamp)) {
+                localDirty.emplace_back(tracked->second, std::move(fresh));
+            }
+        }
+    }
+};
+
+std::vector<std::pair<std::string, std::string>> indexFiles(const std::vector<IndexEntry> &entries) {
+    std::vector<std::pair<std::string, std::string>> files;
+    files.reserve(entries.size());
+    for (const auto &entry : entries) {
+        files.emplace_back(entry.path, entry.hash);
+    }
+    return files;
+}
+
+// Header lines of a commit object are "key=value" up to "files:".
+void parseCommitHeader(std::string_view content, CommitView &view) {
+    view = {};
+    std::size_t pos = 0;
+    while (pos < content.size()) {
+        std::size_t end = content.find('\n', pos);
+        if (end == std::string_view::npos) {
+            end = content.size();
+        }
+        std::string_view line = content.substr(pos, end - pos);
+        pos = end + 1;
+        if (line == "files:") {
+            break;
+        }
+        auto eq = line.find('=');
+        if (eq == std::string_view::npos) {
+            continue;
+        }
+        std::string_view key = line.substr(0, eq);
+        std::string_view value = line.substr(eq + 1);
+        if (key == "id") {
+            view.id = value;
+        } else if (key == "author") {
+            view.author = value;
+        } else if (key == "timestamp") {
+            view.timestamp = value;
+        } else if (key == "branch") {
+            view.branch = value;
+        } else if (key == "parent") {
+            view.parent = value == "null" ? std::string_view() : value;
+        } else if (key == "parent2") {
+            view.parent2 = value;
+        } else if (key == "message") {
+            view.message = value;
+        } else if (key == "tree") {
+            view.tree = value;
+        }
+    }
+}
+
+bool hasConflictMarkers(const std::string &data) {
+    return data.rfind("<<<<<<< ", 0) == 0 || data.find("\n<<<<<<< ") != std::string::npos;
+}
+
+bool readWholeFile(const fs::path &file, std::string &data) {
+    stats::count(stats::Counter::FsCalls);
+    std::ifstream in(file, std::ios::binary);
+    if (!in) {
+        return false;
+    }
+    std::ostringstream buffer;
+    buffer << in.rdbuf();
+    data = buffer.str();
+    return true;
+}
+
+// Header plus hunks for one file; kind is 'A', 'M' or 'D'.
+void writeFileDiff(const std::string &path,
+                   char kind,
+                   const std::string &oldData,
+                   const std::string &newData,
+                   const textdiff::LineSink &sink) {
+    sink("diff --glite a/" + path + " b/" + path);
+    if (kind == 'A') {
+        sink("new file");
+    } else if (kind == 'D') {
+        sink("deleted file");
+    }
+    if (textdiff::looksBinary(oldData) || textdiff::looksBinary(newData)) {
+        sink("Binary files a/" + path + " and b/" + path + " differ");
+        return;
+    }
+    sink(kind == 'A' ? std::string("--- /dev/null") : "--- a/" + path);
+    sink(kind == 'D' ? std::string("+++ /dev/null") : "+++ b/" + path);
+    textdiff::unifiedDiff(oldData, newData, 3, sink);
+}
+
+// One workspace update produced by a merge. An empty blobId without content
+// deletes the path.
+struct MergeAction {
+    std::string path;
+    std::string blobId;
+    bool hasContent = false;
+    std::string content;
+};
+
+} // namespace
+
+CommitRecord CommitView::toRecord() const {
+    CommitRecord record;
+    record.id = std::string(id);
+    record.parent = std::string(parent);
+    record.parent2 = std::string(parent2);
+    record.author = std::string(author);
+    record.timestamp = std::string(timestamp);
+    record.message = std::string(message);
+    record.branch = std::string(branch);
+    record.tree = std::string(tree);
+    return record;
+}
+
 RepoService::RepoService(StorageManager &storage)
     : storage_(storage) {}
 
@@ -34,8 +309,12 @@ std::string RepoService::currentBranch(const fs::path &repoRoot) const {
 }
 
 void RepoService::setCurrentBranch(const fs::path &repoRoot, const std::string &branch) const {
-    std::ofstream out(repoRoot / ".glite" / "HEAD", std::ios::binary | std::ios::trunc);
-    out << "ref: " << branch << "\n";
+    RepoLock lock(repoRoot, RepoLock::Mode::Write);
+    LockFile head(repoRoot / ".glite" / "HEAD");
+    std::string error;
+    if (head.acquire(error) && head.write("ref: " + branch + "\n", error)) {
+        journal::commitLock(head, error);
+    }
 }
 
 std::string RepoService::branchHead(const fs::path &repoRoot, const std::string &branch) const {
@@ -47,97 +326,422 @@ std::string RepoService::branchHead(const fs::path &repoRoot, const std::string
     return trim(line);
 }
 
+std::string RepoService::resolveRef(const fs::path &repoRoot, const std::string &name) const {
+    if (!gitlite::util::isValidIdentifier(name) || name == "." || name == "..") {
+        return {};
+    }
+    std::string head = branchHead(repoRoot, name);
+    if (!head.empty()) {
+        return head;
+    }
+    std::ifstream in(repoRoot / ".glite" / "refs" / "tags" / name);
+    std::string line;
+    std::getline(in, line);
+    return trim(line);
+}
+
 bool RepoService::updateBranchHead(const fs::path &repoRoot,
                                    const std::string &branch,
-                                   const std::string &commitId) const {
-    std::ofstream out(repoRoot / ".glite" / "refs" / "heads" / branch, std::ios::binary | std::ios::trunc);
-    if (!out) {
-        return false;
-    }
-    out << commitId << "\n";
-    return true;
+                                   const std::string &commitId,
+                                   std::string &error,
+                                   const std::optional<std::string> &expected) const {
+    RepoLock lock(repoRoot, RepoLock::Mode::Write);
+    return updateRef(repoRoot / ".glite" / "refs" / "heads" / branch, commitId, expected, error);
 }
 
 std::vector<std::pair<std::string, std::string>> RepoService::listBranchesWithHead(const fs::path &repoRoot) const {
     std::vector<std::pair<std::string, std::string>> branches;
-    fs::path dir = repoRoot / ".glite" / "refs" / "heads";
-    if (!fs::exists(dir)) {
-        return branches;
-    }
-    for (const auto &entry : fs::directory_iterator(dir)) {
-        if (entry.is_regular_file()) {
-            std::string branch = entry.path().filename().string();
-            branches.emplace_back(branch, branchHead(repoRoot, branch));
-        }
-    }
-    std::sort(branches.begin(), branches.end(), [](const auto &lhs, const auto &rhs) {
-        return lhs.first < rhs.first;
+    forEachBranch(repoRoot, [&branches](const std::string &name, const std::string &head) {
+        branches.emplace_back(name, head);
+        return true;
     });
     return branches;
 }
 
-std::vector<std::pair<std::string, std::string>> RepoService::readIndex(const fs::path &repoRoot) const {
-    std::vector<std::pair<std::string, std::string>> entries;
-    std::ifstream in(repoRoot / ".glite" / "index");
-    std::string line;
-    while (std::getline(in, line)) {
-        if (line.empty()) {
-            continue;
+void RepoService::forEachBranch(const fs::path &repoRoot,
+                                const std::function<bool(const std::string &, const std::string &)> &visitor) const {
+    fs::path dir = repoRoot / ".glite" / "refs" / "heads";
+    std::vector<std::string> names;
+    std::error_code ec;
+    for (fs::directory_iterator it(dir, ec), end; !ec && it != end; it.increment(ec)) {
+        if (it->is_regular_file() && it->path().extension() != ".lock") {
+            names.push_back(it->path().filename().string());
         }
-        auto parts = split(line, '\t');
-        if (parts.size() == 2) {
-            entries.emplace_back(parts[0], parts[1]);
+    }
+    std::sort(names.begin(), names.end());
+    std::string head;
+    for (const auto &name : names) {
+        std::ifstream in(dir / name);
+        head.clear();
+        std::getline(in, head);
+        // trim() in place, keeping the buffer.
+        head.erase(head.find_last_not_of(" \t\r\n") + 1);
+        head.erase(0, head.find_first_not_of(" \t\r\n"));
+        if (!visitor(name, head)) {
+            return;
         }
     }
-    return entries;
 }
 
-void RepoService::writeIndex(const fs::path &repoRoot,
-                             const std::vector<std::pair<std::string, std::string>> &entries) const {
-    std::ofstream out(repoRoot / ".glite" / "index", std::ios::binary | std::ios::trunc);
-    for (const auto &entry : entries) {
-        out << entry.first << '\t' << entry.second << "\n";
+std::vector<IndexEntry> RepoService::readIndex(const fs::path &repoRoot) const {
+    static stats::Site site("RepoService::readIndex");
+    stats::Timer timer(site);
+    RepoLock lock(repoRoot, RepoLock::Mode::Read);
+    IndexFile index;
+    if (!index.open(repoRoot / ".glite" / "index")) {
+        return {};
+    }
+    return index.entries();
+}
+
+void RepoService::forEachIndexEntry(const fs::path &repoRoot,
+                                    const std::function<bool(const IndexEntry &)> &visitor) const {
+    RepoLock lock(repoRoot, RepoLock::Mode::Read);
+    IndexFile index;
+    if (index.open(repoRoot / ".glite" / "index")) {
+        index.forEach(visitor);
+    }
+}
+
+bool RepoService::writeIndex(const fs::path &repoRoot,
+                             std::vector<IndexEntry> entries,
+                             std::string &error) const {
+    static stats::Site site("RepoService::writeIndex");
+    stats::Timer timer(site);
+    RepoLock lock(repoRoot, RepoLock::Mode::Write);
+    return IndexFile::write(repoRoot / ".glite" / "index", std::move(entries), error);
+}
+
+bool RepoService::status(const fs::path &repoRoot, WorkspaceStatus &result, std::string &error) const {
+    static stats::Site site("RepoService::status");
+    stats::Timer timer(site);
+    RepoLock lock(repoRoot, RepoLock::Mode::Write);
+    result = {};
+    try {
+        IndexFile index;
+        if (!index.open(repoRoot / ".glite" / "index")) {
+            error = "Index is corrupt.";
+            return false;
+        }
+        auto entries = index.entries();
+        std::int64_t stamp = index.stamp();
+        // Keys view the paths in `entries`, which is not resized below.
+        std::unordered_map<std::string_view, std::size_t> byPath;
+        byPath.reserve(entries.size());
+        for (std::size_t i = 0; i < entries.size(); ++i) {
+            byPath.emplace(entries[i].path, i);
+        }
+
+        auto headFiles = snapshot(repoRoot, branchHead(repoRoot, currentBranch(repoRoot)));
+        for (const auto &entry : entries) {
+            auto it = headFiles.find(entry.path);
+            if (it == headFiles.end()) {
+                result.staged.emplace_back('A', entry.path);
+            } else if (it->second != entry.hash) {
+                result.staged.emplace_back('M', entry.path);
+            }
+        }
+        for (const auto &file : headFiles) {
+            if (!byPath.count(file.first)) {
+                result.staged.emplace_back('D', file.first);
+            }
+        }
+
+        fs::path workspace = repoRoot / "workspace";
+        IgnoreRules ignore;
+        ignore.load(repoRoot);
+        std::vector<char> seen(entries.size(), 0);
+        std::vector<std::pair<std::size_t, IndexEntry>> dirty;
+        std::size_t threads = ThreadPool::defaultThreads();
+        std::unique_ptr<ThreadPool> pool;
+        if (threads > 1) {
+            pool = std::make_unique<ThreadPool>(threads);
+        }
+        if (fs::is_directory(workspace)) {
+            WorkspaceWalk walk(workspace, entries, byPath, ignore, stamp, seen);
+            if (pool) {
+                for (std::size_t i = 0; i < pool->size(); ++i) {
+                    pool->submit([&walk] { walk.run(); });
+                }
+                pool->wait();
+            } else {
+                walk.run();
+            }
+            if (!walk.error.empty()) {
+                error = walk.error;
+                return false;
+            }
+            dirty = std::move(walk.dirty);
+            result.untracked = std::move(walk.untracked);
+        }
+
+        // Only entries whose stat data moved are read, in batches on the pool.
+        std::vector<char> modified(dirty.size(), 0);
+        std::vector<std::string> failures(dirty.size());
+        auto rehash = [&](std::size_t begin, std::size_t end) {
+            for (std::size_t k = begin; k < end; ++k) {
+                try {
+                    modified[k] = hashing::sha256File(workspace / entries[dirty[k].first].path) !=
+                                  entries[dirty[k].first].hash;
+                } catch (const std::exception &ex) {
+                    failures[k] = ex.what();
+                }
+            }
+        };
+        if (!pool || dirty.size() < kParallelStageThreshold) {
+            rehash(0, dirty.size());
+        } else {
+            for (std::size_t begin = 0; begin < dirty.size(); begin += kHashBatch) {
+                std::size_t end = std::min(dirty.size(), begin + kHashBatch);
+                pool->submit([&rehash, begin, end] { rehash(begin, end); });
+            }
+            pool->wait();
+        }
+        result.hashedFiles = dirty.size();
+        bool refreshed = false;
+        for (std::size_t k = 0; k < dirty.size(); ++k) {
+            if (!failures[k].empty()) {
+                error = failures[k];
+                return false;
+            }
+            IndexEntry &entry = entries[dirty[k].first];
+            if (modified[k]) {
+                result.unstaged.emplace_back('M', entry.path);
+                continue;
+            }
+            const IndexEntry &fresh = dirty[k].second;
+            entry.mtimeNs = fresh.mtimeNs;
+            entry.size = fresh.size;
+            entry.inode = fresh.inode;
+            entry.mode = fresh.mode;
+            refreshed = true;
+        }
+        for (std::size_t i = 0; i < entries.size(); ++i) {
+            if (!seen[i]) {
+                result.unstaged.emplace_back('D', entries[i].path);
+            }
+        }
+        // Refreshing is an optimisation; status is still correct if it fails.
+        std::string ignored;
+        if (refreshed) {
+            writeIndex(repoRoot, std::move(entries), ignored);
+        }
+    } catch (const std::exception &ex) {
+        error = ex.what();
+        return false;
     }
+    auto byName = [](const auto &a, const auto &b) { return a.second < b.second; };
+    std::sort(result.staged.begin(), result.staged.end(), byName);
+    std::sort(result.unstaged.begin(), result.unstaged.end(), byName);
+    std::sort(result.untracked.begin(), result.untracked.end());
+    return true;
 }
 
 bool RepoService::addFile(const fs::path &repoRoot,
                           const std::string &relativePath,
                           std::string &message) const {
+    RepoLock lock(repoRoot, RepoLock::Mode::Write);
+    StageResult result;
+    if (!addFiles(repoRoot, {relativePath}, result, message)) {
+        return false;
+    }
+    if (!result.failed.empty()) {
+        message = result.failed.front().second;
+        return false;
+    }
+    message = (result.unchanged.empty() ? "File staged: " : "File unchanged: ") + relativePath;
+    return true;
+}
+
+bool RepoService::addFiles(const fs::path &repoRoot,
+                           const std::vector<std::string> &relativePaths,
+                           StageResult &result,
+                           std::string &error) const {
+    static stats::Site site("RepoService::addFiles");
+    stats::Timer timer(site);
+    RepoLock lock(repoRoot, RepoLock::Mode::Write);
+    result = {};
     fs::path workspace = repoRoot / "workspace";
-    fs::path source = workspace / relativePath;
-    if (!fs::exists(source)) {
-        message = "File not found in workspace.";
+    IndexFile index;
+    if (!index.open(repoRoot / ".glite" / "index")) {
+        error = "Index is corrupt.";
         return false;
     }
-    std::string blobId;
+    ObjectStore store(repoRoot);
+    std::vector<IndexEntry> updates;
     try {
-        blobId = hashing::sha256File(source);
+        // Stat checks are cheap and need the index, so they stay on this
+        // thread; only files that actually changed are queued for hashing.
+        for (const auto &relativePath : relativePaths) {
+            IndexEntry fresh;
+            fresh.path = relativePath;
+            if (!statIndexEntry(workspace / relativePath, fresh)) {
+                result.failed.emplace_back(relativePath, "File not found in workspace.");
+                continue;
+            }
+            IndexEntry existing;
+            if (index.find(relativePath, existing) && indexEntryClean(existing, fresh, index.stamp())) {
+                result.unchanged.push_back(relativePath);
+                continue;
+            }
+            updates.push_back(std::move(fresh));
+        }
     } catch (const std::exception &ex) {
-        message = ex.what();
+        error = ex.what();
         return false;
     }
-    fs::path objectPath = repoRoot / ".glite" / "objects" / blobId;
-    try {
-        if (!fs::exists(objectPath)) {
-            fs::copy_file(source, objectPath);
+
+    // Stat is taken before hashing so an edit that races the read leaves a
+    // newer mtime on disk than the one recorded here. Small files are
+    // hashed in batches; large ones stream through writeLooseFromFile.
+    std::vector<std::string> failures(updates.size());
+    std::vector<std::vector<std::size_t>> jobs;
+    std::vector<std::size_t> batch;
+    for (std::size_t i = 0; i < updates.size(); ++i) {
+        if (updates[i].size > kBatchFileBytes) {
+            jobs.push_back({i});
+            continue;
+        }
+        batch.push_back(i);
+        if (batch.size() == kHashBatch) {
+            jobs.push_back(std::move(batch));
+            batch.clear();
         }
-        auto entries = readIndex(repoRoot);
-        bool replaced = false;
-        for (auto &entry : entries) {
-            if (entry.first == relativePath) {
-                entry.second = blobId;
-                replaced = true;
+    }
+    if (!batch.empty()) {
+        jobs.push_back(std::move(batch));
+    }
+    auto stage = [&](const std::vector<std::size_t> &job) {
+        try {
+            if (job.size() == 1 && updates[job[0]].size > kBatchFileBytes) {
+                std::size_t i = job[0];
+                if (!store.writeLooseFromFile(workspace / updates[i].path, updates[i].hash, failures[i]) &&
+                    failures[i].empty()) {
+                    failures[i] = "Unable to store object.";
+                }
+                return;
+            }
+            std::vector<fs::path> sources;
+            for (std::size_t i : job) {
+                sources.push_back(workspace / updates[i].path);
+            }
+            std::vector<std::string> ids;
+            std::vector<std::string> errors;
+            store.writeLooseBatch(sources, ids, errors);
+            for (std::size_t k = 0; k < job.size(); ++k) {
+                updates[job[k]].hash = std::move(ids[k]);
+                failures[job[k]] = std::move(errors[k]);
+            }
+        } catch (const std::exception &ex) {
+            for (std::size_t i : job) {
+                failures[i] = ex.what();
             }
         }
-        if (!replaced) {
-            entries.emplace_back(relativePath, blobId);
+    };
+    if (updates.size() < kParallelStageThreshold || ThreadPool::defaultThreads() == 1) {
+        for (const auto &job : jobs) {
+            stage(job);
         }
-        writeIndex(repoRoot, entries);
-    } catch (const std::exception &ex) {
-        message = ex.what();
+    } else {
+        ThreadPool pool;
+        for (const auto &job : jobs) {
+            pool.submit([&stage, &job] { stage(job); });
+        }
+        pool.wait();
+    }
+
+    std::size_t kept = 0;
+    for (std::size_t i = 0; i < updates.size(); ++i) {
+        if (!failures[i].empty()) {
+            result.failed.emplace_back(updates[i].path, failures[i]);
+            continue;
+        }
+        result.staged.push_back(updates[i].path);
+        if (kept != i) {
+            updates[kept] = std::move(updates[i]);
+        }
+        ++kept;
+    }
+    updates.resize(kept);
+    if (updates.empty()) {
+        return true;
+    }
+    // Existing entries come first so IndexFile::write keeps the updates.
+    auto entries = index.entries();
+    entries.insert(entries.end(), std::make_move_iterator(updates.begin()), std::make_move_iterator(updates.end()));
+    return writeIndex(repoRoot, std::move(entries), error);
+}
+
+bool RepoService::collectWorkspaceFiles(const fs::path &repoRoot,
+                                        const std::string &pathspec,
+                                        std::vector<std::string> &paths,
+                                        std::string &error) const {
+    static stats::Site site("RepoService::collectWorkspaceFiles");
+    stats::Timer timer(site);
+    RepoLock lock(repoRoot, RepoLock::Mode::Read);
+    fs::path workspace = repoRoot / "workspace";
+    std::string spec = fs::path(pathspec).lexically_normal().generic_string();
+    while (!spec.empty() && spec.back() == '/') {
+        spec.pop_back();
+    }
+    if (spec == ".") {
+        spec.clear();
+    }
+    if (fs::path(spec).is_absolute() || spec == ".." || spec.rfind("../", 0) == 0) {
+        error = "Pathspec is outside the workspace: " + pathspec;
+        return false;
+    }
+
+    IgnoreRules ignore;
+    ignore.load(repoRoot);
+    bool glob = hasGlobCharacters(spec);
+    fs::path start = workspace;
+    if (!glob && !spec.empty()) {
+        start = workspace / spec;
+        std::error_code ec;
+        if (fs::is_regular_file(start, ec)) {
+            if (!ignore.ignored(spec, false)) {
+                paths.push_back(spec);
+            }
+            return true;
+        }
+        if (!fs::is_directory(start, ec)) {
+            error = "Path not found in workspace: " + pathspec;
+            return false;
+        }
+    }
+
+    std::error_code ec;
+    fs::recursive_directory_iterator it(start, fs::directory_options::skip_permission_denied, ec);
+    if (ec) {
+        error = ec.message();
         return false;
     }
-    message = "File staged: " + relativePath;
+    for (; it != fs::recursive_directory_iterator(); it.increment(ec)) {
+        if (ec) {
+            error = ec.message();
+            return false;
+        }
+        std::string relative = it->path().lexically_relative(workspace).generic_string();
+        bool isDirectory = it->is_directory(ec);
+        if (ignore.ignored(relative, isDirectory)) {
+            if (isDirectory) {
+                it.disable_recursion_pending();
+            }
+            continue;
+        }
+        if (isDirectory || !it->is_regular_file(ec)) {
+            continue;
+        }
+        if (glob) {
+            std::string name = it->path().filename().generic_string();
+            if (!globMatch(spec, spec.find('/') == std::string::npos ? name : relative)) {
+                continue;
+            }
+        }
+        paths.push_back(relative);
+    }
+    std::sort(paths.begin(), paths.end());
     return true;
 }
 
@@ -146,54 +750,120 @@ bool RepoService::commit(const fs::path &repoRoot,
                          const std::string &message,
                          CommitRecord &record,
                          std::string &error) const {
+    static stats::Site site("RepoService::commit");
+    stats::Timer timer(site);
+    RepoLock lock(repoRoot, RepoLock::Mode::Write);
     auto indexEntries = readIndex(repoRoot);
-    if (indexEntries.empty()) {
+    std::string branch = currentBranch(repoRoot);
+    std::string parent = branchHead(repoRoot, branch);
+    if (indexEntries.empty() && parent.empty()) {
         error = "Nothing to commit (index empty).";
         return false;
     }
-    std::string branch = currentBranch(repoRoot);
-    std::string parent = branchHead(repoRoot, branch);
 
-    std::string ts = timestamp();
+    // MERGE_HEAD: the merged head on the first line, then one conflicted
+    // path per line.
+    fs::path mergeHeadPath = repoRoot / ".glite" / "MERGE_HEAD";
+    std::string mergeHead;
+    {
+        std::ifstream in(mergeHeadPath);
+        std::getline(in, mergeHead);
+        mergeHead = trim(mergeHead);
+        std::string path;
+        ObjectStore store(repoRoot);
+        while (std::getline(in, path)) {
+            auto it = findEntry(indexEntries, path);
+            std::string data;
+            if (it != indexEntries.end() && store.read(it->hash, data) && hasConflictMarkers(data)) {
+                error = "Unresolved conflict in " + path + "; edit the file and add it before committing.";
+                return false;
+            }
+        }
+    }
+
+    std::vector<std::pair<std::string, std::string>> files = indexFiles(indexEntries);
+    ObjectStore store(repoRoot);
+    std::string treeId;
+    if (!trees::writeTree(store, files, treeId, error)) {
+        return false;
+    }
+    if (!parent.empty() && mergeHead.empty()) {
+        CommitRecord parentRecord = readCommit(repoRoot, parent, true);
+        bool unchanged = false;
+        if (!parentRecord.tree.empty()) {
+            unchanged = parentRecord.tree == treeId;
+        } else {
+            std::unordered_map<std::string, std::string> staged(files.begin(), files.end());
+            unchanged = staged == snapshot(repoRoot, parent);
+        }
+        if (unchanged) {
+            error = "Nothing to commit (index matches last commit).";
+            return false;
+        }
+    }
+
+    CommitRecord pending;
+    pending.parent = parent;
+    pending.parent2 = mergeHead;
+    pending.author = author;
+    pending.message = message;
+    pending.branch = branch;
+    pending.tree = treeId;
+    pending.files = std::move(files);
+    // The tree and commit objects reach disk with the ref that names them.
+    journal::Transaction transaction(repoRoot, "commit (" + branch + "): " + message);
+    if (!writeCommit(repoRoot, pending, error) || !transaction.commit(error)) {
+        return false;
+    }
+    std::error_code ec;
+    fs::remove(mergeHeadPath, ec);
+    record = std::move(pending);
+    return true;
+}
+
+bool RepoService::writeCommit(const fs::path &repoRoot, CommitRecord &record, std::string &error) const {
+    record.timestamp = timestamp();
 
     std::ostringstream body;
-    body << "author=" << author << "\n";
-    body << "timestamp=" << ts << "\n";
-    body << "branch=" << branch << "\n";
-    body << "parent=" << (parent.empty() ? "null" : parent) << "\n";
-    body << "message=" << message << "\n";
-    body << "files:\n";
-    for (const auto &entry : indexEntries) {
-        body << entry.first << '\t' << entry.second << "\n";
+    body << "author=" << record.author << "\n";
+    body << "timestamp=" << record.timestamp << "\n";
+    body << "branch=" << record.branch << "\n";
+    body << "parent=" << (record.parent.empty() ? "null" : record.parent) << "\n";
+    if (!record.parent2.empty()) {
+        body << "parent2=" << record.parent2 << "\n";
     }
+    body << "tree=" << record.tree << "\n";
+    body << "message=" << record.message << "\n";
 
     std::string bodyContent = body.str();
-    std::string commitId = hashing::sha256String(bodyContent);
+    record.id = hashing::sha256String(bodyContent);
 
     std::ostringstream commitFile;
-    commitFile << "id=" << commitId << "\n" << bodyContent;
+    commitFile << "id=" << record.id << "\n" << bodyContent;
 
-    fs::path objectPath = repoRoot / ".glite" / "objects" / commitId;
     try {
-        std::ofstream out(objectPath, std::ios::binary | std::ios::trunc);
-        out << commitFile.str();
-        out.flush();
+        if (!ObjectStore(repoRoot).writeLoose(record.id, commitFile.str(), error)) {
+            return false;
+        }
 
-        updateBranchHead(repoRoot, branch, commitId);
-        writeIndex(repoRoot, {});
+        if (!updateBranchHead(repoRoot, record.branch, record.id, error, record.parent)) {
+            return false;
+        }
     } catch (const std::exception &ex) {
         error = ex.what();
         return false;
     }
 
-    record = {commitId, parent, author, ts, message, branch, indexEntries};
     appendLog(repoRoot, record);
+    recordInGraph(repoRoot, record);
+    storage_.recordCommit(repoRoot, gitlite::util::parseTimestamp(record.timestamp));
     return true;
 }
 
 bool RepoService::createBranch(const fs::path &repoRoot,
                                const std::string &branchName,
                                std::string &error) const {
+    RepoLock lock(repoRoot, RepoLock::Mode::Write);
     fs::path path = repoRoot / ".glite" / "refs" / "heads" / branchName;
     if (fs::exists(path)) {
         error = "Branch already exists.";
@@ -201,67 +871,1108 @@ bool RepoService::createBranch(const fs::path &repoRoot,
     }
     std::string current = currentBranch(repoRoot);
     std::string head = branchHead(repoRoot, current);
+    // Expecting an empty ref makes creation lose cleanly to a concurrent one.
+    return updateRef(path, head, std::string(), error);
+}
+
+bool RepoService::push(const fs::path &repoRoot,
+                       const fs::path &remoteRoot,
+                       SyncResult &result,
+                       std::string &error) const {
+    static stats::Site site("RepoService::push");
+    stats::Timer timer(site);
+    result = {};
+    try {
+        fs::create_directories(remoteRoot / ".glite" / "objects");
+        fs::create_directories(remoteRoot / ".glite" / "refs" / "heads");
+        fs::create_directories(remoteRoot / ".glite" / "refs" / "tags");
+        if (!fs::exists(remoteRoot / ".glite" / "HEAD")) {
+            fs::copy_file(repoRoot / ".glite" / "HEAD", remoteRoot / ".glite" / "HEAD");
+        }
+        if (!fs::exists(remoteRoot / ".glite" / "config") && fs::exists(repoRoot / ".glite" / "config")) {
+            fs::copy_file(repoRoot / ".glite" / "config", remoteRoot / ".glite" / "config");
+        }
+
+        auto updates = planPush(repoRoot, advertiseRefs(remoteRoot), result);
+        std::vector<std::string> wants;
+        for (const auto &update : updates) {
+            wants.push_back(update.newId);
+        }
+        auto missing = missingObjects(repoRoot, remoteRoot, wants);
+        if (!transferObjects(repoRoot, remoteRoot, missing, error)) {
+            return false;
+        }
+        result.objectsTransferred = missing.size();
+        return receiveRefUpdates(remoteRoot, updates, result, error);
+    } catch (const std::exception &ex) {
+        error = ex.what();
+        return false;
+    }
+}
+
+bool RepoService::fetch(const fs::path &repoRoot,
+                        const fs::path &remoteRoot,
+                        SyncResult &result,
+                        std::string &error) const {
+    static stats::Site site("RepoService::fetch");
+    stats::Timer timer(site);
+    RepoLock lock(repoRoot, RepoLock::Mode::Write);
+    result = {};
+    if (!fs::exists(remoteRoot / ".glite")) {
+        error = "Remote not found.";
+        return false;
+    }
     try {
-        std::ofstream out(path, std::ios::binary | std::ios::trunc);
-        out << head << "\n";
+        fs::create_directories(repoRoot / ".glite" / "objects");
+        auto updates = planFetch(repoRoot, advertiseRefs(remoteRoot), result);
+        std::vector<std::string> wants;
+        for (const auto &update : updates) {
+            wants.push_back(update.newId);
+        }
+        ObjectStore target(repoRoot);
+        FetchLimits limits;
+        limits.depth = shallowDepth(repoRoot);
+        std::vector<std::string> boundary;
+        auto missing = missingObjects(
+            remoteRoot, wants, [&target](const std::string &id, bool) { return target.contains(id); }, limits,
+            &boundary);
+        if (!transferObjects(remoteRoot, repoRoot, missing, error) || !addShallowCommits(repoRoot, boundary, error)) {
+            return false;
+        }
+        result.objectsTransferred = missing.size();
+        return applyFetch(repoRoot, updates, error);
     } catch (const std::exception &ex) {
         error = ex.what();
         return false;
     }
-    return true;
 }
 
-bool RepoService::push(const fs::path &repoRoot,
+bool RepoService::pull(const fs::path &repoRoot,
                        const fs::path &remoteRoot,
+                       SyncResult &result,
                        std::string &error) const {
+    static stats::Site site("RepoService::pull");
+    stats::Timer timer(site);
+    RepoLock lock(repoRoot, RepoLock::Mode::Write);
+    return fetch(repoRoot, remoteRoot, result, error) && mergeTrackingRefs(repoRoot, result, error);
+}
+
+bool RepoService::clone(const fs::path &repoRoot,
+                        const fs::path &sourceRoot,
+                        SyncResult &result,
+                        std::string &error,
+                        std::size_t depth) const {
+    static stats::Site site("RepoService::clone");
+    stats::Timer timer(site);
+    RepoLock lock(repoRoot, RepoLock::Mode::Write);
+    if (!fs::exists(sourceRoot / ".glite")) {
+        error = "Source repository not found.";
+        return false;
+    }
+    if (!initClone(repoRoot, error)) {
+        return false;
+    }
     try {
-        if (fs::exists(remoteRoot)) {
-            fs::remove_all(remoteRoot);
+        for (const char *name : {"HEAD", "config", "shallow"}) {
+            if (fs::exists(sourceRoot / ".glite" / name)) {
+                fs::copy_file(sourceRoot / ".glite" / name, repoRoot / ".glite" / name,
+                              fs::copy_options::overwrite_existing);
+            }
+        }
+    } catch (const std::exception &ex) {
+        error = ex.what();
+        return false;
+    }
+    if (depth > 0) {
+        auto config = StorageManager::readRepoConfig(repoRoot);
+        config["shallow.depth"] = std::to_string(depth);
+        if (!StorageManager::writeRepoConfig(repoRoot, config)) {
+            error = "Unable to write the repository config.";
+            return false;
+        }
+    }
+    return pull(repoRoot, sourceRoot, result, error);
+}
+
+bool RepoService::fork(const fs::path &repoRoot,
+                       const fs::path &sourceRoot,
+                       SyncResult &result,
+                       std::string &error) const {
+    RepoLock lock(repoRoot, RepoLock::Mode::Write);
+    RepoLock sourceLock(sourceRoot, RepoLock::Mode::Read);
+    ObjectStore store(repoRoot);
+    ObjectStore source(sourceRoot);
+    try {
+        // A shallow source leaves the fork just as shallow.
+        if (fs::exists(sourceRoot / ".glite" / "shallow")) {
+            fs::copy_file(sourceRoot / ".glite" / "shallow", repoRoot / ".glite" / "shallow",
+                          fs::copy_options::overwrite_existing);
+            auto config = StorageManager::readRepoConfig(repoRoot);
+            config["shallow.depth"] = std::to_string(shallowDepth(sourceRoot));
+            StorageManager::writeRepoConfig(repoRoot, config);
+        }
+    } catch (const std::exception &ex) {
+        error = ex.what();
+        return false;
+    }
+    // Every object now counts as present, so pull only writes refs and files.
+    return store.addAlternate(source.objectsDir(), error) && pull(repoRoot, sourceRoot, result, error);
+}
+
+bool RepoService::detachForks(const fs::path &sourceRoot, std::string &error) const {
+    for (const auto &fork : forksOf(sourceRoot)) {
+        RepoLock lock(fork, RepoLock::Mode::Write);
+        if (!ObjectStore(fork).dissociate(error)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+std::vector<fs::path> RepoService::forksOf(const fs::path &sourceRoot) const {
+    std::vector<fs::path> forks;
+    fs::path objectsDir = fs::absolute(sourceRoot / ".glite" / "objects").lexically_normal();
+    std::error_code ec;
+    for (fs::directory_iterator owner(storage_.root(), ec), end; !ec && owner != end; owner.increment(ec)) {
+        std::error_code inner;
+        for (fs::directory_iterator repo(owner->path(), inner); !inner && repo != end; repo.increment(inner)) {
+            if (!fs::is_regular_file(repo->path() / ".glite" / "objects" / "info" / "alternates", inner)) {
+                continue;
+            }
+            auto dirs = ObjectStore(repo->path()).alternateDirs();
+            if (std::find(dirs.begin(), dirs.end(), objectsDir) != dirs.end()) {
+                forks.push_back(repo->path());
+            }
+        }
+    }
+    return forks;
+}
+
+std::vector<std::string> RepoService::shallowCommits(const fs::path &repoRoot) const {
+    std::vector<std::string> ids;
+    std::ifstream in(repoRoot / ".glite" / "shallow");
+    std::string line;
+    while (std::getline(in, line)) {
+        line = trim(line);
+        if (!line.empty()) {
+            ids.push_back(line);
+        }
+    }
+    return ids;
+}
+
+bool RepoService::addShallowCommits(const fs::path &repoRoot,
+                                    const std::vector<std::string> &ids,
+                                    std::string &error) const {
+    if (ids.empty()) {
+        return true;
+    }
+    auto current = shallowCommits(repoRoot);
+    std::unordered_set<std::string> known(current.begin(), current.end());
+    std::string content;
+    for (const auto &id : current) {
+        content += id + "\n";
+    }
+    for (const auto &id : ids) {
+        if (known.insert(id).second) {
+            content += id + "\n";
+        }
+    }
+    LockFile lock(repoRoot / ".glite" / "shallow");
+    return lock.acquire(error) && lock.write(content, error) && lock.commit(error);
+}
+
+std::size_t RepoService::shallowDepth(const fs::path &repoRoot) const {
+    auto config = StorageManager::readRepoConfig(repoRoot);
+    auto it = config.find("shallow.depth");
+    if (it == config.end()) {
+        return 0;
+    }
+    try {
+        return static_cast<std::size_t>(std::stoul(it->second));
+    } catch (const std::exception &) {
+        return 0;
+    }
+}
+
+bool RepoService::initClone(const fs::path &repoRoot, std::string &error) const {
+    try {
+        fs::create_directories(repoRoot / ".glite" / "objects");
+        fs::create_directories(repoRoot / ".glite" / "refs" / "heads");
+        fs::create_directories(repoRoot / "workspace");
+        std::ofstream(repoRoot / ".glite" / "index", std::ios::binary | std::ios::app);
+        std::ofstream(repoRoot / ".glite" / "log", std::ios::binary | std::ios::app);
+    } catch (const std::exception &ex) {
+        error = ex.what();
+        return false;
+    }
+    return true;
+}
+
+RepoService::RefList RepoService::advertiseRefs(const fs::path &repoRoot) const {
+    RefList refs;
+    for (const char *kind : {"heads", "tags"}) {
+        for (const auto &ref : listRefs(repoRoot / ".glite" / "refs" / kind)) {
+            if (!ref.second.empty()) {
+                refs.emplace_back(std::string(kind) + "/" + ref.first, ref.second);
+            }
+        }
+    }
+    return refs;
+}
+
+std::vector<std::string> RepoService::objectsToSend(const fs::path &repoRoot,
+                                                    const std::vector<std::string> &wants,
+                                                    const std::vector<std::string> &haves,
+                                                    const FetchLimits &limits,
+                                                    std::vector<std::string> *boundary) const {
+    ObjectStore store(repoRoot);
+    CommitGraph graph(repoRoot);
+    auto reader = graphReader(repoRoot);
+    std::string error;
+    std::vector<std::uint32_t> havePositions;
+    std::unordered_set<std::string> haveObjects;
+    for (const auto &have : haves) {
+        std::uint32_t position = 0;
+        if (!store.contains(have) || !graph.ensure(have, reader, position, error)) {
+            continue;
+        }
+        havePositions.push_back(position);
+        CommitRecord record = readCommit(repoRoot, have, true);
+        if (record.tree.empty()) {
+            for (const auto &file : readCommit(repoRoot, have).files) {
+                haveObjects.insert(file.second);
+            }
+            continue;
+        }
+        // The peer checked out this snapshot, so it holds every tree and blob
+        // below it. Subtrees shared with an earlier have are walked once.
+        std::vector<std::string> treesToVisit = {record.tree};
+        while (!treesToVisit.empty()) {
+            std::string treeId = treesToVisit.back();
+            treesToVisit.pop_back();
+            if (!haveObjects.insert(treeId).second) {
+                continue;
+            }
+            std::vector<trees::TreeEntry> entries;
+            trees::readTree(store, treeId, entries);
+            for (const auto &entry : entries) {
+                if (entry.isTree) {
+                    treesToVisit.push_back(entry.id);
+                } else {
+                    haveObjects.insert(entry.id);
+                }
+            }
+        }
+    }
+    std::vector<std::uint32_t> shallowPositions;
+    for (const auto &id : limits.peerShallow) {
+        std::uint32_t position = 0;
+        if (store.contains(id) && graph.ensure(id, reader, position, error)) {
+            shallowPositions.push_back(position);
+        }
+    }
+    std::uint32_t position = 0;
+    for (const auto &want : wants) {
+        graph.ensure(want, reader, position, error);
+    }
+    auto peerHas = [&](const std::string &id, bool isCommit) {
+        if (!isCommit) {
+            return haveObjects.count(id) > 0;
+        }
+        std::uint32_t commitPosition = 0;
+        if (!graph.lookup(id, commitPosition)) {
+            return false;
+        }
+        // A shallow peer stops at its boundary commits.
+        for (std::uint32_t shallow : shallowPositions) {
+            if (shallow != commitPosition && graph.isAncestor(commitPosition, shallow)) {
+                return false;
+            }
+        }
+        for (std::uint32_t have : havePositions) {
+            if (graph.isAncestor(commitPosition, have)) {
+                return true;
+            }
+        }
+        return false;
+    };
+    return missingObjects(repoRoot, wants, peerHas, limits, boundary);
+}
+
+std::vector<RepoService::RefUpdate> RepoService::planFetch(const fs::path &repoRoot,
+                                                          const RefList &remoteRefs,
+                                                          SyncResult &result) const {
+    std::vector<RefUpdate> updates;
+    for (const auto &ref : remoteRefs) {
+        bool isTag = false;
+        std::string name;
+        if (!parseRefName(ref.first, isTag, name)) {
+            continue;
+        }
+        fs::path local = repoRoot / ".glite" / "refs" / (isTag ? "tags" : "remotes") / name;
+        std::string current;
+        {
+            std::ifstream in(local);
+            std::getline(in, current);
+            current = trim(current);
+        }
+        // Tags never move once they exist locally.
+        if (ref.second.empty() || current == ref.second || (isTag && !current.empty())) {
+            continue;
+        }
+        updates.push_back({ref.first, current, ref.second});
+        result.updatedRefs.push_back(isTag ? "tag " + name : name);
+    }
+    return updates;
+}
+
+bool RepoService::applyFetch(const fs::path &repoRoot,
+                             const std::vector<RefUpdate> &updates,
+                             std::string &error) const {
+    RepoLock lock(repoRoot, RepoLock::Mode::Write);
+    try {
+        fs::create_directories(repoRoot / ".glite" / "refs" / "remotes");
+        fs::create_directories(repoRoot / ".glite" / "refs" / "tags");
+        for (const auto &update : updates) {
+            bool isTag = false;
+            std::string name;
+            if (!parseRefName(update.ref, isTag, name)) {
+                continue;
+            }
+            fs::path local = repoRoot / ".glite" / "refs" / (isTag ? "tags" : "remotes") / name;
+            if (!updateRef(local, update.newId, std::nullopt, error)) {
+                error = "Failed to update ref " + name + ": " + error;
+                return false;
+            }
+        }
+    } catch (const std::exception &ex) {
+        error = ex.what();
+        return false;
+    }
+    return true;
+}
+
+std::vector<RepoService::RefUpdate> RepoService::planPush(const fs::path &repoRoot,
+                                                         const RefList &remoteRefs,
+                                                         SyncResult &result) const {
+    std::unordered_map<std::string, std::string> remote(remoteRefs.begin(), remoteRefs.end());
+    std::vector<RefUpdate> updates;
+    for (const auto &ref : advertiseRefs(repoRoot)) {
+        auto it = remote.find(ref.first);
+        std::string remoteId = it == remote.end() ? std::string() : it->second;
+        bool isTag = false;
+        std::string name;
+        if (!parseRefName(ref.first, isTag, name)) {
+            continue;
+        }
+        if (remoteId == ref.second || (isTag && !remoteId.empty())) {
+            continue;
+        }
+        // A remote head this repository does not contain cannot be an
+        // ancestor, so that push would not fast-forward either.
+        if (!remoteId.empty() && !isAncestor(repoRoot, remoteId, ref.second)) {
+            result.rejectedRefs.push_back(name + " (non-fast-forward)");
+            continue;
+        }
+        updates.push_back({ref.first, remoteId, ref.second});
+    }
+    return updates;
+}
+
+bool RepoService::receiveRefUpdates(const fs::path &repoRoot,
+                                    const std::vector<RefUpdate> &updates,
+                                    SyncResult &result,
+                                    std::string &error) const {
+    RepoLock lock(repoRoot, RepoLock::Mode::Write);
+    ObjectStore store(repoRoot);
+    try {
+        // A repository with a workspace has its index and files built from
+        // the checked-out branch; moving that branch underneath them would
+        // make the next local commit revert the push (git's
+        // denyCurrentBranch). Mirrors under _remotes/ have no workspace.
+        std::error_code ec;
+        std::string checkedOut = fs::is_directory(repoRoot / "workspace", ec) ? currentBranch(repoRoot) : std::string();
+        for (const auto &update : updates) {
+            bool isTag = false;
+            std::string name;
+            if (!parseRefName(update.ref, isTag, name)) {
+                result.rejectedRefs.push_back(update.ref + " (invalid ref name)");
+                continue;
+            }
+            std::string label = isTag ? "tag " + name : name;
+            if (!isTag && !checkedOut.empty() && name == checkedOut) {
+                result.rejectedRefs.push_back(label + " (checked out in the target's workspace; push to another branch)");
+                continue;
+            }
+            if (!store.contains(update.newId)) {
+                result.rejectedRefs.push_back(label + " (missing objects)");
+                continue;
+            }
+            if (!update.oldId.empty() && (isTag || !isAncestor(repoRoot, update.oldId, update.newId))) {
+                result.rejectedRefs.push_back(label + " (non-fast-forward)");
+                continue;
+            }
+            fs::path refPath = repoRoot / ".glite" / "refs" / (isTag ? "tags" : "heads") / name;
+            fs::create_directories(refPath.parent_path());
+            // Refs move only after every object they point at is in place, and
+            // only if nobody else moved them since they were advertised.
+            if (!updateRef(refPath, update.newId, update.oldId, error)) {
+                error = "Failed to update remote ref " + name + ": " + error;
+                return false;
+            }
+            result.updatedRefs.push_back(label);
+        }
+    } catch (const std::exception &ex) {
+        error = ex.what();
+        return false;
+    }
+    return true;
+}
+
+bool RepoService::mergeTrackingRefs(const fs::path &repoRoot, SyncResult &result, std::string &error) const {
+    RepoLock lock(repoRoot, RepoLock::Mode::Write);
+    result.updatedRefs.clear();
+    try {
+        std::string current = currentBranch(repoRoot);
+        for (const auto &remote : listRefs(repoRoot / ".glite" / "refs" / "remotes")) {
+            std::string localHead = branchHead(repoRoot, remote.first);
+            if (remote.second.empty() || localHead == remote.second) {
+                continue;
+            }
+            if (!localHead.empty() && !isAncestor(repoRoot, localHead, remote.second)) {
+                if (isAncestor(repoRoot, remote.second, localHead)) {
+                    continue;
+                }
+                result.rejectedRefs.push_back(remote.first + " (diverged)");
+                continue;
+            }
+            if (remote.first == current &&
+                !fastForwardWorkspace(repoRoot, localHead, remote.second, result, error)) {
+                return false;
+            }
+            if (!updateBranchHead(repoRoot, remote.first, remote.second, error, localHead)) {
+                error = "Failed to update branch " + remote.first + ": " + error;
+                return false;
+            }
+            result.updatedRefs.push_back(remote.first);
+        }
+    } catch (const std::exception &ex) {
+        error = ex.what();
+        return false;
+    }
+    return true;
+}
+
+bool RepoService::isAncestor(const fs::path &repoRoot,
+                             const std::string &ancestor,
+                             const std::string &descendant) const {
+    if (ancestor.empty() || descendant.empty()) {
+        return false;
+    }
+    if (ancestor == descendant) {
+        return true;
+    }
+    CommitGraph graph(repoRoot);
+    std::uint32_t descendantPos = 0;
+    std::uint32_t ancestorPos = 0;
+    std::string error;
+    // ensure() adds every ancestor of `descendant`, so an id that is still
+    // unknown afterwards cannot be one.
+    if (!graph.ensure(descendant, graphReader(repoRoot), descendantPos, error) ||
+        !graph.lookup(ancestor, ancestorPos)) {
+        return false;
+    }
+    return graph.isAncestor(ancestorPos, descendantPos);
+}
+
+bool RepoService::trackingDivergence(const fs::path &repoRoot, std::size_t &ahead, std::size_t &behind) const {
+    ahead = 0;
+    behind = 0;
+    std::string branch = currentBranch(repoRoot);
+    std::string local = branchHead(repoRoot, branch);
+    std::string tracking;
+    {
+        std::ifstream in(repoRoot / ".glite" / "refs" / "remotes" / branch);
+        std::getline(in, tracking);
+        tracking = trim(tracking);
+    }
+    if (local.empty() || tracking.empty()) {
+        return false;
+    }
+    CommitGraph graph(repoRoot);
+    std::uint32_t localPos = 0;
+    std::uint32_t trackingPos = 0;
+    std::string error;
+    auto reader = graphReader(repoRoot);
+    if (!graph.ensure(local, reader, localPos, error) || !graph.ensure(tracking, reader, trackingPos, error)) {
+        return false;
+    }
+    graph.aheadBehind(localPos, trackingPos, ahead, behind);
+    return true;
+}
+
+bool RepoService::mergeBase(const fs::path &repoRoot,
+                            const std::string &a,
+                            const std::string &b,
+                            std::string &base) const {
+    base.clear();
+    CommitGraph graph(repoRoot);
+    std::uint32_t aPos = 0;
+    std::uint32_t bPos = 0;
+    std::uint32_t basePos = 0;
+    std::string error;
+    auto reader = graphReader(repoRoot);
+    if (!graph.ensure(a, reader, aPos, error) || !graph.ensure(b, reader, bPos, error) ||
+        !graph.mergeBase(aPos, bPos, basePos)) {
+        return false;
+    }
+    base = graph.id(basePos);
+    return true;
+}
+
+CommitGraph::ParentReader RepoService::graphReader(const fs::path &repoRoot) {
+    // Boundary commits of a shallow clone are roots as far as the graph goes.
+    auto shallow = std::make_shared<std::unordered_set<std::string>>();
+    {
+        std::ifstream in(repoRoot / ".glite" / "shallow");
+        std::string line;
+        while (std::getline(in, line)) {
+            shallow->insert(trim(line));
+        }
+    }
+    return [repoRoot, shallow](const std::string &id, CommitGraph::Parents &parents) {
+        if (!commitExists(repoRoot, id)) {
+            return false;
+        }
+        CommitRecord record = readCommit(repoRoot, id, true);
+        parents.ids.clear();
+        if (shallow->count(id) > 0) {
+            parents.time = gitlite::util::parseTimestamp(record.timestamp);
+            return true;
+        }
+        if (!record.parent.empty()) {
+            parents.ids.push_back(record.parent);
+        }
+        if (!record.parent2.empty()) {
+            parents.ids.push_back(record.parent2);
+        }
+        parents.time = gitlite::util::parseTimestamp(record.timestamp);
+        return true;
+    };
+}
+
+void RepoService::recordInGraph(const fs::path &repoRoot, const CommitRecord &record) {
+    // The graph is a cache: failures here only cost a rebuild later.
+    CommitGraph graph(repoRoot);
+    std::string error;
+    std::uint32_t position = 0;
+    CommitGraph::Parents parents;
+    const std::string *parentIds[] = {&record.parent, &record.parent2};
+    for (const std::string *parent : parentIds) {
+        if (parent->empty()) {
+            continue;
+        }
+        if (!graph.ensure(*parent, graphReader(repoRoot), position, error)) {
+            return;
+        }
+        parents.ids.push_back(*parent);
+    }
+    parents.time = gitlite::util::parseTimestamp(record.timestamp);
+    graph.append(record.id, parents, error);
+
+    // Changed-path filter against the first parent. Only subtrees the commit
+    // changed are opened; a walk computes the filter later if this fails.
+    std::string parentTree = record.parent.empty() ? std::string() : readCommit(repoRoot, record.parent, true).tree;
+    std::vector<trees::TreeChange> changes;
+    if (record.tree.empty() || (!record.parent.empty() && parentTree.empty()) ||
+        !trees::diffTrees(ObjectStore(repoRoot), parentTree, record.tree, changes)) {
+        return;
+    }
+    std::vector<std::string> paths;
+    paths.reserve(changes.size());
+    for (const auto &change : changes) {
+        paths.push_back(change.path);
+    }
+    ChangedPathFilters filters(repoRoot);
+    filters.add(record.id, paths);
+    filters.save(error);
+}
+
+bool RepoService::updateRef(const fs::path &refPath,
+                            const std::string &value,
+                            const std::optional<std::string> &expected,
+                            std::string &error) {
+    LockFile lock(refPath);
+    if (!lock.acquire(error)) {
+        return false;
+    }
+    if (expected) {
+        // Compare-and-swap: checked while holding the lock, so no other
+        // writer can move the ref between the read and the rename.
+        std::string current;
+        std::ifstream in(refPath);
+        std::getline(in, current);
+        current = trim(current);
+        if (current != *expected) {
+            error = "Ref " + refPath.filename().string() + " was updated concurrently (now " +
+                    (current.empty() ? std::string("empty") : current.substr(0, 10)) + "); retry.";
+            return false;
+        }
+    }
+    return lock.write(value + "\n", error) && journal::commitLock(lock, error);
+}
+
+std::vector<std::pair<std::string, std::string>> RepoService::listRefs(const fs::path &dir) {
+    std::vector<std::pair<std::string, std::string>> refs;
+    std::error_code ec;
+    if (!fs::is_directory(dir, ec)) {
+        return refs;
+    }
+    for (const auto &entry : fs::directory_iterator(dir, ec)) {
+        if (!entry.is_regular_file() || entry.path().extension() == ".lock") {
+            continue;
+        }
+        std::ifstream in(entry.path());
+        std::string line;
+        std::getline(in, line);
+        refs.emplace_back(entry.path().filename().string(), trim(line));
+    }
+    std::sort(refs.begin(), refs.end());
+    return refs;
+}
+
+std::vector<std::string> RepoService::missingObjects(const fs::path &from,
+                                                     const fs::path &to,
+                                                     const std::vector<std::string> &heads) {
+    ObjectStore target(to);
+    return missingObjects(from, heads, [&target](const std::string &id, bool) { return target.contains(id); });
+}
+
+std::vector<std::string> RepoService::missingObjects(const fs::path &from,
+                                                     const std::vector<std::string> &heads,
+                                                     const PeerHas &peerHas,
+                                                     const FetchLimits &limits,
+                                                     std::vector<std::string> *boundary) {
+    ObjectStore source(from);
+    std::vector<std::string> missing;
+    std::unordered_set<std::string> seen;
+    // Breadth first, so each commit is reached at its smallest depth.
+    std::deque<std::pair<std::string, std::size_t>> pending;
+    for (const auto &head : heads) {
+        pending.emplace_back(head, 1);
+    }
+    while (!pending.empty()) {
+        std::string id = pending.front().first;
+        std::size_t depth = pending.front().second;
+        pending.pop_front();
+        // A commit the peer already has implies it has that commit's whole
+        // history, so the walk stops there.
+        if (id.empty() || !seen.insert(id).second || peerHas(id, true) || !source.contains(id)) {
+            continue;
+        }
+        missing.push_back(id);
+        CommitRecord record = readCommit(from, id, true);
+        bool cut = false;
+        for (const std::string *parent : {&record.parent, &record.parent2}) {
+            if (parent->empty() || peerHas(*parent, true)) {
+                continue;
+            }
+            // Parents missing here too (a shallow source) also end the history.
+            if ((limits.depth > 0 && depth >= limits.depth) || !source.contains(*parent)) {
+                cut = true;
+            } else {
+                pending.emplace_back(*parent, depth + 1);
+            }
+        }
+        if (cut && boundary) {
+            boundary->push_back(id);
+        }
+        if (record.tree.empty()) {
+            for (const auto &file : readCommit(from, id).files) {
+                if (!limits.omitBlobs && seen.insert(file.second).second && !peerHas(file.second, false) &&
+                    source.contains(file.second)) {
+                    missing.push_back(file.second);
+                }
+            }
+        } else {
+            // Trees are always transferred with everything below them, so a
+            // subtree the peer has needs no further inspection.
+            std::vector<std::string> treesToVisit = {record.tree};
+            while (!treesToVisit.empty()) {
+                std::string treeId = treesToVisit.back();
+                treesToVisit.pop_back();
+                if (!seen.insert(treeId).second || peerHas(treeId, false) || !source.contains(treeId)) {
+                    continue;
+                }
+                missing.push_back(treeId);
+                std::vector<trees::TreeEntry> entries;
+                trees::readTree(source, treeId, entries);
+                for (const auto &entry : entries) {
+                    if (entry.isTree) {
+                        treesToVisit.push_back(entry.id);
+                    } else if (!limits.omitBlobs && seen.insert(entry.id).second && !peerHas(entry.id, false) &&
+                               source.contains(entry.id)) {
+                        missing.push_back(entry.id);
+                    }
+                }
+            }
+        }
+    }
+    // Receivers see objects in this order; children before parents is fine
+    // because refs only move once every object has landed.
+    return missing;
+}
+
+bool RepoService::transferObjects(const fs::path &from,
+                                  const fs::path &to,
+                                  const std::vector<std::string> &ids,
+                                  std::string &error) {
+    ObjectStore source(from);
+    ObjectStore target(to);
+    std::string data;
+    for (const auto &id : ids) {
+        // A chunked blob moves as its manifest and the chunks the target
+        // lacks, never as one buffer.
+        std::string ignored;
+        if (target.copyManifest(source, id, ignored)) {
+            continue;
+        }
+        if (!source.read(id, data)) {
+            error = "Unable to read object " + id + ".";
+            return false;
+        }
+        if (!target.writeLoose(id, data, error)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool RepoService::writeWorkspaceFile(const ObjectStore &store,
+                                     const fs::path &repoRoot,
+                                     const std::string &relativePath,
+                                     const std::string &blobId,
+                                     std::string &error) {
+    fs::path relative = fs::path(relativePath).lexically_normal();
+    if (relative.empty() || relative.is_absolute() ||
+        std::any_of(relative.begin(), relative.end(), [](const fs::path &part) { return part == ".."; })) {
+        error = "Refusing to write unsafe path: " + relativePath;
+        return false;
+    }
+    fs::path target = repoRoot / "workspace" / relative;
+    std::error_code ec;
+    fs::create_directories(target.parent_path(), ec);
+    if (!store.materialize(blobId, target, error)) {
+        error = "Unable to write " + relativePath + ": " + error;
+        return false;
+    }
+    return true;
+}
+
+bool RepoService::removeWorkspaceFile(const fs::path &repoRoot, const std::string &relativePath) {
+    fs::path relative = fs::path(relativePath).lexically_normal();
+    if (relative.empty() || relative.is_absolute() ||
+        std::any_of(relative.begin(), relative.end(), [](const fs::path &part) { return part == ".."; })) {
+        return false;
+    }
+    fs::path workspace = repoRoot / "workspace";
+    std::error_code ec;
+    if (!fs::remove(workspace / relative, ec)) {
+        return false;
+    }
+    // Drop directories the removal left empty; fs::remove refuses non-empty ones.
+    for (fs::path dir = relative.parent_path(); !dir.empty(); dir = dir.parent_path()) {
+        if (!fs::remove(workspace / dir, ec)) {
+            break;
+        }
+    }
+    return true;
+}
+
+bool RepoService::applyTreeChanges(const fs::path &repoRoot,
+                                   const std::vector<trees::TreeChange> &changes,
+                                   std::size_t &filesWritten,
+                                   std::size_t &filesRemoved,
+                                   std::string &error) const {
+    ObjectStore store(repoRoot);
+    std::vector<std::string> blobs;
+    for (const auto &change : changes) {
+        if (change.kind != 'D') {
+            blobs.push_back(change.newId);
+        }
+    }
+    if (!store.prefetch(blobs, error)) {
+        return false;
+    }
+    auto entries = readIndex(repoRoot);
+    std::vector<IndexEntry> added;
+    std::unordered_set<std::string> erased;
+    for (const auto &change : changes) {
+        auto it = findEntry(entries, change.path);
+        if (change.kind == 'D') {
+            if (removeWorkspaceFile(repoRoot, change.path)) {
+                ++filesRemoved;
+            }
+            if (it != entries.end()) {
+                erased.insert(change.path);
+            }
+            continue;
+        }
+        if (!writeWorkspaceFile(store, repoRoot, change.path, change.newId, error)) {
+            return false;
+        }
+        ++filesWritten;
+        IndexEntry entry;
+        entry.path = change.path;
+        entry.hash = change.newId;
+        statIndexEntry(repoRoot / "workspace" / change.path, entry);
+        if (it != entries.end()) {
+            *it = std::move(entry);
+        } else {
+            added.push_back(std::move(entry));
+        }
+    }
+    if (!erased.empty()) {
+        entries.erase(std::remove_if(entries.begin(), entries.end(),
+                                     [&erased](const IndexEntry &entry) { return erased.count(entry.path) > 0; }),
+                      entries.end());
+    }
+    entries.insert(entries.end(), std::make_move_iterator(added.begin()), std::make_move_iterator(added.end()));
+    return writeIndex(repoRoot, std::move(entries), error);
+}
+
+bool RepoService::fastForwardWorkspace(const fs::path &repoRoot,
+                                       const std::string &fromCommit,
+                                       const std::string &toCommit,
+                                       SyncResult &result,
+                                       std::string &error) const {
+    std::vector<trees::TreeChange> changes;
+    if (!diffCommits(repoRoot, fromCommit, toCommit, changes, error)) {
+        return false;
+    }
+    std::size_t removed = 0;
+    return applyTreeChanges(repoRoot, changes, result.filesWritten, removed, error);
+}
+
+bool RepoService::checkout(const fs::path &repoRoot,
+                           const std::string &branch,
+                           CheckoutResult &result,
+                           std::string &error) const {
+    static stats::Site site("RepoService::checkout");
+    stats::Timer timer(site);
+    RepoLock lock(repoRoot, RepoLock::Mode::Write);
+    result = {};
+    if (!fs::exists(repoRoot / ".glite" / "refs" / "heads" / branch)) {
+        error = "Branch '" + branch + "' not found.";
+        return false;
+    }
+    if (fs::exists(repoRoot / ".glite" / "MERGE_HEAD")) {
+        error = "A merge is in progress; resolve the conflicts and commit first.";
+        return false;
+    }
+    std::string current = currentBranch(repoRoot);
+    if (current == branch) {
+        result.alreadyOn = true;
+        return true;
+    }
+    std::string from = branchHead(repoRoot, current);
+    std::string to = branchHead(repoRoot, branch);
+    if (from != to) {
+        std::vector<trees::TreeChange> changes;
+        if (!diffCommits(repoRoot, from, to, changes, error)) {
+            return false;
+        }
+        // Local changes survive the switch unless the target touches them.
+        WorkspaceStatus state;
+        if (!status(repoRoot, state, error)) {
+            return false;
+        }
+        std::unordered_set<std::string> dirty;
+        for (const auto *list : {&state.staged, &state.unstaged}) {
+            for (const auto &change : *list) {
+                dirty.insert(change.second);
+            }
+        }
+        std::unordered_set<std::string> untracked(state.untracked.begin(), state.untracked.end());
+        for (const auto &change : changes) {
+            if (dirty.count(change.path)) {
+                error = "Local changes to " + change.path + " would be overwritten; commit or reset them first.";
+                return false;
+            }
+            if (change.kind != 'D' && untracked.count(change.path)) {
+                error = "Untracked file " + change.path + " would be overwritten.";
+                return false;
+            }
         }
-        fs::create_directories(remoteRoot);
-        copyDirectory(repoRoot / ".glite", remoteRoot / ".glite");
-        copyDirectory(repoRoot / "workspace", remoteRoot / "workspace");
-    } catch (const std::exception &ex) {
-        error = ex.what();
-        return false;
+        // The index and HEAD switch together or not at all. Workspace files
+        // are written straight away, before the commit point: a crash in
+        // between leaves them ahead of HEAD, and status shows them as
+        // local changes.
+        journal::Transaction transaction(repoRoot, "checkout: " + current + " -> " + branch);
+        if (!applyTreeChanges(repoRoot, changes, result.filesWritten, result.filesRemoved, error)) {
+            return false;
+        }
+        setCurrentBranch(repoRoot, branch);
+        return transaction.commit(error);
     }
+    setCurrentBranch(repoRoot, branch);
     return true;
 }
 
-bool RepoService::pull(const fs::path &repoRoot,
-                       const fs::path &remoteRoot,
-                       std::string &error) const {
-    try {
-        if (!fs::exists(remoteRoot)) {
-            error = "Remote not found.";
+bool RepoService::diffCommits(const fs::path &repoRoot,
+                              const std::string &oldCommit,
+                              const std::string &newCommit,
+                              std::vector<trees::TreeChange> &changes,
+                              std::string &error) const {
+    changes.clear();
+    CommitRecord before = oldCommit.empty() ? CommitRecord{} : readCommit(repoRoot, oldCommit, true);
+    CommitRecord after = newCommit.empty() ? CommitRecord{} : readCommit(repoRoot, newCommit, true);
+    bool oldTreeOk = oldCommit.empty() || !before.tree.empty();
+    bool newTreeOk = newCommit.empty() || !after.tree.empty();
+    if (oldTreeOk && newTreeOk) {
+        if (!trees::diffTrees(ObjectStore(repoRoot), before.tree, after.tree, changes)) {
+            error = "Unable to read tree objects.";
             return false;
         }
-        copyDirectory(remoteRoot / ".glite", repoRoot / ".glite");
-        copyDirectory(remoteRoot / "workspace", repoRoot / "workspace");
-    } catch (const std::exception &ex) {
-        error = ex.what();
-        return false;
+        return true;
+    }
+    // Commits from before tree objects: compare flat file lists.
+    auto oldFiles = snapshot(repoRoot, oldCommit);
+    auto newFiles = snapshot(repoRoot, newCommit);
+    for (const auto &file : newFiles) {
+        auto it = oldFiles.find(file.first);
+        if (it == oldFiles.end()) {
+            changes.push_back({'A', file.first, {}, file.second});
+        } else if (it->second != file.second) {
+            changes.push_back({'M', file.first, it->second, file.second});
+        }
+    }
+    for (const auto &file : oldFiles) {
+        if (!newFiles.count(file.first)) {
+            changes.push_back({'D', file.first, file.second, {}});
+        }
     }
+    std::sort(changes.begin(), changes.end(),
+              [](const trees::TreeChange &a, const trees::TreeChange &b) { return a.path < b.path; });
     return true;
 }
 
+void RepoService::walkHistory(const fs::path &repoRoot,
+                              const std::string &tip,
+                              std::size_t skip,
+                              const std::function<bool(const CommitRecord &)> &visitor) const {
+    walkHistory(repoRoot, tip, skip, [&visitor](const CommitView &view) { return visitor(view.toRecord()); });
+}
+
+void RepoService::walkHistory(const fs::path &repoRoot,
+                              const std::string &tip,
+                              std::size_t skip,
+                              const std::function<bool(const CommitView &)> &visitor) const {
+    walkHistory(repoRoot, tip, skip, HistoryFilter{}, visitor);
+}
+
+void RepoService::walkHistory(const fs::path &repoRoot,
+                              const std::string &tip,
+                              std::size_t skip,
+                              const HistoryFilter &filter,
+                              const std::function<bool(const CommitView &)> &visitor) const {
+    static stats::Site site("RepoService::walkHistory");
+    stats::Timer timer(site);
+    if (tip.empty()) {
+        return;
+    }
+    CommitGraph graph(repoRoot);
+    auto reader = graphReader(repoRoot);
+    std::uint32_t tipPos = 0;
+    std::string error;
+    if (!graph.ensure(tip, reader, tipPos, error)) {
+        return;
+    }
+    ReachabilityBitmaps::Bits excluded;
+    if (!filter.exclude.empty()) {
+        std::uint32_t excludePos = 0;
+        if (!graph.ensure(filter.exclude, reader, excludePos, error)) {
+            return;
+        }
+        ReachabilityBitmaps bitmaps(repoRoot);
+        bitmaps.load(graph);
+        excluded = bitmaps.reachable(graph, excludePos);
+    }
+    ChangedPathFilters filters(repoRoot);
+    if (!filter.path.empty()) {
+        filters.load();
+    }
+    std::vector<trees::TreeChange> changes;
+    std::vector<std::string> changedPaths;
+    // A commit whose filter rules the path out is passed over unopened; the
+    // rest are diffed against their first parent, which also yields the
+    // filter when the commit has none yet.
+    auto touchesPath = [&](std::uint32_t position, const std::string &commitId) {
+        if (!filters.mayHaveChanged(commitId, filter.path)) {
+            return false;
+        }
+        std::uint32_t parentPos = graph.parent(position, 0);
+        std::string parentId = parentPos == CommitGraph::kNone ? std::string() : graph.id(parentPos);
+        if (!diffCommits(repoRoot, parentId, commitId, changes, error)) {
+            return true;
+        }
+        if (!filters.contains(commitId)) {
+            changedPaths.clear();
+            for (const auto &change : changes) {
+                changedPaths.push_back(change.path);
+            }
+            filters.add(commitId, changedPaths);
+        }
+        const std::string &path = filter.path;
+        return std::any_of(changes.begin(), changes.end(), [&path](const trees::TreeChange &change) {
+            return change.path.compare(0, path.size(), path) == 0 &&
+                   (change.path.size() == path.size() || change.path[path.size()] == '/');
+        });
+    };
+
+    ObjectStore store(repoRoot);
+    std::string id;
+    std::string content;
+    CommitView view;
+    std::size_t skipped = 0;
+    graph.walk(tipPos, [&](std::uint32_t position) {
+        if (ReachabilityBitmaps::test(excluded, position)) {
+            return true;
+        }
+        if (!filter.path.empty() && !touchesPath(position, graph.id(position))) {
+            return true;
+        }
+        if (skipped < skip) {
+            ++skipped;
+            return true;
+        }
+        // Only commits that are actually shown are opened.
+        id = graph.id(position);
+        content.clear();
+        bool read = store.read(id, content);
+        parseCommitHeader(content, view);
+        view.readable = read && !view.timestamp.empty();
+        if (view.id.empty()) {
+            view.id = id;
+        }
+        return visitor(view);
+    });
+    filters.save(error);
+}
+
 std::vector<CommitRecord> RepoService::history(const fs::path &repoRoot,
                                                const std::string &branch,
-                                               std::size_t limit) const {
+                                               std::size_t limit,
+                                               std::size_t skip) const {
     std::vector<CommitRecord> result;
-    std::string head = branchHead(repoRoot, branch);
-    std::string current = head;
-    while (!current.empty() && result.size() < limit) {
-        if (!commitExists(repoRoot, current)) {
-            break;
-        }
-        CommitRecord record = readCommit(repoRoot, current);
-        if (record.id.empty()) {
-            break;
-        }
-        result.push_back(record);
-        current = record.parent;
+    if (limit == 0) {
+        return result;
     }
+    walkHistory(repoRoot, branchHead(repoRoot, branch), skip, [&](const CommitView &view) {
+        result.push_back(view.toRecord());
+        return result.size() < limit;
+    });
     return result;
 }
 
@@ -270,13 +1981,16 @@ void RepoService::appendLog(const fs::path &repoRoot, const CommitRecord &record
     out << record.id << '\t' << record.branch << '\t' << record.timestamp << '\t' << record.message << "\n";
 }
 
-CommitRecord RepoService::readCommit(const fs::path &repoRoot, const std::string &commitId) {
+CommitRecord RepoService::readCommit(const fs::path &repoRoot, const std::string &commitId, bool headerOnly) {
+    static stats::Site site("RepoService::readCommit");
+    stats::Timer timer(site);
     CommitRecord record;
     record.id = commitId;
-    std::ifstream in(repoRoot / ".glite" / "objects" / commitId);
-    if (!in) {
+    std::string content;
+    if (!ObjectStore(repoRoot).read(commitId, content)) {
         return record;
     }
+    std::istringstream in(content);
     std::string line;
     bool filesSection = false;
     while (std::getline(in, line)) {
@@ -285,6 +1999,9 @@ CommitRecord RepoService::readCommit(const fs::path &repoRoot, const std::string
             continue;
         }
         if (line == "files:") {
+            if (headerOnly) {
+                break;
+            }
             filesSection = true;
             continue;
         }
@@ -303,8 +2020,12 @@ CommitRecord RepoService::readCommit(const fs::path &repoRoot, const std::string
                 record.branch = value;
             } else if (key == "parent") {
                 record.parent = value == "null" ? std::string{} : value;
+            } else if (key == "parent2") {
+                record.parent2 = value;
             } else if (key == "message") {
                 record.message = value;
+            } else if (key == "tree") {
+                record.tree = value;
             }
         } else {
             auto parts = split(line, '\t');
@@ -313,14 +2034,31 @@ CommitRecord RepoService::readCommit(const fs::path &repoRoot, const std::string
             }
         }
     }
+    if (!headerOnly && !record.tree.empty()) {
+        trees::flattenTree(ObjectStore(repoRoot), record.tree, record.files);
+    }
     return record;
 }
 
 bool RepoService::commitExists(const fs::path &repoRoot, const std::string &commitId) {
-    return fs::exists(repoRoot / ".glite" / "objects" / commitId);
+    return ObjectStore(repoRoot).contains(commitId);
+}
+
+std::unordered_map<std::string, std::string> RepoService::snapshot(const fs::path &repoRoot,
+                                                                   const std::string &commitId) {
+    std::unordered_map<std::string, std::string> files;
+    if (commitId.empty() || !commitExists(repoRoot, commitId)) {
+        return files;
+    }
+    for (auto &file : readCommit(repoRoot, commitId).files) {
+        files[file.first] = std::move(file.second);
+    }
+    return files;
 }
 
 void RepoService::copyDirectory(const fs::path &from, const fs::path &to) {
+    static stats::Site site("RepoService::copyDirectory");
+    stats::Timer timer(site);
     if (!fs::exists(from)) {
         return;
     }
@@ -329,6 +2067,7 @@ void RepoService::copyDirectory(const fs::path &from, const fs::path &to) {
     }
     fs::create_directories(to);
     for (const auto &entry : fs::recursive_directory_iterator(from)) {
+        stats::count(stats::Counter::FsCalls);
         const auto relative = fs::relative(entry.path(), from);
         const auto target = to / relative;
         if (entry.is_directory()) {
@@ -340,56 +2079,241 @@ void RepoService::copyDirectory(const fs::path &from, const fs::path &to) {
     }
 }
 
-bool RepoService::mergeBranch(const fs::path &repoRoot, const std::string &branch, std::string &error) const {
+bool RepoService::mergeBranch(const fs::path &repoRoot,
+                              const std::string &branch,
+                              const std::string &author,
+                              MergeResult &result,
+                              std::string &error) const {
+    static stats::Site site("RepoService::mergeBranch");
+    stats::Timer timer(site);
+    RepoLock lock(repoRoot, RepoLock::Mode::Write);
+    result = {};
     std::string current = currentBranch(repoRoot);
     if (current == branch) {
         error = "Cannot merge branch into itself.";
         return false;
     }
     
-    std::string branchHeadId = branchHead(repoRoot, branch);
-    if (branchHeadId.empty()) {
+    std::string theirs = branchHead(repoRoot, branch);
+    if (theirs.empty()) {
         error = "Branch '" + branch + "' has no commits.";
         return false;
     }
-    
-    std::string currentHeadId = branchHead(repoRoot, current);
-    
-    // Create merge commit
-    CommitRecord mergeRecord;
-    mergeRecord.id = hashing::sha256String(branchHeadId + currentHeadId + timestamp());
-    mergeRecord.parent = currentHeadId;
-    mergeRecord.author = "merge";
-    mergeRecord.timestamp = timestamp();
-    mergeRecord.message = "Merge branch '" + branch + "' into '" + current + "'";
-    mergeRecord.branch = current;
-    
-    // Copy files from both branches (simplified merge)
-    auto branchCommit = readCommit(repoRoot, branchHeadId);
-    for (const auto &file : branchCommit.files) {
-        mergeRecord.files.push_back(file);
+    fs::path mergeHeadPath = repoRoot / ".glite" / "MERGE_HEAD";
+    if (fs::exists(mergeHeadPath)) {
+        error = "A merge is already in progress; resolve the conflicts and commit first.";
+        return false;
     }
     
-    // Write merge commit
-    fs::path commitPath = repoRoot / ".glite" / "objects" / mergeRecord.id;
-    std::ofstream out(commitPath);
-    out << "id: " << mergeRecord.id << "\n";
-    out << "parent: " << (mergeRecord.parent.empty() ? "null" : mergeRecord.parent) << "\n";
-    out << "author: " << mergeRecord.author << "\n";
-    out << "timestamp: " << mergeRecord.timestamp << "\n";
-    out << "branch: " << mergeRecord.branch << "\n";
-    out << "message: " << mergeRecord.message << "\n";
-    for (const auto &file : mergeRecord.files) {
-        out << file.first << "\t" << file.second << "\n";
+    std::string ours = branchHead(repoRoot, current);
+    if (ours == theirs || isAncestor(repoRoot, theirs, ours)) {
+        result.upToDate = true;
+        result.commitId = ours;
+        return true;
     }
-    
-    updateBranchHead(repoRoot, current, mergeRecord.id);
-    appendLog(repoRoot, mergeRecord);
-    
+    std::unordered_set<std::string> untracked;
+    if (!requireCleanWorkspace(repoRoot, untracked, error)) {
+        return false;
+    }
+
+    if (ours.empty() || isAncestor(repoRoot, ours, theirs)) {
+        journal::Transaction transaction(repoRoot, "merge " + branch + ": fast-forward");
+        SyncResult sync;
+        if (!fastForwardWorkspace(repoRoot, ours, theirs, sync, error)) {
+            return false;
+        }
+        if (!updateBranchHead(repoRoot, current, theirs, error, ours)) {
+            error = "Unable to update branch '" + current + "': " + error;
+            return false;
+        }
+        if (!transaction.commit(error)) {
+            return false;
+        }
+        result.fastForward = true;
+        result.commitId = theirs;
+        result.filesWritten = sync.filesWritten;
+        return true;
+    }
+
+    // Unrelated histories merge against an empty base.
+    std::string base;
+    mergeBase(repoRoot, ours, theirs, base);
+    if (!mergeCommits(repoRoot, base, ours, theirs, branch, true, untracked, result, error)) {
+        return false;
+    }
+    if (!result.conflicts.empty()) {
+        std::ofstream out(mergeHeadPath, std::ios::binary | std::ios::trunc);
+        out << theirs << "\n";
+        for (const auto &path : result.conflicts) {
+            out << path << "\n";
+        }
+        out.flush();
+        if (!out) {
+            error = "Unable to record merge state.";
+            return false;
+        }
+        return true;
+    }
+
+    CommitRecord record;
+    record.parent = ours;
+    record.parent2 = theirs;
+    record.author = author;
+    record.message = "Merge branch '" + branch + "' into '" + current + "'";
+    record.branch = current;
+    forEachIndexEntry(repoRoot, [&record](const IndexEntry &entry) {
+        record.files.emplace_back(entry.path, entry.hash);
+        return true;
+    });
+    if (!trees::writeTree(ObjectStore(repoRoot), record.files, record.tree, error) ||
+        !writeCommit(repoRoot, record, error)) {
+        return false;
+    }
+    result.commitId = record.id;
     return true;
 }
 
+bool RepoService::requireCleanWorkspace(const fs::path &repoRoot,
+                                        std::unordered_set<std::string> &untracked,
+                                        std::string &error) const {
+    WorkspaceStatus state;
+    if (!status(repoRoot, state, error)) {
+        return false;
+    }
+    if (!state.staged.empty() || !state.unstaged.empty()) {
+        error = "You have uncommitted changes; commit or reset them first.";
+        return false;
+    }
+    untracked.clear();
+    untracked.insert(state.untracked.begin(), state.untracked.end());
+    return true;
+}
+
+bool RepoService::mergeCommits(const fs::path &repoRoot,
+                               const std::string &baseCommit,
+                               const std::string &oursCommit,
+                               const std::string &theirsCommit,
+                               const std::string &theirsLabel,
+                               bool keepConflicts,
+                               const std::unordered_set<std::string> &untracked,
+                               MergeResult &result,
+                               std::string &error) const {
+    result.conflicts.clear();
+    std::vector<trees::TreeChange> oursChanges;
+    std::vector<trees::TreeChange> theirsChanges;
+    if (!diffCommits(repoRoot, baseCommit, oursCommit, oursChanges, error) ||
+        !diffCommits(repoRoot, baseCommit, theirsCommit, theirsChanges, error)) {
+        return false;
+    }
+    std::unordered_map<std::string, const trees::TreeChange *> oursByPath;
+    for (const auto &change : oursChanges) {
+        oursByPath.emplace(change.path, &change);
+    }
+
+    // Only paths the other side changed can need work; everything else
+    // already matches HEAD in the workspace and index.
+    ObjectStore store(repoRoot);
+    std::vector<std::string> blobs;
+    for (const auto &change : theirsChanges) {
+        auto it = oursByPath.find(change.path);
+        blobs.push_back(change.newId);
+        if (it != oursByPath.end()) {
+            blobs.push_back(change.oldId);
+            blobs.push_back(it->second->newId);
+        }
+    }
+    if (!store.prefetch(blobs, error)) {
+        return false;
+    }
+    std::vector<MergeAction> plan;
+    for (const auto &change : theirsChanges) {
+        auto it = oursByPath.find(change.path);
+        if (it == oursByPath.end()) {
+            plan.push_back({change.path, change.newId, false, {}});
+            continue;
+        }
+        const trees::TreeChange &mine = *it->second;
+        if (mine.newId == change.newId) {
+            continue;
+        }
+        if (mine.newId.empty() || change.newId.empty()) {
+            // Modified on one side, deleted on the other: keep the modified
+            // file so nothing is lost.
+            result.conflicts.push_back(change.path);
+            if (mine.newId.empty()) {
+                plan.push_back({change.path, change.newId, false, {}});
+            }
+            continue;
+        }
+        std::string baseData;
+        std::string oursData;
+        std::string theirsData;
+        if ((!change.oldId.empty() && !store.read(change.oldId, baseData)) || !store.read(mine.newId, oursData) ||
+            !store.read(change.newId, theirsData)) {
+            error = "Missing blob for " + change.path + ".";
+            return false;
+        }
+        merge::TextMergeResult merged;
+        if (!merge::mergeText(baseData, oursData, theirsData, "HEAD", theirsLabel, merged)) {
+            // Binary: HEAD's version stays in place.
+            result.conflicts.push_back(change.path);
+            continue;
+        }
+        if (merged.conflicts > 0) {
+            result.conflicts.push_back(change.path);
+        }
+        MergeAction action;
+        action.path = change.path;
+        action.hasContent = true;
+        action.content = std::move(merged.text);
+        plan.push_back(std::move(action));
+    }
+    if (!result.conflicts.empty() && !keepConflicts) {
+        return true;
+    }
+    for (const auto &action : plan) {
+        if ((action.hasContent || !action.blobId.empty()) && untracked.count(action.path)) {
+            error = "Merge would overwrite untracked file " + action.path + ".";
+            return false;
+        }
+    }
+
+    auto entries = readIndex(repoRoot);
+    std::unordered_map<std::string, IndexEntry> byPath;
+    for (auto &entry : entries) {
+        byPath[entry.path] = std::move(entry);
+    }
+    for (auto &action : plan) {
+        if (!action.hasContent && action.blobId.empty()) {
+            removeWorkspaceFile(repoRoot, action.path);
+            byPath.erase(action.path);
+            continue;
+        }
+        if (action.hasContent) {
+            action.blobId = hashing::sha256String(action.content);
+            if (!store.writeLoose(action.blobId, action.content, error)) {
+                return false;
+            }
+        }
+        if (!writeWorkspaceFile(store, repoRoot, action.path, action.blobId, error)) {
+            return false;
+        }
+        IndexEntry entry;
+        entry.path = action.path;
+        entry.hash = action.blobId;
+        statIndexEntry(repoRoot / "workspace" / action.path, entry);
+        byPath[action.path] = std::move(entry);
+        ++result.filesWritten;
+    }
+    entries.clear();
+    for (auto &item : byPath) {
+        entries.push_back(std::move(item.second));
+    }
+    return writeIndex(repoRoot, std::move(entries), error);
+}
+
 bool RepoService::rebaseBranch(const fs::path &repoRoot, const std::string &branch, std::string &error) const {
+    RepoLock lock(repoRoot, RepoLock::Mode::Write);
     std::string current = currentBranch(repoRoot);
     if (current == branch) {
         error = "Cannot rebase branch onto itself.";
@@ -403,11 +2327,11 @@ bool RepoService::rebaseBranch(const fs::path &repoRoot, const std::string &bran
     }
     
     // Simplified rebase: just update current branch head to point to branch head
-    updateBranchHead(repoRoot, current, branchHeadId);
-    return true;
+    return updateBranchHead(repoRoot, current, branchHeadId, error);
 }
 
 bool RepoService::renameBranch(const fs::path &repoRoot, const std::string &oldName, const std::string &newName, std::string &error) const {
+    RepoLock lock(repoRoot, RepoLock::Mode::Write);
     fs::path oldRef = repoRoot / ".glite" / "refs" / "heads" / oldName;
     fs::path newRef = repoRoot / ".glite" / "refs" / "heads" / newName;
     
@@ -438,6 +2362,7 @@ bool RepoService::renameBranch(const fs::path &repoRoot, const std::string &oldN
 }
 
 bool RepoService::deleteBranch(const fs::path &repoRoot, const std::string &branchName, std::string &error) const {
+    RepoLock lock(repoRoot, RepoLock::Mode::Write);
     fs::path branchRef = repoRoot / ".glite" / "refs" / "heads" / branchName;
     
     if (!fs::exists(branchRef)) {
@@ -461,9 +2386,9 @@ bool RepoService::deleteBranch(const fs::path &repoRoot, const std::string &bran
 }
 
 bool RepoService::removeFile(const fs::path &repoRoot, const std::string &relativePath, std::string &error) const {
+    RepoLock lock(repoRoot, RepoLock::Mode::Write);
     auto entries = readIndex(repoRoot);
-    auto it = std::find_if(entries.begin(), entries.end(),
-                          [&](const auto &e) { return e.first == relativePath; });
+    auto it = findEntry(entries, relativePath);
     
     if (it == entries.end()) {
         error = "File not in index.";
@@ -471,7 +2396,9 @@ bool RepoService::removeFile(const fs::path &repoRoot, const std::string &relati
     }
     
     entries.erase(it);
-    writeIndex(repoRoot, entries);
+    if (!writeIndex(repoRoot, std::move(entries), error)) {
+        return false;
+    }
     
     // Remove from workspace
     fs::path filePath = repoRoot / "workspace" / relativePath;
@@ -482,35 +2409,132 @@ bool RepoService::removeFile(const fs::path &repoRoot, const std::string &relati
     return true;
 }
 
-std::string RepoService::getDiff(const fs::path &repoRoot) const {
+bool RepoService::diffWorkspace(const fs::path &repoRoot,
+                                bool staged,
+                                const textdiff::LineSink &sink,
+                                std::string &error) const {
+    static stats::Site site("RepoService::diffWorkspace");
+    stats::Timer timer(site);
+    // status() refreshes the index's cached stat data, which needs Write.
+    RepoLock lock(repoRoot, RepoLock::Mode::Write);
+    WorkspaceStatus state;
+    if (!status(repoRoot, state, error)) {
+        return false;
+    }
+    ObjectStore store(repoRoot);
     auto entries = readIndex(repoRoot);
-    if (entries.empty()) {
-        return "No changes staged.";
+    auto indexBlob = [&](const std::string &path) {
+        auto it = findEntry(entries, path);
+        return it == entries.end() ? std::string() : it->hash;
+    };
+    if (staged) {
+        auto head = snapshot(repoRoot, branchHead(repoRoot, currentBranch(repoRoot)));
+        std::vector<std::string> blobs;
+        for (const auto &change : state.staged) {
+            auto it = head.find(change.second);
+            if (it != head.end()) {
+                blobs.push_back(it->second);
+            }
+            blobs.push_back(indexBlob(change.second));
+        }
+        if (!store.prefetch(blobs, error)) {
+            return false;
+        }
+        for (const auto &change : state.staged) {
+            auto it = head.find(change.second);
+            std::string oldId = it == head.end() ? std::string() : it->second;
+            std::string newId = change.first == 'D' ? std::string() : indexBlob(change.second);
+            std::string oldData;
+            std::string newData;
+            if ((!oldId.empty() && !store.read(oldId, oldData)) || (!newId.empty() && !store.read(newId, newData))) {
+                error = "Missing blob for " + change.second + ".";
+                return false;
+            }
+            writeFileDiff(change.second, change.first, oldData, newData, sink);
+        }
+        return true;
     }
-    
-    std::string result = "Staged changes:\n";
-    for (const auto &entry : entries) {
-        result += "  " + entry.first + "\n";
+    std::vector<std::string> blobs;
+    for (const auto &change : state.unstaged) {
+        blobs.push_back(indexBlob(change.second));
     }
-    return result;
+    if (!store.prefetch(blobs, error)) {
+        return false;
+    }
+    for (const auto &change : state.unstaged) {
+        std::string oldData;
+        if (!store.read(indexBlob(change.second), oldData)) {
+            error = "Missing blob for " + change.second + ".";
+            return false;
+        }
+        std::string newData;
+        if (change.first != 'D' && !readWholeFile(repoRoot / "workspace" / change.second, newData)) {
+            error = "Unable to read " + change.second + ".";
+            return false;
+        }
+        writeFileDiff(change.second, change.first, oldData, newData, sink);
+    }
+    return true;
+}
+
+bool RepoService::diffCommitContents(const fs::path &repoRoot,
+                                     const std::string &oldCommit,
+                                     const std::string &newCommit,
+                                     const textdiff::LineSink &sink,
+                                     std::string &error) const {
+    std::vector<trees::TreeChange> changes;
+    if (!diffCommits(repoRoot, oldCommit, newCommit, changes, error)) {
+        return false;
+    }
+    ObjectStore store(repoRoot);
+    std::vector<std::string> blobs;
+    for (const auto &change : changes) {
+        blobs.push_back(change.oldId);
+        blobs.push_back(change.newId);
+    }
+    if (!store.prefetch(blobs, error)) {
+        return false;
+    }
+    for (const auto &change : changes) {
+        std::string oldData;
+        std::string newData;
+        if ((!change.oldId.empty() && !store.read(change.oldId, oldData)) ||
+            (!change.newId.empty() && !store.read(change.newId, newData))) {
+            error = "Missing blob for " + change.path + ".";
+            return false;
+        }
+        writeFileDiff(change.path, change.kind, oldData, newData, sink);
+    }
+    return true;
 }
 
 bool RepoService::resetFile(const fs::path &repoRoot, const std::string &relativePath, std::string &error) const {
+    RepoLock lock(repoRoot, RepoLock::Mode::Write);
     auto entries = readIndex(repoRoot);
-    auto it = std::find_if(entries.begin(), entries.end(),
-                          [&](const auto &e) { return e.first == relativePath; });
+    auto it = findEntry(entries, relativePath);
+    auto headFiles = snapshot(repoRoot, branchHead(repoRoot, currentBranch(repoRoot)));
+    auto committed = headFiles.find(relativePath);
     
-    if (it == entries.end()) {
+    if (committed != headFiles.end()) {
+        // Unstage by restoring the committed blob; stat data is left unset so
+        // the workspace copy is re-hashed on the next status.
+        if (it == entries.end()) {
+            entries.push_back({relativePath, committed->second});
+        } else if (it->hash != committed->second) {
+            *it = {relativePath, committed->second};
+        }
+    } else if (it != entries.end()) {
+        entries.erase(it);
+    } else {
         error = "File not in index.";
         return false;
     }
     
-    entries.erase(it);
-    writeIndex(repoRoot, entries);
-    return true;
+    return writeIndex(repoRoot, std::move(entries), error);
 }
 
 bool RepoService::addIgnorePattern(const fs::path &repoRoot, const std::string &pattern, std::string &error) const {
+    RepoLock lock(repoRoot, RepoLock::Mode::Write);
     fs::path ignoreFile = repoRoot / ".gliteignore";
     std::ofstream out(ignoreFile, std::ios::app);
     if (!out) {
@@ -522,6 +2546,7 @@ bool RepoService::addIgnorePattern(const fs::path &repoRoot, const std::string &
 }
 
 bool RepoService::createTag(const fs::path &repoRoot, const std::string &tagName, std::string &error) const {
+    RepoLock lock(repoRoot, RepoLock::Mode::Write);
     fs::path tagsDir = repoRoot / ".glite" / "refs" / "tags";
     fs::create_directories(tagsDir);
     
@@ -565,47 +2590,272 @@ CommitRecord RepoService::getCommit(const fs::path &repoRoot, const std::string
 }
 
 bool RepoService::revertCommit(const fs::path &repoRoot, const std::string &commitId, const std::string &author, std::string &error) const {
+    RepoLock lock(repoRoot, RepoLock::Mode::Write);
     if (!commitExists(repoRoot, commitId)) {
         error = "Commit not found.";
         return false;
     }
+    if (fs::exists(repoRoot / ".glite" / "MERGE_HEAD")) {
+        error = "A merge is in progress; resolve the conflicts and commit first.";
+        return false;
+    }
     
-    CommitRecord originalCommit = readCommit(repoRoot, commitId);
+    CommitRecord originalCommit = readCommit(repoRoot, commitId, true);
     std::string current = currentBranch(repoRoot);
     std::string currentHead = branchHead(repoRoot, current);
-    
-    // Create revert commit
-    CommitRecord revertRecord;
-    revertRecord.id = hashing::sha256String(commitId + currentHead + timestamp());
-    revertRecord.parent = currentHead;
-    revertRecord.author = author;
-    revertRecord.timestamp = timestamp();
-    revertRecord.message = "Revert: " + originalCommit.message;
-    revertRecord.branch = current;
-    
-    // Copy files from parent commit (simplified revert)
-    if (!originalCommit.parent.empty()) {
-        CommitRecord parentCommit = readCommit(repoRoot, originalCommit.parent);
-        revertRecord.files = parentCommit.files;
+    if (currentHead.empty()) {
+        error = "No commits on branch '" + current + "'.";
+        return false;
     }
-    
-    // Write revert commit
-    fs::path commitPath = repoRoot / ".glite" / "objects" / revertRecord.id;
-    std::ofstream out(commitPath);
-    out << "id: " << revertRecord.id << "\n";
-    out << "parent: " << (revertRecord.parent.empty() ? "null" : revertRecord.parent) << "\n";
-    out << "author: " << revertRecord.author << "\n";
-    out << "timestamp: " << revertRecord.timestamp << "\n";
-    out << "branch: " << revertRecord.branch << "\n";
-    out << "message: " << revertRecord.message << "\n";
-    for (const auto &file : revertRecord.files) {
-        out << file.first << "\t" << file.second << "\n";
+    std::unordered_set<std::string> untracked;
+    if (!requireCleanWorkspace(repoRoot, untracked, error)) {
+        return false;
     }
-    
-    updateBranchHead(repoRoot, current, revertRecord.id);
-    appendLog(repoRoot, revertRecord);
-    
+
+    // Merging the commit's parent into HEAD with the commit itself as the
+    // base applies exactly the inverse of that commit.
+    MergeResult merged;
+    if (!mergeCommits(repoRoot, commitId, currentHead, originalCommit.parent, "revert", false, untracked, merged, error)) {
+        return false;
+    }
+    if (!merged.conflicts.empty()) {
+        std::string paths;
+        for (const auto &path : merged.conflicts) {
+            paths += (paths.empty() ? "" : ", ") + path;
+        }
+        error = "Revert would conflict in " + paths + "; nothing was changed.";
+        return false;
+    }
+
+    CommitRecord record;
+    record.parent = currentHead;
+    record.author = author;
+    record.message = "Revert: " + originalCommit.message;
+    record.branch = current;
+    forEachIndexEntry(repoRoot, [&record](const IndexEntry &entry) {
+        record.files.emplace_back(entry.path, entry.hash);
+        return true;
+    });
+    if (!trees::writeTree(ObjectStore(repoRoot), record.files, record.tree, error)) {
+        return false;
+    }
+    if (record.tree == readCommit(repoRoot, currentHead, true).tree) {
+        error = "Nothing to revert; HEAD already lacks those changes.";
+        return false;
+    }
+    return writeCommit(repoRoot, record, error);
+}
+
+bool RepoService::repack(const fs::path &repoRoot, bool all, RepackStats &stats, std::string &error) const {
+    // Shared with gc, whose pack is written outside the repository lock.
+    LockFile gcLock(repoRoot / ".glite" / "gc");
+    if (!gcLock.acquire(error)) {
+        return false;
+    }
+    RepoLock lock(repoRoot, RepoLock::Mode::Write);
+    RepackOptions options = repackOptions(repoRoot);
+    std::unordered_set<std::string> reachable;
+    if (!markReachable(repoRoot, reachable, error, &options.pathHints)) {
+        return false;
+    }
+    ObjectStore store(repoRoot);
+    return store.repack(all, options, stats, error);
+}
+
+RepackOptions RepoService::repackOptions(const fs::path &repoRoot) const {
+    RepackOptions options;
+    auto config = StorageManager::readRepoConfig(repoRoot);
+    auto readInt = [&](const std::string &key, int fallback) {
+        auto it = config.find(key);
+        if (it == config.end()) {
+            return fallback;
+        }
+        try {
+            return std::max(0, std::stoi(it->second));
+        } catch (const std::exception &) {
+            return fallback;
+        }
+    };
+    options.maxDeltaDepth = readInt("pack.depth", options.maxDeltaDepth);
+    options.window = readInt("pack.window", options.window);
+    return options;
+}
+
+bool RepoService::gc(const fs::path &repoRoot, bool pruneNow, RepackStats &result, std::string &error) const {
+    static stats::Site site("RepoService::gc");
+    stats::Timer timer(site);
+    result = {};
+    LockFile gcLock(repoRoot / ".glite" / "gc");
+    if (!gcLock.acquire(error)) {
+        return false;
+    }
+    auto config = StorageManager::readRepoConfig(repoRoot);
+    long graceDays = 14;
+    if (pruneNow) {
+        graceDays = 0;
+    } else if (auto it = config.find("gc.graceDays"); it != config.end()) {
+        try {
+            graceDays = std::max(0L, std::stol(it->second));
+        } catch (const std::exception &) {
+        }
+    }
+    std::chrono::seconds grace(graceDays * 24 * 60 * 60);
+
+    std::vector<fs::path> roots = forksOf(repoRoot);
+    roots.insert(roots.begin(), repoRoot);
+    std::unordered_set<std::string> reachable;
+    RepackOptions options = repackOptions(repoRoot);
+    for (const auto &root : roots) {
+        if (!markReachable(root, reachable, error, &options.pathHints)) {
+            return false;
+        }
+    }
+    ObjectStore store(repoRoot);
+    GcPlan plan;
+    if (!store.prepareGc(reachable, grace, options, plan, result, error)) {
+        return false;
+    }
+
+    // Commits, staging and fetches since the first mark only add roots;
+    // marking again picks up what they reach before anything is deleted.
+    RepoLock lock(repoRoot, RepoLock::Mode::Write);
+    for (const auto &root : roots) {
+        if (!markReachable(root, reachable, error)) {
+            return false;
+        }
+    }
+    store.finishGc(plan, reachable, grace, result);
+    CommitGraph graph(repoRoot);
+    std::string graphError;
+    auto keep = [&reachable](const std::string &id) { return reachable.count(id) > 0; };
+    graph.retain(keep, graphError);
+    ChangedPathFilters filters(repoRoot);
+    filters.retain(keep, graphError);
+
+    // Bitmaps are numbered by graph position, so they are rebuilt after
+    // retain renumbers it. `gc.bitmaps = false` turns them off.
+    fs::path bitmapFile = repoRoot / ".glite" / "commit-graph-bitmaps";
+    if (auto it = config.find("gc.bitmaps"); it != config.end() && it->second == "false") {
+        std::error_code ec;
+        fs::remove(bitmapFile, ec);
+        return true;
+    }
+    auto reader = graphReader(repoRoot);
+    std::vector<std::uint32_t> tips;
+    for (const char *kind : {"heads", "tags"}) {
+        for (const auto &ref : listRefs(repoRoot / ".glite" / "refs" / kind)) {
+            std::uint32_t position = 0;
+            if (graph.ensure(ref.second, reader, position, graphError)) {
+                tips.push_back(position);
+            }
+        }
+    }
+    ReachabilityBitmaps(repoRoot).write(graph, tips, graphError);
     return true;
 }
 
+bool RepoService::markReachable(const fs::path &repoRoot,
+                                std::unordered_set<std::string> &marked,
+                                std::string &error,
+                                std::unordered_map<std::string, std::string> *pathHints) const {
+    fs::path glite = repoRoot / ".glite";
+    std::vector<std::string> tips;
+    for (const char *kind : {"heads", "tags", "remotes"}) {
+        for (const auto &ref : listRefs(glite / "refs" / kind)) {
+            tips.push_back(ref.second);
+        }
+    }
+    {
+        std::ifstream in(glite / "MERGE_HEAD");
+        std::string mergeHead;
+        std::getline(in, mergeHead);
+        tips.push_back(trim(mergeHead));
+    }
+    forEachIndexEntry(repoRoot, [&](const IndexEntry &entry) {
+        marked.insert(entry.hash);
+        if (pathHints != nullptr) {
+            pathHints->emplace(entry.hash, entry.path);
+        }
+        return true;
+    });
 
+    ObjectStore store(repoRoot);
+    CommitGraph graph(repoRoot);
+    auto reader = graphReader(repoRoot);
+    std::vector<std::uint32_t> commits;
+    for (const auto &tip : tips) {
+        if (tip.empty() || marked.count(tip) > 0) {
+            continue;
+        }
+        std::uint32_t position = 0;
+        if (!graph.ensure(tip, reader, position, error)) {
+            error = "Commit " + tip.substr(0, 10) + " named by a ref is missing; nothing was pruned.";
+            return false;
+        }
+        commits.push_back(position);
+    }
+    // Each tree waits with the path it was found at, for the hints.
+    std::vector<std::pair<std::string, std::string>> treesToVisit;
+    while (!commits.empty()) {
+        std::uint32_t position = commits.back();
+        commits.pop_back();
+        std::string id = graph.id(position);
+        if (!marked.insert(id).second) {
+            continue;
+        }
+        for (int which = 0; which < 2; ++which) {
+            if (graph.parent(position, which) != CommitGraph::kNone) {
+                commits.push_back(graph.parent(position, which));
+            }
+        }
+        std::string data;
+        if (!store.read(id, data)) {
+            error = "Unable to read commit " + id.substr(0, 10) + "; nothing was pruned.";
+            return false;
+        }
+        // Commits from before tree objects list their files instead.
+        std::istringstream in(data);
+        std::string line;
+        bool filesSection = false;
+        while (std::getline(in, line)) {
+            if (filesSection) {
+                auto parts = split(line, '\t');
+                if (parts.size() == 2) {
+                    marked.insert(parts[1]);
+                    if (pathHints != nullptr) {
+                        pathHints->emplace(parts[1], parts[0]);
+                    }
+                }
+            } else if (line == "files:") {
+                filesSection = true;
+            } else if (line.rfind("tree=", 0) == 0) {
+                treesToVisit.emplace_back(line.substr(5), std::string());
+            }
+        }
+        while (!treesToVisit.empty()) {
+            std::string treeId = std::move(treesToVisit.back().first);
+            std::string prefix = std::move(treesToVisit.back().second);
+            treesToVisit.pop_back();
+            if (!marked.insert(treeId).second) {
+                continue;
+            }
+            std::vector<trees::TreeEntry> entries;
+            if (!trees::readTree(store, treeId, entries)) {
+                error = "Unable to read tree " + treeId.substr(0, 10) + "; nothing was pruned.";
+                return false;
+            }
+            for (auto &entry : entries) {
+                if (entry.isTree) {
+                    treesToVisit.emplace_back(std::move(entry.id), prefix + entry.name + "/");
+                } else {
+                    // Blobs are never opened, so a partial clone fetches nothing.
+                    if (pathHints != nullptr) {
+                        pathHints->emplace(entry.id, prefix + entry.name);
+                    }
+                    marked.insert(std::move(entry.id));
+                }
+            }
+        }
+    }
+    return true;
+}
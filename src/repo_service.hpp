@@ -1,9 +1,20 @@
 #pragma once
 
+#include "commit_graph.hpp"
+#include "index_file.hpp"
+#include "object_store.hpp"
 #include "storage_manager.hpp"
+#include "text_diff.hpp"
+#include "tree.hpp"
 
+#include <cstdint>
 #include <filesystem>
+#include <functional>
+#include <optional>
 #include <string>
+#include <string_view>
+#include <unordered_map>
+#include <unordered_set>
 #include <utility>
 #include <vector>
 
@@ -14,7 +25,86 @@ struct CommitRecord {
     std::string timestamp;
     std::string message;
     std::string branch;
+    // Root tree id; empty for commits written before tree objects existed,
+    // which list their files inline.
+    std::string tree;
     std::vector<std::pair<std::string, std::string>> files;
+    // Second parent of a merge commit.
+    std::string parent2;
+};
+
+// Header fields of one commit, viewing a buffer that walkHistory reuses for
+// the next commit. Only valid during the visitor call.
+struct CommitView {
+    std::string_view id;
+    std::string_view parent;
+    std::string_view parent2;
+    std::string_view author;
+    std::string_view timestamp;
+    std::string_view message;
+    std::string_view branch;
+    std::string_view tree;
+    // False when the commit object is missing or has no header; then only
+    // `id` is set.
+    bool readable = true;
+
+    // Owning copy with header fields only.
+    CommitRecord toRecord() const;
+};
+
+// Narrows walkHistory to commits that changed `path` (a file or directory,
+// compared with the first parent) and that `exclude` does not reach. Empty
+// fields do not filter.
+struct HistoryFilter {
+    std::string path;
+    std::string exclude;
+};
+
+struct WorkspaceStatus {
+    // (kind, path) with kind 'A' added, 'M' modified, 'D' deleted.
+    std::vector<std::pair<char, std::string>> staged;
+    std::vector<std::pair<char, std::string>> unstaged;
+    std::vector<std::string> untracked;
+    std::size_t hashedFiles = 0;
+};
+
+struct StageResult {
+    std::vector<std::string> staged;
+    std::vector<std::string> unchanged;
+    // (path, reason)
+    std::vector<std::pair<std::string, std::string>> failed;
+};
+
+struct MergeResult {
+    bool upToDate = false;
+    bool fastForward = false;
+    // New head of the current branch; empty while conflicts are unresolved.
+    std::string commitId;
+    std::size_t filesWritten = 0;
+    std::vector<std::string> conflicts;
+};
+
+struct CheckoutResult {
+    bool alreadyOn = false;
+    std::size_t filesWritten = 0;
+    std::size_t filesRemoved = 0;
+};
+
+struct SyncResult {
+    std::size_t objectsTransferred = 0;
+    std::vector<std::string> updatedRefs;
+    std::vector<std::string> rejectedRefs;
+    std::size_t filesWritten = 0;
+};
+
+// What a fetch asks to leave out. `depth` keeps that many commits below
+// each wanted tip (0 keeps all of them) and `omitBlobs` leaves file
+// contents for a partial clone to fetch on demand. `peerShallow` lists
+// the peer's own boundary commits, whose ancestors it does not have.
+struct FetchLimits {
+    std::size_t depth = 0;
+    bool omitBlobs = false;
+    std::vector<std::string> peerShallow;
 };
 
 class RepoService {
@@ -27,44 +117,252 @@ public:
     void setCurrentBranch(const std::filesystem::path &repoRoot, const std::string &branch) const;
 
     std::string branchHead(const std::filesystem::path &repoRoot, const std::string &branch) const;
+    // Commit named by a branch or, failing that, a tag; empty when neither
+    // exists.
+    std::string resolveRef(const std::filesystem::path &repoRoot, const std::string &name) const;
+    // With `expected`, the head only moves while it still holds that value
+    // ("" for an unborn branch), so concurrent writers cannot lose updates.
     bool updateBranchHead(const std::filesystem::path &repoRoot,
                           const std::string &branch,
-                          const std::string &commitId) const;
+                          const std::string &commitId,
+                          std::string &error,
+                          const std::optional<std::string> &expected = std::nullopt) const;
 
     std::vector<std::pair<std::string, std::string>> listBranchesWithHead(const std::filesystem::path &repoRoot) const;
+    // Visits branches in name order with their heads ("" for an unborn
+    // branch). `head` is a reused buffer. Return false to stop.
+    void forEachBranch(const std::filesystem::path &repoRoot,
+                       const std::function<bool(const std::string &name, const std::string &head)> &visitor) const;
+
+    // The index lists every tracked path (it is not cleared by commit), sorted
+    // by path.
+    std::vector<IndexEntry> readIndex(const std::filesystem::path &repoRoot) const;
+    // Streams the index in path order without copying it; the entry is
+    // reused between calls. Return false to stop.
+    void forEachIndexEntry(const std::filesystem::path &repoRoot,
+                           const std::function<bool(const IndexEntry &)> &visitor) const;
+    bool writeIndex(const std::filesystem::path &repoRoot,
+                    std::vector<IndexEntry> entries,
+                    std::string &error) const;
 
-    std::vector<std::pair<std::string, std::string>> readIndex(const std::filesystem::path &repoRoot) const;
-    void writeIndex(const std::filesystem::path &repoRoot,
-                    const std::vector<std::pair<std::string, std::string>> &entries) const;
+    // Compares HEAD, the index and the workspace. Only files whose stat data
+    // differs from their index entry are re-hashed; refreshed stat data is
+    // written back to the index.
+    bool status(const std::filesystem::path &repoRoot, WorkspaceStatus &result, std::string &error) const;
 
     bool addFile(const std::filesystem::path &repoRoot,
                  const std::string &relativePath,
                  std::string &message) const;
 
+    // Stages many workspace paths with one index read and one index write.
+    // Hashing and object writes run on a thread pool. Per-path problems land
+    // in `result.failed`; false means the index itself could not be updated.
+    bool addFiles(const std::filesystem::path &repoRoot,
+                  const std::vector<std::string> &relativePaths,
+                  StageResult &result,
+                  std::string &error) const;
+
+    // Expands a workspace-relative pathspec into files, skipping anything
+    // matched by .gliteignore. "" or "." is the whole workspace, a directory
+    // is taken recursively, and a glob (*, ?, [..], **) is matched against
+    // every workspace path (against basenames when it contains no '/').
+    bool collectWorkspaceFiles(const std::filesystem::path &repoRoot,
+                               const std::string &pathspec,
+                               std::vector<std::string> &paths,
+                               std::string &error) const;
+
+    // Commits the index on the current branch. While a merge is in progress
+    // (.glite/MERGE_HEAD exists) the commit gets the merged head as its second
+    // parent, and it is refused while a conflicted file is still staged with
+    // conflict markers.
     bool commit(const std::filesystem::path &repoRoot,
                 const std::string &author,
                 const std::string &message,
                 CommitRecord &record,
                 std::string &error) const;
 
+    // Switches HEAD to `branch` and updates the workspace by diffing the two
+    // heads' trees: only changed files are written (large blobs are
+    // reflinked when possible) and only removed files are deleted. Uncommitted
+    // changes are carried over unless the switch would overwrite them.
+    bool checkout(const std::filesystem::path &repoRoot,
+                  const std::string &branch,
+                  CheckoutResult &result,
+                  std::string &error) const;
+
     bool createBranch(const std::filesystem::path &repoRoot,
                       const std::string &branchName,
                       std::string &error) const;
 
+    // Object-level sync. Only commits and blobs the other side lacks are
+    // copied; refs are switched afterwards with atomic renames. Branches that
+    // would not fast-forward are reported in `rejectedRefs` and left alone.
     bool push(const std::filesystem::path &repoRoot,
               const std::filesystem::path &remoteRoot,
+              SyncResult &result,
               std::string &error) const;
 
+    // Downloads missing objects and records the remote's branch heads under
+    // .glite/refs/remotes/ without touching local branches or the workspace.
+    bool fetch(const std::filesystem::path &repoRoot,
+               const std::filesystem::path &remoteRoot,
+               SyncResult &result,
+               std::string &error) const;
+
+    // fetch, then fast-forward local branches and refresh the workspace files
+    // touched by the new commits on the current branch.
     bool pull(const std::filesystem::path &repoRoot,
               const std::filesystem::path &remoteRoot,
+              SyncResult &result,
               std::string &error) const;
 
+    // With `depth`, only that many commits below each branch head are
+    // copied; the commits whose parents were left out are recorded in
+    // .glite/shallow and later fetches keep to the same depth.
+    bool clone(const std::filesystem::path &repoRoot,
+               const std::filesystem::path &sourceRoot,
+               SyncResult &result,
+               std::string &error,
+               std::size_t depth = 0) const;
+
+    // Fills the freshly created repository `repoRoot` from `sourceRoot` on
+    // the same filesystem without copying objects: the source's object
+    // directory is listed in objects/info/alternates.
+    bool fork(const std::filesystem::path &repoRoot,
+              const std::filesystem::path &sourceRoot,
+              SyncResult &result,
+              std::string &error) const;
+
+    // Gives every repository that borrows objects from `sourceRoot` its own
+    // copies, ahead of deleting the source.
+    bool detachForks(const std::filesystem::path &sourceRoot, std::string &error) const;
+
+    // Boundary commits of a shallow clone, whose parents are not stored.
+    std::vector<std::string> shallowCommits(const std::filesystem::path &repoRoot) const;
+    bool addShallowCommits(const std::filesystem::path &repoRoot,
+                           const std::vector<std::string> &ids,
+                           std::string &error) const;
+    // Depth a shallow clone was created with (0 for a complete one).
+    std::size_t shallowDepth(const std::filesystem::path &repoRoot) const;
+
+    // Building blocks of push and fetch that do not assume the other
+    // repository is on this filesystem; transport.hpp drives them over the
+    // network. Ref names are "heads/<branch>" or "tags/<tag>".
+    using RefList = std::vector<std::pair<std::string, std::string>>;
+
+    struct RefUpdate {
+        std::string ref;
+        // "" when the ref does not exist yet.
+        std::string oldId;
+        std::string newId;
+    };
+
+    RefList advertiseRefs(const std::filesystem::path &repoRoot) const;
+
+    // Objects reachable from `wants` that a peer holding the commits `haves`
+    // lacks, in send order. The peer is assumed to have each have's history
+    // and every tree and blob of its snapshot; unknown haves are ignored.
+    // Sent commits whose parents are held back go to `boundary`.
+    std::vector<std::string> objectsToSend(const std::filesystem::path &repoRoot,
+                                           const std::vector<std::string> &wants,
+                                           const std::vector<std::string> &haves,
+                                           const FetchLimits &limits = {},
+                                           std::vector<std::string> *boundary = nullptr) const;
+
+    // Remote heads that moved since the last fetch and tags missing locally.
+    // Names go to `result.updatedRefs`; applyFetch writes the refs (heads
+    // under refs/remotes/) once their objects are stored.
+    std::vector<RefUpdate> planFetch(const std::filesystem::path &repoRoot,
+                                     const RefList &remoteRefs,
+                                     SyncResult &result) const;
+    bool applyFetch(const std::filesystem::path &repoRoot,
+                    const std::vector<RefUpdate> &updates,
+                    std::string &error) const;
+
+    // Local heads and tags the remote lacks. Branches that would not
+    // fast-forward go to `result.rejectedRefs`.
+    std::vector<RefUpdate> planPush(const std::filesystem::path &repoRoot,
+                                    const RefList &remoteRefs,
+                                    SyncResult &result) const;
+    // Receiving end of a push, run once the objects are stored. Each ref is
+    // checked again (valid name, objects present, fast-forward) and swapped
+    // against `oldId`.
+    bool receiveRefUpdates(const std::filesystem::path &repoRoot,
+                           const std::vector<RefUpdate> &updates,
+                           SyncResult &result,
+                           std::string &error) const;
+
+    // Second half of pull: fast-forwards local branches to refs/remotes/.
+    // `result.updatedRefs` is replaced by the branches that moved.
+    bool mergeTrackingRefs(const std::filesystem::path &repoRoot, SyncResult &result, std::string &error) const;
+
+    // Empty repository layout for a clone, without HEAD or config.
+    bool initClone(const std::filesystem::path &repoRoot, std::string &error) const;
+
+    // Ancestry queries are answered from .glite/commit-graph, which is
+    // extended on demand for commits that are not in it yet.
+    bool isAncestor(const std::filesystem::path &repoRoot,
+                    const std::string &ancestor,
+                    const std::string &descendant) const;
+
+    // How far the current branch and its tracking ref (refs/remotes/, set by
+    // fetch) have moved apart. False when the branch has no tracking ref or
+    // either side has no commits.
+    bool trackingDivergence(const std::filesystem::path &repoRoot, std::size_t &ahead, std::size_t &behind) const;
+
+    // Files that differ between two commits (either may be empty). Commits
+    // with trees are compared subtree by subtree.
+    bool diffCommits(const std::filesystem::path &repoRoot,
+                     const std::string &oldCommit,
+                     const std::string &newCommit,
+                     std::vector<trees::TreeChange> &changes,
+                     std::string &error) const;
+
+    bool mergeBase(const std::filesystem::path &repoRoot,
+                   const std::string &a,
+                   const std::string &b,
+                   std::string &base) const;
+
+    // Visits commits reachable from `tip` newest first, after skipping
+    // `skip` of them. Records carry header fields only (`files` is empty);
+    // use getCommit for the file list. Return false from `visitor` to stop.
+    void walkHistory(const std::filesystem::path &repoRoot,
+                     const std::string &tip,
+                     std::size_t skip,
+                     const std::function<bool(const CommitRecord &)> &visitor) const;
+    // Same walk without a CommitRecord per commit: one object store and one
+    // buffer serve every commit, and fields are views into the buffer.
+    void walkHistory(const std::filesystem::path &repoRoot,
+                     const std::string &tip,
+                     std::size_t skip,
+                     const std::function<bool(const CommitView &)> &visitor) const;
+    // Filtered walk; `skip` counts commits that pass the filter. Commits are
+    // tested against .glite/commit-graph-paths and, for `exclude`, against
+    // .glite/commit-graph-bitmaps before any object is opened. Filters
+    // missing for the commits it reaches are computed and saved on the way.
+    void walkHistory(const std::filesystem::path &repoRoot,
+                     const std::string &tip,
+                     std::size_t skip,
+                     const HistoryFilter &filter,
+                     const std::function<bool(const CommitView &)> &visitor) const;
+
+    // One page of walkHistory for `branch`, header fields only.
     std::vector<CommitRecord> history(const std::filesystem::path &repoRoot,
                                       const std::string &branch,
-                                      std::size_t limit = 50) const;
+                                      std::size_t limit = 50,
+                                      std::size_t skip = 0) const;
 
+    // Merges `branch` into the current branch. Fast-forwards when possible;
+    // otherwise diffs both heads against their merge base and only touches
+    // files changed on the other side. Files changed on both sides (with
+    // different blobs) get a three-way line merge. Conflicts are left in the
+    // workspace with markers, listed in `result.conflicts` and recorded in
+    // .glite/MERGE_HEAD for the next commit. Refuses to run with uncommitted
+    // changes.
     bool mergeBranch(const std::filesystem::path &repoRoot,
                      const std::string &branch,
+                     const std::string &author,
+                     MergeResult &result,
                      std::string &error) const;
     
     bool rebaseBranch(const std::filesystem::path &repoRoot,
@@ -84,7 +382,22 @@ public:
                     const std::string &relativePath,
                     std::string &error) const;
     
-    std::string getDiff(const std::filesystem::path &repoRoot) const;
+    // Unified line diffs, streamed to `sink` one line at a time. With
+    // `staged` the index is compared with HEAD, otherwise the workspace with
+    // the index. Paths whose stat data or blob ids match are skipped without
+    // reading them, and binary files are reported but not diffed.
+    bool diffWorkspace(const std::filesystem::path &repoRoot,
+                       bool staged,
+                       const textdiff::LineSink &sink,
+                       std::string &error) const;
+
+    // Line diffs for every file that differs between two commits (either may
+    // be empty).
+    bool diffCommitContents(const std::filesystem::path &repoRoot,
+                            const std::string &oldCommit,
+                            const std::string &newCommit,
+                            const textdiff::LineSink &sink,
+                            std::string &error) const;
     
     bool resetFile(const std::filesystem::path &repoRoot,
                    const std::string &relativePath,
@@ -103,18 +416,114 @@ public:
     CommitRecord getCommit(const std::filesystem::path &repoRoot,
                            const std::string &commitId) const;
     
+    // Applies the inverse of `commitId` on top of HEAD with the merge
+    // machinery (base = the commit, theirs = its parent). Nothing is changed
+    // when the revert would conflict.
     bool revertCommit(const std::filesystem::path &repoRoot,
                       const std::string &commitId,
                       const std::string &author,
                       std::string &error) const;
 
+    bool repack(const std::filesystem::path &repoRoot,
+                bool all,
+                RepackStats &stats,
+                std::string &error) const;
+
+    // Deletes objects that nothing can reach and repacks the rest. Roots
+    // are every branch, tag and tracking ref, MERGE_HEAD and the index, of
+    // this repository and of every fork borrowing its objects. Unreachable
+    // objects younger than `gc.graceDays` (default 14; 0 with `pruneNow`)
+    // survive, since a writer may not have referenced them yet. The mark
+    // and the new pack are done without the repository lock; only the final
+    // sweep holds it, after marking again from the roots as they are then.
+    bool gc(const std::filesystem::path &repoRoot, bool pruneNow, RepackStats &stats, std::string &error) const;
+
 private:
     StorageManager &storage_;
 
     static void appendLog(const std::filesystem::path &repoRoot, const CommitRecord &record);
-    static CommitRecord readCommit(const std::filesystem::path &repoRoot, const std::string &commitId);
+    static CommitRecord readCommit(const std::filesystem::path &repoRoot,
+                                   const std::string &commitId,
+                                   bool headerOnly = false);
+    // Fills in id and timestamp, writes the commit object, moves the branch
+    // head and records the commit in the log and the commit graph.
+    bool writeCommit(const std::filesystem::path &repoRoot, CommitRecord &record, std::string &error) const;
+    static CommitGraph::ParentReader graphReader(const std::filesystem::path &repoRoot);
+    // Adds everything reachable from the repository's roots (see gc) to
+    // `marked`. History below a commit already marked is not walked again.
+    // With `pathHints`, each blob met is also mapped to the first path it
+    // was found at, for the delta search of repack and gc.
+    bool markReachable(const std::filesystem::path &repoRoot,
+                       std::unordered_set<std::string> &marked,
+                       std::string &error,
+                       std::unordered_map<std::string, std::string> *pathHints = nullptr) const;
+    // Repositories whose alternates name this one's object directory.
+    std::vector<std::filesystem::path> forksOf(const std::filesystem::path &sourceRoot) const;
+    // The pack.* settings; callers fill pathHints through markReachable.
+    RepackOptions repackOptions(const std::filesystem::path &repoRoot) const;
+    static void recordInGraph(const std::filesystem::path &repoRoot, const CommitRecord &record);
     static bool commitExists(const std::filesystem::path &repoRoot, const std::string &commitId);
+    static std::unordered_map<std::string, std::string> snapshot(const std::filesystem::path &repoRoot,
+                                                                 const std::string &commitId);
     static void copyDirectory(const std::filesystem::path &from, const std::filesystem::path &to);
+    // Rewrites a ref through "<ref>.lock"; with `expected` this is a
+    // compare-and-swap against the ref's current value.
+    static bool updateRef(const std::filesystem::path &refPath,
+                          const std::string &value,
+                          const std::optional<std::string> &expected,
+                          std::string &error);
+    static std::vector<std::pair<std::string, std::string>> listRefs(const std::filesystem::path &dir);
+    // Whether the receiving side already has an object; `isCommit` tells
+    // commits (whose history is then implied) from trees and blobs.
+    using PeerHas = std::function<bool(const std::string &id, bool isCommit)>;
+    static std::vector<std::string> missingObjects(const std::filesystem::path &from,
+                                                   const std::filesystem::path &to,
+                                                   const std::vector<std::string> &heads);
+    static std::vector<std::string> missingObjects(const std::filesystem::path &from,
+                                                   const std::vector<std::string> &heads,
+                                                   const PeerHas &peerHas,
+                                                   const FetchLimits &limits = {},
+                                                   std::vector<std::string> *boundary = nullptr);
+    static bool transferObjects(const std::filesystem::path &from,
+                                const std::filesystem::path &to,
+                                const std::vector<std::string> &ids,
+                                std::string &error);
+    static bool writeWorkspaceFile(const ObjectStore &store,
+                                   const std::filesystem::path &repoRoot,
+                                   const std::string &relativePath,
+                                   const std::string &blobId,
+                                   std::string &error);
+    static bool removeWorkspaceFile(const std::filesystem::path &repoRoot, const std::string &relativePath);
+    // Fails unless the index and workspace match HEAD; untracked paths are
+    // returned so callers can avoid overwriting them.
+    bool requireCleanWorkspace(const std::filesystem::path &repoRoot,
+                               std::unordered_set<std::string> &untracked,
+                               std::string &error) const;
+    // Three-way merge of `oursCommit` and `theirsCommit` against `baseCommit`
+    // into the workspace and index. When the merge conflicts and
+    // `keepConflicts` is false, nothing is written and only
+    // `result.conflicts` is filled in.
+    bool mergeCommits(const std::filesystem::path &repoRoot,
+                      const std::string &baseCommit,
+                      const std::string &oursCommit,
+                      const std::string &theirsCommit,
+                      const std::string &theirsLabel,
+                      bool keepConflicts,
+                      const std::unordered_set<std::string> &untracked,
+                      MergeResult &result,
+                      std::string &error) const;
+    // Writes or deletes exactly the changed paths and updates their index
+    // entries; the rest of the index keeps its cached stat data.
+    bool applyTreeChanges(const std::filesystem::path &repoRoot,
+                          const std::vector<trees::TreeChange> &changes,
+                          std::size_t &filesWritten,
+                          std::size_t &filesRemoved,
+                          std::string &error) const;
+    bool fastForwardWorkspace(const std::filesystem::path &repoRoot,
+                              const std::string &fromCommit,
+                              const std::string &toCommit,
+                              SyncResult &result,
+                              std::string &error) const;
 };
 
 
@@ -0,0 +1,179 @@
+#include "server.hpp"
+
+#include "gitlite_app.hpp"
+#include "hashing.hpp"
+#include "thread_pool.hpp"
+#include "transport.hpp"
+#include "utils.hpp"
+
+#include <csignal>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <vector>
+
+namespace {
+
+std::atomic<bool> gSignalled{false};
+
+void onSignal(int) {
+    gSignalled = true;
+}
+
+bool sendLine(Socket &client, const std::string &line) {
+    return client.writeAll(line + "\n");
+}
+
+// Output lines may carry embedded newlines; every physical line is framed.
+bool sendOutput(Socket &client, const std::vector<std::string> &output) {
+    std::string frame;
+    for (const auto &text : output) {
+        std::istringstream lines(text);
+        std::string line;
+        bool any = false;
+        while (std::getline(lines, line)) {
+            frame += "| " + line + "\n";
+            any = true;
+        }
+        if (!any) {
+            frame += "|\n";
+        }
+    }
+    return frame.empty() || client.writeAll(frame);
+}
+
+} // namespace
+
+Server::Server(const ServerOptions &options) : options_(options), repoService_(storage_) {}
+
+void Server::stop() {
+    stopping_ = true;
+}
+
+bool Server::run(std::string &error) {
+    hashing::ensureSodium();
+    Socket listener;
+    if (!Socket::listen(options_.host, options_.port, listener, error)) {
+        return false;
+    }
+    gSignalled = false;
+    auto previousInt = std::signal(SIGINT, onSignal);
+    auto previousTerm = std::signal(SIGTERM, onSignal);
+    std::cerr << "gitlite server listening on " << options_.host << ":" << options_.port << std::endl;
+
+    {
+        std::size_t threads = options_.threads ? options_.threads : ThreadPool::defaultThreads();
+        // A queue no longer than the pool: once every session thread is busy,
+        // new clients wait in the kernel's listen backlog.
+        ThreadPool sessions(threads, threads);
+        while (!stopping_ && !gSignalled) {
+            Socket client;
+            if (!listener.accept(client, 500, error)) {
+                if (!error.empty()) {
+                    std::cerr << "Warning: " << error << std::endl;
+                    error.clear();
+                }
+                continue;
+            }
+            auto shared = std::make_shared<Socket>(std::move(client));
+            sessions.submit([this, shared]() { serveSession(*shared); });
+        }
+        // Wake sessions blocked on idle clients so the pool can drain.
+        std::lock_guard<std::mutex> lock(clientsMutex_);
+        for (Socket *client : clients_) {
+            client->shutdown();
+        }
+    }
+
+    std::signal(SIGINT, previousInt);
+    std::signal(SIGTERM, previousTerm);
+    std::cerr << "gitlite server stopped" << std::endl;
+    return true;
+}
+
+void Server::serveSession(Socket &client) {
+    {
+        std::lock_guard<std::mutex> lock(clientsMutex_);
+        if (stopping_ || gSignalled) {
+            return;
+        }
+        clients_.insert(&client);
+    }
+    std::string peer = client.peer();
+    client.setTimeout(options_.idleTimeoutSeconds);
+
+    try {
+        GitLiteApp app(storage_, true);
+        app.confineToStorage();
+        std::string username;
+        std::string line;
+        bool open = sendLine(client, "gitlite 1 ready");
+        while (open && client.readLine(line)) {
+            if (line == "quit") {
+                sendLine(client, "bye");
+                break;
+            }
+            if (!app.loggedIn()) {
+                std::istringstream words(line);
+                std::string verb, password;
+                words >> verb >> username;
+                std::getline(words >> std::ws, password);
+                std::string error;
+                if (verb != "login" || username.empty()) {
+                    open = sendLine(client, "err Log in first: login <user> <password>");
+                } else if (!app.login(username, password, error)) {
+                    std::cerr << "Failed login for " << username << " from " << peer << std::endl;
+                    open = sendLine(client, "err " + error);
+                } else {
+                    open = sendLine(client, "ok");
+                }
+                continue;
+            }
+            if (line.rfind("upload-pack ", 0) == 0 || line.rfind("receive-pack ", 0) == 0) {
+                open = serveTransfer(client, username, line);
+                continue;
+            }
+            if (line.empty()) {
+                open = sendLine(client, "ok");
+                continue;
+            }
+            std::vector<std::string> output;
+            bool ok = app.runCommand(line, output);
+            open = sendOutput(client, output) && sendLine(client, ok ? "ok" : "err");
+        }
+    } catch (const std::exception &ex) {
+        sendLine(client, std::string("err Internal error: ") + ex.what());
+        std::cerr << "Session " << peer << " failed: " << ex.what() << std::endl;
+    }
+
+    std::lock_guard<std::mutex> lock(clientsMutex_);
+    clients_.erase(&client);
+}
+
+bool Server::serveTransfer(Socket &client, const std::string &username, const std::string &request) {
+    bool upload = request.rfind("upload-pack ", 0) == 0;
+    std::string target = gitlite::util::trim(request.substr(request.find(' ') + 1));
+    std::size_t slash = target.find('/');
+    std::string owner = slash == std::string::npos ? std::string() : target.substr(0, slash);
+    std::string repo = slash == std::string::npos ? std::string() : target.substr(slash + 1);
+    if (!gitlite::util::isValidIdentifier(owner) || !gitlite::util::isValidIdentifier(repo) ||
+        !storage_.repoExists(owner, repo)) {
+        return sendLine(client, "err Repository '" + target + "' not found.");
+    }
+    auto user = storage_.findUser(username);
+    bool canWrite = user && (user->role == "admin" || owner == username || storage_.isCollaborator(owner, repo, username));
+    if (upload ? !(canWrite || repoService_.isPublic(owner, repo)) : !canWrite) {
+        return sendLine(client, "err Permission denied for '" + target + "'.");
+    }
+
+    auto root = storage_.repoPath(owner, repo);
+    if (upload) {
+        return transport::serveUploadPack(client, repoService_, root);
+    }
+    SyncResult result;
+    bool open = transport::serveReceivePack(client, repoService_, root, result);
+    if (!result.updatedRefs.empty()) {
+        storage_.refreshCatalogEntry(owner, repo);
+    }
+    return open;
+}
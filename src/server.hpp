@@ -0,0 +1,55 @@
+#pragma once
+
+#include "repo_service.hpp"
+#include "socket_io.hpp"
+#include "storage_manager.hpp"
+
+#include <atomic>
+#include <cstddef>
+#include <mutex>
+#include <set>
+#include <string>
+
+struct ServerOptions {
+    std::string host = "127.0.0.1";
+    unsigned short port = 9419;
+    // 0 uses one session thread per hardware thread.
+    std::size_t threads = 0;
+    // Sessions that stay silent this long are closed.
+    int idleTimeoutSeconds = 600;
+};
+
+// Serves the GitLite command set to many clients at once. Each connection
+// gets its own headless GitLiteApp; all of them share one StorageManager, and
+// RepoService serialises writers per repository with RepoLock.
+//
+// Line protocol (one request or response per line):
+//   S: gitlite 1 ready
+//   C: login <user> <password>        S: ok | err <message>
+//   C: <command line>                 S: | <output line> ... then ok | err
+//   C: quit                           S: bye
+//
+// `upload-pack` and `receive-pack` switch a logged-in session into an object
+// transfer; see transport.hpp.
+class Server {
+public:
+    explicit Server(const ServerOptions &options);
+
+    // Accepts clients until stop() is called or the process receives SIGINT
+    // or SIGTERM. Returns false if the address could not be bound.
+    bool run(std::string &error);
+    void stop();
+
+private:
+    ServerOptions options_;
+    StorageManager storage_;
+    RepoService repoService_;
+    std::atomic<bool> stopping_{false};
+    std::mutex clientsMutex_;
+    std::set<Socket *> clients_;
+
+    void serveSession(Socket &client);
+    // Checks access to the named repository and hands the connection to
+    // transport; false when the connection must be closed.
+    bool serveTransfer(Socket &client, const std::string &username, const std::string &request);
+};
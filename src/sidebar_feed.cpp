@@ -0,0 +1,134 @@
+#include "sidebar_feed.hpp"
+
+#include "stats.hpp"
+
+#include <exception>
+#include <system_error>
+#include <utility>
+
+namespace fs = std::filesystem;
+
+SidebarFeed::SidebarFeed(StorageManager &storage, RepoService &repoService)
+    : storage_(storage), repoService_(repoService), worker_(1, 1) {}
+
+SidebarFeed::~SidebarFeed() {
+    stopping_ = true;
+    worker_.wait();
+}
+
+void SidebarFeed::request(const std::string &username, const fs::path &currentDir) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    pending_ = Request{username, currentDir};
+    if (running_) {
+        return;
+    }
+    running_ = true;
+    worker_.submit([this] { drain(); });
+}
+
+std::shared_ptr<const SidebarFeed::Snapshot> SidebarFeed::latest() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return latest_;
+}
+
+bool SidebarFeed::takeUpdate() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return std::exchange(updated_, false);
+}
+
+void SidebarFeed::drain() {
+    while (true) {
+        Request next;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (!pending_ || stopping_) {
+                running_ = false;
+                return;
+            }
+            next = std::move(*pending_);
+            pending_.reset();
+        }
+        try {
+            refresh(next);
+        } catch (const std::exception &) {
+            // A vanished repository or unreadable catalog leaves the last
+            // snapshot in place until the next request.
+        }
+    }
+}
+
+void SidebarFeed::refresh(const Request &request) {
+    static stats::Site site("SidebarFeed::refresh");
+    stats::Timer timer(site);
+
+    CatalogQuery query;
+    query.owner = request.username;
+    query.limit = kMaxRepos;
+    auto page = storage_.queryCatalog(query);
+
+    // Summaries from the previous snapshot stand in until recomputed.
+    auto previous = latest();
+    auto carried = [&previous, &request](const std::string &name) -> const Repo * {
+        if (!previous || previous->username != request.username) {
+            return nullptr;
+        }
+        for (const auto &repo : previous->repos) {
+            if (repo.name == name) {
+                return &repo;
+            }
+        }
+        return nullptr;
+    };
+
+    Snapshot snapshot;
+    snapshot.username = request.username;
+    snapshot.more = page.total > page.entries.size();
+    std::vector<fs::path> roots;
+    std::error_code ec;
+    auto currentCanonical = fs::weakly_canonical(request.currentDir, ec);
+    for (const auto &entry : page.entries) {
+        Repo repo;
+        repo.name = entry.name;
+        repo.visibility = entry.visibility;
+        if (const Repo *old = carried(entry.name)) {
+            repo.dirty = old->dirty;
+            repo.aheadBehind = old->aheadBehind;
+        }
+        fs::path repoRoot = storage_.repoPath(request.username, entry.name);
+        std::error_code repoEc;
+        std::error_code wsEc;
+        auto repoCanonical = fs::weakly_canonical(repoRoot, repoEc);
+        auto workspaceCanonical = fs::weakly_canonical(repoRoot / "workspace", wsEc);
+        repo.current = !ec && !repoEc &&
+                       (currentCanonical == repoCanonical || (!wsEc && currentCanonical == workspaceCanonical));
+        snapshot.repos.push_back(std::move(repo));
+        roots.push_back(std::move(repoRoot));
+    }
+    publish(snapshot);
+
+    for (std::size_t i = 0; i < roots.size() && !stopping_; ++i) {
+        Repo &repo = snapshot.repos[i];
+        WorkspaceStatus status;
+        std::string error;
+        if (repoService_.status(roots[i], status, error)) {
+            repo.dirty = !status.staged.empty() || !status.unstaged.empty() || !status.untracked.empty();
+        } else {
+            repo.dirty.reset();
+        }
+        std::size_t ahead = 0;
+        std::size_t behind = 0;
+        if (repoService_.trackingDivergence(roots[i], ahead, behind)) {
+            repo.aheadBehind = std::make_pair(ahead, behind);
+        } else {
+            repo.aheadBehind.reset();
+        }
+        publish(snapshot);
+    }
+}
+
+void SidebarFeed::publish(const Snapshot &snapshot) {
+    auto copy = std::make_shared<const Snapshot>(snapshot);
+    std::lock_guard<std::mutex> lock(mutex_);
+    latest_ = std::move(copy);
+    updated_ = true;
+}
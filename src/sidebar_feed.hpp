@@ -0,0 +1,80 @@
+#pragma once
+
+#include "repo_service.hpp"
+#include "storage_manager.hpp"
+#include "thread_pool.hpp"
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <vector>
+
+// Gathers the sidebar's contents on a background thread so the prompt never
+// waits on the filesystem. The UI draws the newest snapshot it has, however
+// stale, and polls for a fresher one while idle. Each refresh runs in two
+// steps: the repository list first, then a status summary per repository.
+class SidebarFeed {
+public:
+    struct Repo {
+        std::string name;
+        std::string visibility;
+        // The shell is in this repository or its workspace.
+        bool current = false;
+        // nullopt until checked, or when status failed.
+        std::optional<bool> dirty;
+        // Commits the current branch and its tracking ref lack from each
+        // other; only set after a fetch has recorded one.
+        std::optional<std::pair<std::size_t, std::size_t>> aheadBehind;
+    };
+
+    struct Snapshot {
+        std::string username;
+        std::vector<Repo> repos;
+        // The catalog holds more repositories than are listed.
+        bool more = false;
+    };
+
+    static constexpr std::size_t kMaxRepos = 15;
+
+    SidebarFeed(StorageManager &storage, RepoService &repoService);
+    // Waits for the repository being summarized, then stops.
+    ~SidebarFeed();
+
+    SidebarFeed(const SidebarFeed &) = delete;
+    SidebarFeed &operator=(const SidebarFeed &) = delete;
+
+    // Queues a refresh. Requests made while one runs collapse into a single
+    // follow-up with the newest arguments.
+    void request(const std::string &username, const std::filesystem::path &currentDir);
+
+    // Newest published snapshot; nullptr before the first one.
+    std::shared_ptr<const Snapshot> latest() const;
+    // True once for every batch of snapshots published since the last call.
+    bool takeUpdate();
+
+private:
+    struct Request {
+        std::string username;
+        std::filesystem::path currentDir;
+    };
+
+    StorageManager &storage_;
+    RepoService &repoService_;
+    mutable std::mutex mutex_;
+    std::optional<Request> pending_;
+    bool running_ = false;
+    std::shared_ptr<const Snapshot> latest_;
+    bool updated_ = false;
+    std::atomic<bool> stopping_{false};
+    // Declared last so its worker is joined before the state above goes.
+    ThreadPool worker_;
+
+    void drain();
+    void refresh(const Request &request);
+    void publish(const Snapshot &snapshot);
+};
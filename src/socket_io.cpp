@@ -0,0 +1,293 @@
+#include "socket_io.hpp"
+
+#include <cerrno>
+#include <cstring>
+#include <utility>
+
+#if !defined(_WIN32)
+#include <arpa/inet.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+#endif
+
+namespace {
+
+constexpr std::size_t kReadChunk = 64 * 1024;
+
+} // namespace
+
+Socket::~Socket() {
+    close();
+}
+
+Socket::Socket(Socket &&other) noexcept {
+    *this = std::move(other);
+}
+
+Socket &Socket::operator=(Socket &&other) noexcept {
+    if (this != &other) {
+        close();
+        fd_ = other.fd_;
+        buffer_ = std::move(other.buffer_);
+        bufferPos_ = other.bufferPos_;
+        other.fd_ = -1;
+        other.bufferPos_ = 0;
+    }
+    return *this;
+}
+
+#if defined(_WIN32)
+
+bool Socket::listen(const std::string &, unsigned short, Socket &, std::string &error) {
+    error = "Networking is not supported on this platform.";
+    return false;
+}
+
+bool Socket::connect(const std::string &, unsigned short, Socket &, std::string &error) {
+    error = "Networking is not supported on this platform.";
+    return false;
+}
+
+bool Socket::accept(Socket &, int, std::string &error) {
+    error = "Networking is not supported on this platform.";
+    return false;
+}
+
+bool Socket::fill() {
+    return false;
+}
+
+bool Socket::writeAll(const std::string &) {
+    return false;
+}
+
+void Socket::setTimeout(int) {}
+
+void Socket::shutdown() {}
+
+void Socket::close() {
+    fd_ = -1;
+}
+
+std::string Socket::peer() const {
+    return {};
+}
+
+#else
+
+namespace {
+
+bool resolve(const std::string &host,
+             unsigned short port,
+             bool passive,
+             addrinfo *&result,
+             std::string &error) {
+    addrinfo hints{};
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_flags = passive ? AI_PASSIVE : 0;
+    std::string service = std::to_string(port);
+    int rc = ::getaddrinfo(host.empty() ? nullptr : host.c_str(), service.c_str(), &hints, &result);
+    if (rc != 0) {
+        error = "Unable to resolve " + host + ": " + ::gai_strerror(rc);
+        return false;
+    }
+    return true;
+}
+
+} // namespace
+
+bool Socket::listen(const std::string &host, unsigned short port, Socket &out, std::string &error) {
+    addrinfo *addresses = nullptr;
+    if (!resolve(host, port, true, addresses, error)) {
+        return false;
+    }
+    int fd = -1;
+    for (addrinfo *ai = addresses; ai; ai = ai->ai_next) {
+        fd = ::socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+        if (fd < 0) {
+            continue;
+        }
+        int yes = 1;
+        ::setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof(yes));
+        if (::bind(fd, ai->ai_addr, ai->ai_addrlen) == 0 && ::listen(fd, 64) == 0) {
+            break;
+        }
+        ::close(fd);
+        fd = -1;
+    }
+    ::freeaddrinfo(addresses);
+    if (fd < 0) {
+        error = "Unable to listen on " + host + ":" + std::to_string(port) + ": " + std::strerror(errno);
+        return false;
+    }
+    out.close();
+    out.fd_ = fd;
+    return true;
+}
+
+bool Socket::connect(const std::string &host, unsigned short port, Socket &out, std::string &error) {
+    addrinfo *addresses = nullptr;
+    if (!resolve(host, port, false, addresses, error)) {
+        return false;
+    }
+    int fd = -1;
+    for (addrinfo *ai = addresses; ai; ai = ai->ai_next) {
+        fd = ::socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+        if (fd < 0) {
+            continue;
+        }
+        if (::connect(fd, ai->ai_addr, ai->ai_addrlen) == 0) {
+            break;
+        }
+        ::close(fd);
+        fd = -1;
+    }
+    ::freeaddrinfo(addresses);
+    if (fd < 0) {
+        error = "Unable to connect to " + host + ":" + std::to_string(port) + ": " + std::strerror(errno);
+        return false;
+    }
+    int yes = 1;
+    ::setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &yes, sizeof(yes));
+    out.close();
+    out.fd_ = fd;
+    return true;
+}
+
+bool Socket::accept(Socket &client, int timeoutMs, std::string &error) {
+    error.clear();
+    pollfd waiter{fd_, POLLIN, 0};
+    int ready = ::poll(&waiter, 1, timeoutMs);
+    if (ready == 0 || (ready < 0 && errno == EINTR)) {
+        return false;
+    }
+    if (ready < 0) {
+        error = std::string("poll failed: ") + std::strerror(errno);
+        return false;
+    }
+    int fd = ::accept(fd_, nullptr, nullptr);
+    if (fd < 0) {
+        if (errno != EINTR && errno != EAGAIN && errno != ECONNABORTED) {
+            error = std::string("accept failed: ") + std::strerror(errno);
+        }
+        return false;
+    }
+    int yes = 1;
+    ::setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &yes, sizeof(yes));
+    client.close();
+    client.fd_ = fd;
+    return true;
+}
+
+bool Socket::fill() {
+    if (fd_ < 0) {
+        return false;
+    }
+    if (bufferPos_ > 0) {
+        buffer_.erase(0, bufferPos_);
+        bufferPos_ = 0;
+    }
+    char chunk[kReadChunk];
+    while (true) {
+        ssize_t got = ::recv(fd_, chunk, sizeof(chunk), 0);
+        if (got > 0) {
+            buffer_.append(chunk, static_cast<std::size_t>(got));
+            return true;
+        }
+        if (got < 0 && errno == EINTR) {
+            continue;
+        }
+        return false;
+    }
+}
+
+bool Socket::writeAll(const std::string &data) {
+    std::size_t sent = 0;
+    while (sent < data.size()) {
+        ssize_t put = ::send(fd_, data.data() + sent, data.size() - sent, MSG_NOSIGNAL);
+        if (put < 0 && errno == EINTR) {
+            continue;
+        }
+        if (put <= 0) {
+            return false;
+        }
+        sent += static_cast<std::size_t>(put);
+    }
+    return true;
+}
+
+void Socket::setTimeout(int seconds) {
+    if (fd_ < 0) {
+        return;
+    }
+    timeval tv{};
+    tv.tv_sec = seconds;
+    ::setsockopt(fd_, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    ::setsockopt(fd_, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+}
+
+void Socket::shutdown() {
+    if (fd_ >= 0) {
+        ::shutdown(fd_, SHUT_RDWR);
+    }
+}
+
+void Socket::close() {
+    if (fd_ >= 0) {
+        ::close(fd_);
+        fd_ = -1;
+    }
+    buffer_.clear();
+    bufferPos_ = 0;
+}
+
+std::string Socket::peer() const {
+    sockaddr_storage address{};
+    socklen_t length = sizeof(address);
+    if (fd_ < 0 || ::getpeername(fd_, reinterpret_cast<sockaddr *>(&address), &length) != 0) {
+        return "unknown";
+    }
+    char host[NI_MAXHOST] = {0};
+    char service[NI_MAXSERV] = {0};
+    if (::getnameinfo(reinterpret_cast<sockaddr *>(&address), length, host, sizeof(host), service,
+                      sizeof(service), NI_NUMERICHOST | NI_NUMERICSERV) != 0) {
+        return "unknown";
+    }
+    return std::string(host) + ":" + service;
+}
+
+#endif
+
+bool Socket::readLine(std::string &line, std::size_t maxLength) {
+    while (true) {
+        std::size_t newline = buffer_.find('\n', bufferPos_);
+        if (newline != std::string::npos) {
+            line.assign(buffer_, bufferPos_, newline - bufferPos_);
+            bufferPos_ = newline + 1;
+            if (!line.empty() && line.back() == '\r') {
+                line.pop_back();
+            }
+            return true;
+        }
+        if (buffer_.size() - bufferPos_ > maxLength || !fill()) {
+            return false;
+        }
+    }
+}
+
+bool Socket::readExact(std::size_t length, std::string &data) {
+    while (buffer_.size() - bufferPos_ < length) {
+        if (!fill()) {
+            return false;
+        }
+    }
+    data.assign(buffer_, bufferPos_, length);
+    bufferPos_ += length;
+    return true;
+}
@@ -0,0 +1,47 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+
+// Blocking TCP socket with a read buffer for line-based protocols. Only
+// implemented for POSIX systems; elsewhere every operation fails.
+class Socket {
+public:
+    Socket() = default;
+    ~Socket();
+
+    Socket(const Socket &) = delete;
+    Socket &operator=(const Socket &) = delete;
+    Socket(Socket &&other) noexcept;
+    Socket &operator=(Socket &&other) noexcept;
+
+    static bool listen(const std::string &host, unsigned short port, Socket &out, std::string &error);
+    static bool connect(const std::string &host, unsigned short port, Socket &out, std::string &error);
+
+    // Waits up to `timeoutMs` for a client. Returns false with an empty
+    // `error` when the wait timed out.
+    bool accept(Socket &client, int timeoutMs, std::string &error);
+
+    // Reads up to '\n' (dropped, along with a preceding '\r'). Lines longer
+    // than `maxLength` fail. False on EOF, error or timeout.
+    bool readLine(std::string &line, std::size_t maxLength = 64 * 1024);
+    bool readExact(std::size_t length, std::string &data);
+    bool writeAll(const std::string &data);
+
+    // Applies to every later read and write; 0 waits forever.
+    void setTimeout(int seconds);
+    // Wakes up a thread blocked on this socket; later reads see EOF.
+    void shutdown();
+    void close();
+
+    bool isOpen() const { return fd_ >= 0; }
+    int fd() const { return fd_; }
+    std::string peer() const;
+
+private:
+    int fd_ = -1;
+    std::string buffer_;
+    std::size_t bufferPos_ = 0;
+
+    bool fill();
+};
@@ -0,0 +1,176 @@
+#include "stats.hpp"
+
+#include "utils.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <utility>
+#include <unistd.h>
+
+namespace fs = std::filesystem;
+
+namespace stats {
+
+namespace detail {
+std::atomic<bool> gEnabled{false};
+std::array<std::atomic<std::uint64_t>, static_cast<std::size_t>(Counter::Count)> gCounters{};
+} // namespace detail
+
+namespace {
+
+// A long session is cut off here rather than growing without bound.
+constexpr std::size_t kMaxTraceEvents = 1 << 20;
+
+std::atomic<Site *> gSites{nullptr};
+std::atomic<unsigned> gNextThread{1};
+thread_local Trace *tCurrentTrace = nullptr;
+
+unsigned threadNumber() {
+    thread_local unsigned number = gNextThread.fetch_add(1, std::memory_order_relaxed);
+    return number;
+}
+
+} // namespace
+
+const char *counterName(Counter counter) {
+    switch (counter) {
+    case Counter::BytesHashed:
+        return "bytes hashed";
+    case Counter::ObjectsRead:
+        return "objects read";
+    case Counter::ObjectsWritten:
+        return "objects written";
+    case Counter::FilesStatted:
+        return "files stat'ed";
+    case Counter::FsCalls:
+        return "fs calls";
+    case Counter::Fsyncs:
+        return "fsyncs";
+    case Counter::ChunksWritten:
+        return "chunks written";
+    case Counter::ChunksReused:
+        return "chunks reused";
+    case Counter::Count:
+        break;
+    }
+    return "?";
+}
+
+void setEnabled(bool on) {
+    detail::gEnabled.store(on, std::memory_order_relaxed);
+}
+
+std::int64_t nowNs() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch())
+        .count();
+}
+
+Site::Site(const char *siteName) : name(siteName) {
+    next = gSites.load(std::memory_order_relaxed);
+    while (!gSites.compare_exchange_weak(next, this, std::memory_order_release, std::memory_order_relaxed)) {
+    }
+}
+
+void Site::record(std::uint64_t elapsedNs) {
+    calls.fetch_add(1, std::memory_order_relaxed);
+    totalNs.fetch_add(elapsedNs, std::memory_order_relaxed);
+    std::uint64_t seen = maxNs.load(std::memory_order_relaxed);
+    while (elapsedNs > seen && !maxNs.compare_exchange_weak(seen, elapsedNs, std::memory_order_relaxed)) {
+    }
+}
+
+void Timer::finish() {
+    std::int64_t elapsed = nowNs() - startNs_;
+    site_->record(static_cast<std::uint64_t>(elapsed));
+    if (Trace *trace = tCurrentTrace) {
+        trace->add(site_->name, startNs_, elapsed);
+    }
+}
+
+Trace::Trace(fs::path path) : path_(std::move(path)), originNs_(nowNs()) {}
+
+void Trace::add(const std::string &name, std::int64_t startNs, std::int64_t durationNs) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (events_.size() >= kMaxTraceEvents) {
+        ++dropped_;
+        return;
+    }
+    events_.push_back({name, startNs - originNs_, durationNs, threadNumber()});
+}
+
+std::size_t Trace::size() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return events_.size();
+}
+
+bool Trace::write(std::string &error) const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::ofstream out(path_, std::ios::trunc);
+    if (!out) {
+        error = "Unable to write trace to " + path_.string() + ".";
+        return false;
+    }
+    long pid = static_cast<long>(getpid());
+    out << "{\"displayTimeUnit\":\"ms\",\"droppedEvents\":" << dropped_ << ",\"traceEvents\":[";
+    for (std::size_t i = 0; i < events_.size(); ++i) {
+        const auto &event = events_[i];
+        // Chrome trace timestamps are in microseconds.
+        out << (i ? ",\n" : "\n") << "{\"name\":" << gitlite::util::jsonQuote(event.name)
+            << ",\"cat\":\"gitlite\",\"ph\":\"X\",\"ts\":" << event.startNs / 1000.0
+            << ",\"dur\":" << event.durationNs / 1000.0 << ",\"pid\":" << pid << ",\"tid\":" << event.thread << "}";
+    }
+    out << "\n]}\n";
+    out.flush();
+    if (!out) {
+        error = "Unable to write trace to " + path_.string() + ".";
+        return false;
+    }
+    return true;
+}
+
+Trace *currentTrace() {
+    return tCurrentTrace;
+}
+
+TraceBinding::TraceBinding(Trace *trace) : previous_(tCurrentTrace) {
+    tCurrentTrace = trace;
+}
+
+TraceBinding::~TraceBinding() {
+    tCurrentTrace = previous_;
+}
+
+Snapshot snapshot() {
+    Snapshot result;
+    for (std::size_t i = 0; i < result.counters.size(); ++i) {
+        result.counters[i] = detail::gCounters[i].load(std::memory_order_relaxed);
+    }
+    for (Site *site = gSites.load(std::memory_order_acquire); site; site = site->next) {
+        SiteTotals totals;
+        totals.name = site->name;
+        totals.calls = site->calls.load(std::memory_order_relaxed);
+        totals.totalNs = site->totalNs.load(std::memory_order_relaxed);
+        totals.maxNs = site->maxNs.load(std::memory_order_relaxed);
+        if (totals.calls > 0) {
+            result.sites.push_back(std::move(totals));
+        }
+    }
+    std::sort(result.sites.begin(), result.sites.end(), [](const SiteTotals &a, const SiteTotals &b) {
+        return a.totalNs != b.totalNs ? a.totalNs > b.totalNs : a.name < b.name;
+    });
+    return result;
+}
+
+void reset() {
+    for (auto &counter : detail::gCounters) {
+        counter.store(0, std::memory_order_relaxed);
+    }
+    for (Site *site = gSites.load(std::memory_order_acquire); site; site = site->next) {
+        site->calls.store(0, std::memory_order_relaxed);
+        site->totalNs.store(0, std::memory_order_relaxed);
+        site->maxNs.store(0, std::memory_order_relaxed);
+    }
+}
+
+} // namespace stats
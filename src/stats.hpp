@@ -0,0 +1,146 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// Process-wide counters and scoped timers for hot paths. Everything is off
+// until setEnabled(true) (the `stats on` command or GLITE_STATS=1); while off,
+// count() and Timer cost one relaxed atomic load.
+namespace stats {
+
+enum class Counter {
+    BytesHashed,
+    ObjectsRead,
+    ObjectsWritten,
+    FilesStatted,
+    FsCalls,
+    Fsyncs,
+    ChunksWritten,
+    ChunksReused,
+    Count
+};
+
+const char *counterName(Counter counter);
+
+namespace detail {
+extern std::atomic<bool> gEnabled;
+extern std::array<std::atomic<std::uint64_t>, static_cast<std::size_t>(Counter::Count)> gCounters;
+} // namespace detail
+
+inline bool enabled() {
+    return detail::gEnabled.load(std::memory_order_relaxed);
+}
+
+void setEnabled(bool on);
+
+inline void count(Counter counter, std::uint64_t amount = 1) {
+    if (enabled()) {
+        detail::gCounters[static_cast<std::size_t>(counter)].fetch_add(amount, std::memory_order_relaxed);
+    }
+}
+
+std::int64_t nowNs();
+
+// A named code region. Declare one as a function-local static and time it
+// with Timer; sites register themselves on first use.
+struct Site {
+    explicit Site(const char *name);
+
+    const char *name;
+    std::atomic<std::uint64_t> calls{0};
+    std::atomic<std::uint64_t> totalNs{0};
+    std::atomic<std::uint64_t> maxNs{0};
+    Site *next = nullptr;
+
+    void record(std::uint64_t elapsedNs);
+};
+
+// Events in Chrome's trace format (chrome://tracing, Perfetto), collected
+// for one session. Timers on a thread record into the trace bound to it;
+// ThreadPool workers inherit the submitting thread's binding.
+class Trace {
+public:
+    explicit Trace(std::filesystem::path path);
+
+    void add(const std::string &name, std::int64_t startNs, std::int64_t durationNs);
+    bool write(std::string &error) const;
+
+    const std::filesystem::path &path() const { return path_; }
+    std::size_t size() const;
+
+private:
+    struct Event {
+        std::string name;
+        std::int64_t startNs;
+        std::int64_t durationNs;
+        unsigned thread;
+    };
+
+    std::filesystem::path path_;
+    std::int64_t originNs_;
+    mutable std::mutex mutex_;
+    std::vector<Event> events_;
+    std::size_t dropped_ = 0;
+};
+
+Trace *currentTrace();
+
+class TraceBinding {
+public:
+    explicit TraceBinding(Trace *trace);
+    ~TraceBinding();
+
+    TraceBinding(const TraceBinding &) = delete;
+    TraceBinding &operator=(const TraceBinding &) = delete;
+
+private:
+    Trace *previous_;
+};
+
+class Timer {
+public:
+    explicit Timer(Site &site) {
+        if (enabled()) {
+            site_ = &site;
+            startNs_ = nowNs();
+        }
+    }
+    ~Timer() {
+        if (site_) {
+            finish();
+        }
+    }
+
+    Timer(const Timer &) = delete;
+    Timer &operator=(const Timer &) = delete;
+
+private:
+    Site *site_ = nullptr;
+    std::int64_t startNs_ = 0;
+
+    void finish();
+};
+
+struct SiteTotals {
+    std::string name;
+    std::uint64_t calls = 0;
+    std::uint64_t totalNs = 0;
+    std::uint64_t maxNs = 0;
+};
+
+struct Snapshot {
+    std::array<std::uint64_t, static_cast<std::size_t>(Counter::Count)> counters{};
+    // Sites that ran at least once, busiest first.
+    std::vector<SiteTotals> sites;
+};
+
+Snapshot snapshot();
+void reset();
+
+} // namespace stats
@@ -1,15 +1,27 @@
 #include "storage_manager.hpp"
 
+#include "journal.hpp"
 #include "utils.hpp"
 
 #include <algorithm>
+#include <chrono>
 #include <fstream>
+#include <iterator>
 #include <stdexcept>
+#include <system_error>
 
 namespace fs = std::filesystem;
 using gitlite::util::split;
 using gitlite::util::timestamp;
 
+namespace {
+
+// catalog.log is folded into catalog.tsv once it grows past this, about a
+// thousand commits.
+constexpr std::uintmax_t kCatalogLogLimit = 64 * 1024;
+
+} // namespace
+
 StorageManager::StorageManager() {
     root_ = fs::current_path() / "storage";
     ensureDirectory(root_);
@@ -21,9 +33,64 @@ const fs::path &StorageManager::root() const {
     return root_;
 }
 
-std::vector<User> StorageManager::loadUsers() {
-    std::vector<User> users;
-    std::ifstream in(root_ / "users.tsv");
+StorageManager::FileStamp StorageManager::stampFile(const fs::path &path) {
+    FileStamp stamp;
+    std::error_code ec;
+    stamp.mtime = fs::last_write_time(path, ec);
+    if (ec) {
+        return stamp;
+    }
+    stamp.size = fs::file_size(path, ec);
+    if (ec) {
+        return stamp;
+    }
+    stamp.valid = true;
+    stamp.racy = fs::file_time_type::clock::now() - stamp.mtime < std::chrono::seconds(1);
+    return stamp;
+}
+
+bool StorageManager::isCurrent(const fs::path &path, const FileStamp &stamp) {
+    if (!stamp.valid || stamp.racy) {
+        return false;
+    }
+    FileStamp now = stampFile(path);
+    return now.valid && now.mtime == stamp.mtime && now.size == stamp.size;
+}
+
+bool StorageManager::writeAtomically(const fs::path &path, const std::string &content) {
+    fs::path scratch = path;
+    scratch += ".lock";
+    {
+        std::ofstream out(scratch, std::ios::binary | std::ios::trunc);
+        out << content;
+        out.flush();
+        if (!out) {
+            return false;
+        }
+    }
+    std::error_code ec;
+    if (!journal::syncFile(scratch)) {
+        fs::remove(scratch, ec);
+        return false;
+    }
+    fs::rename(scratch, path, ec);
+    if (ec) {
+        return false;
+    }
+    journal::syncDirectory(path.parent_path());
+    return true;
+}
+
+void StorageManager::refreshUsers() {
+    fs::path path = root_ / "users.tsv";
+    if (isCurrent(path, usersStamp_)) {
+        return;
+    }
+    // Stamp before reading, so a write racing with the read is seen next time.
+    usersStamp_ = stampFile(path);
+    users_.clear();
+    userIndex_.clear();
+    std::ifstream in(path);
     std::string line;
     while (std::getline(in, line)) {
         if (line.empty()) {
@@ -31,22 +98,55 @@ std::vector<User> StorageManager::loadUsers() {
         }
         auto parts = split(line, '\t');
         if (parts.size() >= 3) {
-            users.push_back({parts[0], parts[1], parts[2]});
+            userIndex_[parts[0]] = users_.size();
+            users_.push_back({parts[0], parts[1], parts[2]});
         }
     }
-    return users;
+}
+
+std::vector<User> StorageManager::loadUsers() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    refreshUsers();
+    return users_;
+}
+
+std::optional<User> StorageManager::findUser(const std::string &username) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    refreshUsers();
+    auto it = userIndex_.find(username);
+    if (it == userIndex_.end()) {
+        return std::nullopt;
+    }
+    return users_[it->second];
 }
 
 void StorageManager::saveUsers(const std::vector<User> &users) {
-    std::ofstream out(root_ / "users.tsv", std::ios::binary | std::ios::trunc);
+    std::string content;
     for (const auto &user : users) {
-        out << user.username << '\t' << user.passwordHash << '\t' << user.role << "\n";
+        content += user.username + '\t' + user.passwordHash + '\t' + user.role + "\n";
+    }
+    std::lock_guard<std::mutex> lock(mutex_);
+    fs::path path = root_ / "users.tsv";
+    if (!writeAtomically(path, content)) {
+        usersStamp_ = {};
+        return;
     }
+    users_ = users;
+    userIndex_.clear();
+    for (std::size_t i = 0; i < users_.size(); ++i) {
+        userIndex_[users_[i].username] = i;
+    }
+    usersStamp_ = stampFile(path);
 }
 
-std::unordered_map<std::string, std::set<std::string>> StorageManager::loadPermissions() {
-    std::unordered_map<std::string, std::set<std::string>> perms;
-    std::ifstream in(root_ / "permissions.tsv");
+void StorageManager::refreshPermissions() {
+    fs::path path = root_ / "permissions.tsv";
+    if (isCurrent(path, permsStamp_)) {
+        return;
+    }
+    permsStamp_ = stampFile(path);
+    perms_.clear();
+    std::ifstream in(path);
     std::string line;
     while (std::getline(in, line)) {
         if (line.empty()) {
@@ -65,25 +165,54 @@ std::unordered_map<std::string, std::set<std::string>> StorageManager::loadPermi
                 }
             }
         }
-        perms[parts[0]] = std::move(collaborators);
+        perms_[parts[0]] = std::move(collaborators);
     }
-    return perms;
+}
+
+std::unordered_map<std::string, std::set<std::string>> StorageManager::loadPermissions() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    refreshPermissions();
+    return perms_;
+}
+
+bool StorageManager::isCollaborator(const std::string &owner, const std::string &repo, const std::string &username) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    refreshPermissions();
+    auto it = perms_.find(owner + "/" + repo);
+    return it != perms_.end() && it->second.count(username) > 0;
 }
 
 void StorageManager::savePermissions(const std::unordered_map<std::string, std::set<std::string>> &perms) {
-    std::ofstream out(root_ / "permissions.tsv", std::ios::binary | std::ios::trunc);
+    std::string content;
     for (const auto &entry : perms) {
-        out << entry.first << '\t';
+        content += entry.first + '\t';
         bool first = true;
         for (const auto &collab : entry.second) {
             if (!first) {
-                out << ',';
+                content += ',';
             }
-            out << collab;
+            content += collab;
             first = false;
         }
-        out << "\n";
+        content += "\n";
+    }
+    std::lock_guard<std::mutex> lock(mutex_);
+    fs::path path = root_ / "permissions.tsv";
+    if (!writeAtomically(path, content)) {
+        permsStamp_ = {};
+        return;
     }
+    perms_ = perms;
+    permsStamp_ = stampFile(path);
+}
+
+const std::map<std::string, std::string> &StorageManager::cachedConfig(const fs::path &path) {
+    CachedConfig &entry = configs_[path.string()];
+    if (!isCurrent(path, entry.stamp)) {
+        entry.stamp = stampFile(path);
+        entry.values = parseKeyValueFile(path);
+    }
+    return entry.values;
 }
 
 void StorageManager::ensureUserFolder(const std::string &username) {
@@ -91,41 +220,284 @@ void StorageManager::ensureUserFolder(const std::string &username) {
 }
 
 std::vector<std::string> StorageManager::listUserRepos(const std::string &username) {
+    CatalogQuery query;
+    query.owner = username;
     std::vector<std::string> repos;
-    fs::path userPath = root_ / username;
-    if (!fs::exists(userPath)) {
-        return repos;
-    }
-    for (const auto &entry : fs::directory_iterator(userPath)) {
-        if (entry.is_directory()) {
-            repos.push_back(entry.path().filename().string());
-        }
+    for (auto &entry : queryCatalog(query).entries) {
+        repos.push_back(std::move(entry.name));
     }
-    std::sort(repos.begin(), repos.end());
     return repos;
 }
 
 std::vector<std::pair<std::string, std::string>> StorageManager::listAllRepos() {
     std::vector<std::pair<std::string, std::string>> repos;
-    if (!fs::exists(root_)) {
-        return repos;
+    for (auto &entry : queryCatalog({}).entries) {
+        repos.emplace_back(std::move(entry.owner), std::move(entry.name));
+    }
+    return repos;
+}
+
+CatalogPage StorageManager::queryCatalog(const CatalogQuery &query) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    refreshCatalog();
+    // Keys are "owner/name", so both filters are a contiguous key range.
+    std::string keyPrefix = query.owner.empty() ? query.prefix : query.owner + "/" + query.prefix;
+    CatalogPage page;
+    for (auto it = catalog_.lower_bound(keyPrefix);
+         it != catalog_.end() && it->first.compare(0, keyPrefix.size(), keyPrefix) == 0;
+         ++it) {
+        if (query.publicOnly && it->second.visibility != "public") {
+            continue;
+        }
+        if (page.total >= query.skip && (query.limit == 0 || page.entries.size() < query.limit)) {
+            page.entries.push_back(it->second);
+        }
+        ++page.total;
+    }
+    return page;
+}
+
+void StorageManager::refreshCatalog() {
+    fs::path path = root_ / "catalog.tsv";
+    std::error_code ec;
+    if (!fs::exists(path, ec)) {
+        // First run on an existing storage tree: build the catalog by scanning.
+        catalog_.clear();
+        for (const auto &userEntry : fs::directory_iterator(root_, ec)) {
+            const auto userName = userEntry.path().filename().string();
+            if (!userEntry.is_directory() || userName.empty() || userName.front() == '_') {
+                continue;
+            }
+            std::error_code repoEc;
+            for (const auto &repoEntry : fs::directory_iterator(userEntry.path(), repoEc)) {
+                if (repoEntry.is_directory()) {
+                    RepoEntry entry = scanRepo(userName, repoEntry.path().filename().string());
+                    catalog_[entry.owner + "/" + entry.name] = std::move(entry);
+                }
+            }
+        }
+        saveCatalog();
+        return;
+    }
+    if (!isCurrent(path, catalogStamp_)) {
+        catalogStamp_ = stampFile(path);
+        catalog_.clear();
+        catalogLogOffset_ = 0;
+        std::ifstream in(path);
+        std::string line;
+        while (std::getline(in, line)) {
+            parseCatalogRow(line);
+        }
+    }
+    replayCatalogLog();
+}
+
+void StorageManager::parseCatalogRow(const std::string &line) {
+    auto parts = split(line, '\t');
+    if (parts.size() < 6) {
+        return;
     }
-    for (const auto &userEntry : fs::directory_iterator(root_)) {
-        if (!userEntry.is_directory()) {
+    RepoEntry entry;
+    entry.owner = parts[0];
+    entry.name = parts[1];
+    entry.visibility = parts[2];
+    entry.created = parts[3];
+    try {
+        entry.lastCommit = std::stoll(parts[4]);
+        entry.size = std::stoull(parts[5]);
+    } catch (const std::exception &) {
+    }
+    catalog_[entry.owner + "/" + entry.name] = std::move(entry);
+}
+
+void StorageManager::replayCatalogLog() {
+    fs::path path = root_ / "catalog.log";
+    std::error_code ec;
+    auto size = fs::file_size(path, ec);
+    if (ec) {
+        catalogLogOffset_ = 0;
+        return;
+    }
+    if (size < catalogLogOffset_) {
+        // Folded into catalog.tsv by another process: start over from it.
+        catalogStamp_ = {};
+        refreshCatalog();
+        return;
+    }
+    if (size == catalogLogOffset_) {
+        return;
+    }
+    // "<owner>\t<name>\t<last commit>" per line, later lines winning. A
+    // line still being appended is left for the next refresh.
+    std::ifstream in(path, std::ios::binary);
+    in.seekg(static_cast<std::streamoff>(catalogLogOffset_));
+    std::string pending(static_cast<std::size_t>(size - catalogLogOffset_), '\0');
+    in.read(&pending[0], static_cast<std::streamsize>(pending.size()));
+    pending.resize(static_cast<std::size_t>(in.gcount()));
+    std::size_t start = 0;
+    for (std::size_t end = pending.find('\n'); end != std::string::npos; end = pending.find('\n', start)) {
+        auto parts = split(pending.substr(start, end - start), '\t');
+        start = end + 1;
+        if (parts.size() < 3) {
             continue;
         }
-        const auto &userName = userEntry.path().filename().string();
-        if (!userName.empty() && userName.front() == '_') {
+        auto it = catalog_.find(parts[0] + "/" + parts[1]);
+        if (it == catalog_.end()) {
             continue;
         }
-        for (const auto &repoEntry : fs::directory_iterator(userEntry.path())) {
-            if (repoEntry.is_directory()) {
-                repos.emplace_back(userName, repoEntry.path().filename().string());
+        try {
+            it->second.lastCommit = std::stoll(parts[2]);
+        } catch (const std::exception &) {
+        }
+    }
+    catalogLogOffset_ += start;
+}
+
+bool StorageManager::saveCatalog() {
+    std::string content;
+    for (const auto &item : catalog_) {
+        const RepoEntry &entry = item.second;
+        content += entry.owner + '\t' + entry.name + '\t' + entry.visibility + '\t' + entry.created + '\t' +
+                   std::to_string(entry.lastCommit) + '\t' + std::to_string(entry.size) + "\n";
+    }
+    fs::path path = root_ / "catalog.tsv";
+    if (!writeAtomically(path, content)) {
+        catalogStamp_ = {};
+        return false;
+    }
+    catalogStamp_ = stampFile(path);
+    // The table now holds everything the log said.
+    std::error_code ec;
+    fs::remove(root_ / "catalog.log", ec);
+    catalogLogOffset_ = 0;
+    return true;
+}
+
+RepoEntry StorageManager::scanRepo(const std::string &owner, const std::string &repo) {
+    RepoEntry entry;
+    entry.owner = owner;
+    entry.name = repo;
+    fs::path repoRoot = repoPath(owner, repo);
+    const auto &config = cachedConfig(repoRoot / ".glite" / "config");
+    auto it = config.find("visibility");
+    if (it != config.end()) {
+        entry.visibility = it->second;
+    }
+    it = config.find("created");
+    if (it != config.end()) {
+        entry.created = it->second;
+    }
+    // The log's last line is the newest commit: "<id>\t<branch>\t<time>\t<message>".
+    std::ifstream log(repoRoot / ".glite" / "log");
+    std::string line;
+    std::string last;
+    while (std::getline(log, line)) {
+        if (!line.empty()) {
+            last = line;
+        }
+    }
+    auto fields = split(last, '\t');
+    if (fields.size() >= 3) {
+        entry.lastCommit = gitlite::util::parseTimestamp(fields[2]);
+    }
+    std::error_code ec;
+    for (fs::recursive_directory_iterator walk(repoRoot, ec), end; !ec && walk != end; walk.increment(ec)) {
+        std::error_code sizeEc;
+        if (walk->is_regular_file(sizeEc)) {
+            auto bytes = walk->file_size(sizeEc);
+            if (!sizeEc) {
+                entry.size += bytes;
             }
         }
     }
-    std::sort(repos.begin(), repos.end());
-    return repos;
+    return entry;
+}
+
+void StorageManager::refreshCatalogEntry(const std::string &owner, const std::string &repo) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    refreshCatalog();
+    std::error_code ec;
+    if (!fs::is_directory(repoPath(owner, repo), ec)) {
+        catalog_.erase(owner + "/" + repo);
+    } else {
+        catalog_[owner + "/" + repo] = scanRepo(owner, repo);
+    }
+    saveCatalog();
+}
+
+void StorageManager::recordCommit(const fs::path &repoRoot, std::int64_t time) {
+    std::error_code ec;
+    fs::path rel = fs::weakly_canonical(repoRoot, ec).lexically_relative(fs::weakly_canonical(root_, ec));
+    auto first = rel.begin();
+    if (ec || rel.empty() || std::distance(rel.begin(), rel.end()) != 2 || *first == "..") {
+        return;
+    }
+    std::string key = first->string() + "/" + std::next(first)->string();
+    std::lock_guard<std::mutex> lock(mutex_);
+    refreshCatalog();
+    auto it = catalog_.find(key);
+    if (it == catalog_.end()) {
+        return;
+    }
+    it->second.lastCommit = time;
+    // A commit appends one line instead of rewriting the table. The log is
+    // a cache like the table, so it is not fsynced.
+    if (catalogLogOffset_ >= kCatalogLogLimit) {
+        saveCatalog();
+        return;
+    }
+    std::ofstream log(root_ / "catalog.log", std::ios::binary | std::ios::app);
+    log << key.substr(0, key.find('/')) << '\t' << key.substr(key.find('/') + 1) << '\t' << time << '\n';
+    log.flush();
+    if (!log) {
+        saveCatalog();
+    }
+}
+
+bool StorageManager::deleteRepo(const std::string &owner, const std::string &repo, std::string &error) {
+    std::error_code ec;
+    fs::remove_all(repoPath(owner, repo), ec);
+    if (ec) {
+        error = "Failed to delete repository: " + ec.message();
+        return false;
+    }
+    std::lock_guard<std::mutex> lock(mutex_);
+    refreshCatalog();
+    catalog_.erase(owner + "/" + repo);
+    saveCatalog();
+    return true;
+}
+
+bool StorageManager::transferRepo(const std::string &owner,
+                                  const std::string &repo,
+                                  const std::string &newOwner,
+                                  std::string &error) {
+    fs::path oldPath = repoPath(owner, repo);
+    fs::path newPath = repoPath(newOwner, repo);
+    std::error_code ec;
+    fs::create_directories(newPath.parent_path(), ec);
+    fs::rename(oldPath, newPath, ec);
+    if (ec) {
+        error = "Failed to move repository: " + ec.message();
+        return false;
+    }
+    std::lock_guard<std::mutex> lock(mutex_);
+    fs::path cfg = newPath / ".glite" / "config";
+    auto kv = parseKeyValueFile(cfg);
+    if (!kv.empty()) {
+        kv["owner"] = newOwner;
+        writeKeyValueFile(cfg, kv);
+    }
+    refreshCatalog();
+    auto it = catalog_.find(owner + "/" + repo);
+    RepoEntry entry = it != catalog_.end() ? it->second : scanRepo(newOwner, repo);
+    if (it != catalog_.end()) {
+        catalog_.erase(it);
+    }
+    entry.owner = newOwner;
+    catalog_[newOwner + "/" + repo] = std::move(entry);
+    saveCatalog();
+    return true;
 }
 
 fs::path StorageManager::repoPath(const std::string &owner, const std::string &repo) const {
@@ -156,25 +528,41 @@ bool StorageManager::createRepo(const std::string &owner, const std::string &rep
         error = std::string("Failed to create repository: ") + ex.what();
         return false;
     }
+    std::lock_guard<std::mutex> lock(mutex_);
+    refreshCatalog();
+    catalog_[owner + "/" + repo] = scanRepo(owner, repo);
+    saveCatalog();
     return true;
 }
 
 bool StorageManager::setVisibility(const std::string &owner, const std::string &repo, bool isPublic) {
     fs::path cfg = repoPath(owner, repo) / ".glite" / "config";
+    std::lock_guard<std::mutex> lock(mutex_);
     if (!fs::exists(cfg)) {
         return false;
     }
-    auto kv = parseKeyValueFile(cfg);
+    auto kv = cachedConfig(cfg);
     kv["visibility"] = isPublic ? "public" : "private";
-    return writeKeyValueFile(cfg, kv);
+    CachedConfig &entry = configs_[cfg.string()];
+    if (!writeKeyValueFile(cfg, kv)) {
+        entry.stamp = {};
+        return false;
+    }
+    entry.values = std::move(kv);
+    entry.stamp = stampFile(cfg);
+    refreshCatalog();
+    auto it = catalog_.find(owner + "/" + repo);
+    if (it != catalog_.end()) {
+        it->second.visibility = isPublic ? "public" : "private";
+        saveCatalog();
+    }
+    return true;
 }
 
 std::string StorageManager::getVisibility(const std::string &owner, const std::string &repo) {
     fs::path cfg = repoPath(owner, repo) / ".glite" / "config";
-    if (!fs::exists(cfg)) {
-        return "private";
-    }
-    auto kv = parseKeyValueFile(cfg);
+    std::lock_guard<std::mutex> lock(mutex_);
+    const auto &kv = cachedConfig(cfg);
     auto it = kv.find("visibility");
     if (it == kv.end()) {
         return "private";
@@ -182,6 +570,14 @@ std::string StorageManager::getVisibility(const std::string &owner, const std::s
     return it->second;
 }
 
+std::map<std::string, std::string> StorageManager::readRepoConfig(const fs::path &repoRoot) {
+    return parseKeyValueFile(repoRoot / ".glite" / "config");
+}
+
+bool StorageManager::writeRepoConfig(const fs::path &repoRoot, const std::map<std::string, std::string> &kv) {
+    return writeKeyValueFile(repoRoot / ".glite" / "config", kv);
+}
+
 void StorageManager::ensureDirectory(const fs::path &path) {
     if (!fs::exists(path)) {
         fs::create_directories(path);
@@ -220,14 +616,11 @@ std::map<std::string, std::string> StorageManager::parseKeyValueFile(const fs::p
 
 bool StorageManager::writeKeyValueFile(const fs::path &path,
                                        const std::map<std::string, std::string> &kv) {
-    std::ofstream out(path, std::ios::binary | std::ios::trunc);
-    if (!out) {
-        return false;
-    }
+    std::string content;
     for (const auto &entry : kv) {
-        out << entry.first << "=" << entry.second << "\n";
+        content += entry.first + "=" + entry.second + "\n";
     }
-    return true;
+    return writeAtomically(path, content);
 }
 
 
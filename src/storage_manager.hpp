@@ -2,8 +2,11 @@
 
 #include "utils.hpp"
 
+#include <cstdint>
 #include <filesystem>
 #include <map>
+#include <mutex>
+#include <optional>
 #include <set>
 #include <string>
 #include <unordered_map>
@@ -15,6 +18,32 @@ struct User {
     std::string role; // "admin" or "user"
 };
 
+// One row of storage/catalog.tsv.
+struct RepoEntry {
+    std::string owner;
+    std::string name;
+    std::string visibility = "private";
+    std::string created;
+    std::int64_t lastCommit = 0; // seconds since the epoch, 0 before the first commit
+    std::uintmax_t size = 0;     // bytes on disk when the entry was last refreshed
+};
+
+struct CatalogQuery {
+    std::string owner;  // empty: every owner
+    std::string prefix; // matched against the repo name, or "owner/name" when owner is empty
+    bool publicOnly = false;
+    std::size_t skip = 0;
+    std::size_t limit = 0; // 0: no limit
+};
+
+struct CatalogPage {
+    std::vector<RepoEntry> entries;
+    std::size_t total = 0; // matches before skip/limit
+};
+
+// users.tsv, permissions.tsv and repository configs are parsed once and kept
+// in memory. A cached file is re-read when its size or mtime changes, and
+// writes go through to disk atomically before updating the cache.
 class StorageManager {
 public:
     StorageManager();
@@ -23,9 +52,11 @@ public:
 
     std::vector<User> loadUsers();
     void saveUsers(const std::vector<User> &users);
+    std::optional<User> findUser(const std::string &username);
 
     std::unordered_map<std::string, std::set<std::string>> loadPermissions();
     void savePermissions(const std::unordered_map<std::string, std::set<std::string>> &perms);
+    bool isCollaborator(const std::string &owner, const std::string &repo, const std::string &username);
 
     void ensureUserFolder(const std::string &username);
 
@@ -40,8 +71,68 @@ public:
     bool setVisibility(const std::string &owner, const std::string &repo, bool isPublic);
     std::string getVisibility(const std::string &owner, const std::string &repo);
 
+    // Repository catalog (storage/catalog.tsv): one row per repository,
+    // sorted by owner/name, kept up to date by the methods that create, move
+    // or delete repositories. Built from a directory scan when missing.
+    // Commit times are appended to storage/catalog.log and folded into the
+    // table by its next rewrite.
+    CatalogPage queryCatalog(const CatalogQuery &query);
+    bool deleteRepo(const std::string &owner, const std::string &repo, std::string &error);
+    bool transferRepo(const std::string &owner, const std::string &repo, const std::string &newOwner, std::string &error);
+    // Re-reads visibility, creation time, last commit and size from disk.
+    void refreshCatalogEntry(const std::string &owner, const std::string &repo);
+    // Called after a commit; ignored for repositories outside storage/.
+    // Appends one line to catalog.log.
+    void recordCommit(const std::filesystem::path &repoRoot, std::int64_t time);
+
+    // Key/value settings in <repoRoot>/.glite/config.
+    static std::map<std::string, std::string> readRepoConfig(const std::filesystem::path &repoRoot);
+    static bool writeRepoConfig(const std::filesystem::path &repoRoot,
+                                const std::map<std::string, std::string> &kv);
+
 private:
+    // Identifies the file contents a cache entry was parsed from. A stamp
+    // taken within a second of the file's mtime is "racy": a later write in
+    // the same clock tick could keep size and mtime, so it is never trusted.
+    struct FileStamp {
+        bool valid = false;
+        bool racy = false;
+        std::filesystem::file_time_type mtime{};
+        std::uintmax_t size = 0;
+    };
+
+    struct CachedConfig {
+        FileStamp stamp;
+        std::map<std::string, std::string> values;
+    };
+
     std::filesystem::path root_;
+    std::mutex mutex_;
+    FileStamp usersStamp_;
+    std::vector<User> users_;
+    std::unordered_map<std::string, std::size_t> userIndex_;
+    FileStamp permsStamp_;
+    std::unordered_map<std::string, std::set<std::string>> perms_;
+    std::unordered_map<std::string, CachedConfig> configs_;
+    FileStamp catalogStamp_;
+    std::map<std::string, RepoEntry> catalog_; // keyed by "owner/name"
+    std::uintmax_t catalogLogOffset_ = 0;      // bytes of catalog.log applied to catalog_
+
+    void refreshCatalog();
+    void parseCatalogRow(const std::string &line);
+    // Applies catalog.log lines appended since the last call.
+    void replayCatalogLog();
+    // Rewrites catalog.tsv and drops catalog.log.
+    bool saveCatalog();
+    RepoEntry scanRepo(const std::string &owner, const std::string &repo);
+
+    static FileStamp stampFile(const std::filesystem::path &path);
+    static bool isCurrent(const std::filesystem::path &path, const FileStamp &stamp);
+    static bool writeAtomically(const std::filesystem::path &path, const std::string &content);
+
+    void refreshUsers();
+    void refreshPermissions();
+    const std::map<std::string, std::string> &cachedConfig(const std::filesystem::path &path);
 
     static void ensureDirectory(const std::filesystem::path &path);
     static void ensureFile(const std::filesystem::path &path);
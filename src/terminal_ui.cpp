@@ -2,7 +2,9 @@
 
 #include <algorithm>
 #include <cctype>
+#include <cstdlib>
 #include <ncurses.h>
+#include <utility>
 
 namespace {
 std::pair<int, int> computePaneWidths(int maxX) {
@@ -35,8 +37,51 @@ std::pair<int, int> computePaneWidths(int maxX) {
 }
 } // namespace
 
-TerminalUI::TerminalUI() 
-    : terminalWin_(nullptr), sidebarWin_(nullptr), terminalScrollOffset_(0), splitScreenMode_(false) {
+Scrollback::Scrollback(std::size_t capacity) : capacity_(std::max<std::size_t>(1, capacity)) {}
+
+void Scrollback::push(std::string line) {
+    if (lines_.size() < capacity_) {
+        lines_.push_back(std::move(line));
+        return;
+    }
+    lines_[head_] = std::move(line);
+    head_ = (head_ + 1) % capacity_;
+}
+
+const std::string &Scrollback::operator[](std::size_t index) const {
+    return lines_[(head_ + index) % lines_.size()];
+}
+
+void Scrollback::clear() {
+    lines_.clear();
+    head_ = 0;
+}
+
+void Scrollback::setCapacity(std::size_t capacity) {
+    capacity = std::max<std::size_t>(1, capacity);
+    std::size_t keep = std::min(capacity, lines_.size());
+    std::vector<std::string> kept;
+    kept.reserve(keep);
+    for (std::size_t i = lines_.size() - keep; i < lines_.size(); ++i) {
+        kept.push_back(std::move(lines_[(head_ + i) % lines_.size()]));
+    }
+    lines_.swap(kept);
+    capacity_ = capacity;
+    head_ = 0;
+}
+
+TerminalUI::TerminalUI(bool headless)
+    : terminalWin_(nullptr), sidebarWin_(nullptr), terminalScrollOffset_(0), splitScreenMode_(false),
+      headless_(headless) {
+    if (const char *lines = std::getenv("GLITE_SCROLLBACK")) {
+        unsigned long value = std::strtoul(lines, nullptr, 10);
+        if (value > 0) {
+            terminalLines_.setCapacity(value);
+        }
+    }
+    if (headless_) {
+        return;
+    }
     initscr();
     cbreak();
     noecho();
@@ -56,15 +101,31 @@ TerminalUI::TerminalUI()
 }
 
 TerminalUI::~TerminalUI() {
-    endwin();
+    if (!headless_) {
+        endwin();
+    }
+}
+
+std::vector<std::string> TerminalUI::takeOutput() {
+    std::vector<std::string> out;
+    out.swap(captured_);
+    return out;
 }
 
 void TerminalUI::addHistory(const std::string &entry, int colorPair) {
+    if (headless_) {
+        captured_.push_back(entry);
+        return;
+    }
     history_.emplace_back(entry, colorPair);
     drawHistory();
 }
 
 void TerminalUI::drawHistory() {
+    if (headless_) {
+        return;
+    }
+    layoutDirty_ = true;
     clear();
     int maxY, maxX;
     getmaxyx(stdscr, maxY, maxX);
@@ -83,6 +144,10 @@ void TerminalUI::drawHistory() {
 int TerminalUI::menu(const std::string &title,
                      const std::vector<std::string> &options,
                      const std::string &hint) {
+    if (headless_) {
+        return -1;
+    }
+    layoutDirty_ = true;
     if (options.empty()) {
         return -1;
     }
@@ -201,6 +266,10 @@ int TerminalUI::menu(const std::string &title,
 }
 
 std::string TerminalUI::prompt(const std::string &label, bool secret, std::size_t maxLen) {
+    if (headless_) {
+        return {};
+    }
+    layoutDirty_ = true;
     WINDOW *win = nullptr;
     std::string input;
 
@@ -275,6 +344,12 @@ std::string TerminalUI::prompt(const std::string &label, bool secret, std::size_
 }
 
 void TerminalUI::message(const std::string &title, const std::vector<std::string> &lines, int colorPair) {
+    if (headless_) {
+        captured_.push_back(title);
+        captured_.insert(captured_.end(), lines.begin(), lines.end());
+        return;
+    }
+    layoutDirty_ = true;
     WINDOW *win = nullptr;
 
     auto redrawMessage = [&]() {
@@ -334,6 +409,10 @@ void TerminalUI::message(const std::string &title, const std::vector<std::string
 }
 
 bool TerminalUI::confirm(const std::string &question) {
+    if (headless_) {
+        return false;
+    }
+    layoutDirty_ = true;
     WINDOW *win = nullptr;
 
     auto redrawConfirm = [&]() {
@@ -395,6 +474,10 @@ int TerminalUI::list(const std::string &title,
 }
 
 std::string TerminalUI::getCommand(const std::string &prompt) {
+    if (headless_) {
+        return {};
+    }
+    layoutDirty_ = true;
     echo();
     curs_set(1);
     
@@ -415,6 +498,9 @@ std::string TerminalUI::getCommand(const std::string &prompt) {
 }
 
 void TerminalUI::initSplitScreen() {
+    if (headless_) {
+        return;
+    }
     splitScreenMode_ = true;
     terminalScrollOffset_ = 0;
     terminalLines_.clear();
@@ -442,6 +528,9 @@ void TerminalUI::initSplitScreen() {
 }
 
 void TerminalUI::refreshSplitScreen() {
+    if (headless_) {
+        return;
+    }
     if (!splitScreenMode_) return;
     
     int maxY, maxX;
@@ -458,50 +547,94 @@ void TerminalUI::refreshSplitScreen() {
         mvwin(sidebarWin_, 0, terminalWidth + 1);
     }
 
-    // Draw separator
+    // werase rather than wclear: ncurses then only sends the cells that
+    // actually differ from what is on screen.
+    erase();
     if (terminalWidth < maxX) {
         for (int y = 0; y < maxY; y++) {
             mvaddch(y, terminalWidth, '|');
         }
     }
+    wnoutrefresh(stdscr);
     
-    // Refresh terminal window
     if (terminalWin_) {
-        wclear(terminalWin_);
+        werase(terminalWin_);
         box(terminalWin_, 0, 0);
         mvwprintw(terminalWin_, 0, 2, " Terminal ");
-        
-        int winHeight, winWidth;
-        getmaxyx(terminalWin_, winHeight, winWidth);
-        int startLine = std::max(0, static_cast<int>(terminalLines_.size()) - (winHeight - 2) + terminalScrollOffset_);
-        int endLine = startLine + (winHeight - 2);
-        
-        int y = 1;
-        for (int i = startLine; i < endLine && i < static_cast<int>(terminalLines_.size()); i++) {
-            std::string line = terminalLines_[i];
-            if (static_cast<int>(line.size()) > winWidth - 2) {
-                line = line.substr(0, winWidth - 2);
-            }
-            mvwprintw(terminalWin_, y++, 1, "%s", line.c_str());
-        }
-        
-        wrefresh(terminalWin_);
+        drawnRows_.assign(static_cast<std::size_t>(terminalRows()), std::nullopt);
     }
+    layoutDirty_ = false;
+    drawTerminalRows();
     
-    // Refresh sidebar
     if (sidebarWin_) {
-        wclear(sidebarWin_);
+        werase(sidebarWin_);
         box(sidebarWin_, 0, 0);
-        wrefresh(sidebarWin_);
+        if (!sidebarTitle_.empty()) {
+            mvwprintw(sidebarWin_, 0, 2, " %s ", sidebarTitle_.c_str());
+        }
+        int winHeight, winWidth;
+        getmaxyx(sidebarWin_, winHeight, winWidth);
+        int y = 1;
+        for (std::size_t i = 0; i < sidebarContent_.size() && y < winHeight - 1; i++) {
+            mvwprintw(sidebarWin_, y++, 1, "%.*s", std::max(0, winWidth - 2), sidebarContent_[i].c_str());
+        }
+        wnoutrefresh(sidebarWin_);
     }
     
-    refresh();
+    doupdate();
+}
+
+int TerminalUI::terminalRows() const {
+    if (!terminalWin_) {
+        return 0;
+    }
+    return std::max(0, getmaxy(terminalWin_) - 2);
+}
+
+void TerminalUI::drawTerminalRows() {
+    if (headless_ || !splitScreenMode_ || !terminalWin_) {
+        return;
+    }
+    if (layoutDirty_) {
+        refreshSplitScreen();
+        return;
+    }
+    int rows = terminalRows();
+    int width = std::max(0, getmaxx(terminalWin_) - 2);
+    if (drawnRows_.size() != static_cast<std::size_t>(rows)) {
+        drawnRows_.assign(static_cast<std::size_t>(rows), std::nullopt);
+    }
+    int total = static_cast<int>(terminalLines_.size());
+    int startLine = std::max(0, total - rows - terminalScrollOffset_);
+    for (int y = 0; y < rows; ++y) {
+        int i = startLine + y;
+        std::string text = i < total ? terminalLines_[static_cast<std::size_t>(i)].substr(0, width) : std::string();
+        auto &drawn = drawnRows_[static_cast<std::size_t>(y)];
+        if (drawn && *drawn == text) {
+            continue;
+        }
+        // Padding to the pane width overwrites the old row without
+        // touching the box border.
+        mvwprintw(terminalWin_, y + 1, 1, "%-*s", width, text.c_str());
+        drawn = std::move(text);
+    }
+    wnoutrefresh(terminalWin_);
+    doupdate();
 }
 
 void TerminalUI::drawSidebar(const std::vector<std::string> &content, const std::string &title) {
     if (!splitScreenMode_ || !sidebarWin_) return;
+    if (!layoutDirty_ && content == sidebarContent_ && title == sidebarTitle_) {
+        return;
+    }
+    sidebarContent_ = content;
+    sidebarTitle_ = title;
+    if (layoutDirty_) {
+        refreshSplitScreen();
+        return;
+    }
     
-    wclear(sidebarWin_);
+    werase(sidebarWin_);
     box(sidebarWin_, 0, 0);
     mvwprintw(sidebarWin_, 0, 2, " %s ", title.c_str());
     
@@ -517,33 +650,140 @@ void TerminalUI::drawSidebar(const std::vector<std::string> &content, const std:
         mvwprintw(sidebarWin_, y++, 1, "%s", line.c_str());
     }
     
-    wrefresh(sidebarWin_);
+    wnoutrefresh(sidebarWin_);
+    doupdate();
 }
 
 void TerminalUI::addTerminalLine(const std::string &line) {
-    terminalLines_.push_back(line);
-    // Keep last 1000 lines
-    if (terminalLines_.size() > 1000) {
-        terminalLines_.erase(terminalLines_.begin());
+    if (headless_) {
+        captured_.push_back(line);
+        return;
     }
+    terminalLines_.push(line);
     terminalScrollOffset_ = 0;
-    refreshSplitScreen();
+    drawTerminalRows();
+}
+
+void TerminalUI::addTerminalLines(const std::vector<std::string> &lines) {
+    if (headless_) {
+        captured_.insert(captured_.end(), lines.begin(), lines.end());
+        return;
+    }
+    for (const auto &line : lines) {
+        terminalLines_.push(line);
+    }
+    terminalScrollOffset_ = 0;
+    drawTerminalRows();
 }
 
 void TerminalUI::scrollTerminal(int lines) {
     terminalScrollOffset_ += lines;
-    int maxScroll = std::max(0, static_cast<int>(terminalLines_.size()) - 10);
+    int maxScroll = std::max(0, static_cast<int>(terminalLines_.size()) - terminalRows());
     terminalScrollOffset_ = std::max(0, std::min(terminalScrollOffset_, maxScroll));
-    refreshSplitScreen();
+    drawTerminalRows();
 }
 
 void TerminalUI::clearTerminal() {
+    if (headless_) {
+        captured_.clear();
+        return;
+    }
     terminalLines_.clear();
     terminalScrollOffset_ = 0;
-    refreshSplitScreen();
+    drawTerminalRows();
+}
+
+void TerminalUI::setScrollbackLines(std::size_t lines) {
+    terminalLines_.setCapacity(lines);
+    terminalScrollOffset_ = 0;
+    drawTerminalRows();
+}
+
+void TerminalUI::setIdleHandler(std::function<bool()> handler) {
+    idleHandler_ = std::move(handler);
+}
+
+std::size_t TerminalUI::waitForMore() {
+    static const char *label = "-- More -- Space: next page | Enter: next line | q: stop";
+    int winHeight, winWidth;
+    getmaxyx(terminalWin_, winHeight, winWidth);
+    while (true) {
+        wmove(terminalWin_, winHeight - 1, 1);
+        wclrtoeol(terminalWin_);
+        wattron(terminalWin_, A_REVERSE);
+        wprintw(terminalWin_, "%.*s", std::max(0, winWidth - 2), label);
+        wattroff(terminalWin_, A_REVERSE);
+        wrefresh(terminalWin_);
+        int ch = wgetch(terminalWin_);
+        if (ch == KEY_RESIZE) {
+            refreshSplitScreen();
+            getmaxyx(terminalWin_, winHeight, winWidth);
+            continue;
+        }
+        std::size_t next = 0;
+        if (ch == ' ' || ch == KEY_NPAGE) {
+            // One row of the previous page stays for context.
+            next = static_cast<std::size_t>(std::max(1, terminalRows() - 1));
+        } else if (ch == '\n' || ch == KEY_ENTER || ch == KEY_DOWN) {
+            next = 1;
+        } else if (ch != 'q' && ch != 'Q' && ch != 27) {
+            continue;
+        }
+        wmove(terminalWin_, winHeight - 1, 1);
+        wclrtoeol(terminalWin_);
+        wrefresh(terminalWin_);
+        return next;
+    }
+}
+
+TerminalUI::Pager::Pager(TerminalUI &ui) : ui_(ui) {
+    paged_ = !ui_.headless_ && ui_.splitScreenMode_ && ui_.terminalWin_;
+    // The command line itself is already on screen.
+    budget_ = static_cast<std::size_t>(std::max(1, ui_.terminalRows() - 1));
+}
+
+TerminalUI::Pager::~Pager() {
+    flush();
+}
+
+bool TerminalUI::Pager::add(const std::string &line) {
+    if (stopped_) {
+        return false;
+    }
+    if (ui_.headless_) {
+        ui_.captured_.push_back(line);
+        return true;
+    }
+    if (paged_ && shown_ >= budget_) {
+        flush();
+        budget_ = ui_.waitForMore();
+        shown_ = 0;
+        if (budget_ == 0) {
+            stopped_ = true;
+            ui_.addTerminalLine("(output stopped)");
+            return false;
+        }
+    }
+    pending_.push_back(line);
+    ++shown_;
+    // Unpaged output still reaches the screen in bounded batches.
+    if (pending_.size() >= 256) {
+        flush();
+    }
+    return true;
+}
+
+void TerminalUI::Pager::flush() {
+    if (!pending_.empty()) {
+        ui_.addTerminalLines(pending_);
+        pending_.clear();
+    }
 }
 
 std::string TerminalUI::getTerminalCommand(const std::string &prompt) {
+    if (headless_) {
+        return {};
+    }
     if (!splitScreenMode_ || !terminalWin_) {
         return getCommand(prompt);
     }
@@ -568,9 +808,18 @@ std::string TerminalUI::getTerminalCommand(const std::string &prompt) {
     };
 
     redrawPrompt();
+    if (idleHandler_) {
+        wtimeout(terminalWin_, kIdlePollMs);
+    }
 
     while (true) {
         int ch = wgetch(terminalWin_);
+        if (ch == ERR) {
+            if (idleHandler_ && idleHandler_()) {
+                redrawPrompt();
+            }
+            continue;
+        }
         if (ch == KEY_RESIZE) {
             refreshSplitScreen();
             getmaxyx(terminalWin_, winHeight, winWidth);
@@ -609,6 +858,7 @@ std::string TerminalUI::getTerminalCommand(const std::string &prompt) {
         }
     }
     
+    wtimeout(terminalWin_, -1);
     curs_set(0);
     
     addTerminalLine(prompt + input);
@@ -1,15 +1,47 @@
 #pragma once
 
+#include <cstddef>
+#include <functional>
 #include <ncurses.h>
+#include <optional>
 #include <string>
 #include <vector>
 #include <utility>
 
+// Fixed-capacity line store for the terminal pane. Once full, each push
+// overwrites the oldest line, so appends cost O(1) however long the
+// session runs. Index 0 is the oldest line kept.
+class Scrollback {
+public:
+    static constexpr std::size_t kDefaultCapacity = 10000;
+
+    explicit Scrollback(std::size_t capacity = kDefaultCapacity);
+
+    void push(std::string line);
+    const std::string &operator[](std::size_t index) const;
+    std::size_t size() const { return lines_.size(); }
+    std::size_t capacity() const { return capacity_; }
+    void clear();
+    // Keeps the newest lines that fit.
+    void setCapacity(std::size_t capacity);
+
+private:
+    std::vector<std::string> lines_;
+    std::size_t capacity_;
+    // Slot of the oldest line once the buffer has wrapped.
+    std::size_t head_ = 0;
+};
+
 class TerminalUI {
 public:
-    TerminalUI();
+    // A headless UI never touches the terminal: output lines are captured for
+    // takeOutput() and interactive widgets return their "cancelled" value.
+    explicit TerminalUI(bool headless = false);
     ~TerminalUI();
 
+    bool headless() const { return headless_; }
+    std::vector<std::string> takeOutput();
+
     int menu(const std::string &title,
              const std::vector<std::string> &options,
              const std::string &hint = "↑↓/Mouse Navigate | ↵/Click Select | Q Back");
@@ -33,18 +65,68 @@ public:
     void initSplitScreen();
     void drawSidebar(const std::vector<std::string> &content, const std::string &title);
     void addTerminalLine(const std::string &line);
+    // Appends a batch with a single redraw.
+    void addTerminalLines(const std::vector<std::string> &lines);
     void scrollTerminal(int lines);
     std::string getTerminalCommand(const std::string &prompt);
+    // Full redraw of both panes; other calls only repaint rows that changed.
     void refreshSplitScreen();
     void clearTerminal();
+    // Defaults to $GLITE_SCROLLBACK lines, or Scrollback::kDefaultCapacity.
+    void setScrollbackLines(std::size_t lines);
+    // Called about every kIdlePollMs while getTerminalCommand() waits for a
+    // key. Returning true means it drew something, and the prompt and
+    // cursor are put back.
+    void setIdleHandler(std::function<bool()> handler);
+    static constexpr int kIdlePollMs = 100;
+
+    // Feeds one command's output to the terminal pane like `more`: after
+    // each screenful it waits for Space (next page), Enter (next line) or q
+    // (drop the rest). Producers are paused while it waits, and can check
+    // stopped() to give up early. Headless UIs capture everything.
+    class Pager {
+    public:
+        explicit Pager(TerminalUI &ui);
+        ~Pager();
+
+        Pager(const Pager &) = delete;
+        Pager &operator=(const Pager &) = delete;
+
+        // False once the user has stopped the output.
+        bool add(const std::string &line);
+        bool stopped() const { return stopped_; }
+        void flush();
+
+    private:
+        TerminalUI &ui_;
+        std::vector<std::string> pending_;
+        std::size_t shown_ = 0;
+        std::size_t budget_ = 0;
+        bool paged_ = false;
+        bool stopped_ = false;
+    };
 
 private:
     std::vector<std::pair<std::string, int>> history_;
     WINDOW *terminalWin_;
     WINDOW *sidebarWin_;
-    std::vector<std::string> terminalLines_;
+    Scrollback terminalLines_;
     int terminalScrollOffset_;
     bool splitScreenMode_;
+    bool headless_;
+    std::vector<std::string> captured_;
+    // What each terminal row shows on screen; nullopt forces a repaint.
+    std::vector<std::optional<std::string>> drawnRows_;
+    std::vector<std::string> sidebarContent_;
+    std::string sidebarTitle_;
+    // Set when a modal dialog has painted over the split view.
+    bool layoutDirty_ = true;
+    std::function<bool()> idleHandler_;
+
+    void drawTerminalRows();
+    int terminalRows() const;
+    // Shows the pager prompt; returns the rows to show next, 0 to stop.
+    std::size_t waitForMore();
 };
 
 
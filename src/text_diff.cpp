@@ -0,0 +1,247 @@
+#include "text_diff.hpp"
+
+#include <algorithm>
+#include <unordered_map>
+
+namespace textdiff {
+
+namespace {
+
+struct Snake {
+    std::size_t x0 = 0;
+    std::size_t y0 = 0;
+    std::size_t x1 = 0;
+    std::size_t y1 = 0;
+};
+
+class Matcher {
+public:
+    Matcher(const std::vector<int> &a, const std::vector<int> &b, std::vector<std::pair<std::size_t, std::size_t>> &out)
+        : a_(a), b_(b), out_(out) {
+        // Same bound as xdiff: sqrt(N + M), but never below 256.
+        long total = static_cast<long>(a.size() + b.size());
+        long cost = 1;
+        while (cost * cost < total) {
+            cost *= 2;
+        }
+        maxCost_ = std::max(256L, cost);
+    }
+
+    void run(std::size_t aBegin, std::size_t aEnd, std::size_t bBegin, std::size_t bEnd) {
+        while (aBegin < aEnd && bBegin < bEnd && a_[aBegin] == b_[bBegin]) {
+            out_.emplace_back(aBegin++, bBegin++);
+        }
+        std::size_t suffix = 0;
+        while (aBegin < aEnd - suffix && bBegin < bEnd - suffix && a_[aEnd - suffix - 1] == b_[bEnd - suffix - 1]) {
+            ++suffix;
+        }
+        aEnd -= suffix;
+        bEnd -= suffix;
+        if (aBegin < aEnd && bBegin < bEnd) {
+            // Both ends differ here, so the edit distance is at least 2 and
+            // each half of the split is strictly smaller.
+            Snake snake = middleSnake(aBegin, aEnd, bBegin, bEnd);
+            run(aBegin, snake.x0, bBegin, snake.y0);
+            for (std::size_t x = snake.x0, y = snake.y0; x < snake.x1; ++x, ++y) {
+                out_.emplace_back(x, y);
+            }
+            run(snake.x1, aEnd, snake.y1, bEnd);
+        }
+        for (std::size_t i = 0; i < suffix; ++i) {
+            out_.emplace_back(aEnd + i, bEnd + i);
+        }
+    }
+
+private:
+    const std::vector<int> &a_;
+    const std::vector<int> &b_;
+    std::vector<std::pair<std::size_t, std::size_t>> &out_;
+    long maxCost_ = 256;
+
+    // Finds the middle snake of an optimal edit path (Myers 1986, section
+    // 4b), searching forward from the start and backward from the end until
+    // the two frontiers overlap. Coordinates are absolute.
+    Snake middleSnake(std::size_t aBegin, std::size_t aEnd, std::size_t bBegin, std::size_t bEnd) const {
+        const long n = static_cast<long>(aEnd - aBegin);
+        const long m = static_cast<long>(bEnd - bBegin);
+        const long delta = n - m;
+        const bool odd = (delta & 1) != 0;
+        const long limit = (n + m + 1) / 2;
+        const long offset = limit + 1;
+        std::vector<long> forward(static_cast<std::size_t>(2 * offset + 1), 0);
+        std::vector<long> backward(static_cast<std::size_t>(2 * offset + 1), 0);
+        auto at = [&](std::vector<long> &v, long k) -> long & { return v[static_cast<std::size_t>(k + offset)]; };
+        auto same = [&](long x, long y) { return a_[aBegin + x] == b_[bBegin + y]; };
+
+        for (long d = 0; d <= limit; ++d) {
+            for (long k = -d; k <= d; k += 2) {
+                long x = (k == -d || (k != d && at(forward, k - 1) < at(forward, k + 1))) ? at(forward, k + 1)
+                                                                                        : at(forward, k - 1) + 1;
+                long y = x - k;
+                long startX = x;
+                long startY = y;
+                while (x < n && y < m && same(x, y)) {
+                    ++x;
+                    ++y;
+                }
+                at(forward, k) = x;
+                long reverseK = delta - k;
+                if (odd && reverseK >= -(d - 1) && reverseK <= d - 1 && x + at(backward, reverseK) >= n) {
+                    return {aBegin + startX, bBegin + startY, aBegin + x, bBegin + y};
+                }
+            }
+            for (long k = -d; k <= d; k += 2) {
+                long x = (k == -d || (k != d && at(backward, k - 1) < at(backward, k + 1))) ? at(backward, k + 1)
+                                                                                          : at(backward, k - 1) + 1;
+                long y = x - k;
+                long startX = x;
+                long startY = y;
+                while (x < n && y < m && same(n - 1 - x, m - 1 - y)) {
+                    ++x;
+                    ++y;
+                }
+                at(backward, k) = x;
+                long forwardK = delta - k;
+                if (!odd && forwardK >= -d && forwardK <= d && x + at(forward, forwardK) >= n) {
+                    return {aBegin + (n - x), bBegin + (m - y), aBegin + (n - startX), bBegin + (m - startY)};
+                }
+            }
+            if (d >= maxCost_) {
+                // Give up on a minimal script: split at the forward point that
+                // got furthest. It is past the start and short of the end, so
+                // both halves are still smaller.
+                long bestX = 0;
+                long bestScore = -1;
+                for (long k = -d; k <= d; k += 2) {
+                    long x = std::min(at(forward, k), n);
+                    long y = x - k;
+                    if (y >= 0 && y <= m && x + y > bestScore) {
+                        bestScore = x + y;
+                        bestX = x;
+                    }
+                }
+                long bestY = bestScore - bestX;
+                if (bestScore > 0 && bestScore < n + m) {
+                    return {aBegin + bestX, bBegin + bestY, aBegin + bestX, bBegin + bestY};
+                }
+            }
+        }
+        // Unreachable for non-empty inputs; fall back to "replace everything".
+        return {aEnd, bBegin, aEnd, bBegin};
+    }
+};
+
+} // namespace
+
+std::vector<std::string> splitLines(const std::string &text) {
+    std::vector<std::string> lines;
+    std::size_t start = 0;
+    while (start < text.size()) {
+        std::size_t end = text.find('\n', start);
+        if (end == std::string::npos) {
+            lines.push_back(text.substr(start));
+            break;
+        }
+        lines.push_back(text.substr(start, end + 1 - start));
+        start = end + 1;
+    }
+    return lines;
+}
+
+bool looksBinary(const std::string &data) {
+    std::size_t window = std::min<std::size_t>(data.size(), 8000);
+    return data.find('\0') < window;
+}
+
+std::vector<std::pair<std::size_t, std::size_t>> matchLines(const std::vector<std::string> &a,
+                                                            const std::vector<std::string> &b) {
+    // Compare small integers instead of strings inside the search.
+    std::unordered_map<std::string, int> ids;
+    auto intern = [&ids](const std::vector<std::string> &lines) {
+        std::vector<int> out;
+        out.reserve(lines.size());
+        for (const auto &line : lines) {
+            out.push_back(ids.emplace(line, static_cast<int>(ids.size())).first->second);
+        }
+        return out;
+    };
+    std::vector<int> left = intern(a);
+    std::vector<int> right = intern(b);
+    std::vector<std::pair<std::size_t, std::size_t>> matches;
+    Matcher(left, right, matches).run(0, left.size(), 0, right.size());
+    return matches;
+}
+
+void unifiedDiff(const std::string &oldText, const std::string &newText, std::size_t context, const LineSink &sink) {
+    if (oldText == newText) {
+        return;
+    }
+    auto a = splitLines(oldText);
+    auto b = splitLines(newText);
+    auto matches = matchLines(a, b);
+    matches.emplace_back(a.size(), b.size());
+
+    // Changed regions: [aBegin, aEnd) replaced by [bBegin, bEnd).
+    struct Region {
+        std::size_t aBegin, aEnd, bBegin, bEnd;
+    };
+    std::vector<Region> regions;
+    std::size_t i = 0;
+    std::size_t j = 0;
+    for (const auto &match : matches) {
+        if (match.first > i || match.second > j) {
+            regions.push_back({i, match.first, j, match.second});
+        }
+        i = match.first + 1;
+        j = match.second + 1;
+    }
+
+    auto emit = [&sink](char prefix, const std::string &line) {
+        bool newline = !line.empty() && line.back() == '\n';
+        sink(prefix + line.substr(0, newline ? line.size() - 1 : line.size()));
+        if (!newline) {
+            sink("\\ No newline at end of file");
+        }
+    };
+    auto range = [](std::size_t start, std::size_t count) {
+        // An empty range names the line before it, as in diff -u.
+        std::size_t first = count == 0 ? start : start + 1;
+        return std::to_string(first) + (count == 1 ? std::string() : "," + std::to_string(count));
+    };
+
+    std::size_t r = 0;
+    while (r < regions.size()) {
+        // Regions closer than 2 * context share a hunk.
+        std::size_t last = r;
+        while (last + 1 < regions.size() && regions[last + 1].aBegin - regions[last].aEnd <= 2 * context) {
+            ++last;
+        }
+        std::size_t lead = std::min(context, regions[r].aBegin);
+        std::size_t trail = std::min(context, a.size() - regions[last].aEnd);
+        std::size_t aStart = regions[r].aBegin - lead;
+        std::size_t bStart = regions[r].bBegin - lead;
+        std::size_t aCount = regions[last].aEnd + trail - aStart;
+        std::size_t bCount = regions[last].bEnd + trail - bStart;
+        sink("@@ -" + range(aStart, aCount) + " +" + range(bStart, bCount) + " @@");
+
+        std::size_t aPos = aStart;
+        for (std::size_t k = r; k <= last; ++k) {
+            for (; aPos < regions[k].aBegin; ++aPos) {
+                emit(' ', a[aPos]);
+            }
+            for (std::size_t x = regions[k].aBegin; x < regions[k].aEnd; ++x) {
+                emit('-', a[x]);
+            }
+            for (std::size_t y = regions[k].bBegin; y < regions[k].bEnd; ++y) {
+                emit('+', b[y]);
+            }
+            aPos = regions[k].aEnd;
+        }
+        for (; aPos < regions[last].aEnd + trail; ++aPos) {
+            emit(' ', a[aPos]);
+        }
+        r = last + 1;
+    }
+}
+
+} // namespace textdiff
@@ -0,0 +1,36 @@
+#pragma once
+
+#include <cstddef>
+#include <functional>
+#include <string>
+#include <utility>
+#include <vector>
+
+// Line-level diffing shared by merge and diff output.
+namespace textdiff {
+
+// Receives output one line at a time (without the trailing newline), so
+// callers can stream large diffs instead of building one string.
+using LineSink = std::function<void(const std::string &line)>;
+
+// Splits `text` into lines that keep their trailing '\n', so joining the
+// pieces gives back the original bytes. A final line without '\n' is kept.
+std::vector<std::string> splitLines(const std::string &text);
+
+// Heuristic used by git: a NUL byte in the first 8000 bytes means binary.
+bool looksBinary(const std::string &data);
+
+// Longest common subsequence of two line lists as (index in a, index in b)
+// pairs, increasing in both. Uses Myers' O(ND) algorithm in linear space
+// after trimming the common prefix and suffix, so cost follows the size of
+// the difference rather than the size of the files. As in xdiff, very
+// expensive searches are cut short at a good split point, so the result may
+// be slightly longer than minimal on huge, mostly different inputs.
+std::vector<std::pair<std::size_t, std::size_t>> matchLines(const std::vector<std::string> &a,
+                                                            const std::vector<std::string> &b);
+
+// Writes `@@ -a,b +c,d @@` hunks with `context` lines around each change.
+// Nothing is written when the texts are equal.
+void unifiedDiff(const std::string &oldText, const std::string &newText, std::size_t context, const LineSink &sink);
+
+} // namespace textdiff
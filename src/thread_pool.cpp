@@ -0,0 +1,77 @@
+#include "thread_pool.hpp"
+
+#include "stats.hpp"
+
+#include <algorithm>
+#include <utility>
+
+ThreadPool::ThreadPool(std::size_t threads, std::size_t queueLimit) {
+    if (threads == 0) {
+        threads = defaultThreads();
+    }
+    queueLimit_ = queueLimit == 0 ? threads * 4 : queueLimit;
+    workers_.reserve(threads);
+    for (std::size_t i = 0; i < threads; ++i) {
+        workers_.emplace_back([this] { workerLoop(); });
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stopping_ = true;
+    }
+    taskReady_.notify_all();
+    for (auto &worker : workers_) {
+        worker.join();
+    }
+}
+
+std::size_t ThreadPool::defaultThreads() {
+    return std::max<std::size_t>(1, std::thread::hardware_concurrency());
+}
+
+void ThreadPool::submit(std::function<void()> task) {
+    if (stats::Trace *trace = stats::currentTrace()) {
+        task = [trace, inner = std::move(task)] {
+            stats::TraceBinding binding(trace);
+            inner();
+        };
+    }
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        spaceReady_.wait(lock, [this] { return queue_.size() < queueLimit_; });
+        queue_.push_back(std::move(task));
+    }
+    taskReady_.notify_one();
+}
+
+void ThreadPool::wait() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    idle_.wait(lock, [this] { return queue_.empty() && running_ == 0; });
+}
+
+void ThreadPool::workerLoop() {
+    while (true) {
+        std::function<void()> task;
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            taskReady_.wait(lock, [this] { return stopping_ || !queue_.empty(); });
+            if (queue_.empty()) {
+                return;
+            }
+            task = std::move(queue_.front());
+            queue_.pop_front();
+            ++running_;
+        }
+        spaceReady_.notify_one();
+        task();
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            --running_;
+            if (queue_.empty() && running_ == 0) {
+                idle_.notify_all();
+            }
+        }
+    }
+}
@@ -0,0 +1,46 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Fixed set of worker threads fed from a bounded FIFO queue. `submit` blocks
+// while the queue is full, so producers that walk huge trees never buffer more
+// than a few tasks per worker.
+class ThreadPool {
+public:
+    // 0 picks std::thread::hardware_concurrency() workers and a queue of four
+    // tasks per worker.
+    explicit ThreadPool(std::size_t threads = 0, std::size_t queueLimit = 0);
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool &) = delete;
+    ThreadPool &operator=(const ThreadPool &) = delete;
+
+    // Tasks must not throw; report failures through captured state instead.
+    void submit(std::function<void()> task);
+
+    // Blocks until every submitted task has finished.
+    void wait();
+
+    std::size_t size() const { return workers_.size(); }
+
+    static std::size_t defaultThreads();
+
+private:
+    std::vector<std::thread> workers_;
+    std::deque<std::function<void()>> queue_;
+    std::size_t queueLimit_ = 0;
+    std::size_t running_ = 0;
+    bool stopping_ = false;
+    std::mutex mutex_;
+    std::condition_variable taskReady_;
+    std::condition_variable spaceReady_;
+    std::condition_variable idle_;
+
+    void workerLoop();
+};
@@ -0,0 +1,794 @@
+#include "transport.hpp"
+
+#include "compression.hpp"
+#include "hashing.hpp"
+#include "object_store.hpp"
+#include "repo_lock.hpp"
+#include "storage_manager.hpp"
+#include "utils.hpp"
+
+#include <algorithm>
+#include <cctype>
+#include <cstdlib>
+#include <fstream>
+#include <map>
+#include <mutex>
+#include <sstream>
+#include <unordered_set>
+
+namespace fs = std::filesystem;
+using gitlite::util::trim;
+
+namespace transport {
+
+namespace {
+
+constexpr std::size_t kChunkSize = 1 << 20;
+// Speed matters more than ratio here: most of the stream is file content,
+// and a chunk that does not shrink is sent stored.
+constexpr int kWireLevel = 1;
+// Refuses chunks a well-behaved peer never sends before allocating for them.
+constexpr std::size_t kMaxChunk = std::size_t(256) << 20;
+constexpr std::size_t kMaxRequestLines = 1 << 20;
+constexpr int kClientTimeoutSeconds = 120;
+
+// Passwords used earlier in this process, for fetching the missing objects
+// of partial clones without asking again.
+std::mutex gCredentialsMutex;
+std::map<std::string, Credentials> gCredentials;
+
+std::string credentialKey(const RemoteUrl &url) {
+    return url.user + "@" + url.host + ":" + std::to_string(url.port);
+}
+
+bool isHexId(const std::string &value) {
+    return value.size() == 64 && std::all_of(value.begin(), value.end(), [](unsigned char ch) {
+               return std::isdigit(ch) || (ch >= 'a' && ch <= 'f');
+           });
+}
+
+bool isBranchName(const std::string &name) {
+    return gitlite::util::isValidIdentifier(name) && name != "." && name != "..";
+}
+
+// Blob and tree ids hash the stored bytes. Commit objects start with their
+// own "id=" line, which is not part of the hash.
+bool objectMatches(const std::string &id, const std::string &data) {
+    hashing::Digest expected;
+    if (!hashing::Digest::parse(id, expected)) {
+        return false;
+    }
+    const auto *bytes = reinterpret_cast<const unsigned char *>(data.data());
+    std::string prefix = "id=" + id + "\n";
+    if (data.compare(0, prefix.size(), prefix) == 0) {
+        return hashing::sha256Digest(bytes + prefix.size(), data.size() - prefix.size()) == expected;
+    }
+    return hashing::sha256Digest(bytes, data.size()) == expected;
+}
+
+std::string listDigest(const std::vector<std::string> &ids) {
+    std::string joined;
+    joined.reserve(ids.size() * 65);
+    for (const auto &id : ids) {
+        joined += id + "\n";
+    }
+    return hashing::sha256String(joined);
+}
+
+bool readReply(Socket &socket, std::string &line, std::string &error) {
+    if (!socket.readLine(line)) {
+        error = "Connection to the remote closed unexpectedly.";
+        return false;
+    }
+    if (line.rfind("err", 0) == 0) {
+        error = trim(line.substr(3));
+        if (error.empty()) {
+            error = "Remote reported an error.";
+        }
+        return false;
+    }
+    return true;
+}
+
+bool expectOk(Socket &socket, std::string &error) {
+    std::string line;
+    if (!readReply(socket, line, error)) {
+        return false;
+    }
+    if (line != "ok") {
+        error = "Unexpected reply from remote: " + line;
+        return false;
+    }
+    return true;
+}
+
+bool openSession(const RemoteUrl &url, const Credentials &credentials, Socket &socket, std::string &error) {
+    if (!Socket::connect(url.host, url.port, socket, error)) {
+        return false;
+    }
+    socket.setTimeout(kClientTimeoutSeconds);
+    std::string greeting;
+    if (!socket.readLine(greeting) || greeting.rfind("gitlite 1", 0) != 0) {
+        error = url.host + ":" + std::to_string(url.port) + " is not a GitLite server.";
+        return false;
+    }
+    if (!socket.writeAll("login " + credentials.user + " " + credentials.password + "\n") ||
+        !expectOk(socket, error)) {
+        error = "Remote login failed: " + error;
+        return false;
+    }
+    return true;
+}
+
+bool sendAdvertisement(Socket &client, const RepoService &service, const fs::path &repoRoot) {
+    std::string reply;
+    for (const auto &ref : service.advertiseRefs(repoRoot)) {
+        reply += "ref " + ref.second + " " + ref.first + "\n";
+    }
+    reply += "head " + service.currentBranch(repoRoot) + "\nok\n";
+    return client.writeAll(reply);
+}
+
+bool readAdvertisement(Socket &socket, RepoService::RefList &refs, std::string &head, std::string &error) {
+    std::string line;
+    while (readReply(socket, line, error)) {
+        if (line == "ok") {
+            return true;
+        }
+        std::istringstream words(line);
+        std::string verb, id, name;
+        words >> verb >> id >> name;
+        if (verb == "ref" && isHexId(id) && !name.empty()) {
+            refs.emplace_back(name, id);
+        } else if (verb == "head") {
+            head = isBranchName(id) ? id : "main";
+        } else {
+            error = "Unexpected reply from remote: " + line;
+            return false;
+        }
+    }
+    return false;
+}
+
+// Tips the local repository holds with their full history: the peer may
+// leave out everything they reach.
+std::vector<std::string> localTips(const RepoService &service, const fs::path &repoRoot) {
+    std::vector<std::string> tips;
+    for (const auto &ref : service.advertiseRefs(repoRoot)) {
+        tips.push_back(ref.second);
+    }
+    std::error_code ec;
+    for (fs::directory_iterator it(repoRoot / ".glite" / "refs" / "remotes", ec), end; !ec && it != end;
+         it.increment(ec)) {
+        std::ifstream in(it->path());
+        std::string id;
+        std::getline(in, id);
+        id = trim(id);
+        if (isHexId(id)) {
+            tips.push_back(id);
+        }
+    }
+    return tips;
+}
+
+bool sendPack(Socket &socket, const fs::path &repoRoot, const std::vector<std::string> &ids, std::string &error) {
+    if (!socket.writeAll("pack " + std::to_string(ids.size()) + " " + listDigest(ids) + "\n")) {
+        error = "Connection lost.";
+        return false;
+    }
+    std::string line;
+    if (!socket.readLine(line) || line.rfind("from ", 0) != 0) {
+        error = "Peer did not answer the pack header.";
+        return false;
+    }
+    std::size_t start = 0;
+    try {
+        start = static_cast<std::size_t>(std::stoull(line.substr(5)));
+    } catch (const std::exception &) {
+        start = ids.size() + 1;
+    }
+    if (start > ids.size()) {
+        error = "Peer asked to resume past the end of the pack.";
+        return false;
+    }
+
+    ObjectStore store(repoRoot);
+    std::string raw;
+    std::string data;
+    auto flush = [&]() {
+        std::string compressed;
+        if (!compression::deflateBytes(reinterpret_cast<const unsigned char *>(raw.data()), raw.size(), compressed,
+                                       kWireLevel)) {
+            error = "Unable to compress pack data.";
+            return false;
+        }
+        bool stored = compressed.size() >= raw.size();
+        std::string frame = stored ? "stored " + std::to_string(raw.size()) + "\n"
+                                   : "chunk " + std::to_string(raw.size()) + " " + std::to_string(compressed.size()) + "\n";
+        bool sent = socket.writeAll(frame) && socket.writeAll(stored ? raw : compressed);
+        raw.clear();
+        if (!sent) {
+            error = "Connection lost while sending objects.";
+            return false;
+        }
+        return true;
+    };
+    for (std::size_t i = start; i < ids.size(); ++i) {
+        if (!store.read(ids[i], data)) {
+            error = "Unable to read object " + ids[i] + ".";
+            return false;
+        }
+        raw += ids[i] + " " + std::to_string(data.size()) + "\n";
+        raw += data;
+        if (raw.size() >= kChunkSize && !flush()) {
+            return false;
+        }
+    }
+    if (!raw.empty() && !flush()) {
+        return false;
+    }
+    if (!socket.writeAll("end\n")) {
+        error = "Connection lost while sending objects.";
+        return false;
+    }
+    return true;
+}
+
+// The pack header, after the boundary commits of a shallow fetch.
+bool readPackHeader(Socket &socket, std::vector<std::string> &boundary, std::string &header, std::string &error) {
+    while (readReply(socket, header, error)) {
+        if (header.rfind("shallow ", 0) != 0) {
+            return true;
+        }
+        std::string id = header.substr(8);
+        if (!isHexId(id)) {
+            error = "Unexpected reply from remote: " + header;
+            return false;
+        }
+        boundary.push_back(id);
+    }
+    return false;
+}
+
+bool storeChunk(const ObjectStore &store, const std::string &chunk, std::size_t &stored, std::string &error) {
+    std::size_t pos = 0;
+    while (pos < chunk.size()) {
+        std::size_t space = chunk.find(' ', pos);
+        std::size_t newline = chunk.find('\n', pos);
+        if (space == std::string::npos || newline == std::string::npos || space > newline) {
+            error = "Malformed pack data.";
+            return false;
+        }
+        std::string id = chunk.substr(pos, space - pos);
+        std::size_t size = 0;
+        try {
+            size = static_cast<std::size_t>(std::stoull(chunk.substr(space + 1, newline - space - 1)));
+        } catch (const std::exception &) {
+            size = chunk.size();
+        }
+        pos = newline + 1;
+        if (!isHexId(id) || size > chunk.size() - pos) {
+            error = "Malformed pack data.";
+            return false;
+        }
+        std::string data = chunk.substr(pos, size);
+        pos += size;
+        if (!objectMatches(id, data)) {
+            error = "Object " + id + " does not match its id.";
+            return false;
+        }
+        if (!store.writeLoose(id, data, error)) {
+            return false;
+        }
+        ++stored;
+    }
+    return true;
+}
+
+bool receivePack(Socket &socket,
+                 const fs::path &repoRoot,
+                 const std::string &header,
+                 std::size_t &received,
+                 std::string &error) {
+    std::istringstream words(header);
+    std::string verb, digest;
+    std::size_t total = 0;
+    words >> verb >> total >> digest;
+    if (verb != "pack" || !isHexId(digest)) {
+        error = "Malformed pack header: " + header;
+        return false;
+    }
+
+    fs::path resumeFile = repoRoot / ".glite" / "resume" / digest;
+    std::size_t stored = 0;
+    {
+        std::ifstream in(resumeFile);
+        in >> stored;
+        if (!in || stored > total) {
+            stored = 0;
+        }
+    }
+    const std::size_t resumedFrom = stored;
+    std::error_code ec;
+    fs::create_directories(resumeFile.parent_path(), ec);
+    if (!socket.writeAll("from " + std::to_string(stored) + "\n")) {
+        error = "Connection lost.";
+        return false;
+    }
+
+    ObjectStore store(repoRoot);
+    std::string line;
+    std::string compressed;
+    std::string chunk;
+    while (true) {
+        if (!socket.readLine(line)) {
+            error = "Transfer interrupted after " + std::to_string(stored) + " of " + std::to_string(total) +
+                    " objects; run the command again to resume.";
+            return false;
+        }
+        if (line == "end") {
+            break;
+        }
+        if (line.rfind("err", 0) == 0) {
+            error = trim(line.substr(3));
+            return false;
+        }
+        std::istringstream frame(line);
+        std::size_t rawSize = 0;
+        std::size_t compressedSize = 0;
+        frame >> verb >> rawSize;
+        bool isStored = verb == "stored";
+        if (!isStored) {
+            frame >> compressedSize;
+        }
+        if ((verb != "chunk" && !isStored) || !frame || rawSize > kMaxChunk || compressedSize > kMaxChunk) {
+            error = "Malformed pack frame: " + line.substr(0, 80);
+            return false;
+        }
+        if (!socket.readExact(isStored ? rawSize : compressedSize, isStored ? chunk : compressed)) {
+            error = "Transfer interrupted after " + std::to_string(stored) + " of " + std::to_string(total) +
+                    " objects; run the command again to resume.";
+            return false;
+        }
+        if (!isStored &&
+            (!compression::inflateBytes(reinterpret_cast<const unsigned char *>(compressed.data()), compressed.size(),
+                                        chunk) ||
+             chunk.size() != rawSize)) {
+            error = "Corrupt pack chunk.";
+            return false;
+        }
+        if (!storeChunk(store, chunk, stored, error)) {
+            return false;
+        }
+        // Objects are durable once written; only the count needs recording.
+        std::ofstream(resumeFile, std::ios::trunc) << stored << "\n";
+    }
+    if (stored != total) {
+        error = "Pack ended after " + std::to_string(stored) + " of " + std::to_string(total) + " objects.";
+        return false;
+    }
+    fs::remove(resumeFile, ec);
+    received = total - resumedFrom;
+    return true;
+}
+
+} // namespace
+
+std::string RemoteUrl::toString() const {
+    std::string out = "gitlite://";
+    if (!user.empty()) {
+        out += user + "@";
+    }
+    out += host;
+    if (port != kDefaultPort) {
+        out += ":" + std::to_string(port);
+    }
+    return out + "/" + owner + "/" + repo;
+}
+
+bool isRemoteUrl(const std::string &text) {
+    return text.rfind("gitlite://", 0) == 0;
+}
+
+bool parseRemoteUrl(const std::string &text, RemoteUrl &url, std::string &error) {
+    url = {};
+    error = "Invalid remote URL '" + text + "'. Use gitlite://[user@]host[:port]/<owner>/<repo>.";
+    if (!isRemoteUrl(text)) {
+        return false;
+    }
+    std::string rest = text.substr(10);
+    std::size_t slash = rest.find('/');
+    if (slash == std::string::npos) {
+        return false;
+    }
+    std::string authority = rest.substr(0, slash);
+    std::string path = rest.substr(slash + 1);
+    while (!path.empty() && path.back() == '/') {
+        path.pop_back();
+    }
+    std::size_t at = authority.rfind('@');
+    if (at != std::string::npos) {
+        url.user = authority.substr(0, at);
+        authority = authority.substr(at + 1);
+    }
+    std::size_t colon = authority.rfind(':');
+    if (colon != std::string::npos && authority.find(']') == std::string::npos) {
+        std::string port = authority.substr(colon + 1);
+        authority = authority.substr(0, colon);
+        if (port.empty() || port.size() > 5 || !std::all_of(port.begin(), port.end(), ::isdigit) ||
+            std::stoul(port) == 0 || std::stoul(port) > 65535) {
+            return false;
+        }
+        url.port = static_cast<unsigned short>(std::stoul(port));
+    }
+    if (authority.size() > 2 && authority.front() == '[' && authority.back() == ']') {
+        authority = authority.substr(1, authority.size() - 2);
+    }
+    url.host = authority;
+    std::size_t middle = path.find('/');
+    if (middle == std::string::npos) {
+        return false;
+    }
+    url.owner = path.substr(0, middle);
+    url.repo = path.substr(middle + 1);
+    if (url.host.empty() || !gitlite::util::isValidIdentifier(url.owner) ||
+        !gitlite::util::isValidIdentifier(url.repo) || (!url.user.empty() && !gitlite::util::isValidIdentifier(url.user))) {
+        return false;
+    }
+    error.clear();
+    return true;
+}
+
+bool fetch(const RepoService &service,
+           const fs::path &repoRoot,
+           const RemoteUrl &url,
+           const Credentials &credentials,
+           SyncResult &result,
+           std::string &error,
+           std::string *remoteHead) {
+    RepoLock lock(repoRoot, RepoLock::Mode::Write);
+    result = {};
+    Socket socket;
+    if (!openSession(url, credentials, socket, error)) {
+        return false;
+    }
+    RepoService::RefList refs;
+    std::string head = "main";
+    if (!socket.writeAll("upload-pack " + url.owner + "/" + url.repo + "\n") ||
+        !readAdvertisement(socket, refs, head, error)) {
+        return false;
+    }
+    if (remoteHead) {
+        *remoteHead = head;
+    }
+
+    auto updates = service.planFetch(repoRoot, refs, result);
+    std::string request;
+    std::unordered_set<std::string> listed;
+    for (const auto &update : updates) {
+        if (listed.insert(update.newId).second) {
+            request += "want " + update.newId + "\n";
+        }
+    }
+    if (!request.empty()) {
+        for (const auto &tip : localTips(service, repoRoot)) {
+            if (listed.insert(tip).second) {
+                request += "have " + tip + "\n";
+            }
+        }
+        // Shallow and partial clones stay that way on every fetch.
+        for (const auto &id : service.shallowCommits(repoRoot)) {
+            request += "shallow " + id + "\n";
+        }
+        if (std::size_t depth = service.shallowDepth(repoRoot)) {
+            request += "deepen " + std::to_string(depth) + "\n";
+        }
+        if (ObjectStore(repoRoot).isPartial()) {
+            request += "filter blob:none\n";
+        }
+    }
+    request += "done\n";
+    std::vector<std::string> boundary;
+    std::string header;
+    if (!socket.writeAll(request) || !readPackHeader(socket, boundary, header, error) ||
+        !receivePack(socket, repoRoot, header, result.objectsTransferred, error) || !expectOk(socket, error) ||
+        !service.addShallowCommits(repoRoot, boundary, error)) {
+        return false;
+    }
+    socket.writeAll("quit\n");
+    return service.applyFetch(repoRoot, updates, error);
+}
+
+bool fetchObjects(const fs::path &repoRoot,
+                  const RemoteUrl &url,
+                  const Credentials &credentials,
+                  const std::vector<std::string> &ids,
+                  std::string &error) {
+    Socket socket;
+    if (!openSession(url, credentials, socket, error)) {
+        return false;
+    }
+    RepoService::RefList refs;
+    std::string head;
+    if (!socket.writeAll("upload-pack " + url.owner + "/" + url.repo + "\n") ||
+        !readAdvertisement(socket, refs, head, error)) {
+        return false;
+    }
+    std::string request = "exact\n";
+    for (const auto &id : ids) {
+        request += "want " + id + "\n";
+    }
+    request += "done\n";
+    std::vector<std::string> boundary;
+    std::string header;
+    std::size_t received = 0;
+    if (!socket.writeAll(request) || !readPackHeader(socket, boundary, header, error) ||
+        !receivePack(socket, repoRoot, header, received, error) || !expectOk(socket, error)) {
+        return false;
+    }
+    socket.writeAll("quit\n");
+    return true;
+}
+
+void rememberCredentials(const RemoteUrl &url, const Credentials &credentials) {
+    std::lock_guard<std::mutex> lock(gCredentialsMutex);
+    gCredentials[credentialKey(url)] = credentials;
+}
+
+bool fetchPromisedObjects(const fs::path &repoRoot, const std::vector<std::string> &ids, std::string &error) {
+    auto config = StorageManager::readRepoConfig(repoRoot);
+    RemoteUrl url;
+    if (!parseRemoteUrl(config["remote.url"], url, error)) {
+        error = "Partial clone has no usable remote.url to fetch missing objects from.";
+        return false;
+    }
+    Credentials credentials;
+    {
+        std::lock_guard<std::mutex> lock(gCredentialsMutex);
+        auto it = gCredentials.find(credentialKey(url));
+        if (it != gCredentials.end()) {
+            credentials = it->second;
+        }
+    }
+    if (credentials.user.empty()) {
+        const char *user = std::getenv("GLITE_USER");
+        const char *password = std::getenv("GLITE_REMOTE_PASSWORD");
+        credentials.user = !url.user.empty() ? url.user : user ? user : "";
+        credentials.password = password ? password : "";
+    }
+    if (credentials.user.empty() || credentials.password.empty()) {
+        error = "File contents of this partial clone are on " + url.toString() +
+                "; run fetch once or set GLITE_REMOTE_PASSWORD so they can be downloaded.";
+        return false;
+    }
+    if (!fetchObjects(repoRoot, url, credentials, ids, error)) {
+        error = "Unable to fetch missing objects: " + error;
+        return false;
+    }
+    return true;
+}
+
+bool pull(const RepoService &service,
+          const fs::path &repoRoot,
+          const RemoteUrl &url,
+          const Credentials &credentials,
+          SyncResult &result,
+          std::string &error) {
+    RepoLock lock(repoRoot, RepoLock::Mode::Write);
+    return fetch(service, repoRoot, url, credentials, result, error) &&
+           service.mergeTrackingRefs(repoRoot, result, error);
+}
+
+bool push(const RepoService &service,
+          const fs::path &repoRoot,
+          const RemoteUrl &url,
+          const Credentials &credentials,
+          SyncResult &result,
+          std::string &error) {
+    result = {};
+    Socket socket;
+    if (!openSession(url, credentials, socket, error)) {
+        return false;
+    }
+    RepoService::RefList refs;
+    std::string head;
+    if (!socket.writeAll("receive-pack " + url.owner + "/" + url.repo + "\n") ||
+        !readAdvertisement(socket, refs, head, error)) {
+        return false;
+    }
+
+    auto updates = service.planPush(repoRoot, refs, result);
+    ObjectStore store(repoRoot);
+    std::vector<std::string> wants;
+    std::vector<std::string> haves;
+    std::string request;
+    for (const auto &update : updates) {
+        wants.push_back(update.newId);
+        request += "update " + (update.oldId.empty() ? std::string("-") : update.oldId) + " " + update.newId + " " +
+                   update.ref + "\n";
+    }
+    for (const auto &ref : refs) {
+        if (store.contains(ref.second)) {
+            haves.push_back(ref.second);
+        }
+    }
+    std::vector<std::string> ids;
+    if (!wants.empty()) {
+        ids = service.objectsToSend(repoRoot, wants, haves);
+    }
+    if (!socket.writeAll(request) || !sendPack(socket, repoRoot, ids, error)) {
+        return false;
+    }
+    result.objectsTransferred = ids.size();
+
+    std::string line;
+    while (readReply(socket, line, error)) {
+        if (line == "ok") {
+            socket.writeAll("quit\n");
+            return true;
+        }
+        if (line.rfind("| updated ", 0) == 0) {
+            result.updatedRefs.push_back(line.substr(10));
+        } else if (line.rfind("| rejected ", 0) == 0) {
+            result.rejectedRefs.push_back(line.substr(11));
+        }
+    }
+    return false;
+}
+
+bool clone(const RepoService &service,
+           const fs::path &repoRoot,
+           const RemoteUrl &url,
+           const Credentials &credentials,
+           SyncResult &result,
+           std::string &error,
+           const CloneOptions &options) {
+    RepoLock lock(repoRoot, RepoLock::Mode::Write);
+    if (!service.initClone(repoRoot, error)) {
+        return false;
+    }
+    auto config = StorageManager::readRepoConfig(repoRoot);
+    config["name"] = url.repo;
+    config["owner"] = url.owner;
+    config["remote.url"] = url.toString();
+    if (options.depth > 0) {
+        config["shallow.depth"] = std::to_string(options.depth);
+    }
+    if (!StorageManager::writeRepoConfig(repoRoot, config)) {
+        error = "Unable to write the repository config.";
+        return false;
+    }
+    if (options.blobless) {
+        std::ofstream promisor(repoRoot / ".glite" / "promisor", std::ios::trunc);
+        promisor << "blob:none\n";
+        if (!promisor) {
+            error = "Unable to mark the clone as partial.";
+            return false;
+        }
+    }
+    std::string head;
+    if (!fetch(service, repoRoot, url, credentials, result, error, &head)) {
+        return false;
+    }
+    std::size_t transferred = result.objectsTransferred;
+    service.setCurrentBranch(repoRoot, head);
+    if (!service.mergeTrackingRefs(repoRoot, result, error)) {
+        return false;
+    }
+    result.objectsTransferred = transferred;
+    return true;
+}
+
+bool serveUploadPack(Socket &client, const RepoService &service, const fs::path &repoRoot) {
+    if (!sendAdvertisement(client, service, repoRoot)) {
+        return false;
+    }
+    std::vector<std::string> wants;
+    std::vector<std::string> haves;
+    FetchLimits limits;
+    bool exact = false;
+    std::string line;
+    std::size_t lines = 0;
+    while (true) {
+        if (!client.readLine(line)) {
+            return false;
+        }
+        if (line == "done") {
+            break;
+        }
+        std::istringstream words(line);
+        std::string verb, value;
+        words >> verb >> value;
+        bool valid = ++lines <= kMaxRequestLines;
+        if (verb == "want" || verb == "have" || verb == "shallow") {
+            valid = valid && isHexId(value);
+            (verb == "want" ? wants : verb == "have" ? haves : limits.peerShallow).push_back(value);
+        } else if (verb == "deepen") {
+            valid = valid && !value.empty() && value.size() < 10 &&
+                    std::all_of(value.begin(), value.end(), ::isdigit);
+            limits.depth = valid ? static_cast<std::size_t>(std::stoul(value)) : 0;
+        } else if (verb == "filter") {
+            valid = valid && value == "blob:none";
+            limits.omitBlobs = true;
+        } else if (verb == "exact") {
+            exact = true;
+        } else {
+            valid = false;
+        }
+        if (!valid) {
+            client.writeAll("err Bad upload-pack request: " + line.substr(0, 80) + "\n");
+            return false;
+        }
+    }
+    std::vector<std::string> ids;
+    std::vector<std::string> boundary;
+    if (exact) {
+        // Objects a partial clone found missing, sent as asked without a walk.
+        ObjectStore store(repoRoot);
+        std::unordered_set<std::string> listed;
+        for (const auto &id : wants) {
+            if (listed.insert(id).second && store.contains(id)) {
+                ids.push_back(id);
+            }
+        }
+    } else if (!wants.empty()) {
+        ids = service.objectsToSend(repoRoot, wants, haves, limits, &boundary);
+    }
+    std::string shallowLines;
+    for (const auto &id : boundary) {
+        shallowLines += "shallow " + id + "\n";
+    }
+    std::string error;
+    if (!client.writeAll(shallowLines) || !sendPack(client, repoRoot, ids, error)) {
+        client.writeAll("err " + error + "\n");
+        return false;
+    }
+    return client.writeAll("ok\n");
+}
+
+bool serveReceivePack(Socket &client, const RepoService &service, const fs::path &repoRoot, SyncResult &result) {
+    result = {};
+    if (!sendAdvertisement(client, service, repoRoot)) {
+        return false;
+    }
+    std::vector<RepoService::RefUpdate> updates;
+    std::string line;
+    while (true) {
+        if (!client.readLine(line)) {
+            return false;
+        }
+        if (line.rfind("pack ", 0) == 0) {
+            break;
+        }
+        std::istringstream words(line);
+        std::string verb, oldId, newId, ref;
+        words >> verb >> oldId >> newId >> ref;
+        if (oldId == "-") {
+            oldId.clear();
+        }
+        if (verb != "update" || (!oldId.empty() && !isHexId(oldId)) || !isHexId(newId) || ref.empty() ||
+            updates.size() >= kMaxRequestLines) {
+            client.writeAll("err Bad receive-pack request: " + line.substr(0, 80) + "\n");
+            return false;
+        }
+        updates.push_back({ref, oldId, newId});
+    }
+    std::string error;
+    if (!receivePack(client, repoRoot, line, result.objectsTransferred, error)) {
+        client.writeAll("err " + error + "\n");
+        return false;
+    }
+    if (!service.receiveRefUpdates(repoRoot, updates, result, error)) {
+        return client.writeAll("err " + error + "\n");
+    }
+    std::string reply;
+    for (const auto &ref : result.updatedRefs) {
+        reply += "| updated " + ref + "\n";
+    }
+    for (const auto &ref : result.rejectedRefs) {
+        reply += "| rejected " + ref + "\n";
+    }
+    return client.writeAll(reply + "ok\n");
+}
+
+} // namespace transport
@@ -0,0 +1,128 @@
+#pragma once
+
+#include "repo_service.hpp"
+#include "socket_io.hpp"
+
+#include <cstddef>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+// Push, fetch, pull and clone between machines, spoken inside a server
+// session (server.hpp) after `login`. Two requests switch the session into a
+// transfer:
+//
+//   C: upload-pack <owner>/<repo>                 fetch, pull, clone
+//   S: ref <id> <heads/x|tags/x> ... head <branch> ok | err <message>
+//   C: want <id> ... have <id> ... [shallow <id> ... deepen <n>]
+//      [filter blob:none] [exact] done
+//   S: shallow <id> ... pack <count> <digest>
+//   C: from <n>
+//   S: chunk <raw size> <compressed size> | stored <size>, then bytes ... end ok
+//
+//   C: receive-pack <owner>/<repo>                push
+//   S: ref <id> <ref> ... head <branch> ok | err <message>
+//   C: update <old|-> <new> <ref> ... pack <count> <digest>
+//   S: from <n>
+//   C: chunk ... end
+//   S: | updated <ref> | rejected <ref> (<reason>) ... ok | err <message>
+//
+// Request lines are written in one batch without waiting for replies, so a
+// transfer costs three round trips however many objects it moves. A chunk
+// holds about 1 MiB of records "<id> <size>\n<bytes>", deflated unless that
+// does not shrink it. Receivers verify every object's hash and store it as it
+// arrives, counting landed objects in .glite/resume/<digest>, where the
+// digest covers the ordered id list. A retried transfer of the same list
+// answers `from <n>` and the sender skips what already arrived.
+//
+// A shallow clone sends its depth and boundary commits with each fetch and
+// gets back the commits whose parents were cut off. A partial clone asks for
+// `filter blob:none`, and later fetches single blobs with `exact`: the wanted
+// objects themselves, with no history walk.
+namespace transport {
+
+constexpr unsigned short kDefaultPort = 9419;
+
+// gitlite://[user@]host[:port]/<owner>/<repo>
+struct RemoteUrl {
+    std::string user;
+    std::string host;
+    unsigned short port = kDefaultPort;
+    std::string owner;
+    std::string repo;
+
+    std::string toString() const;
+};
+
+bool isRemoteUrl(const std::string &text);
+bool parseRemoteUrl(const std::string &text, RemoteUrl &url, std::string &error);
+
+struct Credentials {
+    std::string user;
+    std::string password;
+};
+
+// Client side; each call opens one connection to the server.
+bool fetch(const RepoService &service,
+           const std::filesystem::path &repoRoot,
+           const RemoteUrl &url,
+           const Credentials &credentials,
+           SyncResult &result,
+           std::string &error,
+           std::string *remoteHead = nullptr);
+bool pull(const RepoService &service,
+          const std::filesystem::path &repoRoot,
+          const RemoteUrl &url,
+          const Credentials &credentials,
+          SyncResult &result,
+          std::string &error);
+bool push(const RepoService &service,
+          const std::filesystem::path &repoRoot,
+          const RemoteUrl &url,
+          const Credentials &credentials,
+          SyncResult &result,
+          std::string &error);
+struct CloneOptions {
+    // Commits of history kept below each branch head; 0 keeps all of them.
+    std::size_t depth = 0;
+    // Leave file contents on the server until a checkout or diff needs them.
+    bool blobless = false;
+};
+
+// Records `url` as remote.url in the new repository's config before the
+// transfer starts, so an interrupted clone can be resumed by cloning again.
+bool clone(const RepoService &service,
+           const std::filesystem::path &repoRoot,
+           const RemoteUrl &url,
+           const Credentials &credentials,
+           SyncResult &result,
+           std::string &error,
+           const CloneOptions &options = {});
+
+// Downloads exactly `ids` into `repoRoot`.
+bool fetchObjects(const std::filesystem::path &repoRoot,
+                  const RemoteUrl &url,
+                  const Credentials &credentials,
+                  const std::vector<std::string> &ids,
+                  std::string &error);
+
+// Keeps `credentials` for the rest of the process so fetchPromisedObjects
+// can reach the same server without asking for a password.
+void rememberCredentials(const RemoteUrl &url, const Credentials &credentials);
+
+// ObjectStore::MissingObjectFetcher for partial clones: fetches from the
+// clone's remote.url with remembered credentials, or GLITE_REMOTE_PASSWORD.
+bool fetchPromisedObjects(const std::filesystem::path &repoRoot,
+                          const std::vector<std::string> &ids,
+                          std::string &error);
+
+// Server side: the rest of an upload-pack or receive-pack request once the
+// server has checked access to `repoRoot`. Return false when the connection
+// is no longer usable.
+bool serveUploadPack(Socket &client, const RepoService &service, const std::filesystem::path &repoRoot);
+bool serveReceivePack(Socket &client,
+                      const RepoService &service,
+                      const std::filesystem::path &repoRoot,
+                      SyncResult &result);
+
+} // namespace transport
@@ -0,0 +1,192 @@
+#include "tree.hpp"
+
+#include "hashing.hpp"
+#include "utils.hpp"
+
+#include <algorithm>
+#include <sstream>
+
+namespace trees {
+
+namespace {
+
+bool validName(const std::string &name) {
+    return !name.empty() && name != "." && name != ".." && name.find('/') == std::string::npos &&
+           name.find('\t') == std::string::npos && name.find('\n') == std::string::npos;
+}
+
+bool writeLevel(const ObjectStore &store,
+                const std::vector<std::pair<std::string, std::string>> &files,
+                std::size_t begin,
+                std::size_t end,
+                std::size_t prefixLength,
+                std::string &id,
+                std::string &error) {
+    std::string body;
+    std::size_t i = begin;
+    while (i < end) {
+        const std::string &path = files[i].first;
+        std::size_t slash = path.find('/', prefixLength);
+        if (slash == std::string::npos) {
+            body += "blob\t" + files[i].second + "\t" + path.substr(prefixLength) + "\n";
+            ++i;
+            continue;
+        }
+        // Paths are sorted, so everything under this directory is contiguous.
+        std::size_t childPrefix = slash + 1;
+        std::size_t j = i + 1;
+        while (j < end && files[j].first.compare(0, childPrefix, path, 0, childPrefix) == 0) {
+            ++j;
+        }
+        std::string childId;
+        if (!writeLevel(store, files, i, j, childPrefix, childId, error)) {
+            return false;
+        }
+        body += "tree\t" + childId + "\t" + path.substr(prefixLength, slash - prefixLength) + "\n";
+        i = j;
+    }
+    id = hashing::sha256String(body);
+    return store.writeLoose(id, body, error);
+}
+
+void addAll(const ObjectStore &store,
+            const TreeEntry &entry,
+            const std::string &path,
+            char kind,
+            std::vector<TreeChange> &changes) {
+    if (!entry.isTree) {
+        TreeChange change;
+        change.kind = kind;
+        change.path = path;
+        (kind == 'D' ? change.oldId : change.newId) = entry.id;
+        changes.push_back(std::move(change));
+        return;
+    }
+    std::vector<std::pair<std::string, std::string>> files;
+    flattenTree(store, entry.id, files, path + "/");
+    for (auto &file : files) {
+        TreeChange change;
+        change.kind = kind;
+        change.path = std::move(file.first);
+        (kind == 'D' ? change.oldId : change.newId) = std::move(file.second);
+        changes.push_back(std::move(change));
+    }
+}
+
+} // namespace
+
+bool writeTree(const ObjectStore &store,
+               const std::vector<std::pair<std::string, std::string>> &files,
+               std::string &rootId,
+               std::string &error) {
+    for (const auto &file : files) {
+        for (const auto &part : gitlite::util::split(file.first, '/')) {
+            if (!validName(part)) {
+                error = "Invalid path in index: " + file.first;
+                return false;
+            }
+        }
+    }
+    return writeLevel(store, files, 0, files.size(), 0, rootId, error);
+}
+
+bool readTree(const ObjectStore &store, const std::string &id, std::vector<TreeEntry> &entries) {
+    entries.clear();
+    std::string data;
+    if (!store.read(id, data)) {
+        return false;
+    }
+    std::istringstream in(data);
+    std::string line;
+    while (std::getline(in, line)) {
+        std::size_t first = line.find('\t');
+        std::size_t second = first == std::string::npos ? first : line.find('\t', first + 1);
+        if (second == std::string::npos) {
+            return false;
+        }
+        TreeEntry entry;
+        std::string type = line.substr(0, first);
+        entry.isTree = type == "tree";
+        entry.id = line.substr(first + 1, second - first - 1);
+        entry.name = line.substr(second + 1);
+        if ((!entry.isTree && type != "blob") || !validName(entry.name)) {
+            return false;
+        }
+        entries.push_back(std::move(entry));
+    }
+    return true;
+}
+
+bool flattenTree(const ObjectStore &store,
+                 const std::string &id,
+                 std::vector<std::pair<std::string, std::string>> &files,
+                 const std::string &prefix) {
+    std::vector<TreeEntry> entries;
+    if (!readTree(store, id, entries)) {
+        return false;
+    }
+    for (const auto &entry : entries) {
+        if (entry.isTree) {
+            if (!flattenTree(store, entry.id, files, prefix + entry.name + "/")) {
+                return false;
+            }
+        } else {
+            files.emplace_back(prefix + entry.name, entry.id);
+        }
+    }
+    return true;
+}
+
+bool diffTrees(const ObjectStore &store,
+               const std::string &oldId,
+               const std::string &newId,
+               std::vector<TreeChange> &changes,
+               const std::string &prefix) {
+    if (oldId == newId) {
+        return true;
+    }
+    std::vector<TreeEntry> before;
+    std::vector<TreeEntry> after;
+    if ((!oldId.empty() && !readTree(store, oldId, before)) || (!newId.empty() && !readTree(store, newId, after))) {
+        return false;
+    }
+    auto byName = [](const TreeEntry &a, const TreeEntry &b) { return a.name < b.name; };
+    std::sort(before.begin(), before.end(), byName);
+    std::sort(after.begin(), after.end(), byName);
+
+    std::size_t i = 0;
+    std::size_t j = 0;
+    while (i < before.size() || j < after.size()) {
+        int order = i == before.size() ? 1 : j == after.size() ? -1 : before[i].name.compare(after[j].name);
+        if (order < 0) {
+            addAll(store, before[i], prefix + before[i].name, 'D', changes);
+            ++i;
+        } else if (order > 0) {
+            addAll(store, after[j], prefix + after[j].name, 'A', changes);
+            ++j;
+        } else {
+            const TreeEntry &oldEntry = before[i++];
+            const TreeEntry &newEntry = after[j++];
+            std::string path = prefix + oldEntry.name;
+            if (oldEntry.isTree && newEntry.isTree) {
+                if (!diffTrees(store, oldEntry.id, newEntry.id, changes, path + "/")) {
+                    return false;
+                }
+            } else if (!oldEntry.isTree && !newEntry.isTree) {
+                if (oldEntry.id != newEntry.id) {
+                    changes.push_back({'M', path, oldEntry.id, newEntry.id});
+                }
+            } else {
+                addAll(store, oldEntry, path, 'D', changes);
+                addAll(store, newEntry, path, 'A', changes);
+            }
+        }
+    }
+    if (prefix.empty()) {
+        std::stable_sort(changes.begin(), changes.end(),
+                         [](const TreeChange &a, const TreeChange &b) { return a.path < b.path; });
+    }
+    return true;
+}
+
+} // namespace trees
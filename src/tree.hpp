@@ -0,0 +1,55 @@
+#pragma once
+
+#include "object_store.hpp"
+
+#include <string>
+#include <utility>
+#include <vector>
+
+// Directory snapshots stored as content-addressed tree objects, one per
+// directory. A tree object is a text list in index (full path) order:
+//   blob\t<id>\t<name>
+//   tree\t<id>\t<name>
+// Identical directories hash to the same id, so commits share every
+// unchanged subtree and diffs can skip a subtree by comparing ids alone.
+namespace trees {
+
+struct TreeEntry {
+    bool isTree = false;
+    std::string id;
+    std::string name;
+};
+
+// One difference between two snapshots. kind is 'A', 'M' or 'D'; the hash of
+// the missing side is empty.
+struct TreeChange {
+    char kind = 'M';
+    std::string path;
+    std::string oldId;
+    std::string newId;
+};
+
+// `files` are (path, blob id) pairs sorted by path, as in the index. Writes any
+// tree objects the store lacks and returns the root id.
+bool writeTree(const ObjectStore &store,
+               const std::vector<std::pair<std::string, std::string>> &files,
+               std::string &rootId,
+               std::string &error);
+
+bool readTree(const ObjectStore &store, const std::string &id, std::vector<TreeEntry> &entries);
+
+// Appends every file below tree `id` as (path, blob id), sorted by path.
+bool flattenTree(const ObjectStore &store,
+                 const std::string &id,
+                 std::vector<std::pair<std::string, std::string>> &files,
+                 const std::string &prefix = {});
+
+// Changes from tree `oldId` to tree `newId` (either may be empty for "no
+// tree"), sorted by path. Subtrees with equal ids are not opened.
+bool diffTrees(const ObjectStore &store,
+               const std::string &oldId,
+               const std::string &newId,
+               std::vector<TreeChange> &changes,
+               const std::string &prefix = {});
+
+} // namespace trees
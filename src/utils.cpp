@@ -46,13 +46,28 @@ std::tm localTime(std::time_t tt) {
 
 std::string timestamp() {
     auto now = std::chrono::system_clock::now();
-    std::time_t tt = std::chrono::system_clock::to_time_t(now);
-    std::tm tm = localTime(tt);
+    return formatTimestamp(static_cast<std::int64_t>(std::chrono::system_clock::to_time_t(now)));
+}
+
+std::string formatTimestamp(std::int64_t seconds) {
+    std::tm tm = localTime(static_cast<std::time_t>(seconds));
     std::ostringstream oss;
     oss << std::put_time(&tm, "%Y-%m-%dT%H:%M:%S");
     return oss.str();
 }
 
+std::int64_t parseTimestamp(const std::string &value) {
+    std::tm tm {};
+    std::istringstream in(value);
+    in >> std::get_time(&tm, "%Y-%m-%dT%H:%M:%S");
+    if (in.fail()) {
+        return 0;
+    }
+    tm.tm_isdst = -1;
+    std::time_t tt = std::mktime(&tm);
+    return tt == static_cast<std::time_t>(-1) ? 0 : static_cast<std::int64_t>(tt);
+}
+
 bool isValidIdentifier(const std::string &value) {
     if (value.empty()) {
         return false;
@@ -62,6 +77,42 @@ bool isValidIdentifier(const std::string &value) {
     });
 }
 
+std::string jsonQuote(const std::string &value) {
+    static const char kHex[] = "0123456789abcdef";
+    std::string out;
+    out.reserve(value.size() + 2);
+    out.push_back('"');
+    for (unsigned char ch : value) {
+        switch (ch) {
+        case '"':
+            out += "\\\"";
+            break;
+        case '\\':
+            out += "\\\\";
+            break;
+        case '\n':
+            out += "\\n";
+            break;
+        case '\r':
+            out += "\\r";
+            break;
+        case '\t':
+            out += "\\t";
+            break;
+        default:
+            if (ch < 0x20) {
+                out += "\\u00";
+                out.push_back(kHex[ch >> 4]);
+                out.push_back(kHex[ch & 0xf]);
+            } else {
+                out.push_back(static_cast<char>(ch));
+            }
+        }
+    }
+    out.push_back('"');
+    return out;
+}
+
 } // namespace gitlite::util
 
 
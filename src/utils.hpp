@@ -1,5 +1,6 @@
 #pragma once
 
+#include <cstdint>
 #include <string>
 #include <vector>
 
@@ -11,8 +12,18 @@ std::string trim(const std::string &text);
 
 std::string timestamp();
 
+// Local-time string in the timestamp() format for seconds since the epoch.
+std::string formatTimestamp(std::int64_t seconds);
+
+// Seconds since the epoch for a local-time string produced by timestamp();
+// 0 if it does not parse.
+std::int64_t parseTimestamp(const std::string &value);
+
 bool isValidIdentifier(const std::string &value);
 
+// Quotes `value` as a JSON string literal.
+std::string jsonQuote(const std::string &value);
+
 } // namespace gitlite::util
 
 